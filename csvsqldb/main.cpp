@@ -36,8 +36,10 @@
 
 #include <boost/program_options.hpp>
 
+#include <algorithm>
 #include <fstream>
 #include <sstream>
+#include <thread>
 
 #include <stdio.h>
 
@@ -56,10 +58,21 @@ namespace po = boost::program_options;
 class CsvDB
 {
 public:
-    CsvDB(csvsqldb::Database& database, bool showHeaderLine, bool verbose, csvsqldb::StringVector files)
+    CsvDB(csvsqldb::Database& database,
+          bool showHeaderLine,
+          bool verbose,
+          uint16_t numberOfThreads,
+          size_t memoryBudget,
+          bool hugePages,
+          csvsqldb::eOutputFormat outputFormat,
+          csvsqldb::StringVector files)
     : _database(database)
     , _showHeaderLine(showHeaderLine)
     , _verbose(verbose)
+    , _numberOfThreads(numberOfThreads)
+    , _memoryBudget(memoryBudget)
+    , _hugePages(hugePages)
+    , _outputFormat(outputFormat)
     , _files(files)
     {
     }
@@ -67,9 +80,17 @@ public:
     bool executeSql(const std::string& sql)
     {
         try {
+            if(_outputFormat == csvsqldb::BINARY_FORMAT) {
+                checkSingleResult(sql);
+            }
+
             csvsqldb::ExecutionContext context(_database);
             context._files = _files;
             context._showHeaderLine = _showHeaderLine;
+            context._numberOfThreads = _numberOfThreads;
+            context._memoryBudget = _memoryBudget;
+            context._hugePages = _hugePages;
+            context._outputFormat = _outputFormat;
 
             csvsqldb::ExecutionEngine<csvsqldb::OperatorNodeFactory> engine(context);
             csvsqldb::ExecutionStatistics statistics;
@@ -85,11 +106,14 @@ public:
                 OUT("\nUsed max " << statistics._maxUsedBlocks << " blocks with a total of " << statistics._maxUsedCapacity
                                   << " MiB");
                 OUT("Total blocks used " << statistics._totalBlocks);
+                OUT("Blocks spilled " << statistics._spilledBlocks);
+                OUT("Block memory allocated " << statistics._allocatedBlocks << " times, reused " << statistics._pooledBlocks
+                                              << " times");
 
                 rowCount = engine.execute(statistics, std::cout);
             }
         } catch(const std::exception& ex) {
-            std::cout << "ERROR: " << ex.what() << "\n";
+            messageStream() << "ERROR: " << ex.what() << "\n";
         }
         return true;
     }
@@ -119,16 +143,44 @@ public:
     }
 
 private:
+    /// a binary row stream ends with its end frame, so a reader would silently ignore the stream of a second result
+    void checkSingleResult(const std::string& sql) const
+    {
+        csvsqldb::FunctionRegistry functions;
+        csvsqldb::initBuildInFunctions(functions);
+        csvsqldb::SQLParser parser(functions);
+        parser.setInput(sql);
+        size_t results = 0;
+        while(csvsqldb::ASTNodePtr astnode = parser.parse()) {
+            if(std::dynamic_pointer_cast<csvsqldb::ASTQueryNode>(astnode) || std::dynamic_pointer_cast<csvsqldb::ASTExplainNode>(astnode)) {
+                ++results;
+            }
+        }
+        if(results > 1) {
+            CSVSQLDB_THROW(csvsqldb::Exception, "the binary output format allows only one query per execution");
+        }
+    }
+
+    /// messages must not be mixed into a binary row stream on stdout
+    std::ostream& messageStream() const
+    {
+        return _outputFormat == csvsqldb::BINARY_FORMAT ? std::cerr : std::cout;
+    }
+
     void output(const std::string& message)
     {
         if(_verbose) {
-            std::cout << message << std::endl;
+            messageStream() << message << std::endl;
         }
     }
 
     csvsqldb::Database& _database;
     bool _showHeaderLine;
     bool _verbose;
+    uint16_t _numberOfThreads;
+    size_t _memoryBudget;
+    bool _hugePages;
+    csvsqldb::eOutputFormat _outputFormat;
     csvsqldb::StringVector _files;
 };
 
@@ -154,6 +206,10 @@ public:
     , _showHeaderLine(true)
     , _verbose(false)
     , _interactive(false)
+    , _numberOfThreads(1)
+    , _memoryBudget(1000)
+    , _hugePages(false)
+    , _outputFormat(csvsqldb::CSV_FORMAT)
     {
         csvsqldb::GlobalConfiguration::create<CSVDBGlobalConfiguration>();
         try {
@@ -184,6 +240,7 @@ private:
     virtual bool setUp(int argc, char** argv)
     {
         std::string showHeader("on");
+        std::string outputFormat("csv");
 
         // clang-format off
         po::options_description desc("Options");
@@ -193,6 +250,10 @@ private:
         ("interactive,i", "opens an interactive sql shell")
         ("verbose,v", "output verbose statistics")
         ("show-header-line", po::value<std::string>(&showHeader), "if set to 'on' outputs a header line")
+        ("output-format", po::value<std::string>(&outputFormat), "'csv' or 'binary', binary output can be scanned again as a table file")
+        ("threads,t", po::value<uint16_t>(&_numberOfThreads), "number of threads to scan csv files and aggregate with, 0 uses all cores")
+        ("memory-budget,b", po::value<size_t>(&_memoryBudget), "memory for blocks in MiB, beyond that cached blocks are spilled to a temporary file or the query fails")
+        ("huge-pages", "request huge pages for the block memory")
         ("datbase-path,p", po::value<std::string>(&_databasePath), "path to the database")
         ("command-file,c", po::value<std::string>(&_commandFile), "command file with sql commands to process")
         ("sql,s", po::value<std::string>(&_sql), "sql commands to call")
@@ -234,9 +295,23 @@ private:
         if(vm.count("verbose")) {
             _verbose = true;
         }
+        if(vm.count("huge-pages")) {
+            _hugePages = true;
+        }
+        if(vm.count("threads") && _numberOfThreads == 0) {
+            _numberOfThreads = static_cast<uint16_t>(std::max(1u, std::thread::hardware_concurrency()));
+        }
         if(vm.count("show-header-line")) {
             _showHeaderLine = csvsqldb::toupper_copy(vm["show-header-line"].as<std::string>()) == "ON";
         }
+        if(vm.count("output-format")) {
+            std::string format = csvsqldb::tolower_copy(outputFormat);
+            if(format == "binary") {
+                _outputFormat = csvsqldb::BINARY_FORMAT;
+            } else if(format != "csv") {
+                CSVSQLDB_THROW(csvsqldb::BadoptionException, "unknown output format '" << outputFormat << "'");
+            }
+        }
         if(vm.count("mapping")) {
             csvsqldb::StringVector mapping;
             for(const auto& part : vm["mapping"].as<std::vector<std::string>>()) {
@@ -257,7 +332,7 @@ private:
     void output(const std::string& message)
     {
         if(_verbose) {
-            std::cout << message << std::endl;
+            (_outputFormat == csvsqldb::BINARY_FORMAT ? std::cerr : std::cout) << message << std::endl;
         }
     }
 
@@ -284,7 +359,7 @@ private:
 
         OUT("");
 
-        CsvDB csvDB(database, _showHeaderLine, _verbose, _files);
+        CsvDB csvDB(database, _showHeaderLine, _verbose, _numberOfThreads, _memoryBudget * 1024 * 1024, _hugePages, _outputFormat, _files);
 
         if(!_sql.empty()) {
             csvDB.executeSql(_sql);
@@ -448,6 +523,10 @@ private:
     bool _showHeaderLine;
     bool _verbose;
     bool _interactive;
+    uint16_t _numberOfThreads;
+    size_t _memoryBudget;
+    bool _hugePages;
+    csvsqldb::eOutputFormat _outputFormat;
     csvsqldb::StringVector _files;
 };
 
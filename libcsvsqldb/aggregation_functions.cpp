@@ -33,9 +33,102 @@
 
 #include "aggregation_functions.h"
 
+#include "stack_machine.h"
+
 
 namespace csvsqldb
 {
+    namespace
+    {
+        size_t countValues(const ValueVector& values, size_t rows)
+        {
+            const uint8_t* nulls = values._nulls.data();
+            size_t count = 0;
+            for(size_t n = 0; n < rows; ++n) {
+                count += !nulls[n];
+            }
+            return count;
+        }
+
+        template <typename T>
+        T sumValues(const T* data, const uint8_t* nulls, size_t rows)
+        {
+            T sum = 0;
+            for(size_t n = 0; n < rows; ++n) {
+                sum += nulls[n] ? 0 : data[n];
+            }
+            return sum;
+        }
+
+        /**
+         * Returns the sum of the non NULL values of the batch column as INT or REAL variant, or a NULL variant if
+         * there is none.
+         */
+        Variant sumBatch(const ValueVector& values, size_t rows, size_t count)
+        {
+            if(!count) {
+                return Variant(values.getType());
+            }
+            if(values.getType() == REAL) {
+                return Variant(sumValues(values.data<double>(), values._nulls.data(), rows));
+            }
+            return Variant(sumValues(values.data<int64_t>(), values._nulls.data(), rows));
+        }
+
+        /**
+         * Returns the row of the first non NULL value no other value is better than, or rows if all values are NULL.
+         */
+        template <typename T, typename Better>
+        size_t findBest(const T* data, const uint8_t* nulls, size_t rows, Better better)
+        {
+            size_t best = rows;
+            for(size_t n = 0; n < rows; ++n) {
+                if(!nulls[n] && (best == rows || better(data[n], data[best]))) {
+                    best = n;
+                }
+            }
+            return best;
+        }
+
+        template <typename Better>
+        size_t findBest(const ValueVector& values, size_t rows, Better better)
+        {
+            if(values.getType() == REAL) {
+                return findBest(values.data<double>(), values._nulls.data(), rows, better);
+            }
+            return findBest(values.data<int64_t>(), values._nulls.data(), rows, better);
+        }
+
+        struct Less {
+            template <typename T>
+            bool operator()(T lhs, T rhs) const
+            {
+                return lhs < rhs;
+            }
+        };
+
+        struct Greater {
+            template <typename T>
+            bool operator()(T lhs, T rhs) const
+            {
+                return rhs < lhs;
+            }
+        };
+
+        bool isSummable(const ValueVector& values)
+        {
+            return values.getType() == INT || values.getType() == REAL;
+        }
+    }
+
+
+    void AggregationFunction::doStepBatch(const ValueVector& values, size_t rows)
+    {
+        for(size_t row = 0; row < rows; ++row) {
+            doStep(values.getVariant(row));
+        }
+    }
+
 
     AggregationFunctionPtr AggregationFunction::create(eAggregateFunction aggrFunc, eType type)
     {
@@ -83,11 +176,35 @@ namespace csvsqldb
         }
     }
 
+    void CountAggregationFunction::doStepBatch(const ValueVector& values, size_t rows)
+    {
+        size_t count = countValues(values, rows);
+        if(count) {
+            if(_count.isNull()) {
+                _count = count;
+            } else {
+                _count += static_cast<int64_t>(count);
+            }
+        }
+    }
+
     const Variant& CountAggregationFunction::doFinalize()
     {
         return _count;
     }
 
+    void CountAggregationFunction::doMerge(const AggregationFunction& other)
+    {
+        const Variant& count = static_cast<const CountAggregationFunction&>(other)._count;
+        if(!count.isNull()) {
+            if(_count.isNull()) {
+                _count = count;
+            } else {
+                _count += count;
+            }
+        }
+    }
+
 
     AggregationFunction* RowCountAggregationFunction::clone(BlockPtr block) const
     {
@@ -108,11 +225,21 @@ namespace csvsqldb
         _count += 1;
     }
 
+    void RowCountAggregationFunction::doStepBatch(const ValueVector& values, size_t rows)
+    {
+        _count += static_cast<int64_t>(rows);
+    }
+
     const Variant& RowCountAggregationFunction::doFinalize()
     {
         return _count;
     }
 
+    void RowCountAggregationFunction::doMerge(const AggregationFunction& other)
+    {
+        _count += static_cast<const RowCountAggregationFunction&>(other)._count;
+    }
+
 
     AggregationFunction* PaththroughAggregationFunction::clone(BlockPtr block) const
     {
@@ -136,11 +263,27 @@ namespace csvsqldb
         }
     }
 
+    void PaththroughAggregationFunction::doStepBatch(const ValueVector& values, size_t rows)
+    {
+        if(rows) {
+            doStep(values.getVariant(0));
+        }
+    }
+
     const Variant& PaththroughAggregationFunction::doFinalize()
     {
         return _value;
     }
 
+    void PaththroughAggregationFunction::doMerge(const AggregationFunction& other)
+    {
+        const Variant& value = static_cast<const PaththroughAggregationFunction&>(other)._value;
+        if(_value.getType() == NONE && value.getType() != NONE) {
+            _value = value;
+            _value.disconnect();
+        }
+    }
+
 
     AggregationFunction* SumAggregationFunction::clone(BlockPtr block) const
     {
@@ -167,11 +310,25 @@ namespace csvsqldb
         }
     }
 
+    void SumAggregationFunction::doStepBatch(const ValueVector& values, size_t rows)
+    {
+        if(!isSummable(values)) {
+            AggregationFunction::doStepBatch(values, rows);
+            return;
+        }
+        doStep(sumBatch(values, rows, countValues(values, rows)));
+    }
+
     const Variant& SumAggregationFunction::doFinalize()
     {
         return _sum;
     }
 
+    void SumAggregationFunction::doMerge(const AggregationFunction& other)
+    {
+        doStep(static_cast<const SumAggregationFunction&>(other)._sum);
+    }
+
 
     AggregationFunction* AvgAggregationFunction::clone(BlockPtr block) const
     {
@@ -199,6 +356,24 @@ namespace csvsqldb
         }
     }
 
+    void AvgAggregationFunction::doStepBatch(const ValueVector& values, size_t rows)
+    {
+        if(!isSummable(values)) {
+            AggregationFunction::doStepBatch(values, rows);
+            return;
+        }
+        size_t count = countValues(values, rows);
+        if(count) {
+            Variant sum = sumBatch(values, rows, count);
+            if(_sum.isNull()) {
+                _sum = sum;
+            } else {
+                _sum += sum;
+            }
+            _count += static_cast<int64_t>(count);
+        }
+    }
+
     const Variant& AvgAggregationFunction::doFinalize()
     {
         if(!_sum.isNull()) {
@@ -207,6 +382,19 @@ namespace csvsqldb
         return _sum;
     }
 
+    void AvgAggregationFunction::doMerge(const AggregationFunction& other)
+    {
+        const AvgAggregationFunction& avg = static_cast<const AvgAggregationFunction&>(other);
+        if(!avg._sum.isNull()) {
+            if(_sum.isNull()) {
+                _sum = avg._sum;
+            } else {
+                _sum += avg._sum;
+            }
+            _count += avg._count;
+        }
+    }
+
 
     AggregationFunction* MinAggregationFunction::clone(BlockPtr block) const
     {
@@ -227,6 +415,7 @@ namespace csvsqldb
         if(!value.isNull()) {
             if(_value.isNull()) {
                 _value = value;
+                _value.disconnect();
             } else {
                 if(value < _value) {
                     _value = value;
@@ -236,11 +425,24 @@ namespace csvsqldb
         }
     }
 
+    void MinAggregationFunction::doStepBatch(const ValueVector& values, size_t rows)
+    {
+        size_t best = findBest(values, rows, Less());
+        if(best < rows) {
+            doStep(values.getVariant(best));
+        }
+    }
+
     const Variant& MinAggregationFunction::doFinalize()
     {
         return _value;
     }
 
+    void MinAggregationFunction::doMerge(const AggregationFunction& other)
+    {
+        doStep(static_cast<const MinAggregationFunction&>(other)._value);
+    }
+
 
     AggregationFunction* MaxAggregationFunction::clone(BlockPtr block) const
     {
@@ -261,6 +463,7 @@ namespace csvsqldb
         if(!value.isNull()) {
             if(_value.isNull()) {
                 _value = value;
+                _value.disconnect();
             } else {
                 if(_value < value) {
                     _value = value;
@@ -270,11 +473,24 @@ namespace csvsqldb
         }
     }
 
+    void MaxAggregationFunction::doStepBatch(const ValueVector& values, size_t rows)
+    {
+        size_t best = findBest(values, rows, Greater());
+        if(best < rows) {
+            doStep(values.getVariant(best));
+        }
+    }
+
     const Variant& MaxAggregationFunction::doFinalize()
     {
         return _value;
     }
 
+    void MaxAggregationFunction::doMerge(const AggregationFunction& other)
+    {
+        doStep(static_cast<const MaxAggregationFunction&>(other)._value);
+    }
+
 
     AggregationFunction* ArbitraryAggregationFunction::clone(BlockPtr block) const
     {
@@ -300,8 +516,22 @@ namespace csvsqldb
         }
     }
 
+    void ArbitraryAggregationFunction::doStepBatch(const ValueVector& values, size_t rows)
+    {
+        for(size_t row = 0; row < rows && _value.isNull(); ++row) {
+            if(!values.isNull(row)) {
+                doStep(values.getVariant(row));
+            }
+        }
+    }
+
     const Variant& ArbitraryAggregationFunction::doFinalize()
     {
         return _value;
     }
+
+    void ArbitraryAggregationFunction::doMerge(const AggregationFunction& other)
+    {
+        doStep(static_cast<const ArbitraryAggregationFunction&>(other)._value);
+    }
 }
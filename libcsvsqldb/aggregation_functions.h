@@ -42,6 +42,8 @@
 namespace csvsqldb
 {
 
+    struct ValueVector;
+
     class AggregationFunction;
     typedef std::shared_ptr<AggregationFunction> AggregationFunctionPtr;
     typedef std::vector<AggregationFunctionPtr> AggregationFunctions;
@@ -64,11 +66,32 @@ namespace csvsqldb
             doStep(value);
         }
 
+        /**
+         * Steps the values of the first rows of an evaluated batch column at once. The functions aggregate the plain
+         * arrays of the column directly instead of building a Variant per row.
+         * @param values The batch column to aggregate
+         * @param rows The number of rows of the batch
+         */
+        void stepBatch(const ValueVector& values, size_t rows)
+        {
+            doStepBatch(values, rows);
+        }
+
         const Variant& finalize()
         {
             return doFinalize();
         }
 
+        /**
+         * Merges the partial aggregation state of another function of the same kind into this one, as if all values
+         * stepped into the other function had been stepped into this one. Has to be called before finalize.
+         * @param other The function with the partial state to merge
+         */
+        void merge(const AggregationFunction& other)
+        {
+            doMerge(other);
+        }
+
         virtual bool suppress() const
         {
             return false;
@@ -85,10 +108,14 @@ namespace csvsqldb
         {
         }
 
+        /// steps each value of the batch column on its own
+        virtual void doStepBatch(const ValueVector& values, size_t rows);
+
     private:
         virtual void doInit() = 0;
         virtual void doStep(const Variant& value) = 0;
         virtual const Variant& doFinalize() = 0;
+        virtual void doMerge(const AggregationFunction& other) = 0;
     };
 
 
@@ -110,7 +137,9 @@ namespace csvsqldb
     private:
         virtual void doInit();
         virtual void doStep(const Variant& value);
+        virtual void doStepBatch(const ValueVector& values, size_t rows);
         virtual const Variant& doFinalize();
+        virtual void doMerge(const AggregationFunction& other);
 
         Variant _count;
     };
@@ -134,7 +163,9 @@ namespace csvsqldb
     private:
         virtual void doInit();
         virtual void doStep(const Variant& value);
+        virtual void doStepBatch(const ValueVector& values, size_t rows);
         virtual const Variant& doFinalize();
+        virtual void doMerge(const AggregationFunction& other);
 
         Variant _count;
     };
@@ -163,7 +194,9 @@ namespace csvsqldb
     private:
         virtual void doInit();
         virtual void doStep(const Variant& value);
+        virtual void doStepBatch(const ValueVector& values, size_t rows);
         virtual const Variant& doFinalize();
+        virtual void doMerge(const AggregationFunction& other);
 
         Variant _value;
         bool _suppress;
@@ -191,7 +224,9 @@ namespace csvsqldb
     private:
         virtual void doInit();
         virtual void doStep(const Variant& value);
+        virtual void doStepBatch(const ValueVector& values, size_t rows);
         virtual const Variant& doFinalize();
+        virtual void doMerge(const AggregationFunction& other);
 
         Variant _sum;
     };
@@ -219,7 +254,9 @@ namespace csvsqldb
     private:
         virtual void doInit();
         virtual void doStep(const Variant& value);
+        virtual void doStepBatch(const ValueVector& values, size_t rows);
         virtual const Variant& doFinalize();
+        virtual void doMerge(const AggregationFunction& other);
 
         Variant _count;
         Variant _sum;
@@ -244,7 +281,9 @@ namespace csvsqldb
     private:
         virtual void doInit();
         virtual void doStep(const Variant& value);
+        virtual void doStepBatch(const ValueVector& values, size_t rows);
         virtual const Variant& doFinalize();
+        virtual void doMerge(const AggregationFunction& other);
 
         Variant _value;
     };
@@ -268,7 +307,9 @@ namespace csvsqldb
     private:
         virtual void doInit();
         virtual void doStep(const Variant& value);
+        virtual void doStepBatch(const ValueVector& values, size_t rows);
         virtual const Variant& doFinalize();
+        virtual void doMerge(const AggregationFunction& other);
 
         Variant _value;
     };
@@ -292,7 +333,9 @@ namespace csvsqldb
     private:
         virtual void doInit();
         virtual void doStep(const Variant& value);
+        virtual void doStepBatch(const ValueVector& values, size_t rows);
         virtual const Variant& doFinalize();
+        virtual void doMerge(const AggregationFunction& other);
 
         Variant _value;
     };
@@ -0,0 +1,239 @@
+//
+//  aggregation_hash_table.cpp
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "aggregation_hash_table.h"
+
+#include "base/exception.h"
+
+#include <cstring>
+
+
+namespace csvsqldb
+{
+
+    namespace
+    {
+        const size_t INITIAL_SLOTS = 1024;
+
+        size_t alignedSize(size_t size)
+        {
+            return (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+        }
+    }
+
+
+    AggregationHashTable::AggregationHashTable(const AggregationFunctions& aggregateFunctions, BlockManager& blockManager)
+    : _aggregateFunctions(aggregateFunctions)
+    , _blockManager(blockManager)
+    , _mask(0)
+    , _groupCount(0)
+    {
+    }
+
+    AggregationHashTable::~AggregationHashTable()
+    {
+        clear();
+    }
+
+    void AggregationHashTable::clear()
+    {
+        for(auto* state : _states) {
+            state->~AggregationFunction();
+        }
+        for(auto& block : _blocks) {
+            _blockManager.release(block);
+        }
+        _blocks.clear();
+        _states.clear();
+        Slots().swap(_slots);
+        _groupSlots.clear();
+        _mask = 0;
+        _groupCount = 0;
+    }
+
+    AggregationFunction* const* AggregationHashTable::findOrInsert(const Values& row, const IndexVector& groupingIndices)
+    {
+        buildKey(row, groupingIndices);
+        return findOrInsert(_key.data(), _key.size(), hashKeyBytes(_key.data(), _key.size()));
+    }
+
+    AggregationFunction* const*
+    AggregationHashTable::findOrInsert(const Values& row, const IndexVector& groupingIndices, size_t maxBlocks, uint64_t& hash)
+    {
+        buildKey(row, groupingIndices);
+        hash = hashKeyBytes(_key.data(), _key.size());
+        Slot& slot = lookup(_key.data(), _key.size(), hash);
+        if(slot._key) {
+            return getStates(slot._group);
+        }
+        return insert(slot, _key.data(), _key.size(), hash, maxBlocks);
+    }
+
+    AggregationFunction* const* AggregationHashTable::find(const Values& row, const IndexVector& groupingIndices)
+    {
+        if(!_groupCount) {
+            return nullptr;
+        }
+        buildKey(row, groupingIndices);
+        Slot& slot = lookup(_key.data(), _key.size(), hashKeyBytes(_key.data(), _key.size()));
+        return slot._key ? getStates(slot._group) : nullptr;
+    }
+
+    void AggregationHashTable::merge(const AggregationHashTable& other, size_t partition, size_t partitions)
+    {
+        size_t count = _aggregateFunctions.size();
+
+        for(size_t group = 0; group < other._groupCount; ++group) {
+            const Slot& slot = other._slots[other._groupSlots[group]];
+            if((slot._hash >> 32) % partitions == partition) {
+                AggregationFunction* const* states = findOrInsert(slot._key, slot._keyLength, slot._hash);
+                AggregationFunction* const* otherStates = other.getStates(group);
+                for(size_t n = 0; n < count; ++n) {
+                    states[n]->merge(*otherStates[n]);
+                }
+            }
+        }
+    }
+
+    AggregationFunction* const* AggregationHashTable::findOrInsert(const char* key, size_t length, uint64_t hash)
+    {
+        Slot& slot = lookup(key, length, hash);
+        if(!slot._key) {
+            return insert(slot, key, length, hash);
+        }
+        return getStates(slot._group);
+    }
+
+    AggregationHashTable::Slot& AggregationHashTable::lookup(const char* key, size_t length, uint64_t hash)
+    {
+        if(_slots.empty()) {
+            _slots.resize(INITIAL_SLOTS, Slot{0, nullptr, 0, 0});
+            _mask = INITIAL_SLOTS - 1;
+        }
+
+        // returns the slot of the key or the empty slot it has to be inserted into
+        for(size_t pos = hash & _mask;; pos = (pos + 1) & _mask) {
+            Slot& slot = _slots[pos];
+            if(!slot._key || (slot._hash == hash && slot._keyLength == length && ::memcmp(slot._key, key, length) == 0)) {
+                return slot;
+            }
+        }
+    }
+
+    void AggregationHashTable::buildKey(const Values& row, const IndexVector& groupingIndices)
+    {
+        _key.clear();
+        for(auto index : groupingIndices) {
+            appendHashKey(*row[index], _key);
+        }
+    }
+
+    AggregationFunction* const* AggregationHashTable::insert(Slot& slot, const char* key, size_t length, uint64_t hash, size_t maxBlocks)
+    {
+        size_t keySize = alignedSize(length);
+        char* arenaKey = nullptr;
+        size_t states = _states.size();
+
+        for(bool newBlock = _blocks.empty(); !arenaKey; newBlock = true) {
+            if(newBlock) {
+                if(maxBlocks && _blocks.size() >= maxBlocks) {
+                    // the group is not added, the states of a rewound attempt are already destroyed
+                    return nullptr;
+                }
+                _blocks.push_back(_blockManager.createBlock());
+            }
+            BlockPtr block = _blocks.back();
+            if(!block->hasSizeFor(keySize)) {
+                if(block->offset() == 0) {
+                    CSVSQLDB_THROW(csvsqldb::Exception, "grouping values do not fit into a block");
+                }
+                continue;
+            }
+            size_t start = block->offset();
+            arenaKey = block->getRawBuffer();
+            ::memcpy(arenaKey, key, length);
+            block->moveOffset(keySize);
+
+            // the aggregation states follow the key in the same block
+            for(const auto& function : _aggregateFunctions) {
+                AggregationFunction* state = function->clone(block);
+                if(!state) {
+                    if(start == 0) {
+                        CSVSQLDB_THROW(csvsqldb::Exception, "aggregation states do not fit into a block");
+                    }
+                    for(size_t n = states; n < _states.size(); ++n) {
+                        _states[n]->~AggregationFunction();
+                    }
+                    _states.resize(states);
+                    block->rewind(start);
+                    arenaKey = nullptr;
+                    break;
+                }
+                block->moveOffset(alignedSize(block->offset()) - block->offset());
+                state->init();
+                _states.push_back(state);
+            }
+        }
+
+        slot._hash = hash;
+        slot._key = arenaKey;
+        slot._keyLength = length;
+        slot._group = _groupCount++;
+        _groupSlots.push_back(static_cast<size_t>(&slot - &_slots[0]));
+
+        AggregationFunction* const* result = getStates(slot._group);
+        if(_groupCount * 2 > _slots.size()) {
+            grow();
+        }
+        return result;
+    }
+
+    void AggregationHashTable::grow()
+    {
+        Slots slots(_slots.size() * 2, Slot{0, nullptr, 0, 0});
+        size_t mask = slots.size() - 1;
+
+        for(const auto& slot : _slots) {
+            if(slot._key) {
+                size_t pos = slot._hash & mask;
+                while(slots[pos]._key) {
+                    pos = (pos + 1) & mask;
+                }
+                slots[pos] = slot;
+                _groupSlots[slot._group] = pos;
+            }
+        }
+        _slots.swap(slots);
+        _mask = mask;
+    }
+}
@@ -0,0 +1,145 @@
+//
+//  aggregation_hash_table.h
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef csvsqldb_aggregation_hash_table_h
+#define csvsqldb_aggregation_hash_table_h
+
+#include "libcsvsqldb/inc.h"
+
+#include "aggregation_functions.h"
+#include "block.h"
+#include "hash_key.h"
+
+
+namespace csvsqldb
+{
+
+    /**
+     * Hash table for grouped aggregations. It uses open addressing with linear probing on a power of two sized slot
+     * array. The grouping values of a row are serialized into a compact key, which is copied into a block arena
+     * together with the aggregation states of the group, so a group is one contiguous piece of memory. Every slot keeps
+     * the precomputed hash, so probing and growing only compares keys on a hash match.
+     * Grouping values that are both NULL are treated as equal, so all NULL values end up in one group.
+     */
+    class CSVSQLDB_EXPORT AggregationHashTable
+    {
+    public:
+        /**
+         * Constructs an empty table.
+         * @param aggregateFunctions The aggregation functions that are cloned as states for every new group
+         * @param blockManager The block manager to allocate the arena blocks from
+         */
+        AggregationHashTable(const AggregationFunctions& aggregateFunctions, BlockManager& blockManager);
+
+        ~AggregationHashTable();
+
+        /**
+         * Looks up the group of the given row and adds a new group with initialized aggregation states, if it does not
+         * exist yet.
+         * @param row The row to look up
+         * @param groupingIndices The indices of the grouping values in the row
+         * @return The aggregation states of the group, one for each aggregation function. The returned pointer is only
+         * valid until the next call.
+         */
+        AggregationFunction* const* findOrInsert(const Values& row, const IndexVector& groupingIndices);
+
+        /**
+         * Like findOrInsert, but a new group is only added, as long as the arena does not exceed the given number of
+         * blocks.
+         * @param row The row to look up
+         * @param groupingIndices The indices of the grouping values in the row
+         * @param maxBlocks The maximum number of arena blocks, 0 for no limit
+         * @param hash Returns the hash of the grouping values, so a row that was not added can be partitioned by it
+         * @return The aggregation states of the group, or nullptr if the group does not exist and the table is full
+         */
+        AggregationFunction* const* findOrInsert(const Values& row, const IndexVector& groupingIndices, size_t maxBlocks, uint64_t& hash);
+
+        /**
+         * Looks up the group of the given row without adding it.
+         * @return The aggregation states of the group, or nullptr if the group does not exist
+         */
+        AggregationFunction* const* find(const Values& row, const IndexVector& groupingIndices);
+
+        /**
+         * Merges all groups of another table, that belong to the given hash partition, into this table. The aggregation
+         * states of groups contained in both tables are merged, other groups are added. Merging different partitions of
+         * the same table concurrently into different tables is safe.
+         * @param other The table to merge
+         * @param partition The partition to merge
+         * @param partitions The total number of partitions
+         */
+        void merge(const AggregationHashTable& other, size_t partition, size_t partitions);
+
+        /// Returns the number of groups
+        size_t size() const
+        {
+            return _groupCount;
+        }
+
+        /// Returns the aggregation states of a group, the groups are numbered in the order of their insertion
+        AggregationFunction* const* getStates(size_t group) const
+        {
+            return _states.data() + group * _aggregateFunctions.size();
+        }
+
+        /// Destroys all groups and releases the arena blocks
+        void clear();
+
+    private:
+        struct Slot {
+            uint64_t _hash;
+            const char* _key;
+            size_t _keyLength;
+            size_t _group;
+        };
+        typedef std::vector<Slot> Slots;
+
+        void buildKey(const Values& row, const IndexVector& groupingIndices);
+        AggregationFunction* const* findOrInsert(const char* key, size_t length, uint64_t hash);
+        Slot& lookup(const char* key, size_t length, uint64_t hash);
+        AggregationFunction* const* insert(Slot& slot, const char* key, size_t length, uint64_t hash, size_t maxBlocks = 0);
+        void grow();
+
+        const AggregationFunctions& _aggregateFunctions;
+        BlockManager& _blockManager;
+        Blocks _blocks;
+        Slots _slots;
+        std::vector<size_t> _groupSlots;
+        size_t _mask;
+        size_t _groupCount;
+        std::vector<AggregationFunction*> _states;
+        HashKey _key;
+    };
+}
+
+#endif
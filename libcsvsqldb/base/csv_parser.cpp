@@ -36,28 +36,62 @@
 #include "exception.h"
 #include "time_helper.h"
 
+#include <cstring>
+
 
 namespace csvsqldb
 {
     namespace csv
     {
+        CSVSQLDB_IMPLEMENT_EXCEPTION(InvalidFieldException, csvsqldb::Exception);
+
 
         CSVParser::CSVParser(CSVParserContext context, std::istream& stream, Types types, CSVParserCallback& callback)
         : _context(context)
-        , _stream(stream)
+        , _stream(&stream)
         , _types(types)
         , _callback(callback)
         , _state(INIT)
         , _typeIterator(_types.begin())
         , _lineCount(1)
+        , _data(nullptr)
         , _stringBufferSize(256)
         , _n(0)
         , _count(0)
+        , _index(_context._delimiter)
+        , _terminatorPending(false)
+        , _lineParsed(false)
         , _stringParser(_stringBuffer, _stringBufferSize, std::bind(&CSVParser::readNextChar, this, std::placeholders::_1))
         {
             _buffer.resize(_bufferLength);
-            _stringBuffer.resize(_stringBufferSize);
             readBuffer();
+            initialize();
+        }
+
+        CSVParser::CSVParser(CSVParserContext context, const char* data, size_t length, Types types, CSVParserCallback& callback)
+        : _context(context)
+        , _stream(nullptr)
+        , _types(types)
+        , _callback(callback)
+        , _state(INIT)
+        , _typeIterator(_types.begin())
+        , _lineCount(1)
+        , _data(data)
+        , _stringBufferSize(256)
+        , _n(0)
+        , _count(static_cast<std::streamsize>(length))
+        , _index(_context._delimiter)
+        , _terminatorPending(false)
+        , _lineParsed(false)
+        , _stringParser(_stringBuffer, _stringBufferSize, std::bind(&CSVParser::readNextChar, this, std::placeholders::_1))
+        {
+            _index.reset(_data, length);
+            initialize();
+        }
+
+        void CSVParser::initialize()
+        {
+            _stringBuffer.resize(_stringBufferSize);
             if(_context._skipFirstLine) {
                 findEndOfLine();
                 ++_lineCount;
@@ -71,7 +105,9 @@ namespace csvsqldb
                 _typeIterator = _types.begin();
             }
 
+            _lineParsed = false;
             while(_count > 0) {
+                _lineParsed = true;
                 try {
                     switch(*_typeIterator) {
                         case LONG:
@@ -95,15 +131,32 @@ namespace csvsqldb
                         case BOOLEAN:
                             parseBool();
                             break;
+                        case SKIP:
+                            skipField();
+                            break;
+                    }
+                } catch(const InvalidFieldException& ex) {
+                    // the invalid field is already consumed, so reporting it as NULL keeps the following fields in their columns
+                    reportNull(*_typeIterator);
+                    std::cerr << "ERROR: using NULL for an invalid field in line " << _lineCount << ": " << ex.what() << "\n";
+                }
+                finishField();
+                ++_typeIterator;
+                if(_typeIterator == _types.end() && (_state != LINESTART && _state != END)) {
+                    std::cerr << "ERROR: skipping surplus fields in line " << _lineCount << "\n";
+                    while(_state != LINESTART && _state != END) {
+                        try {
+                            skipField();
+                        } catch(const InvalidFieldException&) {
+                            // the surplus field is consumed and dropped anyway
+                        }
+                        finishField();
                     }
-                    ++_typeIterator;
-                    if(_typeIterator == _types.end() && (_state != LINESTART && _state != END)) {
-                        CSVSQLDB_THROW(csvsqldb::Exception, "too many fields found in line " << _lineCount);
-                    } else if(_typeIterator != _types.end() && (_state == LINESTART || _state == END)) {
-                        CSVSQLDB_THROW(csvsqldb::Exception, "too few fields found in line " << _lineCount);
+                } else if(_typeIterator != _types.end() && (_state == LINESTART || _state == END)) {
+                    std::cerr << "ERROR: using NULL for missing fields in line " << _lineCount << "\n";
+                    for(; _typeIterator != _types.end(); ++_typeIterator) {
+                        reportNull(*_typeIterator);
                     }
-                } catch(const csvsqldb::Exception& ex) {
-                    std::cerr << "ERROR: skipping line " << _lineCount << ": " << ex.what() << "\n";
                 }
 
                 if(_n == static_cast<size_t>(_count) && _state == LINESTART) {
@@ -134,46 +187,52 @@ namespace csvsqldb
 
         void CSVParser::parseString()
         {
+            size_t length = 0;
+            if(const char* field = nextField(length)) {
+                // the callbacks expect a null terminated string
+                copyToStringBuffer(field, length);
+                _callback.onString(&_stringBuffer[0], length, length == 0);
+                return;
+            }
             size_t len = _stringParser.parseToBuffer();
             _callback.onString(&_stringBuffer[0], len, !_stringBuffer[0]);
         }
 
         void CSVParser::parseLong()
         {
-            char c = readNextChar();
-            _stringBuffer[0] = c;
+            size_t length = 0;
+            const char* field = readField(length);
+            if(!length) {
+                _callback.onLong(std::numeric_limits<int64_t>::max(), true);
+                return;
+            }
+            const char* end = field + length;
             int64_t value = 0;
-            int n = 0;
             bool neg = false;
-            if(c == '-') {
-                c = readNextChar();
+            if(*field == '-') {
+                ++field;
                 neg = true;
-            } else if(c == '+') {
-                c = readNextChar();
+            } else if(*field == '+') {
+                ++field;
             }
-            while(c) {
-                n = c - 48;
+            for(; field != end; ++field) {
+                int n = *field - 48;
                 if(n < 0 || n > 9) {
-                    CSVSQLDB_THROW(csvsqldb::Exception, "field is not a long in line " << _lineCount);
+                    CSVSQLDB_THROW(InvalidFieldException, "field is not a long in line " << _lineCount);
                 }
                 value = 10 * value + n;
-                c = readNextChar();
-            }
-            if(_stringBuffer[0]) {
-                _callback.onLong(neg ? value * (-1) : value, false);
-            } else {
-                _callback.onLong(std::numeric_limits<int64_t>::max(), true);
             }
+            _callback.onLong(neg ? value * (-1) : value, false);
         }
 
         void CSVParser::parseDouble()
         {
-            size_t n = 0;
-            _stringBuffer[n] = readNextChar();
-            while(_stringBuffer[n]) {
-                _stringBuffer[++n] = readNextChar();
-            }
-            if(_stringBuffer[0]) {
+            size_t length = 0;
+            const char* field = readField(length);
+            if(length) {
+                if(field != &_stringBuffer[0]) {
+                    copyToStringBuffer(field, length);
+                }
                 _callback.onDouble(::atof(&_stringBuffer[0]), false);
             } else {
                 _callback.onDouble(std::numeric_limits<double>::max(), true);
@@ -182,16 +241,13 @@ namespace csvsqldb
 
         void CSVParser::parseBool()
         {
-            char c = readNextChar();
-            if(c) {
-                if((c - 48) < 0 || (c - 48) > 9) {
-                    CSVSQLDB_THROW(csvsqldb::Exception, "field is not a bool in line " << _lineCount);
-                }
-                _callback.onBoolean((c - 48) != 0, false);
-                c = readNextChar();
-                if(c) {
-                    CSVSQLDB_THROW(csvsqldb::Exception, "field is not a bool in line " << _lineCount);
+            size_t length = 0;
+            const char* field = readField(length);
+            if(length) {
+                if(length != 1 || (field[0] - 48) < 0 || (field[0] - 48) > 9) {
+                    CSVSQLDB_THROW(InvalidFieldException, "field is not a bool in line " << _lineCount);
                 }
+                _callback.onBoolean((field[0] - 48) != 0, false);
             } else {
                 _callback.onBoolean(false, true);
             }
@@ -199,29 +255,29 @@ namespace csvsqldb
 
         void CSVParser::parseDate()
         {
-            size_t n = 0;
-            _stringBuffer[n] = readNextChar();
-            while(_stringBuffer[n]) {
-                _stringBuffer[++n] = readNextChar();
-            }
-            if(_stringBuffer[0]) {
+            size_t length = 0;
+            const char* field = readField(length);
+            if(length) {
                 // TODO LCF: check for digits
-                if(_stringBuffer[4] != '-' || _stringBuffer[7] != '-') {
-                    CSVSQLDB_THROW(csvsqldb::Exception, "expected a date field (YYYY-mm-dd) in line " << _lineCount);
+                if(length < 10 || field[4] != '-' || field[7] != '-') {
+                    CSVSQLDB_THROW(InvalidFieldException, "expected a date field (YYYY-mm-dd) in line " << _lineCount);
                 }
 
-                uint16_t year = static_cast<uint16_t>(_stringBuffer[0] - 48) * 1000;
-                year += static_cast<uint16_t>(_stringBuffer[1] - 48) * 100;
-                year += static_cast<uint16_t>(_stringBuffer[2] - 48) * 10;
-                year += static_cast<uint16_t>(_stringBuffer[3] - 48);
+                uint16_t year = static_cast<uint16_t>(field[0] - 48) * 1000;
+                year += static_cast<uint16_t>(field[1] - 48) * 100;
+                year += static_cast<uint16_t>(field[2] - 48) * 10;
+                year += static_cast<uint16_t>(field[3] - 48);
 
-                uint16_t mo = static_cast<uint16_t>(_stringBuffer[5] - 48) * 10;
-                mo += static_cast<uint16_t>(_stringBuffer[6] - 48);
+                uint16_t mo = static_cast<uint16_t>(field[5] - 48) * 10;
+                mo += static_cast<uint16_t>(field[6] - 48);
                 csvsqldb::Date::eMonth month = static_cast<csvsqldb::Date::eMonth>(mo);
 
-                uint16_t day = static_cast<uint16_t>(_stringBuffer[8] - 48) * 10;
-                day += static_cast<uint16_t>(_stringBuffer[9] - 48);
+                uint16_t day = static_cast<uint16_t>(field[8] - 48) * 10;
+                day += static_cast<uint16_t>(field[9] - 48);
 
+                if(!csvsqldb::Date::isValid(year, month, day)) {
+                    CSVSQLDB_THROW(InvalidFieldException, "invalid date in line " << _lineCount);
+                }
                 csvsqldb::Date date(year, month, day);
                 _callback.onDate(date, false);
             } else {
@@ -231,26 +287,26 @@ namespace csvsqldb
 
         void CSVParser::parseTime()
         {
-            size_t n = 0;
-            _stringBuffer[n] = readNextChar();
-            while(_stringBuffer[n]) {
-                _stringBuffer[++n] = readNextChar();
-            }
-            if(_stringBuffer[0]) {
+            size_t length = 0;
+            const char* field = readField(length);
+            if(length) {
                 // TODO LCF: check for digits
-                if(_stringBuffer[2] != ':' || _stringBuffer[5] != ':') {
-                    CSVSQLDB_THROW(csvsqldb::Exception, "expected a time field (HH:MM:SS) in line " << _lineCount);
+                if(length < 8 || field[2] != ':' || field[5] != ':') {
+                    CSVSQLDB_THROW(InvalidFieldException, "expected a time field (HH:MM:SS) in line " << _lineCount);
                 }
 
-                uint16_t hour = static_cast<uint16_t>(_stringBuffer[0] - 48) * 10;
-                hour += static_cast<uint16_t>(_stringBuffer[1] - 48);
+                uint16_t hour = static_cast<uint16_t>(field[0] - 48) * 10;
+                hour += static_cast<uint16_t>(field[1] - 48);
 
-                uint16_t minute = static_cast<uint16_t>(_stringBuffer[3] - 48) * 10;
-                minute += static_cast<uint16_t>(_stringBuffer[4] - 48);
+                uint16_t minute = static_cast<uint16_t>(field[3] - 48) * 10;
+                minute += static_cast<uint16_t>(field[4] - 48);
 
-                uint16_t second = static_cast<uint16_t>(_stringBuffer[6] - 48) * 10;
-                second += static_cast<uint16_t>(_stringBuffer[7] - 48);
+                uint16_t second = static_cast<uint16_t>(field[6] - 48) * 10;
+                second += static_cast<uint16_t>(field[7] - 48);
 
+                if(!csvsqldb::Time::isValid(hour, minute, second, 0)) {
+                    CSVSQLDB_THROW(InvalidFieldException, "invalid time in line " << _lineCount);
+                }
                 csvsqldb::Time time(hour, minute, second);
                 _callback.onTime(time, false);
             } else {
@@ -260,43 +316,42 @@ namespace csvsqldb
 
         void CSVParser::parseTimestamp()
         {
-            size_t n = 0;
-            _stringBuffer[n] = readNextChar();
-            while(_stringBuffer[n]) {
-                _stringBuffer[++n] = readNextChar();
-            }
-            if(_stringBuffer[0]) {
+            size_t length = 0;
+            const char* field = readField(length);
+            if(length) {
                 // TODO LCF: check for digits
-                if(_stringBuffer[4] != '-' || _stringBuffer[7] != '-' || (_stringBuffer[10] != 'T' && _stringBuffer[10] != ' ')
-                   || _stringBuffer[13] != ':'
-                   || _stringBuffer[16] != ':') {
-                    CSVSQLDB_THROW(csvsqldb::Exception,
+                if(length < 19 || field[4] != '-' || field[7] != '-' || (field[10] != 'T' && field[10] != ' ') || field[13] != ':'
+                   || field[16] != ':') {
+                    CSVSQLDB_THROW(InvalidFieldException,
                                    "expected a timestamp field (YYYY-mm-ddTHH:MM:SS) in line " << _lineCount << ", but got '"
-                                                                                               << &_stringBuffer[0]
+                                                                                               << std::string(field, length)
                                                                                                << "'");
                 }
 
-                uint16_t year = static_cast<uint16_t>(_stringBuffer[0] - 48) * 1000;
-                year += static_cast<uint16_t>(_stringBuffer[1] - 48) * 100;
-                year += static_cast<uint16_t>(_stringBuffer[2] - 48) * 10;
-                year += static_cast<uint16_t>(_stringBuffer[3] - 48);
+                uint16_t year = static_cast<uint16_t>(field[0] - 48) * 1000;
+                year += static_cast<uint16_t>(field[1] - 48) * 100;
+                year += static_cast<uint16_t>(field[2] - 48) * 10;
+                year += static_cast<uint16_t>(field[3] - 48);
 
-                uint16_t mo = static_cast<uint16_t>(_stringBuffer[5] - 48) * 10;
-                mo += static_cast<uint16_t>(_stringBuffer[6] - 48);
+                uint16_t mo = static_cast<uint16_t>(field[5] - 48) * 10;
+                mo += static_cast<uint16_t>(field[6] - 48);
                 csvsqldb::Date::eMonth month = static_cast<csvsqldb::Date::eMonth>(mo);
 
-                uint16_t day = static_cast<uint16_t>(_stringBuffer[8] - 48) * 10;
-                day += static_cast<uint16_t>(_stringBuffer[9] - 48);
+                uint16_t day = static_cast<uint16_t>(field[8] - 48) * 10;
+                day += static_cast<uint16_t>(field[9] - 48);
 
-                uint16_t hour = static_cast<uint16_t>(_stringBuffer[11] - 48) * 10;
-                hour += static_cast<uint16_t>(_stringBuffer[12] - 48);
+                uint16_t hour = static_cast<uint16_t>(field[11] - 48) * 10;
+                hour += static_cast<uint16_t>(field[12] - 48);
 
-                uint16_t minute = static_cast<uint16_t>(_stringBuffer[14] - 48) * 10;
-                minute += static_cast<uint16_t>(_stringBuffer[15] - 48);
+                uint16_t minute = static_cast<uint16_t>(field[14] - 48) * 10;
+                minute += static_cast<uint16_t>(field[15] - 48);
 
-                uint16_t second = static_cast<uint16_t>(_stringBuffer[17] - 48) * 10;
-                second += static_cast<uint16_t>(_stringBuffer[18] - 48);
+                uint16_t second = static_cast<uint16_t>(field[17] - 48) * 10;
+                second += static_cast<uint16_t>(field[18] - 48);
 
+                if(!csvsqldb::Timestamp::isValid(year, month, day, hour, minute, second, 0)) {
+                    CSVSQLDB_THROW(InvalidFieldException, "invalid timestamp in line " << _lineCount);
+                }
                 csvsqldb::Timestamp ts(year, month, day, hour, minute, second, 0);
                 _callback.onTimestamp(ts, false);
             } else {
@@ -304,6 +359,95 @@ namespace csvsqldb
             }
         }
 
+        void CSVParser::skipField()
+        {
+            size_t length = 0;
+            if(!nextField(length)) {
+                // quoted fields are consumed by the string parser, so that delimiters within quotes are not mistaken
+                _stringParser.parseToBuffer();
+            }
+        }
+
+        void CSVParser::reportNull(CsvTypes type)
+        {
+            switch(type) {
+                case LONG:
+                    _callback.onLong(std::numeric_limits<int64_t>::max(), true);
+                    break;
+                case DOUBLE:
+                    _callback.onDouble(std::numeric_limits<double>::max(), true);
+                    break;
+                case STRING:
+                    _stringBuffer[0] = '\0';
+                    _callback.onString(&_stringBuffer[0], 0, true);
+                    break;
+                case DATE:
+                    _callback.onDate(csvsqldb::Date(), true);
+                    break;
+                case TIME:
+                    _callback.onTime(csvsqldb::Time(), true);
+                    break;
+                case TIMESTAMP:
+                    _callback.onTimestamp(csvsqldb::Timestamp(), true);
+                    break;
+                case BOOLEAN:
+                    _callback.onBoolean(false, true);
+                    break;
+                case SKIP:
+                    break;
+            }
+        }
+
+        const char* CSVParser::nextField(size_t& length)
+        {
+            size_t end = _index.next(_n);
+            // quoted fields need the string state machine and fields crossing the end of the buffer have to be assembled
+            // character by character, all other fields are handed out directly from the buffer
+            if(end >= static_cast<size_t>(_count) || _data[end] == '"' || _data[end] == '\'') {
+                return nullptr;
+            }
+            const char* field = _data + _n;
+            length = end - _n;
+            _n = end;
+            _terminatorPending = true;
+            return field;
+        }
+
+        const char* CSVParser::readField(size_t& length)
+        {
+            if(const char* field = nextField(length)) {
+                return field;
+            }
+            length = 0;
+            for(char c = readNextChar(); c; c = readNextChar()) {
+                if(length + 1 >= _stringBuffer.size()) {
+                    _stringBuffer.resize(_stringBuffer.size() + _stringBufferSize);
+                }
+                _stringBuffer[length++] = c;
+            }
+            _stringBuffer[length] = '\0';
+            return &_stringBuffer[0];
+        }
+
+        void CSVParser::finishField()
+        {
+            // the terminator of a field handed out from the buffer is consumed after the callback was called, as reading it
+            // might refill the buffer
+            if(_terminatorPending) {
+                _terminatorPending = false;
+                readNextChar();
+            }
+        }
+
+        void CSVParser::copyToStringBuffer(const char* field, size_t length)
+        {
+            if(length + 1 > _stringBuffer.size()) {
+                _stringBuffer.resize(length + 1);
+            }
+            ::memcpy(&_stringBuffer[0], field, length);
+            _stringBuffer[length] = '\0';
+        }
+
         void CSVParser::findEndOfLine()
         {
             readNextChar();
@@ -318,29 +462,26 @@ namespace csvsqldb
                 _state = END;
                 return '\0';
             }
-            if(!ignoreDelimiter && _buffer[_n] == _context._delimiter) {
+            if(!ignoreDelimiter && _data[_n] == _context._delimiter) {
                 _state = FIELDSTART;
                 ++_n;
-                while(_buffer[_n] == ' ') {
+                // never look behind the end of the input, as a memory mapping may end exactly at a page boundary
+                while(checkBuffer() && _data[_n] == ' ') {
                     ++_n;
-                    if(!checkBuffer()) {
-                        _state = END;
-                        return '\0';
-                    }
                 }
                 return '\0';
             }
-            if(_buffer[_n] == '\n' || _buffer[_n] == '\r') {
+            if(_data[_n] == '\n' || _data[_n] == '\r') {
                 _state = LINESTART;
                 ++_n;
                 if(checkBuffer()) {
-                    if(_buffer[_n] == '\n') {
+                    if(_data[_n] == '\n') {
                         ++_n;
                     }
                 }
                 return '\0';
             }
-            return _buffer[_n++];
+            return _data[_n++];
         }
 
         bool CSVParser::checkBuffer()
@@ -355,9 +496,16 @@ namespace csvsqldb
 
         bool CSVParser::readBuffer()
         {
-            _stream.read(&_buffer[0], _bufferLength);
-            _count = _stream.gcount();
             _n = 0;
+            if(!_stream) {
+                // the whole input was handed over as memory region, so there is nothing left to read
+                _count = 0;
+                return false;
+            }
+            _stream->read(&_buffer[0], _bufferLength);
+            _count = _stream->gcount();
+            _data = &_buffer[0];
+            _index.reset(_data, static_cast<size_t>(_count));
             return _count > 0;
         }
     }
@@ -37,6 +37,7 @@
 #include "libcsvsqldb/inc.h"
 
 #include "csv_string_parser.h"
+#include "csv_structural_index.h"
 #include "date.h"
 #include "time.h"
 #include "timestamp.h"
@@ -53,6 +54,10 @@ namespace csvsqldb
      */
     namespace csv
     {
+        /**
+         * Exception for fields, that cannot be converted to the type of their column.
+         */
+        CSVSQLDB_DECLARE_EXCEPTION(InvalidFieldException, csvsqldb::Exception);
 
         /**
          * Context for the parametration of a CSV parser
@@ -84,11 +89,13 @@ namespace csvsqldb
             virtual void onBoolean(bool boolean, bool isNull) = 0;
         };
 
-        enum CsvTypes { LONG, DOUBLE, STRING, DATE, TIME, TIMESTAMP, BOOLEAN };
+        /// SKIP marks a field, that is not converted and not reported to the callback
+        enum CsvTypes { LONG, DOUBLE, STRING, DATE, TIME, TIMESTAMP, BOOLEAN, SKIP };
         typedef std::vector<CsvTypes> Types;
 
         /**
-         * A class used to parse CSV streams.
+         * A class used to parse CSV streams. Unquoted fields are located with a CSVStructuralIndex and converted directly from
+         * the input buffer, only quoted fields and fields crossing the end of the buffer are read character by character.
          */
         class CSVSQLDB_EXPORT CSVParser : noncopyable
         {
@@ -102,14 +109,36 @@ namespace csvsqldb
              */
             CSVParser(CSVParserContext context, std::istream& stream, Types types, CSVParserCallback& callback);
 
+            /**
+             * Constructs a CSV parser working directly on a memory region, e.g. a memory mapped file. The data is not copied,
+             * so it has to stay valid for the lifetime of the parser.
+             * @param context The parametrising context to use
+             * @param data The start of the input to parse, the input has not to be null terminated
+             * @param length The length of the input in bytes
+             * @param types The column types of the input lines in the right order
+             * @param callback The callback to call type methods for
+             */
+            CSVParser(CSVParserContext context, const char* data, size_t length, Types types, CSVParserCallback& callback);
+
             /**
              * Parses one line of input and calls the corresponding type method callbacks. Skips the first line of input, if
              * specified
-             * by the context.
+             * by the context. Invalid and missing fields are reported as NULL and surplus fields are skipped, so that each line
+             * delivers exactly one value per type. Exceptions thrown by the callback are not caught.
              * @return true if there are more lines to parse, false otherwise
              */
             bool parseLine();
 
+            /**
+             * Returns if the last call of parseLine parsed a line. A line, whose fields are all skipped, calls no type method
+             * of the callback, so this is the only way to notice it.
+             * @return true if the last call of parseLine parsed a line, false otherwise
+             */
+            bool hasParsedLine() const
+            {
+                return _lineParsed;
+            }
+
             /**
              * Returns the current count of lines excluding skipped lines.
              * @return The current line count starting with one.
@@ -131,14 +160,22 @@ namespace csvsqldb
             void parseDate();
             void parseTime();
             void parseTimestamp();
+            void skipField();
+            void reportNull(CsvTypes type);
+
+            const char* nextField(size_t& length);
+            const char* readField(size_t& length);
+            void finishField();
+            void copyToStringBuffer(const char* field, size_t length);
 
+            void initialize();
             void findEndOfLine();
             char readNextChar(bool ignoreDelimiter = false);
             bool checkBuffer();
             bool readBuffer();
 
             CSVParserContext _context;
-            std::istream& _stream;
+            std::istream* _stream;
             Types _types;
             CSVParserCallback& _callback;
 
@@ -146,10 +183,14 @@ namespace csvsqldb
             Types::const_iterator _typeIterator;
             size_t _lineCount;
             BufferType _buffer;
+            const char* _data;
             BufferType _stringBuffer;
             size_t _stringBufferSize;
             size_t _n;
             std::streamsize _count;
+            CSVStructuralIndex _index;
+            bool _terminatorPending;
+            bool _lineParsed;
             CSVStringParser _stringParser;
             static const std::streamsize _bufferLength = 8192;
         };
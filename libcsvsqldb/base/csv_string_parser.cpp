@@ -33,6 +33,7 @@
 
 #include "csv_string_parser.h"
 
+#include "csv_parser.h"
 #include "exception.h"
 
 
@@ -73,7 +74,7 @@ namespace csvsqldb
             }
             _buffer[pos] = '\0';
             if(_currentState == ERROR || !newState->_final) {
-                throw Exception("wrong delimiters in string");
+                throw InvalidFieldException("wrong delimiters in string");
             }
 
             return pos;
@@ -78,7 +78,8 @@ namespace csvsqldb
             CSVStringParser(BufferType& buffer, const size_t bufferSize, ReadFunction readFunction);
 
             /**
-             * Parses the next characters returned by the readFunction as a CSV string.
+             * Parses the next characters returned by the readFunction as a CSV string. A string with wrong delimiters is read
+             * up to the end of its field, before an InvalidFieldException is thrown.
              * @return Returns the number of characters read into the buffer
              */
             size_t parseToBuffer();
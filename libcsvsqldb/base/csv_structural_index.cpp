@@ -0,0 +1,235 @@
+//
+//  csv_structural_index.cpp
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "csv_structural_index.h"
+
+#include "exception.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CSVSQLDB_HAS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(CSVSQLDB_HAS_SSE2) && defined(__GNUC__)
+#define CSVSQLDB_HAS_AVX2 1
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+namespace csvsqldb
+{
+    namespace csv
+    {
+        namespace
+        {
+            const size_t chunkSize = 64;
+            const size_t noChunk = static_cast<size_t>(-1);
+
+            inline size_t countTrailingZeros(uint64_t mask)
+            {
+#ifdef _MSC_VER
+                unsigned long index;
+                _BitScanForward64(&index, mask);
+                return index;
+#else
+                return static_cast<size_t>(__builtin_ctzll(mask));
+#endif
+            }
+
+            inline bool isStructural(char c, char delimiter)
+            {
+                return c == delimiter || c == '\n' || c == '\r' || c == '"' || c == '\'';
+            }
+
+            uint64_t classifyScalar(const char* data, char delimiter)
+            {
+                uint64_t mask = 0;
+                for(size_t n = 0; n < chunkSize; ++n) {
+                    if(isStructural(data[n], delimiter)) {
+                        mask |= static_cast<uint64_t>(1) << n;
+                    }
+                }
+                return mask;
+            }
+
+#ifdef CSVSQLDB_HAS_SSE2
+            uint64_t classifySSE2(const char* data, char delimiter)
+            {
+                const __m128i delim = _mm_set1_epi8(delimiter);
+                const __m128i lf = _mm_set1_epi8('\n');
+                const __m128i cr = _mm_set1_epi8('\r');
+                const __m128i dquote = _mm_set1_epi8('"');
+                const __m128i squote = _mm_set1_epi8('\'');
+
+                uint64_t mask = 0;
+                for(size_t n = 0; n < chunkSize; n += 16) {
+                    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + n));
+                    const __m128i lineEnd = _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr));
+                    const __m128i quote = _mm_or_si128(_mm_cmpeq_epi8(v, dquote), _mm_cmpeq_epi8(v, squote));
+                    const __m128i structural = _mm_or_si128(_mm_cmpeq_epi8(v, delim), _mm_or_si128(lineEnd, quote));
+                    mask |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(structural))) << n;
+                }
+                return mask;
+            }
+#endif
+
+#ifdef CSVSQLDB_HAS_AVX2
+            __attribute__((target("avx2"))) uint64_t classifyAVX2(const char* data, char delimiter)
+            {
+                const __m256i delim = _mm256_set1_epi8(delimiter);
+                const __m256i lf = _mm256_set1_epi8('\n');
+                const __m256i cr = _mm256_set1_epi8('\r');
+                const __m256i dquote = _mm256_set1_epi8('"');
+                const __m256i squote = _mm256_set1_epi8('\'');
+
+                uint64_t mask = 0;
+                for(size_t n = 0; n < chunkSize; n += 32) {
+                    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + n));
+                    const __m256i lineEnd = _mm256_or_si256(_mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, cr));
+                    const __m256i quote = _mm256_or_si256(_mm256_cmpeq_epi8(v, dquote), _mm256_cmpeq_epi8(v, squote));
+                    const __m256i structural = _mm256_or_si256(_mm256_cmpeq_epi8(v, delim), _mm256_or_si256(lineEnd, quote));
+                    mask |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(structural))) << n;
+                }
+                return mask;
+            }
+#endif
+        }
+
+        CSVStructuralIndex::CSVStructuralIndex(char delimiter)
+        : CSVStructuralIndex(delimiter, bestInstructionSet())
+        {
+        }
+
+        CSVStructuralIndex::CSVStructuralIndex(char delimiter, eInstructionSet instructionSet)
+        : _delimiter(delimiter)
+        , _instructionSet(instructionSet)
+        , _classify(&classifyScalar)
+        , _data(nullptr)
+        , _length(0)
+        , _chunk(noChunk)
+        , _mask(0)
+        {
+            if(!isSupported(_instructionSet)) {
+                CSVSQLDB_THROW(csvsqldb::Exception, "instruction set not supported by this cpu");
+            }
+            switch(_instructionSet) {
+                case SCALAR:
+                    break;
+#ifdef CSVSQLDB_HAS_SSE2
+                case SSE2:
+                    _classify = &classifySSE2;
+                    break;
+#endif
+#ifdef CSVSQLDB_HAS_AVX2
+                case AVX2:
+                    _classify = &classifyAVX2;
+                    break;
+#endif
+                default:
+                    break;
+            }
+        }
+
+        void CSVStructuralIndex::reset(const char* data, size_t length)
+        {
+            _data = data;
+            _length = length;
+            _chunk = noChunk;
+            _mask = 0;
+        }
+
+        size_t CSVStructuralIndex::next(size_t pos)
+        {
+            while(pos < _length) {
+                size_t chunk = pos & ~(chunkSize - 1);
+                if(chunk != _chunk) {
+                    _mask = classify(chunk);
+                    _chunk = chunk;
+                }
+                uint64_t mask = _mask & (~static_cast<uint64_t>(0) << (pos - chunk));
+                if(mask) {
+                    return chunk + countTrailingZeros(mask);
+                }
+                pos = chunk + chunkSize;
+            }
+            return _length;
+        }
+
+        uint64_t CSVStructuralIndex::classify(size_t chunk) const
+        {
+            if(chunk + chunkSize <= _length) {
+                return _classify(_data + chunk, _delimiter);
+            }
+            // the tail is classified byte by byte, as we must not read behind the end of the buffer
+            uint64_t mask = 0;
+            for(size_t n = chunk; n < _length; ++n) {
+                if(isStructural(_data[n], _delimiter)) {
+                    mask |= static_cast<uint64_t>(1) << (n - chunk);
+                }
+            }
+            return mask;
+        }
+
+        bool CSVStructuralIndex::isSupported(eInstructionSet instructionSet)
+        {
+            switch(instructionSet) {
+                case SCALAR:
+                    return true;
+                case SSE2:
+#ifdef CSVSQLDB_HAS_SSE2
+                    return true;
+#else
+                    return false;
+#endif
+                case AVX2:
+#ifdef CSVSQLDB_HAS_AVX2
+                    __builtin_cpu_init();
+                    return __builtin_cpu_supports("avx2") != 0;
+#else
+                    return false;
+#endif
+            }
+            return false;
+        }
+
+        CSVStructuralIndex::eInstructionSet CSVStructuralIndex::bestInstructionSet()
+        {
+            static const eInstructionSet best = isSupported(AVX2) ? AVX2 : (isSupported(SSE2) ? SSE2 : SCALAR);
+            return best;
+        }
+    }
+}
@@ -0,0 +1,126 @@
+//
+//  csv_structural_index.h
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef csvsqldb_csv_structural_index_h
+#define csvsqldb_csv_structural_index_h
+
+#include "libcsvsqldb/inc.h"
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace csvsqldb
+{
+    namespace csv
+    {
+
+        /**
+         * Index of the structural characters (field delimiter, line ends and quotes) of a CSV buffer. The buffer is
+         * classified in chunks of 64 bytes at once, each chunk resulting in a bit mask of the structural positions. Depending
+         * on the capabilities of the cpu, the classification is done with AVX2, SSE2 or a portable scalar implementation. The
+         * best available implementation is selected at runtime.
+         */
+        class CSVSQLDB_EXPORT CSVStructuralIndex
+        {
+        public:
+            /// The implementations available for the classification of a chunk
+            enum eInstructionSet { SCALAR, SSE2, AVX2 };
+
+            /**
+             * Constructs an index using the best instruction set available on the running cpu.
+             * @param delimiter The field delimiter of the CSV input
+             */
+            explicit CSVStructuralIndex(char delimiter);
+
+            /**
+             * Constructs an index using the given instruction set.
+             * @param delimiter The field delimiter of the CSV input
+             * @param instructionSet The instruction set to use, has to be supported by the running cpu
+             */
+            CSVStructuralIndex(char delimiter, eInstructionSet instructionSet);
+
+            /**
+             * Sets the buffer to index. The buffer is not copied and has to stay valid until the next reset.
+             * @param data The start of the buffer
+             * @param length The length of the buffer in bytes
+             */
+            void reset(const char* data, size_t length);
+
+            /**
+             * Finds the next structural character.
+             * @param pos The position to start the search at
+             * @return The position of the next structural character at or after pos, or the length of the buffer if there is
+             * none
+             */
+            size_t next(size_t pos);
+
+            /**
+             * Returns the instruction set used by this index.
+             * @return The instruction set
+             */
+            eInstructionSet instructionSet() const
+            {
+                return _instructionSet;
+            }
+
+            /**
+             * Checks if the running cpu supports the given instruction set.
+             * @param instructionSet The instruction set to check
+             * @return true if the instruction set can be used, false otherwise
+             */
+            static bool isSupported(eInstructionSet instructionSet);
+
+            /**
+             * Returns the best instruction set supported by the running cpu.
+             * @return The best instruction set available
+             */
+            static eInstructionSet bestInstructionSet();
+
+        private:
+            typedef uint64_t (*ClassifyFunction)(const char* data, char delimiter);
+
+            uint64_t classify(size_t chunk) const;
+
+            char _delimiter;
+            eInstructionSet _instructionSet;
+            ClassifyFunction _classify;
+            const char* _data;
+            size_t _length;
+            size_t _chunk;
+            uint64_t _mask;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,92 @@
+//
+//  memory_mapped_file.cpp
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "base/memory_mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace csvsqldb
+{
+    MemoryMappedFile::MemoryMappedFile(const std::string& path, eAccessPattern pattern)
+    : _data(nullptr)
+    , _size(0)
+    {
+        struct stat st;
+        // only regular files can be mapped, pipes and character devices have to be read as streams. Check this before
+        // opening, as opening a fifo would block and swallow the input intended for the stream fallback.
+        if(::stat(path.c_str(), &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+            return;
+        }
+
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd == -1) {
+            return;
+        }
+        if(::fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+            ::close(fd);
+            return;
+        }
+
+        void* data = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping stays valid after closing the descriptor
+        ::close(fd);
+        if(data == MAP_FAILED) {
+            return;
+        }
+
+        switch(pattern) {
+            case NORMAL:
+                break;
+            case SEQUENTIAL:
+                ::madvise(data, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+                break;
+            case RANDOM:
+                ::madvise(data, static_cast<size_t>(st.st_size), MADV_RANDOM);
+                break;
+        }
+
+        _data = static_cast<const char*>(data);
+        _size = static_cast<size_t>(st.st_size);
+    }
+
+    MemoryMappedFile::~MemoryMappedFile()
+    {
+        if(_data) {
+            ::munmap(const_cast<char*>(_data), _size);
+        }
+    }
+}
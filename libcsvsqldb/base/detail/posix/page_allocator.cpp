@@ -0,0 +1,105 @@
+//
+//  page_allocator.cpp
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "base/page_allocator.h"
+
+#include <cstdint>
+#include <new>
+
+#include <sys/mman.h>
+
+
+namespace csvsqldb
+{
+    namespace
+    {
+        const size_t sHugePageSize = 2 * 1024 * 1024;
+
+        void* mapPages(size_t size)
+        {
+            return ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        }
+    }
+
+    char* allocatePages(size_t size, bool hugePages)
+    {
+        void* pages = MAP_FAILED;
+        hugePages = hugePages && size % sHugePageSize == 0;
+#ifdef MAP_HUGETLB
+        if(hugePages) {
+            // only succeeds if the administrator reserved huge pages
+            pages = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        }
+#endif
+#ifdef MADV_HUGEPAGE
+        if(pages == MAP_FAILED && hugePages) {
+            // transparent huge pages can only back memory aligned to the huge page size, so the mapping is over allocated
+            // and the unaligned head and tail are unmapped again
+            char* mapped = static_cast<char*>(mapPages(size + sHugePageSize));
+            if(mapped == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            size_t head = (sHugePageSize - reinterpret_cast<uintptr_t>(mapped) % sHugePageSize) % sHugePageSize;
+            if(head) {
+                ::munmap(mapped, head);
+            }
+            ::munmap(mapped + head + size, sHugePageSize - head);
+            pages = mapped + head;
+            ::madvise(pages, size, MADV_HUGEPAGE);
+        }
+#endif
+        if(pages == MAP_FAILED) {
+            pages = mapPages(size);
+            if(pages == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+        }
+        return static_cast<char*>(pages);
+    }
+
+    void freePages(char* pages, size_t size)
+    {
+        if(pages) {
+            ::munmap(pages, size);
+        }
+    }
+
+    size_t hugePageSize()
+    {
+#if defined(MAP_HUGETLB) || defined(MADV_HUGEPAGE)
+        return sHugePageSize;
+#else
+        return 0;
+#endif
+    }
+}
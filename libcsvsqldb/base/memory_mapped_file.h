@@ -0,0 +1,103 @@
+//
+//  memory_mapped_file.h
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef csvsqldb_memory_mapped_file_h
+#define csvsqldb_memory_mapped_file_h
+
+#include "libcsvsqldb/inc.h"
+
+#include "base/types.h"
+
+#include <string>
+
+
+namespace csvsqldb
+{
+
+    /**
+     * A read only memory mapping of a whole file. If the file cannot be mapped (e.g. it is a pipe, it is empty or the
+     * platform does not support mappings), no exception is thrown, but isMapped() will return false. Callers are expected to
+     * fall back to stream based reading in this case.
+     */
+    class CSVSQLDB_EXPORT MemoryMappedFile : noncopyable
+    {
+    public:
+        /// Hint for the operating system, how the mapped pages will be accessed
+        enum eAccessPattern { NORMAL, SEQUENTIAL, RANDOM };
+
+        /**
+         * Maps the given file into memory.
+         * @param path The path of the file to map
+         * @param pattern The expected access pattern, will be passed to the operating system as paging hint
+         */
+        explicit MemoryMappedFile(const std::string& path, eAccessPattern pattern = SEQUENTIAL);
+
+        /**
+         * Unmaps the file. All pointers returned by data() are invalid afterwards.
+         */
+        ~MemoryMappedFile();
+
+        /**
+         * Checks if the file could be mapped.
+         * @return true if the file contents are accessible via data(), false otherwise
+         */
+        bool isMapped() const
+        {
+            return _data != nullptr;
+        }
+
+        /**
+         * Returns the start of the mapped file contents. The contents are not null terminated.
+         * @return The start of the mapping or nullptr if the file could not be mapped
+         */
+        const char* data() const
+        {
+            return _data;
+        }
+
+        /**
+         * Returns the size of the mapped file contents.
+         * @return The number of mapped bytes or 0 if the file could not be mapped
+         */
+        size_t size() const
+        {
+            return _size;
+        }
+
+    private:
+        const char* _data;
+        size_t _size;
+    };
+}
+
+#endif
@@ -0,0 +1,68 @@
+//
+//  page_allocator.h
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef csvsqldb_page_allocator_h
+#define csvsqldb_page_allocator_h
+
+#include "libcsvsqldb/inc.h"
+
+#include <cstddef>
+
+
+namespace csvsqldb
+{
+    /**
+     * Allocates page aligned memory directly from the operating system. Throws std::bad_alloc if no memory is available.
+     * @param size The number of bytes to allocate
+     * @param hugePages If true, huge pages are requested. Explicit huge pages are used if the size is a multiple of the huge
+     * page size and the system has some reserved, otherwise transparent huge pages are advised for memory aligned to the
+     * huge page size. If the platform does not support huge pages, normal pages are used.
+     * @return The allocated memory
+     */
+    CSVSQLDB_EXPORT char* allocatePages(size_t size, bool hugePages);
+
+    /**
+     * Returns the size of the huge pages requested by allocatePages.
+     * @return The huge page size in bytes, or 0 if the platform does not support huge pages
+     */
+    CSVSQLDB_EXPORT size_t hugePageSize();
+
+    /**
+     * Frees memory allocated with allocatePages.
+     * @param pages The memory to free, can be nullptr
+     * @param size The size passed to allocatePages
+     */
+    CSVSQLDB_EXPORT void freePages(char* pages, size_t size);
+}
+
+#endif
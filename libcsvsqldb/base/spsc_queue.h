@@ -0,0 +1,207 @@
+//
+//  spsc_queue.h
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef csvsqldb_spsc_queue_h
+#define csvsqldb_spsc_queue_h
+
+#include "libcsvsqldb/inc.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+
+namespace csvsqldb
+{
+    /**
+     * A bounded queue for exactly one producer thread and one consumer thread. The values are handed over through a ring
+     * buffer without any locking. Only if the ring is full, the producer parks until the consumer has taken a value, and
+     * only if the ring is empty, the consumer parks until the producer has added one. Closing the queue wakes up both sides.
+     */
+    template <typename T>
+    class SPSCQueue
+    {
+    public:
+        /**
+         * Constructs a queue that holds at most capacity values.
+         * @param capacity The maximal number of values in the queue, has to be at least 1
+         */
+        explicit SPSCQueue(size_t capacity)
+        : _ring(capacity + 1)
+        , _head(0)
+        , _tail(0)
+        , _closed(false)
+        , _producerParked(false)
+        , _consumerParked(false)
+        {
+        }
+
+        SPSCQueue(const SPSCQueue&) = delete;
+        SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+        /**
+         * Adds a value to the queue. Parks the calling producer thread while the queue is full. May only be called by the
+         * producer thread.
+         * @param value The value to add
+         * @return true if the value was added, false if the queue was closed and the value was not added
+         */
+        bool push(const T& value)
+        {
+            size_t head = _head.load(std::memory_order_relaxed);
+            size_t next = increment(head);
+            if(next == _tail.load(std::memory_order_acquire)) {
+                park(_producerParked, [&] { return next != _tail.load() || _closed.load(); });
+            }
+            if(_closed.load()) {
+                return false;
+            }
+            _ring[head] = value;
+            _head.store(next);
+            wakeUp(_consumerParked);
+            return true;
+        }
+
+        /**
+         * Removes the oldest value from the queue. Parks the calling consumer thread while the queue is empty. May only be
+         * called by the consumer thread.
+         * @param value Receives the removed value
+         * @return true if a value was removed, false if the queue is closed and empty
+         */
+        bool pop(T& value)
+        {
+            if(_tail.load(std::memory_order_relaxed) == _head.load(std::memory_order_acquire)) {
+                park(_consumerParked, [&] { return _tail.load(std::memory_order_relaxed) != _head.load() || _closed.load(); });
+            }
+            return tryPop(value);
+        }
+
+        /**
+         * Removes the oldest value from the queue without waiting. May only be called by the consumer thread.
+         * @param value Receives the removed value
+         * @return true if a value was removed, false if the queue is empty
+         */
+        bool tryPop(T& value)
+        {
+            size_t tail = _tail.load(std::memory_order_relaxed);
+            if(tail == _head.load(std::memory_order_acquire)) {
+                return false;
+            }
+            value = _ring[tail];
+            _tail.store(increment(tail));
+            wakeUp(_producerParked);
+            return true;
+        }
+
+        /**
+         * Closes the queue. Values already in the queue can still be removed, but no more values are added. A parked thread
+         * is woken up. Can be called from both threads.
+         */
+        void close()
+        {
+            _closed.store(true);
+            std::unique_lock<std::mutex> lock(_parkMutex);
+            _parkCondition.notify_all();
+        }
+
+        /**
+         * Checks if the queue was closed.
+         * @return true if the queue was closed, false otherwise
+         */
+        bool isClosed() const
+        {
+            return _closed.load();
+        }
+
+        /**
+         * Returns the maximal number of values in the queue.
+         * @return The capacity of the queue
+         */
+        size_t capacity() const
+        {
+            return _ring.size() - 1;
+        }
+
+        /**
+         * Checks if the producer is parked on the full queue. May only be called by the consumer thread.
+         * @return true if the producer waits for the consumer to take a value, false otherwise
+         */
+        bool isProducerParked() const
+        {
+            // the flag stays set for a moment after a wake up, but the producer only fills the queue after clearing it
+            if(increment(_head.load()) != _tail.load()) {
+                return false;
+            }
+            return _producerParked.load();
+        }
+
+    private:
+        size_t increment(size_t index) const
+        {
+            return ++index == _ring.size() ? 0 : index;
+        }
+
+        template <typename Predicate>
+        void park(std::atomic<bool>& parked, Predicate ready)
+        {
+            // the parked flag is published before the condition is checked again, so the other side either sees the flag
+            // or the change is seen here
+            std::unique_lock<std::mutex> lock(_parkMutex);
+            parked.store(true);
+            _parkCondition.wait(lock, ready);
+            parked.store(false);
+        }
+
+        void wakeUp(std::atomic<bool>& parked)
+        {
+            if(parked.load()) {
+                std::unique_lock<std::mutex> lock(_parkMutex);
+                _parkCondition.notify_all();
+            }
+        }
+
+        std::vector<T> _ring;
+        // producer and consumer indices are kept on separate cache lines to avoid false sharing
+        std::atomic<size_t> _head;
+        char _headPadding[64 - sizeof(std::atomic<size_t>)];
+        std::atomic<size_t> _tail;
+        char _tailPadding[64 - sizeof(std::atomic<size_t>)];
+        std::atomic<bool> _closed;
+        std::atomic<bool> _producerParked;
+        std::atomic<bool> _consumerParked;
+        std::mutex _parkMutex;
+        std::condition_variable _parkCondition;
+    };
+}
+
+#endif
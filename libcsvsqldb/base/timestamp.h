@@ -319,10 +319,11 @@ namespace csvsqldb
             return _time;
         }
 
-    private:
-        static int64_t calcJulDay(uint16_t year, uint16_t month, uint16_t day, uint16_t hour, uint16_t minute, uint16_t second, uint16_t millisecond);
         static void
         calcFromJulDay(int64_t time, uint16_t& year, uint16_t& month, uint16_t& day, uint16_t& hour, uint16_t& minute, uint16_t& second, uint16_t& millisecond);
+
+    private:
+        static int64_t calcJulDay(uint16_t year, uint16_t month, uint16_t day, uint16_t hour, uint16_t minute, uint16_t second, uint16_t millisecond);
         int64_t _time;
     } __attribute__((__packed__));
 }
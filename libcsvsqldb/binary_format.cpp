@@ -0,0 +1,426 @@
+//
+//  binary_format.cpp
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "binary_format.h"
+
+#include "base/exception.h"
+
+#include <sstream>
+
+
+namespace csvsqldb
+{
+    namespace
+    {
+        const char streamMagic[] = {'C', 'S', 'V', 'S', 'Q', 'L', 'D', 'B'};
+        const uint8_t streamVersion = 2;
+        // written in the byte order of the host, a stream from a host of the other byte order reads it swapped and is rejected
+        const uint32_t byteOrderMark = 0x01020304;
+        const size_t frameHeaderSize = 2 * sizeof(uint32_t);
+
+        bool matchesType(eType type, csv::CsvTypes csvType)
+        {
+            switch(csvType) {
+                case csv::LONG:
+                    return type == INT;
+                case csv::DOUBLE:
+                    return type == REAL;
+                case csv::STRING:
+                    return type == STRING;
+                case csv::DATE:
+                    return type == DATE;
+                case csv::TIME:
+                    return type == TIME;
+                case csv::TIMESTAMP:
+                    return type == TIMESTAMP;
+                case csv::BOOLEAN:
+                    return type == BOOLEAN;
+                case csv::SKIP:
+                    return true;
+            }
+            return false;
+        }
+    }
+
+
+    BinaryRowWriter::BinaryRowWriter(OutputWriter& writer, size_t frameSize)
+    : _writer(writer)
+    , _frameSize(frameSize)
+    , _rows(0)
+    {
+        _frame.reserve(_frameSize + frameHeaderSize + 1024);
+    }
+
+    void BinaryRowWriter::writeHeader(const SymbolInfos& columns)
+    {
+        _writer.write(streamMagic, sizeof(streamMagic));
+        _writer.write(static_cast<char>(streamVersion));
+        _writer.write(reinterpret_cast<const char*>(&byteOrderMark), sizeof(byteOrderMark));
+
+        uint32_t count = static_cast<uint32_t>(columns.size());
+        _writer.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        _types.clear();
+        for(const auto& info : columns) {
+            _types.push_back(info->_type);
+            _writer.write(static_cast<char>(info->_type));
+            uint32_t length = static_cast<uint32_t>(info->_name.length());
+            _writer.write(reinterpret_cast<const char*>(&length), sizeof(length));
+            _writer.write(info->_name.c_str(), length);
+        }
+        _frame.assign(frameHeaderSize, 0);
+    }
+
+    void BinaryRowWriter::writeRow(const Values& row)
+    {
+        if(row.size() != _types.size()) {
+            CSVSQLDB_THROW(csvsqldb::Exception, "binary row stream expects " << _types.size() << " values per row, but got " << row.size());
+        }
+        for(size_t n = 0; n < row.size(); ++n) {
+            const Value& value = *row[n];
+            if(value.isNull()) {
+                append<uint8_t>(1);
+                continue;
+            }
+            if(value.getType() != _types[n]) {
+                CSVSQLDB_THROW(csvsqldb::Exception, "binary row stream column " << n << " is of type " << typeToString(_types[n])
+                                                                                << ", but got a value of type "
+                                                                                << typeToString(value.getType()));
+            }
+            append<uint8_t>(0);
+            switch(value.getType()) {
+                case NONE:
+                    break;
+                case BOOLEAN:
+                    append<uint8_t>(static_cast<const ValBool&>(value).asBool() ? 1 : 0);
+                    break;
+                case INT:
+                    append<int64_t>(static_cast<const ValInt&>(value).asInt());
+                    break;
+                case REAL:
+                    append<double>(static_cast<const ValDouble&>(value).asDouble());
+                    break;
+                case DATE:
+                    append<uint32_t>(static_cast<const ValDate&>(value).asDate().asJulianDay());
+                    break;
+                case TIME:
+                    append<int32_t>(static_cast<const ValTime&>(value).asTime().asInteger());
+                    break;
+                case TIMESTAMP:
+                    append<int64_t>(static_cast<const ValTimestamp&>(value).asTimestamp().asInteger());
+                    break;
+                case STRING: {
+                    const ValString& s = static_cast<const ValString&>(value);
+                    uint32_t length = static_cast<uint32_t>(s.length());
+                    append<uint32_t>(length);
+                    _frame.insert(_frame.end(), s.asString(), s.asString() + length);
+                    _frame.push_back('\0');
+                    break;
+                }
+            }
+        }
+        ++_rows;
+        if(_frame.size() - frameHeaderSize >= _frameSize) {
+            writeFrame();
+        }
+    }
+
+    void BinaryRowWriter::finish()
+    {
+        if(_rows) {
+            writeFrame();
+        }
+        uint32_t end = 0;
+        _writer.write(reinterpret_cast<const char*>(&end), sizeof(end));
+    }
+
+    void BinaryRowWriter::writeFrame()
+    {
+        uint32_t payload = static_cast<uint32_t>(_frame.size() - frameHeaderSize);
+        ::memcpy(&_frame[0], &payload, sizeof(payload));
+        ::memcpy(&_frame[sizeof(payload)], &_rows, sizeof(_rows));
+        _writer.write(&_frame[0], _frame.size());
+        _frame.resize(frameHeaderSize);
+        _rows = 0;
+    }
+
+
+    bool BinaryRowParser::isBinaryRowStream(const char* data, size_t length)
+    {
+        return length >= sizeof(streamMagic) && ::memcmp(data, streamMagic, sizeof(streamMagic)) == 0;
+    }
+
+    bool BinaryRowParser::isBinaryRowStream(std::istream& stream)
+    {
+        char magic[sizeof(streamMagic)];
+        stream.read(magic, sizeof(magic));
+        size_t length = static_cast<size_t>(stream.gcount());
+        stream.clear();
+        // the characters are put back into the stream buffer instead of seeking, as pipes cannot seek
+        for(size_t n = 0; n < length; ++n) {
+            if(stream.rdbuf()->sungetc() == std::char_traits<char>::eof()) {
+                CSVSQLDB_THROW(csvsqldb::Exception, "could not put back the start of the input stream");
+            }
+        }
+        return isBinaryRowStream(magic, length);
+    }
+
+    BinaryRowParser::BinaryRowParser(const char* data, size_t length, const csv::Types& types, csv::CSVParserCallback& callback)
+    : _data(data)
+    , _length(length)
+    , _position(0)
+    , _stream(nullptr)
+    , _types(types)
+    , _callback(callback)
+    , _cursor(nullptr)
+    , _frameEnd(nullptr)
+    , _rows(0)
+    , _finished(false)
+    {
+        readHeader();
+    }
+
+    BinaryRowParser::BinaryRowParser(std::istream& stream, const csv::Types& types, csv::CSVParserCallback& callback)
+    : _data(nullptr)
+    , _length(0)
+    , _position(0)
+    , _stream(&stream)
+    , _types(types)
+    , _callback(callback)
+    , _cursor(nullptr)
+    , _frameEnd(nullptr)
+    , _rows(0)
+    , _finished(false)
+    {
+        readHeader();
+    }
+
+    bool BinaryRowParser::parseRow()
+    {
+        while(!_rows) {
+            if(_finished || !readFrame()) {
+                return false;
+            }
+        }
+
+        for(size_t n = 0; n < _columnTypes.size(); ++n) {
+            bool isNull = take<uint8_t>() != 0;
+            csv::CsvTypes type = _types[n];
+            if(isNull) {
+                reportNull(type);
+                continue;
+            }
+            switch(_columnTypes[n]) {
+                case NONE:
+                    throwCorrupt();
+                    break;
+                case BOOLEAN: {
+                    bool value = take<uint8_t>() != 0;
+                    if(type != csv::SKIP) {
+                        _callback.onBoolean(value, false);
+                    }
+                    break;
+                }
+                case INT: {
+                    int64_t value = take<int64_t>();
+                    if(type != csv::SKIP) {
+                        _callback.onLong(value, false);
+                    }
+                    break;
+                }
+                case REAL: {
+                    double value = take<double>();
+                    if(type != csv::SKIP) {
+                        _callback.onDouble(value, false);
+                    }
+                    break;
+                }
+                case DATE: {
+                    uint32_t value = take<uint32_t>();
+                    if(type != csv::SKIP) {
+                        _callback.onDate(Date(value), false);
+                    }
+                    break;
+                }
+                case TIME: {
+                    int32_t value = take<int32_t>();
+                    if(type != csv::SKIP) {
+                        _callback.onTime(Time(value), false);
+                    }
+                    break;
+                }
+                case TIMESTAMP: {
+                    int64_t value = take<int64_t>();
+                    if(type != csv::SKIP) {
+                        _callback.onTimestamp(Timestamp(value), false);
+                    }
+                    break;
+                }
+                case STRING: {
+                    uint32_t length = take<uint32_t>();
+                    if(static_cast<size_t>(_frameEnd - _cursor) < static_cast<size_t>(length) + 1 || _cursor[length] != '\0') {
+                        throwCorrupt();
+                    }
+                    if(type != csv::SKIP) {
+                        _callback.onString(_cursor, length, false);
+                    }
+                    _cursor += length + 1;
+                    break;
+                }
+            }
+        }
+        --_rows;
+        return true;
+    }
+
+    void BinaryRowParser::read(char* target, size_t length)
+    {
+        if(_stream) {
+            _stream->read(target, static_cast<std::streamsize>(length));
+            if(static_cast<size_t>(_stream->gcount()) != length) {
+                throwCorrupt();
+            }
+        } else {
+            if(_length - _position < length) {
+                throwCorrupt();
+            }
+            ::memcpy(target, _data + _position, length);
+            _position += length;
+        }
+    }
+
+    void BinaryRowParser::readHeader()
+    {
+        char magic[sizeof(streamMagic)];
+        read(magic, sizeof(magic));
+        if(!isBinaryRowStream(magic, sizeof(magic))) {
+            CSVSQLDB_THROW(csvsqldb::Exception, "input is not a binary row stream");
+        }
+        uint8_t version = 0;
+        read(reinterpret_cast<char*>(&version), sizeof(version));
+        if(version != streamVersion) {
+            CSVSQLDB_THROW(csvsqldb::Exception, "unsupported binary row stream version " << static_cast<int>(version));
+        }
+        uint32_t mark = 0;
+        read(reinterpret_cast<char*>(&mark), sizeof(mark));
+        if(mark != byteOrderMark) {
+            CSVSQLDB_THROW(csvsqldb::Exception, "binary row stream was written on a host with a different byte order");
+        }
+
+        uint32_t count = 0;
+        read(reinterpret_cast<char*>(&count), sizeof(count));
+        if(count != _types.size()) {
+            CSVSQLDB_THROW(csvsqldb::Exception, "binary row stream has " << count << " columns, but the table has " << _types.size());
+        }
+        for(uint32_t n = 0; n < count; ++n) {
+            char type = 0;
+            read(&type, 1);
+            if(static_cast<uint8_t>(type) > TIMESTAMP) {
+                throwCorrupt();
+            }
+            uint32_t length = 0;
+            read(reinterpret_cast<char*>(&length), sizeof(length));
+            std::string name(length, '\0');
+            if(length) {
+                read(&name[0], length);
+            }
+            eType columnType = static_cast<eType>(type);
+            if(columnType != NONE && !matchesType(columnType, _types[n])) {
+                CSVSQLDB_THROW(csvsqldb::Exception, "binary row stream column '" << name << "' is of type " << typeToString(columnType)
+                                                                                 << ", which does not match the table column");
+            }
+            _names.push_back(name);
+            _columnTypes.push_back(columnType);
+        }
+    }
+
+    bool BinaryRowParser::readFrame()
+    {
+        if(_cursor != _frameEnd) {
+            throwCorrupt();
+        }
+        uint32_t payload = 0;
+        read(reinterpret_cast<char*>(&payload), sizeof(payload));
+        if(!payload) {
+            _finished = true;
+            return false;
+        }
+        read(reinterpret_cast<char*>(&_rows), sizeof(_rows));
+        if(_stream) {
+            _buffer.resize(payload);
+            read(&_buffer[0], payload);
+            _cursor = &_buffer[0];
+        } else {
+            if(_length - _position < payload) {
+                throwCorrupt();
+            }
+            _cursor = _data + _position;
+            _position += payload;
+        }
+        _frameEnd = _cursor + payload;
+        return true;
+    }
+
+    void BinaryRowParser::reportNull(csv::CsvTypes type)
+    {
+        switch(type) {
+            case csv::LONG:
+                _callback.onLong(0, true);
+                break;
+            case csv::DOUBLE:
+                _callback.onDouble(0.0, true);
+                break;
+            case csv::STRING:
+                _callback.onString("", 0, true);
+                break;
+            case csv::DATE:
+                _callback.onDate(Date(), true);
+                break;
+            case csv::TIME:
+                _callback.onTime(Time(), true);
+                break;
+            case csv::TIMESTAMP:
+                _callback.onTimestamp(Timestamp(), true);
+                break;
+            case csv::BOOLEAN:
+                _callback.onBoolean(false, true);
+                break;
+            case csv::SKIP:
+                break;
+        }
+    }
+
+    void BinaryRowParser::throwCorrupt() const
+    {
+        CSVSQLDB_THROW(csvsqldb::Exception, "corrupt binary row stream");
+    }
+}
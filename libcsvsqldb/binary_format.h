@@ -0,0 +1,208 @@
+//
+//  binary_format.h
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef csvsqldb_binary_format_h
+#define csvsqldb_binary_format_h
+
+#include "libcsvsqldb/inc.h"
+
+#include "base/csv_parser.h"
+#include "output_writer.h"
+#include "symboltable.h"
+#include "values.h"
+
+#include <cstring>
+#include <istream>
+#include <memory>
+#include <vector>
+
+
+namespace csvsqldb
+{
+    /**
+     * The binary row stream is a typed alternative to csv text, that can be written and read again without any
+     * formatting or parsing. It is used to pipe query results from one csvsqldb invocation into another. All numbers
+     * are stored in the byte order of the writing host, a stream from a host with a different byte order is rejected.
+     *
+     * - header: the magic "CSVSQLDB", a version byte, the byte order mark 0x01020304 as uint32 and the number of columns
+     *   as uint32
+     * - per column: the type as uint8 (see eType), the length of the name as uint32 and the name
+     * - frames: the payload length as uint32, the number of rows as uint32 and the rows of the frame, a frame with a
+     *   payload length of 0 ends the stream
+     * - per value: a null flag byte and for non null values the value itself: BOOLEAN as uint8, INT as int64, REAL as
+     *   double, DATE as uint32 julian day, TIME as int32, TIMESTAMP as int64 and STRING as uint32 length followed by the
+     *   characters and a terminating zero
+     */
+    class CSVSQLDB_EXPORT BinaryRowWriter : noncopyable
+    {
+    public:
+        /**
+         * Constructs a binary writer on top of the given output writer.
+         * @param writer The writer to write the stream to
+         * @param frameSize The payload size in bytes after which a frame is written
+         */
+        explicit BinaryRowWriter(OutputWriter& writer, size_t frameSize = 64 * 1024);
+
+        /**
+         * Writes the stream header with the names and types of the columns.
+         * @param columns The columns of the rows to write
+         */
+        void writeHeader(const SymbolInfos& columns);
+
+        /**
+         * Appends the row to the current frame. The values have to match the types given in the header.
+         * @param row The row to write
+         */
+        void writeRow(const Values& row);
+
+        /**
+         * Writes the pending frame and the end of the stream.
+         */
+        void finish();
+
+    private:
+        template <typename T>
+        void append(const T& value)
+        {
+            const char* p = reinterpret_cast<const char*>(&value);
+            _frame.insert(_frame.end(), p, p + sizeof(T));
+        }
+
+        void writeFrame();
+
+        OutputWriter& _writer;
+        size_t _frameSize;
+        Types _types;
+        std::vector<char> _frame;
+        uint32_t _rows;
+    };
+
+    /**
+     * Reads a binary row stream and reports the values to a csv parser callback, so that the blocks can be built the
+     * same way as for csv files. The stream has to have the same number of columns as the given types and all column
+     * types have to match, values of skipped columns are not reported.
+     */
+    class CSVSQLDB_EXPORT BinaryRowParser : noncopyable
+    {
+    public:
+        /**
+         * Checks if the data starts with the binary row stream magic.
+         * @param data The data to check
+         * @param length The length of the data
+         * @return true if the data is a binary row stream
+         */
+        static bool isBinaryRowStream(const char* data, size_t length);
+
+        /**
+         * Checks if the stream starts with the binary row stream magic. The read position of the stream is left unchanged.
+         * @param stream The stream to check
+         * @return true if the stream is a binary row stream
+         */
+        static bool isBinaryRowStream(std::istream& stream);
+
+        /**
+         * Constructs a parser for mapped data and reads the header. Throws an exception if the header does not match the
+         * given types.
+         * @param data The mapped stream, has to stay valid for the lifetime of the parser
+         * @param length The length of the mapped stream
+         * @param types The expected column types
+         * @param callback The callback to report the values to
+         */
+        BinaryRowParser(const char* data, size_t length, const csv::Types& types, csv::CSVParserCallback& callback);
+
+        /**
+         * Constructs a parser for an input stream and reads the header. Throws an exception if the header does not match
+         * the given types.
+         * @param stream The stream to read from, has to stay valid for the lifetime of the parser
+         * @param types The expected column types
+         * @param callback The callback to report the values to
+         */
+        BinaryRowParser(std::istream& stream, const csv::Types& types, csv::CSVParserCallback& callback);
+
+        /**
+         * Reports the values of the next row to the callback.
+         * @return false if there are no more rows
+         */
+        bool parseRow();
+
+        /// the column names from the stream header
+        const StringVector& columnNames() const
+        {
+            return _names;
+        }
+
+        /// the column types from the stream header
+        const Types& columnTypes() const
+        {
+            return _columnTypes;
+        }
+
+    private:
+        void read(char* target, size_t length);
+        void readHeader();
+        bool readFrame();
+
+        template <typename T>
+        T take()
+        {
+            if(_cursor + sizeof(T) > _frameEnd) {
+                throwCorrupt();
+            }
+            T value;
+            ::memcpy(&value, _cursor, sizeof(T));
+            _cursor += sizeof(T);
+            return value;
+        }
+
+        void reportNull(csv::CsvTypes type);
+        void throwCorrupt() const;
+
+        const char* _data;
+        size_t _length;
+        size_t _position;
+        std::istream* _stream;
+        csv::Types _types;
+        csv::CSVParserCallback& _callback;
+        StringVector _names;
+        Types _columnTypes;
+        std::vector<char> _buffer;
+        const char* _cursor;
+        const char* _frameEnd;
+        uint32_t _rows;
+        bool _finished;
+    };
+
+    typedef std::shared_ptr<BinaryRowParser> BinaryRowParserPtr;
+}
+
+#endif
@@ -33,53 +33,109 @@
 
 #include "block.h"
 
+#include "base/page_allocator.h"
+
+#include <boost/filesystem.hpp>
+
 #include <algorithm>
 
+namespace fs = boost::filesystem;
+
 
 namespace csvsqldb
 {
 
     size_t BlockManager::sBlockNumber = 0;
 
-    BlockManager::BlockManager(size_t maxActiveBlocks, size_t blockCapacity)
+    BlockManager::BlockManager(size_t maxActiveBlocks, size_t blockCapacity, bool hugePages)
+    : BlockManager(MemoryBudget(maxActiveBlocks * blockCapacity), blockCapacity, hugePages)
+    {
+    }
+
+    BlockManager::BlockManager(MemoryBudget memoryBudget, size_t blockCapacity, bool hugePages)
     : _blockCapacity(blockCapacity)
-    , _maxActiveBlocks(maxActiveBlocks)
+    , _memoryBudget(memoryBudget._bytes)
+    , _hugePages(hugePages)
+    , _arenaSize(0)
+    , _pooledBlocks(0)
+    , _allocatedBlocks(0)
     , _activeBlocks(0)
-    , _maxCountActiveBlocks(0)
+    , _residentBlocks(0)
+    , _maxCountResidentBlocks(0)
     , _totalBlocks(0)
+    , _spilledBlocks(0)
+    , _pendingSpills(0)
+    , _spillSlots(0)
     {
+        size_t pageSize = hugePageSize();
+        if(_hugePages && pageSize) {
+            // blocks are usually smaller than a huge page, so they are carved from arenas of whole huge pages
+            _arenaSize = (_blockCapacity + pageSize - 1) / pageSize * pageSize;
+        }
+    }
+
+    BlockManager::~BlockManager()
+    {
+        if(_arenaSize) {
+            for(StoreType arena : _arenas) {
+                freePages(arena, _arenaSize);
+            }
+        } else {
+            for(StoreType store : _freeStores) {
+                freePages(store, _blockCapacity);
+            }
+        }
+        if(_spillFile.is_open()) {
+            _spillFile.close();
+            boost::system::error_code ec;
+            fs::remove(_spillFilePath, ec);
+        }
     }
 
     BlockPtr BlockManager::createBlock()
     {
+        std::unique_lock<std::mutex> lock(_mutex);
+        reserveMemory(lock);
         ++_activeBlocks;
         ++_totalBlocks;
-        _maxCountActiveBlocks = std::max(_activeBlocks, _maxCountActiveBlocks);
-        if(_activeBlocks > _maxActiveBlocks) {
-            CSVSQLDB_THROW(csvsqldb::Exception, "exceeded maximum number of active blocks");
-        }
-        BlockPtr block = new Block(++sBlockNumber, _blockCapacity);
-        _blocks.push_back(block);
+        ++_residentBlocks;
+        _maxCountResidentBlocks = std::max(_residentBlocks, _maxCountResidentBlocks);
+        BlockPtr block = new Block(++sBlockNumber, allocateStore(), _blockCapacity);
+        _blocks.emplace(block->getBlockNumber(), block);
 
         return block;
     }
 
-    BlockPtr BlockManager::getBlock(size_t blockNumber) const
+    BlockPtr BlockManager::getBlock(size_t blockNumber)
     {
-        Blocks::const_iterator iter =
-        std::find_if(_blocks.begin(), _blocks.end(), [&](const BlockPtr block) { return blockNumber == block->getBlockNumber(); });
-        if(iter == _blocks.end()) {
-            CSVSQLDB_THROW(csvsqldb::Exception, "block with number " << blockNumber << " not found");
+        std::unique_lock<std::mutex> lock(_mutex);
+        BlockPtr block = findBlock(blockNumber);
+        waitForTransfer(lock, block);
+        if(block->_cacheable) {
+            _cacheableBlocks.erase(block->_cachePosition);
+            block->_cacheable = false;
+        }
+        if(!block->_store) {
+            load(lock, block);
         }
-        return *iter;
+        return block;
     }
 
     void BlockManager::release(BlockPtr& block)
     {
+        std::unique_lock<std::mutex> lock(_mutex);
         if(block) {
+            waitForTransfer(lock, block);
             --_activeBlocks;
-            if(_blocks.size()) {
-                csvsqldb::remove(_blocks, block);
+            _blocks.erase(block->getBlockNumber());
+            if(block->_cacheable) {
+                _cacheableBlocks.erase(block->_cachePosition);
+            }
+            if(block->_store) {
+                recycleStore(block->_store);
+                --_residentBlocks;
+            } else {
+                _freeSpillSlots.push_back(block->_spillSlot);
             }
 
             delete block;
@@ -90,25 +146,29 @@ namespace csvsqldb
     void BlockManager::cache(const BlockPtr block)
     {
         if(block) {
-            // TODO LCF: here we should mark the block as cachable and cache it later
-            //           in the file system, if resources are low
-            //           if the block is retrieved again, the cachable flag has to be removed
+            std::unique_lock<std::mutex> lock(_mutex);
+            if(!block->_cacheable && !block->_transferring && block->_store) {
+                block->_cacheable = true;
+                block->_cachePosition = _cacheableBlocks.insert(_cacheableBlocks.end(), block);
+            }
         }
     }
 
     size_t BlockManager::getActiveBlocks() const
     {
+        std::unique_lock<std::mutex> lock(_mutex);
         return _activeBlocks;
     }
 
     size_t BlockManager::getMaxActiveBlocks() const
     {
-        return _maxActiveBlocks;
+        return _memoryBudget / _blockCapacity;
     }
 
     size_t BlockManager::getMaxUsedBlocks() const
     {
-        return _maxCountActiveBlocks;
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _maxCountResidentBlocks;
     }
 
     size_t BlockManager::getBlockCapacity() const
@@ -118,21 +178,221 @@ namespace csvsqldb
 
     size_t BlockManager::getTotalBlocks() const
     {
+        std::unique_lock<std::mutex> lock(_mutex);
         return _totalBlocks;
     }
 
+    size_t BlockManager::getMemoryBudget() const
+    {
+        return _memoryBudget;
+    }
 
-    Block::Block(size_t blockNumber, size_t capacity)
-    : _capacity(capacity)
-    , _offset(0)
-    , _blockNumber(blockNumber)
+    size_t BlockManager::getAllocationSize() const
+    {
+        return _arenaSize ? _arenaSize : _blockCapacity;
+    }
+
+    size_t BlockManager::getFreeBlocks() const
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        size_t maxBlocks = _memoryBudget / _blockCapacity;
+        return _residentBlocks < maxBlocks ? maxBlocks - _residentBlocks : 0;
+    }
+
+    size_t BlockManager::getFreeBlockShare() const
+    {
+        return std::max<size_t>(2, getFreeBlocks() / 2);
+    }
+
+    size_t BlockManager::getSpilledBlocks() const
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _spilledBlocks;
+    }
+
+    size_t BlockManager::getPooledBlocks() const
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _pooledBlocks;
+    }
+
+    size_t BlockManager::getAllocatedBlocks() const
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _allocatedBlocks;
+    }
+
+    BlockPtr BlockManager::findBlock(size_t blockNumber) const
+    {
+        BlockIndex::const_iterator iter = _blocks.find(blockNumber);
+        if(iter == _blocks.end()) {
+            CSVSQLDB_THROW(csvsqldb::Exception, "block with number " << blockNumber << " not found");
+        }
+        return iter->second;
+    }
+
+    StoreType BlockManager::allocateStore()
     {
-        _store = new char[capacity];
+        if(!_freeStores.empty()) {
+            StoreType store = _freeStores.back();
+            _freeStores.pop_back();
+            ++_pooledBlocks;
+            return store;
+        }
+        ++_allocatedBlocks;
+        if(_arenaSize) {
+            StoreType arena = allocatePages(_arenaSize, true);
+            _arenas.push_back(arena);
+            // the other blocks of the arena are put into the pool in reverse, so they are handed out in address order
+            for(size_t n = _arenaSize / _blockCapacity - 1; n > 0; --n) {
+                _freeStores.push_back(arena + n * _blockCapacity);
+            }
+            return arena;
+        }
+        return allocatePages(_blockCapacity, _hugePages);
     }
 
-    Block::~Block()
+    void BlockManager::recycleStore(StoreType store)
+    {
+        // the most recently used memory is handed out first, as it is most likely still in the caches
+        _freeStores.push_back(store);
+    }
+
+    void BlockManager::waitForTransfer(std::unique_lock<std::mutex>& lock, BlockPtr block)
+    {
+        _transferDone.wait(lock, [block] { return !block->_transferring; });
+    }
+
+    void BlockManager::reserveMemory(std::unique_lock<std::mutex>& lock)
+    {
+        while((_residentBlocks + 1) * _blockCapacity > _memoryBudget) {
+            if(_cacheableBlocks.empty()) {
+                if(_pendingSpills) {
+                    // another thread is writing a block to the spill file, its memory is free as soon as it is done
+                    _transferDone.wait(lock);
+                    continue;
+                }
+                CSVSQLDB_THROW(csvsqldb::Exception, "exceeded maximum number of active blocks (memory budget of " << _memoryBudget << " bytes)");
+            }
+            // the least recently cached block is spilled first
+            BlockPtr block = _cacheableBlocks.front();
+            _cacheableBlocks.pop_front();
+            block->_cacheable = false;
+            spill(lock, block);
+        }
+    }
+
+    void BlockManager::spill(std::unique_lock<std::mutex>& lock, BlockPtr block)
+    {
+        size_t slot = _spillSlots;
+        if(!_freeSpillSlots.empty()) {
+            slot = _freeSpillSlots.back();
+            _freeSpillSlots.pop_back();
+        } else {
+            ++_spillSlots;
+        }
+        block->_transferring = true;
+        ++_pendingSpills;
+
+        // the block is neither cacheable nor handed out while it is transferring, so its store can be written unlocked
+        lock.unlock();
+        try {
+            writeSpillFile(slot, block->_store, block->_offset);
+        } catch(...) {
+            lock.lock();
+            _freeSpillSlots.push_back(slot);
+            block->_transferring = false;
+            --_pendingSpills;
+            _transferDone.notify_all();
+            throw;
+        }
+        lock.lock();
+
+        recycleStore(block->_store);
+        block->_store = nullptr;
+        block->_spillSlot = slot;
+        block->_transferring = false;
+        --_pendingSpills;
+        --_residentBlocks;
+        ++_spilledBlocks;
+        _transferDone.notify_all();
+    }
+
+    void BlockManager::load(std::unique_lock<std::mutex>& lock, BlockPtr block)
+    {
+        block->_transferring = true;
+        StoreType store = nullptr;
+        try {
+            reserveMemory(lock);
+            store = allocateStore();
+        } catch(...) {
+            block->_transferring = false;
+            _transferDone.notify_all();
+            throw;
+        }
+        ++_residentBlocks;
+        _maxCountResidentBlocks = std::max(_residentBlocks, _maxCountResidentBlocks);
+
+        lock.unlock();
+        try {
+            readSpillFile(block->_spillSlot, store, block->_offset);
+        } catch(...) {
+            lock.lock();
+            recycleStore(store);
+            --_residentBlocks;
+            block->_transferring = false;
+            _transferDone.notify_all();
+            throw;
+        }
+        block->_store = store;
+        block->relocateStrings();
+        lock.lock();
+
+        _freeSpillSlots.push_back(block->_spillSlot);
+        block->_transferring = false;
+        _transferDone.notify_all();
+    }
+
+    void BlockManager::writeSpillFile(size_t slot, const char* data, size_t size)
+    {
+        std::unique_lock<std::mutex> lock(_spillFileMutex);
+        if(!_spillFile.is_open()) {
+            _spillFilePath = (fs::temp_directory_path() / fs::unique_path("csvsqldb-%%%%-%%%%-%%%%-%%%%.blocks")).string();
+            _spillFile.open(_spillFilePath, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+            if(!_spillFile.is_open()) {
+                CSVSQLDB_THROW(csvsqldb::Exception, "could not create spill file " << _spillFilePath);
+            }
+        }
+        _spillFile.seekp(static_cast<std::streamoff>(slot * _blockCapacity));
+        _spillFile.write(data, static_cast<std::streamsize>(size));
+        _spillFile.flush();
+        if(!_spillFile) {
+            _spillFile.clear();
+            CSVSQLDB_THROW(csvsqldb::Exception, "could not write block to spill file " << _spillFilePath);
+        }
+    }
+
+    void BlockManager::readSpillFile(size_t slot, char* data, size_t size)
+    {
+        std::unique_lock<std::mutex> lock(_spillFileMutex);
+        _spillFile.seekg(static_cast<std::streamoff>(slot * _blockCapacity));
+        _spillFile.read(data, static_cast<std::streamsize>(size));
+        if(!_spillFile) {
+            _spillFile.clear();
+            CSVSQLDB_THROW(csvsqldb::Exception, "could not read block from spill file " << _spillFilePath);
+        }
+    }
+
+
+    Block::Block(size_t blockNumber, StoreType store, size_t capacity)
+    : _capacity(capacity)
+    , _store(store)
+    , _offset(0)
+    , _blockNumber(blockNumber)
+    , _cacheable(false)
+    , _spillSlot(0)
+    , _transferring(false)
     {
-        delete[] _store;
     }
 
     bool Block::hasSizeFor(size_t size) const
@@ -429,4 +689,23 @@ namespace csvsqldb
         *(&_store[0] + _offset) = static_cast<char>(0xDD);
         ++_offset;
     }
+
+    void Block::relocateStrings()
+    {
+        // the string values point to their characters behind them, so they have to be adjusted to the new store
+        size_t offset = 0;
+        while(offset < _offset) {
+            char marker = _store[offset++];
+            if(marker == static_cast<char>(0xAA)) {
+                Value* val = reinterpret_cast<Value*>(&_store[0] + offset);
+                if(val->getType() == STRING && !val->isNull()) {
+                    size_t len = static_cast<ValString*>(val)->length();
+                    new(&_store[0] + offset) ValString(&_store[0] + offset + sizeof(ValString), len);
+                }
+                offset += val->size();
+            } else if(marker == static_cast<char>(0xCC) || marker == static_cast<char>(0xDD)) {
+                break;
+            }
+        }
+    }
 }
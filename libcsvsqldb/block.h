@@ -40,7 +40,13 @@
 #include "values.h"
 #include "variant.h"
 
+#include <condition_variable>
+#include <fstream>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 
@@ -60,15 +66,71 @@ namespace csvsqldb
     typedef std::shared_ptr<RowProvider> RowProviderPtr;
 
 
+    /**
+     * A memory budget in bytes. It is a distinct type, so that it cannot be mistaken for the number of blocks passed to
+     * the other constructor of the BlockManager.
+     */
+    struct CSVSQLDB_EXPORT MemoryBudget {
+        explicit MemoryBudget(size_t bytes)
+        : _bytes(bytes)
+        {
+        }
+
+        size_t _bytes;
+    };
+
+
+    /**
+     * Manages the blocks of a query. The blocks kept in memory are limited by a memory budget. If the budget is exhausted,
+     * blocks marked as cacheable are spilled to a temporary file and transparently reloaded by getBlock.
+     * The memory of released or spilled blocks is kept in a pool and reused for new blocks, so streaming queries do not
+     * allocate memory for each block. The pool never grows beyond the memory budget. With huge pages, the block memory is
+     * allocated in arenas of whole huge pages, that are carved into blocks, so the memory allocated from the operating
+     * system can exceed the budget by at most one arena.
+     */
     class CSVSQLDB_EXPORT BlockManager
     {
     public:
-        BlockManager(size_t maxActiveBlocks = 100, size_t blockCapacity = 1 * 1024 * 1024);
-
+        /**
+         * Constructs a block manager.
+         * @param maxActiveBlocks The maximum number of blocks to keep in memory
+         * @param blockCapacity The capacity of each block in bytes
+         * @param hugePages If true, the block memory is requested from the operating system as huge pages
+         */
+        BlockManager(size_t maxActiveBlocks = 100, size_t blockCapacity = 1 * 1024 * 1024, bool hugePages = false);
+
+        /**
+         * Constructs a block manager.
+         * @param memoryBudget The maximum number of bytes of blocks to keep in memory
+         * @param blockCapacity The capacity of each block in bytes
+         * @param hugePages If true, the block memory is requested from the operating system as huge pages
+         */
+        BlockManager(MemoryBudget memoryBudget, size_t blockCapacity = 1 * 1024 * 1024, bool hugePages = false);
+
+        ~BlockManager();
+
+        /**
+         * Creates a new block. If the memory budget would be exceeded, cacheable blocks are spilled first.
+         * @return The new block
+         */
         BlockPtr createBlock();
-        BlockPtr getBlock(size_t blockNumber) const;
+
+        /**
+         * Returns the block with the given number. A spilled block is reloaded into memory. The returned block is no
+         * longer cacheable until it is passed to cache again.
+         * @param blockNumber The number of the block to return
+         * @return The block with the given number
+         */
+        BlockPtr getBlock(size_t blockNumber);
 
         void release(BlockPtr& block);
+
+        /**
+         * Marks the block as cacheable. A cacheable block may be spilled to the temporary file at any time, so no
+         * pointers into it must be used until it is retrieved again with getBlock. Only blocks filled with the add
+         * methods can be cached.
+         * @param block The block to mark
+         */
         void cache(const BlockPtr block);
 
         size_t getActiveBlocks() const;
@@ -76,14 +138,80 @@ namespace csvsqldb
         size_t getMaxUsedBlocks() const;
         size_t getBlockCapacity() const;
         size_t getTotalBlocks() const;
+        size_t getMemoryBudget() const;
+
+        /**
+         * @return The size of each allocation of block memory from the operating system, a multiple of the huge page size
+         * if huge pages are requested and supported, the block capacity otherwise
+         */
+        size_t getAllocationSize() const;
+
+        /**
+         * @return The number of blocks, that can still be created before cacheable blocks have to be spilled
+         */
+        size_t getFreeBlocks() const;
+
+        /**
+         * @return The number of blocks an operator should fill with data, that cannot be spilled, before it falls back to
+         * spilling. The other half of the free blocks is left to the other operators of the query, e.g. for the readers
+         * refilling their queues or the batches of the output.
+         */
+        size_t getFreeBlockShare() const;
+
+        /**
+         * @return The number of times a block was written to the spill file
+         */
+        size_t getSpilledBlocks() const;
+
+        /**
+         * @return The number of times the memory of a block was taken from the pool instead of being allocated
+         */
+        size_t getPooledBlocks() const;
+
+        /**
+         * @return The number of times the memory of a block had to be allocated
+         */
+        size_t getAllocatedBlocks() const;
 
     private:
-        Blocks _blocks;
+        typedef std::list<BlockPtr> CacheableBlocks;
+        typedef std::unordered_map<size_t, BlockPtr> BlockIndex;
+
+        BlockPtr findBlock(size_t blockNumber) const;
+        void waitForTransfer(std::unique_lock<std::mutex>& lock, BlockPtr block);
+        void reserveMemory(std::unique_lock<std::mutex>& lock);
+        void spill(std::unique_lock<std::mutex>& lock, BlockPtr block);
+        void load(std::unique_lock<std::mutex>& lock, BlockPtr block);
+        void writeSpillFile(size_t slot, const char* data, size_t size);
+        void readSpillFile(size_t slot, char* data, size_t size);
+        StoreType allocateStore();
+        void recycleStore(StoreType store);
+
+        mutable std::mutex _mutex;
+        // signalled whenever a block was written to or read from the spill file
+        std::condition_variable _transferDone;
+        // serializes the access to the spill file, which is done without holding _mutex
+        std::mutex _spillFileMutex;
+        BlockIndex _blocks;
+        CacheableBlocks _cacheableBlocks;
+        std::vector<StoreType> _freeStores;
+        std::vector<StoreType> _arenas;
         size_t _blockCapacity;
-        size_t _maxActiveBlocks;
+        size_t _memoryBudget;
+        bool _hugePages;
+        size_t _arenaSize;
+        size_t _pooledBlocks;
+        size_t _allocatedBlocks;
         size_t _activeBlocks;
-        size_t _maxCountActiveBlocks;
+        size_t _residentBlocks;
+        size_t _maxCountResidentBlocks;
         size_t _totalBlocks;
+        size_t _spilledBlocks;
+        size_t _pendingSpills;
+        std::string _spillFilePath;
+        std::fstream _spillFile;
+        std::vector<size_t> _freeSpillSlots;
+        size_t _spillSlots;
 
         static size_t sBlockNumber;
     };
@@ -93,6 +221,14 @@ namespace csvsqldb
     {
     public:
         virtual BlockPtr getNextBlock() = 0;
+
+        /**
+         * Tells the provider, that no more blocks will be requested, so it can stop producing them immediately.
+         * getNextBlock must not be called afterwards.
+         */
+        virtual void cancel()
+        {
+        }
     };
 
 
@@ -100,15 +236,27 @@ namespace csvsqldb
     {
     public:
         virtual const Values* getNextRow() = 0;
+
+        /**
+         * Tells the provider, that no more rows will be requested, so it can stop producing them immediately.
+         * getNextRow must not be called afterwards.
+         */
+        virtual void cancel()
+        {
+        }
     };
 
 
     class CSVSQLDB_EXPORT Block
     {
     public:
-        Block(size_t blockNumber, size_t capacity);
-
-        ~Block();
+        /**
+         * Constructs a block on the given memory. The memory is owned by the BlockManager.
+         * @param blockNumber The unique number of the block
+         * @param store The memory of the block
+         * @param capacity The size of the memory in bytes
+         */
+        Block(size_t blockNumber, StoreType store, size_t capacity);
 
         Value* addValue(const Variant& value);
         Value* addValue(const Value& value);
@@ -142,6 +290,12 @@ namespace csvsqldb
             _offset += add;
         }
 
+        /// drops everything added behind the given offset
+        void rewind(size_t offset)
+        {
+            _offset = offset;
+        }
+
         StoreType getRawBuffer()
         {
             return &_store[_offset];
@@ -151,18 +305,22 @@ namespace csvsqldb
 
     private:
         void markValue();
+        void relocateStrings();
 
         size_t _capacity;
         StoreType _store;
         size_t _offset;
         size_t _blockNumber;
+        bool _cacheable;
+        std::list<BlockPtr>::iterator _cachePosition;
+        size_t _spillSlot;
+        bool _transferring;
+
+        friend class BlockManager;
 
         friend class BlockIterator;
         friend class CachingBlockIterator;
         friend class SortingBlockIterator;
-        friend class GroupingBlockIterator;
-        friend class HashingBlockIterator;
-        friend struct SortOperation;
         friend struct GroupingElement;
     };
 }
@@ -33,8 +33,14 @@
 
 #include "block_iterator.h"
 #include "base/hash_helper.h"
+#include "base/thread_pool.h"
+
+#include <boost/filesystem.hpp>
 
 #include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
 
 
 namespace csvsqldb
@@ -73,20 +79,18 @@ namespace csvsqldb
             ++_offset;
             _typeOffset = _types.begin();
         }
+        // look for next block marker, a block may also end right at a row boundary or contain no rows at all
+        while(*(&(_block->_store)[0] + _offset) == static_cast<char>(0xCC)) {
+            nextBlock();
+            _offset = 0;
+            _endOffset = _block->_offset;
+        }
+
         if(*(&(_block->_store)[0] + _offset) == static_cast<char>(0xDD)) {
             // no more rows left
             return nullptr;
         }
 
-        // look for next block marker
-        if(*(&(_block->_store)[0] + _offset) == static_cast<char>(0xCC)) {
-            _blockManager.release(_previousBlock);
-            _previousBlock = _block;
-            _block = _blockProvider.getNextBlock();
-            _offset = 0;
-            _endOffset = _block->_offset;
-        }
-
         if(_offset == _endOffset) {
             CSVSQLDB_THROW(csvsqldb::Exception, "should have found the end marker in the first place");
         }
@@ -103,6 +107,15 @@ namespace csvsqldb
         return &_row;
     }
 
+    void BlockIterator::nextBlock()
+    {
+        _blockManager.release(_previousBlock);
+        _previousBlock = _block;
+        // the current block is owned by _previousBlock now, so a failing provider must not leave it in _block as well
+        _block = nullptr;
+        _block = _blockProvider.getNextBlock();
+    }
+
     Value* BlockIterator::getNextValue()
     {
         if(_offset == _endOffset) {
@@ -111,9 +124,7 @@ namespace csvsqldb
 
         // look for next block marker
         if(*(&(_block->_store)[0] + _offset) == static_cast<char>(0xCC)) {
-            _blockManager.release(_previousBlock);
-            _previousBlock = _block;
-            _block = _blockProvider.getNextBlock();
+            nextBlock();
             _offset = 0;
             _endOffset = _block->_offset;
         }
@@ -145,6 +156,118 @@ namespace csvsqldb
     }
 
 
+    RowBuffer::RowBuffer(const Types& types, BlockManager& blockManager)
+    : _types(types)
+    , _blockManager(blockManager)
+    , _nextBlock(0)
+    , _rows(0)
+    , _pinned(false)
+    {
+    }
+
+    RowBuffer::~RowBuffer()
+    {
+        _iterator.reset();
+        for(; _nextBlock < _blocks.size(); ++_nextBlock) {
+            _blockManager.release(_blocks[_nextBlock]);
+        }
+    }
+
+    template <typename T>
+    void RowBuffer::add(const T& value)
+    {
+        if(!pinLastBlock()->addValue(value)) {
+            nextBlock();
+            if(!_blocks.back()->addValue(value)) {
+                CSVSQLDB_THROW(csvsqldb::Exception, "value does not fit into a block");
+            }
+        }
+    }
+
+    void RowBuffer::addRow(const Value* const* row)
+    {
+        for(size_t n = 0; n < _types.size(); ++n) {
+            add(*row[n]);
+        }
+        nextRow();
+    }
+
+    void RowBuffer::addValue(const Value& value)
+    {
+        add(value);
+    }
+
+    void RowBuffer::addValue(const Variant& value)
+    {
+        add(value);
+    }
+
+    void RowBuffer::nextRow()
+    {
+        pinLastBlock()->nextRow();
+        ++_rows;
+    }
+
+    void RowBuffer::unpinLastBlock()
+    {
+        if(_pinned) {
+            _blockManager.cache(_blocks.back());
+            _pinned = false;
+        }
+    }
+
+    const Values* RowBuffer::getNextRow()
+    {
+        if(!_iterator) {
+            if(_blocks.empty()) {
+                return nullptr;
+            }
+            pinLastBlock()->endBlocks();
+            unpinLastBlock();
+            _iterator = std::make_shared<BlockIterator>(_types, *this, _blockManager);
+        }
+        const Values* row = _iterator->getNextRow();
+        if(!row) {
+            // the iterator releases the blocks it has read
+            _iterator.reset();
+            _blocks.clear();
+            _nextBlock = 0;
+            _rows = 0;
+        }
+        return row;
+    }
+
+    BlockPtr RowBuffer::getNextBlock()
+    {
+        if(_nextBlock >= _blocks.size()) {
+            CSVSQLDB_THROW(csvsqldb::Exception, "no more buffered blocks");
+        }
+        return _blockManager.getBlock(_blocks[_nextBlock++]->getBlockNumber());
+    }
+
+    BlockPtr RowBuffer::pinLastBlock()
+    {
+        if(_iterator) {
+            CSVSQLDB_THROW(csvsqldb::Exception, "cannot add rows while the buffer is read");
+        }
+        if(_blocks.empty()) {
+            _blocks.push_back(_blockManager.createBlock());
+            _pinned = true;
+        } else if(!_pinned) {
+            _blockManager.getBlock(_blocks.back()->getBlockNumber());
+            _pinned = true;
+        }
+        return _blocks.back();
+    }
+
+    void RowBuffer::nextBlock()
+    {
+        _blocks.back()->markNextBlock();
+        _blockManager.cache(_blocks.back());
+        _blocks.push_back(_blockManager.createBlock());
+    }
+
+
     CachingBlockIterator::CachingBlockIterator(const Types& types, RowProvider& rowProvider, BlockManager& blockManager)
     : _rowProvider(rowProvider)
     , _blockManager(blockManager)
@@ -152,6 +275,7 @@ namespace csvsqldb
     , _currentBlock(0)
     , _offset(0)
     , _endOffset(0)
+    , _firstPinnedBlock(0)
     , _useCache(false)
     , _typeOffset(_types.begin())
     {
@@ -187,6 +311,10 @@ namespace csvsqldb
                 _blocks[_currentBlock]->endBlocks();
             }
         } else {
+            // the blocks of the previous row are not referenced anymore
+            for(; _firstPinnedBlock < _currentBlock; ++_firstPinnedBlock) {
+                _blockManager.cache(_blocks[_firstPinnedBlock]);
+            }
             if(_offset != 0) {
                 if(*(&(_blocks[_currentBlock]->_store)[0] + _offset) != static_cast<char>(0xBB)) {
                     CSVSQLDB_THROW(csvsqldb::Exception, "should be at row delimiter");
@@ -261,157 +389,132 @@ namespace csvsqldb
 
     void CachingBlockIterator::rewind()
     {
+        for(const auto& block : _blocks) {
+            _blockManager.cache(block);
+        }
         _useCache = true;
         _currentBlock = 0;
+        _firstPinnedBlock = 0;
         _offset = 0;
+        _blockManager.getBlock(_blocks[_currentBlock]->getBlockNumber());
         _endOffset = _blocks[_currentBlock]->_offset;
     }
 
     void CachingBlockIterator::getNextBlock()
     {
         if(!_useCache) {
+            if(!_blocks.empty()) {
+                _blockManager.cache(_blocks.back());
+            }
             _blocks.push_back(_blockManager.createBlock());
             ++_currentBlock;
             _offset = 0;
         } else {
             ++_currentBlock;
             _offset = 0;
+            _blockManager.getBlock(_blocks[_currentBlock]->getBlockNumber());
             _endOffset = _blocks[_currentBlock]->_offset;
         }
     }
 
 
-    struct SortOperation {
-        SortOperation(const Types& types, const SortingBlockIterator::SortOrders& sortOrders, const Blocks& blocks)
-        : _types(types)
-        , _sortOrders(sortOrders)
-        , _blocks(blocks)
-        , _offset(0)
-        , _endOffset(0)
-        , _currentBlock(0)
-        {
-            _leftCompare.resize(_sortOrders.size());
-            _rightCompare.resize(_sortOrders.size());
-        }
+    namespace
+    {
+        const unsigned char SORT_KEY_NULL = 0x00;
+        const unsigned char SORT_KEY_VALUE = 0x01;
 
-        bool operator()(const BlockPosition& left, const BlockPosition& right)
+        template <typename T>
+        void appendBigEndian(T value, SortingBlockIterator::SortKey& key)
         {
-            _currentBlock = left._block;
-            _offset = left._offset;
-            _endOffset = _blocks[_currentBlock]->_offset;
-            _typeOffset = _types.begin();
-
-            for(size_t n = 0, count = 0; count < _types.size(); ++count) {
-                Value* val = getNextValue();
-                for(const auto& order : _sortOrders) {
-                    if(order._index == count) {
-                        _leftCompare[n] = val;
-                    }
-                    ++n;
-                }
-                n = 0;
+            for(size_t n = sizeof(T); n > 0; --n) {
+                key.push_back(static_cast<unsigned char>(value >> ((n - 1) * 8)));
             }
+        }
 
-            _currentBlock = right._block;
-            _offset = right._offset;
-            _endOffset = _blocks[_currentBlock]->_offset;
-            _typeOffset = _types.begin();
+        void appendSigned(int64_t value, SortingBlockIterator::SortKey& key)
+        {
+            appendBigEndian(static_cast<uint64_t>(value) ^ 0x8000000000000000ULL, key);
+        }
 
-            for(size_t n = 0, count = 0; count < _types.size(); ++count) {
-                Value* val = getNextValue();
-                for(const auto& order : _sortOrders) {
-                    if(order._index == count) {
-                        _rightCompare[n] = val;
-                    }
-                    ++n;
-                }
-                n = 0;
+        void appendReal(double value, SortingBlockIterator::SortKey& key)
+        {
+            if(value == 0.0) {
+                // -0.0 and 0.0 are equal
+                value = 0.0;
             }
-
-            size_t n = 0;
-            for(const auto& order : _sortOrders) {
-                if(order._order == ASC) {
-                    bool result = *_leftCompare[n] < *_rightCompare[n];
-                    if(!result) {
-                        result = *_rightCompare[n] < *_leftCompare[n];
-                        if(result) {
-                            return false;
-                        }
-                    } else {
-                        return true;
-                    }
-                } else if(order._order == DESC) {
-                    bool result = *_rightCompare[n] < *_leftCompare[n];
-                    if(!result) {
-                        result = *_leftCompare[n] < *_rightCompare[n];
-                        if(result) {
-                            return false;
-                        }
-                    } else {
-                        return true;
-                    }
-                }
-                ++n;
+            uint64_t bits;
+            ::memcpy(&bits, &value, sizeof(bits));
+            if(bits & 0x8000000000000000ULL) {
+                bits = ~bits;
+            } else {
+                bits |= 0x8000000000000000ULL;
             }
-
-            return false;
+            appendBigEndian(bits, key);
         }
 
-    private:
-        Value* getNextValue()
+        void appendString(const char* value, SortingBlockIterator::SortKey& key)
         {
-            if(_offset == _endOffset) {
-                CSVSQLDB_THROW(csvsqldb::Exception, "expected more values, but already at end of block");
-            }
-
-            // look for next block marker
-            if(*(&(_blocks[_currentBlock]->_store)[0] + _offset) == static_cast<char>(0xCC)) {
-                getNextBlock();
+            // the transformed string contains no zero bytes, so a zero byte terminates it and lets prefixes sort first
+            char buffer[256];
+            size_t length = ::strxfrm(buffer, value, sizeof(buffer));
+            if(length < sizeof(buffer)) {
+                key.insert(key.end(), buffer, buffer + length);
+            } else {
+                std::vector<char> transformed(length + 1);
+                ::strxfrm(&transformed[0], value, transformed.size());
+                key.insert(key.end(), transformed.begin(), transformed.begin() + length);
             }
+            key.push_back(0x00);
+        }
 
-            // look for next value marker
-            if(*(&(_blocks[_currentBlock]->_store)[0] + _offset) != static_cast<char>(0xAA)) {
-                CSVSQLDB_THROW(csvsqldb::Exception, "missing value separator");
+        void appendValue(const Value& value, SortingBlockIterator::SortKey& key)
+        {
+            if(value.isNull()) {
+                key.push_back(SORT_KEY_NULL);
+                return;
             }
-            ++_offset;
+            key.push_back(SORT_KEY_VALUE);
 
-            Value* val = nullptr;
-            eType type = *_typeOffset;
-            switch(type) {
-                case STRING:
-                case DATE:
-                case TIME:
-                case TIMESTAMP:
+            switch(value.getType()) {
                 case BOOLEAN:
+                    key.push_back(static_cast<const ValBool&>(value).asBool() ? 1 : 0);
+                    break;
                 case INT:
+                    appendSigned(static_cast<const ValInt&>(value).asInt(), key);
+                    break;
                 case REAL:
-                    val = reinterpret_cast<Value*>(&(_blocks[_currentBlock]->_store)[0] + _offset);
+                    appendReal(static_cast<const ValDouble&>(value).asDouble(), key);
+                    break;
+                case DATE:
+                    appendBigEndian(static_cast<const ValDate&>(value).asDate().asJulianDay(), key);
+                    break;
+                case TIME:
+                    appendSigned(static_cast<const ValTime&>(value).asTime().asInteger(), key);
+                    break;
+                case TIMESTAMP:
+                    appendSigned(static_cast<const ValTimestamp&>(value).asTimestamp().asInteger(), key);
+                    break;
+                case STRING:
+                    appendString(static_cast<const ValString&>(value).asString(), key);
                     break;
                 case NONE:
-                    CSVSQLDB_THROW(csvsqldb::Exception, "type not allowed " << typeToString(type));
+                    CSVSQLDB_THROW(csvsqldb::Exception, "type not allowed " << typeToString(value.getType()));
             }
-            _offset += val->size();
-            ++_typeOffset;
-            return val;
         }
+    }
 
-        void getNextBlock()
-        {
-            ++_currentBlock;
-            _offset = 0;
-            _endOffset = _blocks[_currentBlock]->_offset;
+    void SortingBlockIterator::appendSortKey(const Values& row, const SortOrders& sortOrders, SortKey& key)
+    {
+        for(const auto& order : sortOrders) {
+            size_t start = key.size();
+            appendValue(*row[order._index], key);
+            if(order._order == DESC) {
+                for(size_t n = start; n < key.size(); ++n) {
+                    key[n] = static_cast<unsigned char>(~key[n]);
+                }
+            }
         }
-
-        const Types& _types;
-        Types::const_iterator _typeOffset;
-        const SortingBlockIterator::SortOrders& _sortOrders;
-        const Blocks& _blocks;
-        size_t _offset;
-        size_t _endOffset;
-        size_t _currentBlock;
-        Values _leftCompare;
-        Values _rightCompare;
-    };
+    }
 
     SortingBlockIterator::SortingBlockIterator(const Types& types, const SortOrders& sortOrders, RowProvider& rowProvider, BlockManager& blockManager)
     : _rowProvider(rowProvider)
@@ -420,7 +523,9 @@ namespace csvsqldb
     , _currentBlock(0)
     , _offset(0)
     , _endOffset(0)
+    , _maxRunBlocks(0)
     , _initialize(true)
+    , _advanceWinner(false)
     , _typeOffset(_types.begin())
     , _sortOrders(sortOrders)
     {
@@ -432,32 +537,44 @@ namespace csvsqldb
         for(auto& block : _blocks) {
             _blockManager.release(block);
         }
+        for(const auto& path : _runs) {
+            boost::system::error_code ec;
+            boost::filesystem::remove(path, ec);
+        }
     }
 
     const Values* SortingBlockIterator::getNextRow()
     {
-        if(_blocks.empty()) {
-            getNextBlock();
-            _currentBlock = 0;
-        }
         const Values* row = nullptr;
         if(_initialize) {
+            addBlock();
             do {
                 row = _rowProvider.getNextRow();
                 if(row) {
-                    BlockPosition bp = {_currentBlock, _offset};
-                    _rows.push_back(bp);
+                    if(!_rows.empty() && _blocks.size() >= _maxRunBlocks) {
+                        // the rows do not fit into memory, so continue with an external sort
+                        writeRun();
+                        addBlock();
+                    }
+                    if(_rows.empty()) {
+                        // a run is sized once its input is read, so the blocks held by the scans below are already taken
+                        _maxRunBlocks = freeBlockShare();
+                    }
+                    SortEntry entry = {{_currentBlock, _offset}, _keys.size(), 0};
+                    appendSortKey(*row, _sortOrders, _keys);
+                    entry._keyLength = _keys.size() - entry._keyOffset;
+                    _rows.push_back(entry);
                     bool firstValue = true;
                     for(const auto& value : *row) {
                         if(!_blocks[_currentBlock]->addValue(*value)) {
                             // if the block changes with the first value, we have to adjust the currentBlock and offset in the
                             // rows collection
                             if(firstValue) {
-                                _rows.back() = {_currentBlock, _offset};
+                                _rows.back()._position = {_currentBlock, _offset};
                                 firstValue = false;
                             }
                             _blocks[_currentBlock]->markNextBlock();
-                            getNextBlock();
+                            addBlock();
                             _blocks[_currentBlock]->addValue(*value);
                         }
                     }
@@ -468,9 +585,21 @@ namespace csvsqldb
                 _offset = _blocks[_currentBlock]->offset();
             } while(row);
             _initialize = false;
-            // here we have to sort the thing
-            std::sort(_rows.begin(), _rows.end(), SortOperation(_types, _sortOrders, _blocks));
-            _rowIter = _rows.begin();
+            _blockManager.cache(_blocks[_currentBlock]);
+            if(_runs.empty()) {
+                sortRows();
+                SortKey().swap(_keys);
+                _rowIter = _rows.begin();
+            } else {
+                if(!_rows.empty()) {
+                    writeRun();
+                }
+                mergeRuns();
+            }
+        }
+
+        if(_loserTree) {
+            return getNextMergedRow();
         }
 
         if(_rowIter == _rows.end()) {
@@ -478,9 +607,31 @@ namespace csvsqldb
             return nullptr;
         }
 
-        _currentBlock = _rowIter->_block;
+        row = readRow(*_rowIter);
+        ++_rowIter;
+
+        return row;
+    }
+
+    const Values* SortingBlockIterator::readRow(const SortEntry& entry)
+    {
+        _currentBlock = entry._position._block;
+        // the blocks of the previous row are not referenced anymore, only the one of the current row is retrieved again
+        bool pinned = false;
+        for(auto index : _pinnedBlocks) {
+            if(index != _currentBlock) {
+                _blockManager.cache(_blocks[index]);
+            } else {
+                pinned = true;
+            }
+        }
+        _pinnedBlocks.clear();
+        if(!pinned) {
+            _blockManager.getBlock(_blocks[_currentBlock]->getBlockNumber());
+        }
+        _pinnedBlocks.push_back(_currentBlock);
         _endOffset = _blocks[_currentBlock]->_offset;
-        _offset = _rowIter->_offset;
+        _offset = entry._position._offset;
         _typeOffset = _types.begin();
 
         if(*(&(_blocks[_currentBlock]->_store)[0] + _offset) == static_cast<char>(0xDD)) {
@@ -496,11 +647,7 @@ namespace csvsqldb
             }
             _row[index++] = val;
         }
-        row = &_row;
-
-        ++_rowIter;
-
-        return row;
+        return &_row;
     }
 
     Value* SortingBlockIterator::getNextValue()
@@ -540,16 +687,169 @@ namespace csvsqldb
         return val;
     }
 
+    void SortingBlockIterator::addBlock()
+    {
+        if(!_blocks.empty()) {
+            _blockManager.cache(_blocks.back());
+        }
+        _blocks.push_back(_blockManager.createBlock());
+        _currentBlock = _blocks.size() - 1;
+        _offset = 0;
+    }
+
+    size_t SortingBlockIterator::freeBlockShare() const
+    {
+        return _blockManager.getFreeBlockShare();
+    }
+
     void SortingBlockIterator::getNextBlock()
     {
-        if(_initialize) {
-            _blocks.push_back(_blockManager.createBlock());
-            ++_currentBlock;
-            _offset = 0;
-        } else {
-            ++_currentBlock;
-            _offset = 0;
-            _endOffset = _blocks[_currentBlock]->_offset;
+        ++_currentBlock;
+        _offset = 0;
+        _blockManager.getBlock(_blocks[_currentBlock]->getBlockNumber());
+        _pinnedBlocks.push_back(_currentBlock);
+        _endOffset = _blocks[_currentBlock]->_offset;
+    }
+
+    void SortingBlockIterator::sortRows()
+    {
+        const unsigned char* keys = _keys.data();
+        std::sort(_rows.begin(), _rows.end(), [keys](const SortEntry& left, const SortEntry& right) {
+            return compareSortKeys(keys + left._keyOffset, left._keyLength, keys + right._keyOffset, right._keyLength) < 0;
+        });
+    }
+
+    void SortingBlockIterator::writeRun()
+    {
+        sortRows();
+        SortRunWriter writer;
+        for(const auto& entry : _rows) {
+            writer.writeRow(_keys.data() + entry._keyOffset, entry._keyLength, *readRow(entry));
+        }
+        _runs.push_back(writer.finish());
+
+        _rows.clear();
+        _keys.clear();
+        _pinnedBlocks.clear();
+        for(auto& block : _blocks) {
+            _blockManager.release(block);
+        }
+        _blocks.clear();
+    }
+
+    SortRunReaders SortingBlockIterator::openRuns(size_t count)
+    {
+        SortRunReaders readers;
+        for(size_t n = 0; n < count; ++n) {
+            std::string path = _runs.front();
+            _runs.pop_front();
+            readers.push_back(SortRunReaderPtr(new SortRunReader(path, _types, _blockManager)));
+            readers.back()->next();
+        }
+        return readers;
+    }
+
+    LoserTree::Less SortingBlockIterator::runOrder(const SortRunReaders& readers)
+    {
+        return [&readers](size_t lhs, size_t rhs) {
+            if(readers[lhs]->exhausted()) {
+                return false;
+            }
+            if(readers[rhs]->exhausted()) {
+                return true;
+            }
+            return compareSortKeys(readers[lhs]->key(), readers[lhs]->keyLength(), readers[rhs]->key(), readers[rhs]->keyLength()) < 0;
+        };
+    }
+
+    void SortingBlockIterator::mergeRuns()
+    {
+        // every open run needs a block, so if there are too many runs, some of them are merged into bigger runs first
+        size_t fanIn = freeBlockShare();
+        while(_runs.size() > fanIn) {
+            SortRunReaders readers = openRuns(fanIn);
+            LoserTree tree(readers.size(), runOrder(readers));
+            SortRunWriter writer;
+            while(!readers[tree.winner()]->exhausted()) {
+                const SortRunReaderPtr& reader = readers[tree.winner()];
+                writer.writeRow(reader->key(), reader->keyLength(), reader->row());
+                reader->next();
+                tree.replay();
+            }
+            _runs.push_back(writer.finish());
+        }
+
+        _readers = openRuns(_runs.size());
+        _loserTree.reset(new LoserTree(_readers.size(), runOrder(_readers)));
+    }
+
+    const Values* SortingBlockIterator::getNextMergedRow()
+    {
+        if(_advanceWinner) {
+            _readers[_loserTree->winner()]->next();
+            _loserTree->replay();
+        }
+        _advanceWinner = true;
+
+        const SortRunReaderPtr& reader = _readers[_loserTree->winner()];
+        if(reader->exhausted()) {
+            return nullptr;
+        }
+        return &reader->row();
+    }
+
+
+    namespace
+    {
+        class SingleBlockProvider : public BlockProvider
+        {
+        public:
+            SingleBlockProvider(BlockPtr block)
+            : _block(block)
+            {
+            }
+
+            virtual BlockPtr getNextBlock()
+            {
+                return _block;
+            }
+
+        private:
+            BlockPtr _block;
+        };
+
+        void stepRow(AggregationFunction* const* states, const Values& row, const IndexVector& outputIndices)
+        {
+            for(auto n : outputIndices) {
+                (*states++)->step(valueToVariant(*row[n]));
+            }
+        }
+
+        // returns false with the hash of the grouping values, if the group is not in the table and the table is full
+        bool aggregateRow(AggregationHashTable& groupTable,
+                          const Values& row,
+                          const IndexVector& groupingIndices,
+                          const IndexVector& outputIndices,
+                          size_t maxBlocks,
+                          uint64_t& hash)
+        {
+            AggregationFunction* const* states = groupTable.findOrInsert(row, groupingIndices, maxBlocks, hash);
+            if(!states) {
+                return false;
+            }
+            stepRow(states, row, outputIndices);
+            return true;
+        }
+
+        bool addRow(Block& block, const Values& row)
+        {
+            for(const auto* value : row) {
+                if(!block.addValue(*value)) {
+                    return false;
+                }
+            }
+            block.nextRow();
+            return true;
         }
     }
 
@@ -600,384 +900,293 @@ namespace csvsqldb
                                                  const csvsqldb::IndexVector outputIndices,
                                                  AggregationFunctions& aggregateFunctions,
                                                  RowProvider& rowProvider,
-                                                 BlockManager& blockManager)
+                                                 BlockManager& blockManager,
+                                                 uint16_t numberOfThreads)
     : _rowProvider(rowProvider)
     , _blockManager(blockManager)
-    , _types(types)
-    , _currentBlock(0)
-    , _offset(0)
-    , _endOffset(0)
-    , _useCache(false)
+    , _output(types, blockManager)
+    , _aggregated(false)
+    , _numberOfThreads(std::max(numberOfThreads, uint16_t(1)))
     , _groupingIndices(groupingIndices)
     , _outputIndices(outputIndices)
-    , _typeOffset(_types.begin())
     , _aggregateFunctions(aggregateFunctions)
     {
-        _row.resize(_types.size());
     }
 
     GroupingBlockIterator::~GroupingBlockIterator()
     {
-        for(auto& block : _blocks) {
-            _blockManager.release(block);
-        }
-        for(auto& block : _aggrFuncBlocks) {
-            _blockManager.release(block);
-        }
     }
 
     const Values* GroupingBlockIterator::getNextRow()
     {
-        if(_blocks.empty()) {
-            getNextBlock();
-            _currentBlock = 0;
-        }
-        const Values* row = nullptr;
-        if(!_useCache) {
-            size_t currentAggrFuncBlock = 0;
-            _aggrFuncBlocks.push_back(_blockManager.createBlock());
-            do {
-                row = _rowProvider.getNextRow();
-                if(row) {
-                    GroupingElement element;
-                    // TODO LCF: should be optimized to use only pointers into grouping values
-                    for(auto index : _groupingIndices) {
-                        element._groupingValues.push_back(valueToVariant(*(*row)[index]));
-                    }
-
-                    GroupMap::iterator iter = _groupMap.find(element);
-                    if(iter == _groupMap.end()) {
-                        // group currently not contained - add new group
-                        AggregationFunctionPtrs groupValues;
-                        size_t count = 0;
-                        for(auto n : _outputIndices) {
-                            auto* aggrFunc = _aggregateFunctions[count]->clone(_aggrFuncBlocks[currentAggrFuncBlock]);
-                            if(!aggrFunc) {
-                                _aggrFuncBlocks.push_back(_blockManager.createBlock());
-                                ++currentAggrFuncBlock;
-                                aggrFunc = _aggregateFunctions[count]->clone(_aggrFuncBlocks[currentAggrFuncBlock]);
-                            }
-                            ++count;
-                            aggrFunc->init();
-                            aggrFunc->step(valueToVariant(*(*row)[n]));
-                            groupValues.push_back(aggrFunc);
-                        }
-
-                        element.disconnect();
-                        _groupMap.emplace(element, groupValues);
-                    } else {
-                        // has to perform the aggregation
-                        size_t count = 0;
-                        for(auto n : _outputIndices) {
-                            auto* aggrFunc = iter->second[count++];
-                            aggrFunc->step(valueToVariant(*(*row)[n]));
-                        }
-                    }
+        if(!_aggregated) {
+            _aggregated = true;
+            if(const Values* row = _rowProvider.getNextRow()) {
+                Types inputTypes;
+                for(const auto* value : *row) {
+                    inputTypes.push_back(value->getType());
                 }
-            } while(row);
-
-            // TODO LCF: build new blocks, should be optimized to build only one block at a time
-            getNextBlock();
-            _currentBlock = 0;
-            for(auto& groupElement : _groupMap) {
-                for(auto* aggrFunc : groupElement.second) {
-                    if(!aggrFunc->suppress()) {
-                        const auto& finalVal = aggrFunc->finalize();
-                        if(!_blocks[_currentBlock]->addValue(finalVal)) {
-                            _blocks[_currentBlock]->markNextBlock();
-                            getNextBlock();
-                            _blocks[_currentBlock]->addValue(finalVal);
-                        }
-                    }
+                SpillPartitions partitions;
+                if(_numberOfThreads > 1) {
+                    aggregateParallel(row, inputTypes, partitions);
+                } else {
+                    aggregate(row, inputTypes, partitions);
                 }
-                _blocks[_currentBlock]->nextRow();
-            }
-            _blocks[_currentBlock]->endBlocks();
+                aggregatePartitions(inputTypes, partitions, spillPartitionBits(partitions.size()));
 
-            // reset to start of blocks
-            _currentBlock = 0;
-            _offset = 0;
-            _endOffset = _blocks[_currentBlock]->_offset;
-            _useCache = true;
-        }
-        _typeOffset = _types.begin();
-        if(_offset != 0) {
-            if(*(&(_blocks[_currentBlock]->_store)[0] + _offset) != static_cast<char>(0xBB)) {
-                CSVSQLDB_THROW(csvsqldb::Exception, "should be at row delimiter");
+                // the groups of the first tables are written last, as spilled rows can still belong to them
+                for(const auto& groupTable : _groupTables) {
+                    writeGroups(*groupTable);
+                }
+                _groupTables.clear();
             }
-            ++_offset;
-            _typeOffset = _types.begin();
-        }
-        if(*(&(_blocks[_currentBlock]->_store)[0] + _offset) == static_cast<char>(0xDD)) {
-            // no more rows left
-            return nullptr;
-        }
-
-        // look for next block marker
-        if(*(&(_blocks[_currentBlock]->_store)[0] + _offset) == static_cast<char>(0xCC)) {
-            getNextBlock();
-        }
-
-        if(_offset == _endOffset) {
-            CSVSQLDB_THROW(csvsqldb::Exception, "should have found the end marker in the first place");
         }
+        return _output.getNextRow();
+    }
 
-        size_t index = 0;
-        for(auto type : _types) {
-            Value* val = getNextValue();
-            if(!val) {
-                CSVSQLDB_THROW(csvsqldb::Exception, "expected more values to fill the row");
-            }
-            if(type != val->getType()) {
-                CSVSQLDB_THROW(csvsqldb::Exception, "expected " << typeToString(type) << " but got " << typeToString(val->getType()));
+    void GroupingBlockIterator::aggregate(const Values* row, const Types& inputTypes, SpillPartitions& partitions)
+    {
+        _groupTables.push_back(std::make_shared<AggregationHashTable>(_aggregateFunctions, _blockManager));
+        AggregationHashTable& groupTable = *_groupTables.back();
+        // the blocks the spill partitions are filled in are taken from the share of the table
+        size_t share = _blockManager.getFreeBlockShare();
+        partitions = createSpillPartitions(inputTypes, spillPartitionCount(share / 2), 1);
+        size_t maxBlocks = std::max<size_t>(1, share - partitions.size());
+
+        for(; row; row = _rowProvider.getNextRow()) {
+            uint64_t hash = 0;
+            if(!aggregateRow(groupTable, *row, _groupingIndices, _outputIndices, maxBlocks, hash)) {
+                partitions[spillPartition(hash, 0, partitions.size())][0]->addRow(row->data());
             }
-            _row[index++] = val;
         }
-        row = &_row;
-
-        return row;
+        unpinSpillPartitions(partitions);
     }
 
-    Value* GroupingBlockIterator::getNextValue()
+    void GroupingBlockIterator::aggregateParallel(const Values* row, const Types& inputTypes, SpillPartitions& partitions)
     {
-        if(_offset == _endOffset) {
-            CSVSQLDB_THROW(csvsqldb::Exception, "expected more values, but already at end of block");
+        // every worker holds the block it aggregates, one queued block, its partial table and a pinned block for each spill
+        // partition. The partial tables are merged into tables of the same size, so they get at most half of the blocks.
+        size_t workerBlocks = _blockManager.getFreeBlockShare() / _numberOfThreads;
+        if(workerBlocks < 5) {
+            // the share does not even fit a partial table and two spill partitions per worker
+            aggregate(row, inputTypes, partitions);
+            return;
         }
-
-        // look for next block marker
-        if(*(&(_blocks[_currentBlock]->_store)[0] + _offset) == static_cast<char>(0xCC)) {
-            getNextBlock();
+        partitions = createSpillPartitions(inputTypes, spillPartitionCount((workerBlocks - 2) / 2), _numberOfThreads);
+        size_t maxBlocks = std::min(workerBlocks - 2 - partitions.size(), workerBlocks / 2);
+        AggregationHashTables partials;
+        for(uint16_t n = 0; n < _numberOfThreads; ++n) {
+            partials.push_back(std::make_shared<AggregationHashTable>(_aggregateFunctions, _blockManager));
         }
 
-        // look for next value marker
-        if(*(&(_blocks[_currentBlock]->_store)[0] + _offset) != static_cast<char>(0xAA)) {
-            CSVSQLDB_THROW(csvsqldb::Exception, "missing value separator");
+        std::queue<BlockPtr> blocks;
+        std::mutex queueMutex;
+        std::condition_variable cv;
+        bool finished = false;
+        size_t running = _numberOfThreads;
+        std::exception_ptr error;
+
+        ThreadPool threadPool(_numberOfThreads);
+        threadPool.start();
+
+        // every worker aggregates whole input blocks into its own partial table
+        for(uint16_t n = 0; n < _numberOfThreads; ++n) {
+            threadPool.enqueueTask([&, n]() {
+                try {
+                    for(;;) {
+                        BlockPtr block = nullptr;
+                        {
+                            std::unique_lock<std::mutex> lk(queueMutex);
+                            cv.wait(lk, [&] { return !blocks.empty() || finished; });
+                            if(blocks.empty()) {
+                                break;
+                            }
+                            block = blocks.front();
+                            blocks.pop();
+                        }
+                        cv.notify_all();
+
+                        SingleBlockProvider provider(block);
+                        BlockIterator iterator(inputTypes, provider, _blockManager);
+                        while(const Values* blockRow = iterator.getNextRow()) {
+                            uint64_t hash = 0;
+                            if(!aggregateRow(*partials[n], *blockRow, _groupingIndices, _outputIndices, maxBlocks, hash)) {
+                                partitions[spillPartition(hash, 0, partitions.size())][n]->addRow(blockRow->data());
+                            }
+                        }
+                    }
+                } catch(...) {
+                    std::unique_lock<std::mutex> lk(queueMutex);
+                    if(!error) {
+                        error = std::current_exception();
+                    }
+                    finished = true;
+                }
+                std::unique_lock<std::mutex> lk(queueMutex);
+                --running;
+                cv.notify_all();
+            });
         }
-        ++_offset;
 
-        Value* val = nullptr;
-        eType type = *_typeOffset;
-        switch(type) {
-            case STRING:
-            case DATE:
-            case TIME:
-            case TIMESTAMP:
-            case BOOLEAN:
-            case INT:
-            case REAL:
-                val = reinterpret_cast<Value*>(&(_blocks[_currentBlock]->_store)[0] + _offset);
-                break;
-            case NONE:
-                CSVSQLDB_THROW(csvsqldb::Exception, "type not allowed " << typeToString(type));
+        auto pushBlock = [&](BlockPtr block) {
+            block->endBlocks();
+            std::unique_lock<std::mutex> lk(queueMutex);
+            cv.wait(lk, [&] { return blocks.size() < _numberOfThreads || error; });
+            if(error) {
+                _blockManager.release(block);
+                return false;
+            }
+            blocks.push(block);
+            cv.notify_all();
+            return true;
+        };
+
+        // the block in construction is owned here until it is pushed, the queue or pushBlock take care of it afterwards
+        BlockPtr block = nullptr;
+        try {
+            block = _blockManager.createBlock();
+            for(; row; row = _rowProvider.getNextRow()) {
+                size_t rowStart = block->offset();
+                if(!addRow(*block, *row)) {
+                    block->rewind(rowStart);
+                    BlockPtr filledBlock = block;
+                    block = nullptr;
+                    if(!pushBlock(filledBlock)) {
+                        break;
+                    }
+                    block = _blockManager.createBlock();
+                    if(!addRow(*block, *row)) {
+                        CSVSQLDB_THROW(csvsqldb::Exception, "row does not fit into a block");
+                    }
+                }
+            }
+            if(block) {
+                BlockPtr filledBlock = block;
+                block = nullptr;
+                pushBlock(filledBlock);
+            }
+        } catch(...) {
+            std::unique_lock<std::mutex> lk(queueMutex);
+            if(!error) {
+                error = std::current_exception();
+            }
         }
-        _offset += val->size();
-        ++_typeOffset;
-        return val;
-    }
-
-    void GroupingBlockIterator::getNextBlock()
-    {
-        if(!_useCache) {
-            _blocks.push_back(_blockManager.createBlock());
-            ++_currentBlock;
-            _offset = 0;
-        } else {
-            ++_currentBlock;
-            _offset = 0;
-            _endOffset = _blocks[_currentBlock]->_offset;
+        _blockManager.release(block);
+        {
+            std::unique_lock<std::mutex> lk(queueMutex);
+            finished = true;
+            cv.notify_all();
+            cv.wait(lk, [&] { return running == 0; });
+            while(!blocks.empty()) {
+                _blockManager.release(blocks.front());
+                blocks.pop();
+            }
         }
-    }
-
-
-    HashingBlockIterator::HashingBlockIterator(const Types& types, RowProvider& rowProvider, BlockManager& blockManager, size_t hashTableKeyPosition)
-    : _rowProvider(rowProvider)
-    , _blockManager(blockManager)
-    , _types(types)
-    , _currentBlock(0)
-    , _offset(0)
-    , _endOffset(0)
-    , _useCache(false)
-    , _hashTableKeyPosition(hashTableKeyPosition)
-    , _typeOffset(_types.begin())
-    {
-        _row.resize(_types.size());
-        _context._it = _hashTable.end();
-        _context._end = _hashTable.end();
-    }
-
-    HashingBlockIterator::~HashingBlockIterator()
-    {
-        for(auto& block : _blocks) {
-            _blockManager.release(block);
+        if(error) {
+            std::rethrow_exception(error);
         }
-    }
+        unpinSpillPartitions(partitions);
 
-    void HashingBlockIterator::setContextForKeyValue(const Value& keyValue)
-    {
-        std::pair<HashTable::const_iterator, HashTable::const_iterator> range = _hashTable.equal_range(valueToVariant(keyValue));
-        _context._it = range.first;
-        _context._end = range.second;
-    }
-
-    const Values* HashingBlockIterator::getNextKeyValueRow()
-    {
-        if(_hashTable.empty()) {
-            // fill the cache and hash table
-            while(getNextRow()) {
-                // empty
-            }
-            _useCache = true;
+        // merge the partial tables, every worker merges its own hash partition of all partial tables
+        for(uint16_t n = 0; n < _numberOfThreads; ++n) {
+            _groupTables.push_back(std::make_shared<AggregationHashTable>(_aggregateFunctions, _blockManager));
         }
-        if(_context._it != _context._end) {
-            _currentBlock = _context._it->second._block;
-            _offset = _context._it->second._offset;
-            _endOffset = _blocks[_currentBlock]->_offset;
-            _typeOffset = _types.begin();
-            ++_context._it;
-
-            size_t index = 0;
-            for(auto type : _types) {
-                Value* val = getNextValue();
-                if(!val) {
-                    CSVSQLDB_THROW(csvsqldb::Exception, "expected more values to fill the row (" << typeToString(type) << ")");
+        running = _numberOfThreads;
+        for(uint16_t n = 0; n < _numberOfThreads; ++n) {
+            threadPool.enqueueTask([&, n]() {
+                try {
+                    for(const auto& partial : partials) {
+                        _groupTables[n]->merge(*partial, n, _numberOfThreads);
+                    }
+                } catch(...) {
+                    std::unique_lock<std::mutex> lk(queueMutex);
+                    if(!error) {
+                        error = std::current_exception();
+                    }
                 }
-                _row[index++] = val;
-            }
-            return &_row;
+                std::unique_lock<std::mutex> lk(queueMutex);
+                --running;
+                cv.notify_all();
+            });
+        }
+        {
+            std::unique_lock<std::mutex> lk(queueMutex);
+            cv.wait(lk, [&] { return running == 0; });
+        }
+        threadPool.stop();
+        if(error) {
+            std::rethrow_exception(error);
         }
-        return nullptr;
     }
 
-    const Values* HashingBlockIterator::getNextRow()
+    void GroupingBlockIterator::aggregatePartitions(const Types& inputTypes, SpillPartitions& partitions, size_t level)
     {
-        if(_blocks.empty()) {
-            getNextBlock();
-            _currentBlock = 0;
-        }
-        const Values* row = nullptr;
-        if(!_useCache) {
-            row = _rowProvider.getNextRow();
-            if(row) {
-                BlockPosition pos;
-                pos._block = _currentBlock;
-                pos._offset = _blocks[_currentBlock]->_offset;
-
-                size_t n = 0;
-                for(const auto& value : *row) {
-                    if(_hashTableKeyPosition == n) {
-                        _hashTable.emplace(std::make_pair(valueToVariant(*value), pos));
+        for(auto& partition : partitions) {
+            if(std::all_of(partition.begin(), partition.end(), [](const RowBufferPtr& buffer) { return buffer->size() == 0; })) {
+                continue;
+            }
+            AggregationHashTable groupTable(_aggregateFunctions, _blockManager);
+            size_t share = _blockManager.getFreeBlockShare();
+            SpillPartitions subPartitions = createSpillPartitions(inputTypes, spillPartitionCount(share / 2), 1);
+            // the last level is aggregated without limit, e.g. if all rows belong to the same group
+            size_t maxBlocks = level < MAX_SPILL_BITS ? std::max<size_t>(1, share - subPartitions.size()) : 0;
+
+            for(auto& buffer : partition) {
+                while(const Values* row = buffer->getNextRow()) {
+                    // with several threads, a group can be in the table of one thread, while another one spilled rows of it
+                    AggregationFunction* const* states = nullptr;
+                    for(const auto& firstTable : _groupTables) {
+                        if((states = firstTable->find(*row, _groupingIndices))) {
+                            break;
+                        }
                     }
-                    if(!_blocks[_currentBlock]->addValue(*value)) {
-                        _blocks[_currentBlock]->markNextBlock();
-                        getNextBlock();
-                        _blocks[_currentBlock]->addValue(*value);
+                    uint64_t hash = 0;
+                    if(states) {
+                        stepRow(states, *row, _outputIndices);
+                    } else if(!aggregateRow(groupTable, *row, _groupingIndices, _outputIndices, maxBlocks, hash)) {
+                        subPartitions[spillPartition(hash, level, subPartitions.size())][0]->addRow(row->data());
                     }
-                    ++n;
-                }
-                _blocks[_currentBlock]->nextRow();
-            } else {
-                _blocks[_currentBlock]->endBlocks();
-            }
-        } else {
-            if(_offset != 0) {
-                if(*(&(_blocks[_currentBlock]->_store)[0] + _offset) != static_cast<char>(0xBB)) {
-                    CSVSQLDB_THROW(csvsqldb::Exception, "should be at row delimiter");
-                }
-                ++_offset;
-                _typeOffset = _types.begin();
-            }
-            if(*(&(_blocks[_currentBlock]->_store)[0] + _offset) == static_cast<char>(0xDD)) {
-                // no more rows left
-                return nullptr;
-            }
-
-            // look for next block marker
-            if(*(&(_blocks[_currentBlock]->_store)[0] + _offset) == static_cast<char>(0xCC)) {
-                getNextBlock();
-            }
-
-            if(_offset == _endOffset) {
-                CSVSQLDB_THROW(csvsqldb::Exception, "should have found the end marker in the first place");
-            }
-
-            size_t index = 0;
-            for(auto type : _types) {
-                Value* val = getNextValue();
-                if(!val) {
-                    CSVSQLDB_THROW(csvsqldb::Exception, "expected more values to fill the row");
-                }
-                if(type != val->getType()) {
-                    CSVSQLDB_THROW(csvsqldb::Exception, "expected " << typeToString(type) << " but got " << typeToString(val->getType()));
                 }
-                _row[index++] = val;
             }
-            row = &_row;
+            unpinSpillPartitions(subPartitions);
+            writeGroups(groupTable);
+            groupTable.clear();
+            aggregatePartitions(inputTypes, subPartitions, level + spillPartitionBits(subPartitions.size()));
         }
-
-        return row;
     }
 
-    Value* HashingBlockIterator::getNextValue()
+    void GroupingBlockIterator::writeGroups(const AggregationHashTable& groupTable)
     {
-        if(_offset == _endOffset) {
-            CSVSQLDB_THROW(csvsqldb::Exception, "expected more values, but already at end of block");
-        }
-
-        // look for next block marker
-        if(*(&(_blocks[_currentBlock]->_store)[0] + _offset) == static_cast<char>(0xCC)) {
-            getNextBlock();
-        }
-
-        // look for next value marker
-        if(*(&(_blocks[_currentBlock]->_store)[0] + _offset) != static_cast<char>(0xAA)) {
-            CSVSQLDB_THROW(csvsqldb::Exception, "missing value separator");
-        }
-        ++_offset;
-
-        Value* val = nullptr;
-        eType type = *_typeOffset;
-        switch(type) {
-            case STRING:
-            case DATE:
-            case TIME:
-            case TIMESTAMP:
-            case BOOLEAN:
-            case INT:
-            case REAL:
-                val = reinterpret_cast<Value*>(&(_blocks[_currentBlock]->_store)[0] + _offset);
-                break;
-            case NONE:
-                CSVSQLDB_THROW(csvsqldb::Exception, "type not allowed " << typeToString(type));
+        for(size_t group = 0; group < groupTable.size(); ++group) {
+            AggregationFunction* const* states = groupTable.getStates(group);
+            for(size_t n = 0; n < _aggregateFunctions.size(); ++n) {
+                if(!states[n]->suppress()) {
+                    _output.addValue(states[n]->finalize());
+                }
+            }
+            _output.nextRow();
         }
-        _offset += val->size();
-        ++_typeOffset;
-        return val;
     }
 
-    void HashingBlockIterator::reset()
+    GroupingBlockIterator::SpillPartitions
+    GroupingBlockIterator::createSpillPartitions(const Types& inputTypes, size_t count, size_t buffers)
     {
-        _useCache = false;
-        _currentBlock = 0;
-        _offset = 0;
-        _endOffset = 0;
-        _context._it = _hashTable.end();
-        _context._end = _hashTable.end();
-        for(auto& block : _blocks) {
-            _blockManager.release(block);
+        SpillPartitions partitions(count);
+        for(auto& partition : partitions) {
+            for(size_t n = 0; n < buffers; ++n) {
+                partition.push_back(std::make_shared<RowBuffer>(inputTypes, _blockManager));
+            }
         }
-        _hashTable.clear();
+        return partitions;
     }
 
-    void HashingBlockIterator::getNextBlock()
+    void GroupingBlockIterator::unpinSpillPartitions(SpillPartitions& partitions)
     {
-        if(!_useCache) {
-            _blocks.push_back(_blockManager.createBlock());
-            ++_currentBlock;
-            _offset = 0;
-        } else {
-            ++_currentBlock;
-            _offset = 0;
-            _endOffset = _blocks[_currentBlock]->_offset;
+        // all rows are partitioned, so the last blocks of the partitions can be spilled until they are aggregated
+        for(auto& partition : partitions) {
+            for(auto& buffer : partition) {
+                buffer->unpinLastBlock();
+            }
         }
     }
 }
@@ -37,8 +37,13 @@
 #include "libcsvsqldb/inc.h"
 
 #include "aggregation_functions.h"
+#include "aggregation_hash_table.h"
 #include "block.h"
+#include "external_sort.h"
 
+#include <algorithm>
+#include <cstring>
+#include <deque>
 #include <unordered_map>
 
 
@@ -74,6 +79,9 @@ namespace csvsqldb
     class BlockIterator;
     typedef std::shared_ptr<BlockIterator> BlockIteratorPtr;
 
+    class RowBuffer;
+    typedef std::shared_ptr<RowBuffer> RowBufferPtr;
+
     class CachingBlockIterator;
     typedef std::shared_ptr<CachingBlockIterator> CachingBlockIteratorPtr;
 
@@ -83,20 +91,11 @@ namespace csvsqldb
     class GroupingBlockIterator;
     typedef std::shared_ptr<GroupingBlockIterator> GroupingBlockIteratorPtr;
 
-    class HashingBlockIterator;
-    typedef std::shared_ptr<HashingBlockIterator> HashingBlockIteratorPtr;
-
     struct CSVSQLDB_EXPORT BlockPosition {
         size_t _block;
         size_t _offset;
     };
 
-    typedef std::unordered_multimap<Variant, BlockPosition> HashTable;
-
-    struct CSVSQLDB_EXPORT HashingBlockIteratorContext {
-        HashTable::const_iterator _it;
-        HashTable::const_iterator _end;
-    };
 
 
     class CSVSQLDB_EXPORT BlockIterator
@@ -111,6 +110,7 @@ namespace csvsqldb
         const Values* getNextRow();
 
     private:
+        void nextBlock();
         Value* getNextValue();
 
         BlockProvider& _blockProvider;
@@ -125,6 +125,59 @@ namespace csvsqldb
     };
 
 
+    /**
+     * Buffers rows in a chain of cacheable blocks, so they are spilled to the spill file of the block manager, if the
+     * memory budget is exhausted. Only completed blocks are cacheable, the block rows are added to stays pinned until
+     * unpinLastBlock is called or the rows are read, so every buffer filled at the same time holds one block in memory.
+     * The rows are read once in the order they were added, afterwards the buffer is empty again.
+     */
+    class CSVSQLDB_EXPORT RowBuffer : public RowProvider, public BlockProvider
+    {
+    public:
+        RowBuffer(const Types& types, BlockManager& blockManager);
+
+        virtual ~RowBuffer();
+
+        /// Adds a row with a value for each type of the buffer
+        void addRow(const Value* const* row);
+
+        /// Adds the next value of the current row, the row is finished with nextRow
+        void addValue(const Value& value);
+
+        /// Adds the next value of the current row, the row is finished with nextRow
+        void addValue(const Variant& value);
+
+        void nextRow();
+
+        /// Marks the block rows are added to as cacheable, e.g. once all rows are added. Adding a value pins it again.
+        void unpinLastBlock();
+
+        /// Returns the number of rows added and not read yet
+        size_t size() const
+        {
+            return _rows;
+        }
+
+        virtual const Values* getNextRow();
+
+        virtual BlockPtr getNextBlock();
+
+    private:
+        BlockPtr pinLastBlock();
+        void nextBlock();
+        template <typename T>
+        void add(const T& value);
+
+        const Types _types;
+        BlockManager& _blockManager;
+        Blocks _blocks;
+        size_t _nextBlock;
+        size_t _rows;
+        bool _pinned;
+        BlockIteratorPtr _iterator;
+    };
+
+
     class CSVSQLDB_EXPORT CachingBlockIterator
     {
     public:
@@ -148,12 +201,18 @@ namespace csvsqldb
         size_t _currentBlock;
         size_t _offset;
         size_t _endOffset;
+        size_t _firstPinnedBlock;
         bool _useCache;
         Types::iterator _typeOffset;
     };
 
 
-    class CSVSQLDB_EXPORT SortingBlockIterator
+    /**
+     * Sorts the rows of its input by normalized sort keys. If the rows need more than half of the blocks, that are free
+     * in the block manager once the input is read, sorted runs of that size are written to temporary files and merged
+     * with a loser tree while the rows are returned.
+     */
+    class CSVSQLDB_EXPORT SortingBlockIterator : public RowProvider
     {
     public:
         struct SortOrder {
@@ -162,6 +221,7 @@ namespace csvsqldb
         };
 
         typedef std::vector<SortOrder> SortOrders;
+        typedef std::vector<unsigned char> SortKey;
 
         SortingBlockIterator(const Types& types, const SortOrders& sortOrders, RowProvider& rowProvider, BlockManager& blockManager);
 
@@ -169,11 +229,49 @@ namespace csvsqldb
 
         virtual const Values* getNextRow();
 
+        /**
+         * Appends the normalized sort key of the given row to the key buffer. Two keys compare with compareSortKeys in
+         * the same order as their rows have to be sorted. NULL values sort before all other values in ascending order
+         * and after them in descending order. Strings are encoded with strxfrm, so their order matches strcoll.
+         * @param row The row to encode the sort columns of
+         * @param sortOrders The sort columns and their order
+         * @param key The key buffer to append the encoded key to
+         */
+        static void appendSortKey(const Values& row, const SortOrders& sortOrders, SortKey& key);
+
+        /**
+         * Compares two normalized sort keys bytewise.
+         * @return A value less than, equal to or greater than 0, if the left key sorts before, equal to or after the right
+         * key
+         */
+        static int compareSortKeys(const unsigned char* lhs, size_t lhsLength, const unsigned char* rhs, size_t rhsLength)
+        {
+            int result = ::memcmp(lhs, rhs, std::min(lhsLength, rhsLength));
+            if(result == 0) {
+                return lhsLength < rhsLength ? -1 : (lhsLength > rhsLength ? 1 : 0);
+            }
+            return result;
+        }
+
     private:
-        typedef std::vector<BlockPosition> Rows;
+        struct SortEntry {
+            BlockPosition _position;
+            size_t _keyOffset;
+            size_t _keyLength;
+        };
+        typedef std::vector<SortEntry> Rows;
 
+        const Values* readRow(const SortEntry& entry);
         Value* getNextValue();
+        void addBlock();
+        size_t freeBlockShare() const;
         void getNextBlock();
+        void sortRows();
+        void writeRun();
+        SortRunReaders openRuns(size_t count);
+        static LoserTree::Less runOrder(const SortRunReaders& readers);
+        void mergeRuns();
+        const Values* getNextMergedRow();
 
         RowProvider& _rowProvider;
         BlockManager& _blockManager;
@@ -183,14 +281,29 @@ namespace csvsqldb
         size_t _currentBlock;
         size_t _offset;
         size_t _endOffset;
+        std::vector<size_t> _pinnedBlocks;
         Rows _rows;
         Rows::const_iterator _rowIter;
+        SortKey _keys;
+        size_t _maxRunBlocks;
+        std::deque<std::string> _runs;
+        SortRunReaders _readers;
+        std::unique_ptr<LoserTree> _loserTree;
         bool _initialize;
+        bool _advanceWinner;
         Types::const_iterator _typeOffset;
         const SortOrders _sortOrders;
     };
 
 
+    /**
+     * Aggregates the rows of its input by the grouping values. A hash table only gets new groups, as long as its arena
+     * fits into half of the free blocks of the block manager. After that, the rows of groups that are not in the table
+     * are hash partitioned into spill partitions, and every partition is aggregated on its own after the input is read.
+     * The blocks the partitions are filled in are taken from the same half, so there are fewer partitions under a small
+     * memory budget.
+     * The aggregated rows are buffered in cacheable blocks.
+     */
     class CSVSQLDB_EXPORT GroupingBlockIterator
     {
     public:
@@ -199,69 +312,39 @@ namespace csvsqldb
                               const csvsqldb::IndexVector outputIndices,
                               AggregationFunctions& aggregateFunctions,
                               RowProvider& rowProvider,
-                              BlockManager& blockManager);
+                              BlockManager& blockManager,
+                              uint16_t numberOfThreads = 1);
 
         virtual ~GroupingBlockIterator();
 
         virtual const Values* getNextRow();
 
     private:
-        typedef std::vector<AggregationFunction*> AggregationFunctionPtrs;
-        typedef std::unordered_map<GroupingElement, AggregationFunctionPtrs> GroupMap;
-
-        Value* getNextValue();
-        void getNextBlock();
+        typedef std::shared_ptr<AggregationHashTable> AggregationHashTablePtr;
+        typedef std::vector<AggregationHashTablePtr> AggregationHashTables;
+        typedef std::vector<RowBufferPtr> RowBuffers;
+        // the row buffers of every spill partition, one for each thread that spills rows
+        typedef std::vector<RowBuffers> SpillPartitions;
+
+        void aggregate(const Values* row, const Types& inputTypes, SpillPartitions& partitions);
+        void aggregateParallel(const Values* row, const Types& inputTypes, SpillPartitions& partitions);
+        void aggregatePartitions(const Types& inputTypes, SpillPartitions& partitions, size_t level);
+        void writeGroups(const AggregationHashTable& groupTable);
+        SpillPartitions createSpillPartitions(const Types& inputTypes, size_t count, size_t buffers);
+        void unpinSpillPartitions(SpillPartitions& partitions);
 
         RowProvider& _rowProvider;
         BlockManager& _blockManager;
-        Values _row;
-        Types _types;
-        Blocks _blocks;
-        size_t _currentBlock;
-        size_t _offset;
-        size_t _endOffset;
-        Blocks _aggrFuncBlocks;
-        bool _useCache;
-        GroupMap _groupMap;
+        RowBuffer _output;
+        bool _aggregated;
+        uint16_t _numberOfThreads;
+        AggregationHashTables _groupTables;
         const csvsqldb::IndexVector _groupingIndices;
         const csvsqldb::IndexVector _outputIndices;
-        Types::iterator _typeOffset;
         AggregationFunctions _aggregateFunctions;
     };
 
 
-    class CSVSQLDB_EXPORT HashingBlockIterator
-    {
-    public:
-        HashingBlockIterator(const Types& types, RowProvider& rowProvider, BlockManager& blockManager, size_t hashTableKeyPosition);
-
-        virtual ~HashingBlockIterator();
-
-        virtual const Values* getNextRow();
-
-        void setContextForKeyValue(const Value& keyValue);
-        const Values* getNextKeyValueRow();
-
-        void reset();
-
-    private:
-        Value* getNextValue();
-        void getNextBlock();
-
-        RowProvider& _rowProvider;
-        BlockManager& _blockManager;
-        Values _row;
-        Types _types;
-        Blocks _blocks;
-        size_t _currentBlock;
-        size_t _offset;
-        size_t _endOffset;
-        bool _useCache;
-        HashTable _hashTable;
-        size_t _hashTableKeyPosition;
-        HashingBlockIteratorContext _context;
-        Types::iterator _typeOffset;
-    };
 }
 
 #endif
@@ -0,0 +1,419 @@
+//
+//  columnar_block.cpp
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "columnar_block.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace csvsqldb
+{
+
+    namespace
+    {
+        size_t columnWidth(eType type)
+        {
+            switch(type) {
+                case BOOLEAN:
+                    return sizeof(uint8_t);
+                case DATE:
+                    return sizeof(uint32_t);
+                case TIME:
+                    return sizeof(int32_t);
+                case INT:
+                case TIMESTAMP:
+                    return sizeof(int64_t);
+                case REAL:
+                    return sizeof(double);
+                case STRING:
+                    return 2 * sizeof(uint32_t);
+                case NONE:
+                    break;
+            }
+            CSVSQLDB_THROW(csvsqldb::Exception, "type " << typeToString(type) << " cannot be stored in a columnar block");
+        }
+
+        size_t valueSlotSize()
+        {
+            return std::max({sizeof(ValInt),
+                             sizeof(ValDouble),
+                             sizeof(ValBool),
+                             sizeof(ValDate),
+                             sizeof(ValTime),
+                             sizeof(ValTimestamp),
+                             sizeof(ValString)});
+        }
+    }
+
+
+    ColumnarBlock::ColumnarBlock(const Types& types, size_t capacity)
+    : _types(types)
+    , _columns(types.size())
+    , _capacity(capacity)
+    , _rows(0)
+    , _column(0)
+    {
+        if(!capacity) {
+            CSVSQLDB_THROW(csvsqldb::Exception, "columnar blocks need a capacity of at least one row");
+        }
+        for(size_t n = 0; n < _types.size(); ++n) {
+            Column& column = _columns[n];
+            column._width = columnWidth(_types[n]);
+            column._data.resize(column._width * capacity);
+            column._nulls.resize((capacity + 63) / 64);
+        }
+    }
+
+    void ColumnarBlock::checkColumn(eType type)
+    {
+        if(isFull()) {
+            CSVSQLDB_THROW(csvsqldb::Exception, "columnar block is full");
+        }
+        if(_column >= _types.size()) {
+            CSVSQLDB_THROW(csvsqldb::Exception, "too many values for the row of a columnar block");
+        }
+        if(_types[_column] != type) {
+            CSVSQLDB_THROW(csvsqldb::Exception,
+                           "expected value of type " << typeToString(_types[_column]) << " for column " << _column << " but got "
+                                                     << typeToString(type));
+        }
+    }
+
+    void ColumnarBlock::setNull(bool isNull)
+    {
+        uint64_t& word = _columns[_column]._nulls[_rows >> 6];
+        uint64_t bit = uint64_t(1) << (_rows & 63);
+        word = isNull ? (word | bit) : (word & ~bit);
+        ++_column;
+    }
+
+    void ColumnarBlock::addInt(int64_t num, bool isNull)
+    {
+        checkColumn(INT);
+        columnData<int64_t>(_column)[_rows] = isNull ? 0 : num;
+        setNull(isNull);
+    }
+
+    void ColumnarBlock::addReal(double num, bool isNull)
+    {
+        checkColumn(REAL);
+        columnData<double>(_column)[_rows] = isNull ? 0.0 : num;
+        setNull(isNull);
+    }
+
+    void ColumnarBlock::addString(const char* s, size_t len, bool isNull)
+    {
+        checkColumn(STRING);
+        std::vector<char>& heap = _columns[_column]._heap;
+        StringRef& ref = columnData<StringRef>(_column)[_rows];
+        ref._offset = static_cast<uint32_t>(heap.size());
+        ref._length = 0;
+        if(!isNull) {
+            ref._length = static_cast<uint32_t>(len);
+            heap.insert(heap.end(), s, s + len);
+        }
+        heap.push_back('\0');
+        setNull(isNull);
+    }
+
+    void ColumnarBlock::addBool(bool b, bool isNull)
+    {
+        checkColumn(BOOLEAN);
+        columnData<uint8_t>(_column)[_rows] = !isNull && b;
+        setNull(isNull);
+    }
+
+    void ColumnarBlock::addDate(const csvsqldb::Date& date, bool isNull)
+    {
+        checkColumn(DATE);
+        columnData<uint32_t>(_column)[_rows] = isNull ? 0 : date.asJulianDay();
+        setNull(isNull);
+    }
+
+    void ColumnarBlock::addTime(const csvsqldb::Time& time, bool isNull)
+    {
+        checkColumn(TIME);
+        columnData<int32_t>(_column)[_rows] = isNull ? 0 : time.asInteger();
+        setNull(isNull);
+    }
+
+    void ColumnarBlock::addTimestamp(const csvsqldb::Timestamp& timestamp, bool isNull)
+    {
+        checkColumn(TIMESTAMP);
+        columnData<int64_t>(_column)[_rows] = isNull ? 0 : timestamp.asInteger();
+        setNull(isNull);
+    }
+
+    void ColumnarBlock::addValue(const Value& value)
+    {
+        bool isNull = value.isNull();
+        switch(value.getType()) {
+            case INT:
+                addInt(isNull ? 0 : static_cast<const ValInt&>(value).asInt(), isNull);
+                break;
+            case REAL:
+                addReal(isNull ? 0.0 : static_cast<const ValDouble&>(value).asDouble(), isNull);
+                break;
+            case BOOLEAN:
+                addBool(!isNull && static_cast<const ValBool&>(value).asBool(), isNull);
+                break;
+            case DATE:
+                addDate(isNull ? csvsqldb::Date() : static_cast<const ValDate&>(value).asDate(), isNull);
+                break;
+            case TIME:
+                addTime(isNull ? csvsqldb::Time() : static_cast<const ValTime&>(value).asTime(), isNull);
+                break;
+            case TIMESTAMP:
+                addTimestamp(isNull ? csvsqldb::Timestamp() : static_cast<const ValTimestamp&>(value).asTimestamp(), isNull);
+                break;
+            case STRING: {
+                const ValString& s = static_cast<const ValString&>(value);
+                addString(s.asString(), s.length(), isNull);
+                break;
+            }
+            case NONE:
+                CSVSQLDB_THROW(csvsqldb::Exception, "cannot add values of type NONE to a columnar block");
+        }
+    }
+
+    void ColumnarBlock::addValue(const Variant& value)
+    {
+        bool isNull = value.isNull();
+        switch(value.getType()) {
+            case INT:
+                addInt(isNull ? 0 : value.asInt(), isNull);
+                break;
+            case REAL:
+                addReal(isNull ? 0.0 : value.asDouble(), isNull);
+                break;
+            case BOOLEAN:
+                addBool(!isNull && value.asBool(), isNull);
+                break;
+            case DATE:
+                addDate(isNull ? csvsqldb::Date() : value.asDate(), isNull);
+                break;
+            case TIME:
+                addTime(isNull ? csvsqldb::Time() : value.asTime(), isNull);
+                break;
+            case TIMESTAMP:
+                addTimestamp(isNull ? csvsqldb::Timestamp() : value.asTimestamp(), isNull);
+                break;
+            case STRING:
+                if(isNull) {
+                    addString(nullptr, 0, true);
+                } else {
+                    addString(value.asString(), ::strlen(value.asString()), false);
+                }
+                break;
+            case NONE:
+                CSVSQLDB_THROW(csvsqldb::Exception, "cannot add values of type NONE to a columnar block");
+        }
+    }
+
+    void ColumnarBlock::nextRow()
+    {
+        if(_column != _types.size()) {
+            CSVSQLDB_THROW(csvsqldb::Exception, "expected " << _types.size() << " values for the row but got " << _column);
+        }
+        _column = 0;
+        ++_rows;
+    }
+
+    void ColumnarBlock::clear()
+    {
+        for(auto& column : _columns) {
+            column._heap.clear();
+        }
+        _rows = 0;
+        _column = 0;
+    }
+
+    void ColumnarBlock::addRow(const Values& row)
+    {
+        for(const auto& value : row) {
+            addValue(*value);
+        }
+        nextRow();
+    }
+
+    Variant ColumnarBlock::getVariant(size_t column, size_t row) const
+    {
+        if(isNull(column, row)) {
+            return Variant(_types[column]);
+        }
+        switch(_types[column]) {
+            case INT:
+                return Variant(getInt(column, row));
+            case REAL:
+                return Variant(getReal(column, row));
+            case BOOLEAN:
+                return Variant(getBool(column, row));
+            case DATE:
+                return Variant(getDate(column, row));
+            case TIME:
+                return Variant(getTime(column, row));
+            case TIMESTAMP:
+                return Variant(getTimestamp(column, row));
+            case STRING:
+                return Variant(getString(column, row));
+            case NONE:
+                break;
+        }
+        CSVSQLDB_THROW(csvsqldb::Exception, "type NONE cannot be stored in a columnar block");
+    }
+
+    void ColumnarBlock::appendTo(size_t column, size_t firstRow, size_t rows, ValueVector& vector) const
+    {
+        if(vector.getType() != _types[column]) {
+            CSVSQLDB_THROW(csvsqldb::Exception,
+                           "cannot append column of type " << typeToString(_types[column]) << " to vector of type "
+                                                           << typeToString(vector.getType()));
+        }
+        if(firstRow + rows > _rows) {
+            CSVSQLDB_THROW(csvsqldb::Exception, "rows out of range of the columnar block");
+        }
+
+        size_t start = vector.size();
+        vector._nulls.resize(start + rows);
+        uint8_t* nulls = vector._nulls.data() + start;
+        for(size_t n = 0; n < rows; ++n) {
+            nulls[n] = isNull(column, firstRow + n);
+        }
+
+        switch(_types[column]) {
+            case INT: {
+                const int64_t* data = getColumnData<int64_t>(column) + firstRow;
+                vector._ints.insert(vector._ints.end(), data, data + rows);
+                break;
+            }
+            case REAL: {
+                const double* data = getColumnData<double>(column) + firstRow;
+                vector._reals.insert(vector._reals.end(), data, data + rows);
+                break;
+            }
+            case BOOLEAN: {
+                const uint8_t* data = getColumnData<uint8_t>(column) + firstRow;
+                vector._ints.insert(vector._ints.end(), data, data + rows);
+                break;
+            }
+            case DATE: {
+                const uint32_t* data = getColumnData<uint32_t>(column) + firstRow;
+                vector._ints.insert(vector._ints.end(), data, data + rows);
+                break;
+            }
+            default:
+                CSVSQLDB_THROW(csvsqldb::Exception, "type " << typeToString(_types[column]) << " not supported in value vectors");
+        }
+    }
+
+
+    ColumnarBlockIterator::ColumnarBlockIterator(const ColumnarBlocks& blocks)
+    : _blocks(blocks)
+    , _block(0)
+    , _row(0)
+    {
+        if(!_blocks.empty()) {
+            size_t columns = _blocks.front()->getTypes().size();
+            _values.resize(columns);
+            _slots.resize(columns, ValueSlot(valueSlotSize()));
+        }
+    }
+
+    void ColumnarBlockIterator::seek(size_t block, size_t row)
+    {
+        _block = block;
+        _row = row;
+    }
+
+    const Value* ColumnarBlockIterator::makeValue(const ColumnarBlock& block, size_t column, size_t row)
+    {
+        // the slots are reused for every row, the values are never destructed like the values in the row blocks
+        char* slot = _slots[column].data();
+        bool isNull = block.isNull(column, row);
+        switch(block.getTypes()[column]) {
+            case INT:
+                return isNull ? new(slot) ValInt() : new(slot) ValInt(block.getInt(column, row));
+            case REAL:
+                return isNull ? new(slot) ValDouble() : new(slot) ValDouble(block.getReal(column, row));
+            case BOOLEAN:
+                return isNull ? new(slot) ValBool() : new(slot) ValBool(block.getBool(column, row));
+            case DATE:
+                return isNull ? new(slot) ValDate() : new(slot) ValDate(block.getDate(column, row));
+            case TIME:
+                return isNull ? new(slot) ValTime() : new(slot) ValTime(block.getTime(column, row));
+            case TIMESTAMP:
+                return isNull ? new(slot) ValTimestamp() : new(slot) ValTimestamp(block.getTimestamp(column, row));
+            case STRING:
+                return isNull ? new(slot) ValString()
+                              : new(slot) ValString(block.getString(column, row), block.getStringLength(column, row));
+            case NONE:
+                break;
+        }
+        CSVSQLDB_THROW(csvsqldb::Exception, "type NONE cannot be stored in a columnar block");
+    }
+
+    const Values* ColumnarBlockIterator::getNextRow()
+    {
+        while(_block < _blocks.size() && _row >= _blocks[_block]->getRowCount()) {
+            ++_block;
+            _row = 0;
+        }
+        if(_block >= _blocks.size()) {
+            return nullptr;
+        }
+
+        const ColumnarBlock& block = *_blocks[_block];
+        for(size_t column = 0; column < _values.size(); ++column) {
+            _values[column] = makeValue(block, column, _row);
+        }
+        ++_row;
+        return &_values;
+    }
+
+
+    ColumnarBlocks readColumnarBlocks(RowProvider& provider, const Types& types, size_t capacity)
+    {
+        ColumnarBlocks blocks;
+        ColumnarBlockPtr block;
+        const Values* row = nullptr;
+        while((row = provider.getNextRow())) {
+            if(!block || block->isFull()) {
+                block = std::make_shared<ColumnarBlock>(types, capacity);
+                blocks.push_back(block);
+            }
+            block->addRow(*row);
+        }
+        return blocks;
+    }
+}
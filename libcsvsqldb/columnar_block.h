@@ -0,0 +1,234 @@
+//
+//  columnar_block.h
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef csvsqldb_columnar_block_h
+#define csvsqldb_columnar_block_h
+
+#include "libcsvsqldb/inc.h"
+
+#include "block.h"
+#include "stack_machine.h"
+
+#include <memory>
+#include <vector>
+
+
+namespace csvsqldb
+{
+
+    class ColumnarBlock;
+    typedef std::shared_ptr<ColumnarBlock> ColumnarBlockPtr;
+    typedef std::vector<ColumnarBlockPtr> ColumnarBlocks;
+
+
+    /**
+     * A block that stores its rows column wise (PAX layout) as an alternative to the marker delimited row blocks.
+     * Every column has a fixed width array of its native type and a null bitmap, strings are kept as offset and length
+     * into a separate string heap of the column. A value can therefore be accessed directly by column and row, and
+     * filters and aggregates can stream through the contiguous column arrays.
+     * Values have to be added row by row in column order, like with the row blocks.
+     */
+    class CSVSQLDB_EXPORT ColumnarBlock
+    {
+    public:
+        ColumnarBlock(const Types& types, size_t capacity);
+
+        const Types& getTypes() const
+        {
+            return _types;
+        }
+
+        size_t getRowCount() const
+        {
+            return _rows;
+        }
+
+        size_t getCapacity() const
+        {
+            return _capacity;
+        }
+
+        bool isFull() const
+        {
+            return _rows >= _capacity;
+        }
+
+        void addInt(int64_t num, bool isNull);
+        void addReal(double num, bool isNull);
+        void addString(const char* s, size_t len, bool isNull);
+        void addBool(bool b, bool isNull);
+        void addDate(const csvsqldb::Date& date, bool isNull);
+        void addTime(const csvsqldb::Time& time, bool isNull);
+        void addTimestamp(const csvsqldb::Timestamp& timestamp, bool isNull);
+        void addValue(const Value& value);
+        void addValue(const Variant& value);
+
+        void nextRow();
+
+        /// Removes all rows, so that the block can be filled again.
+        void clear();
+
+        /// Adds a complete row, the values have to match the column types of the block.
+        void addRow(const Values& row);
+
+        bool isNull(size_t column, size_t row) const
+        {
+            return (_columns[column]._nulls[row >> 6] >> (row & 63)) & 1;
+        }
+
+        int64_t getInt(size_t column, size_t row) const
+        {
+            return getColumnData<int64_t>(column)[row];
+        }
+
+        double getReal(size_t column, size_t row) const
+        {
+            return getColumnData<double>(column)[row];
+        }
+
+        bool getBool(size_t column, size_t row) const
+        {
+            return getColumnData<uint8_t>(column)[row] != 0;
+        }
+
+        csvsqldb::Date getDate(size_t column, size_t row) const
+        {
+            return csvsqldb::Date(getColumnData<uint32_t>(column)[row]);
+        }
+
+        csvsqldb::Time getTime(size_t column, size_t row) const
+        {
+            return csvsqldb::Time(getColumnData<int32_t>(column)[row]);
+        }
+
+        csvsqldb::Timestamp getTimestamp(size_t column, size_t row) const
+        {
+            return csvsqldb::Timestamp(getColumnData<int64_t>(column)[row]);
+        }
+
+        const char* getString(size_t column, size_t row) const
+        {
+            return &_columns[column]._heap[getColumnData<StringRef>(column)[row]._offset];
+        }
+
+        size_t getStringLength(size_t column, size_t row) const
+        {
+            return getColumnData<StringRef>(column)[row]._length;
+        }
+
+        Variant getVariant(size_t column, size_t row) const;
+
+        /// Returns the fixed width array of a column. INT columns are int64_t, REAL double, BOOLEAN uint8_t, DATE the
+        /// julian day as uint32_t, TIME int32_t and TIMESTAMP int64_t.
+        template <typename T>
+        const T* getColumnData(size_t column) const
+        {
+            return reinterpret_cast<const T*>(_columns[column]._data.data());
+        }
+
+        /// Returns the null bitmap of a column, one bit per row with the bit set for null values.
+        const uint64_t* getNullBitmap(size_t column) const
+        {
+            return _columns[column]._nulls.data();
+        }
+
+        /// Appends the given rows of a column to a value vector of the same type.
+        void appendTo(size_t column, size_t firstRow, size_t rows, ValueVector& vector) const;
+
+    private:
+        struct StringRef {
+            uint32_t _offset;
+            uint32_t _length;
+        };
+
+        struct Column {
+            std::vector<char> _data;
+            std::vector<uint64_t> _nulls;
+            std::vector<char> _heap;
+            size_t _width;
+        };
+
+        template <typename T>
+        T* columnData(size_t column)
+        {
+            return reinterpret_cast<T*>(_columns[column]._data.data());
+        }
+
+        void checkColumn(eType type);
+        void setNull(bool isNull);
+
+        Types _types;
+        std::vector<Column> _columns;
+        size_t _capacity;
+        size_t _rows;
+        size_t _column;
+    };
+
+
+    /**
+     * Reads the rows of one or more columnar blocks. Each value of the returned rows is constructed from the column
+     * arrays, so no markers have to be walked and every column of a row is found directly.
+     */
+    class CSVSQLDB_EXPORT ColumnarBlockIterator : public RowProvider
+    {
+    public:
+        ColumnarBlockIterator(const ColumnarBlocks& blocks);
+
+        ColumnarBlockIterator(const ColumnarBlockIterator&) = delete;
+        ColumnarBlockIterator& operator=(const ColumnarBlockIterator&) = delete;
+
+        virtual const Values* getNextRow();
+
+        /// Positions the iterator, so that the next call to getNextRow returns the given row of the given block.
+        void seek(size_t block, size_t row);
+
+    private:
+        typedef std::vector<char> ValueSlot;
+
+        const Value* makeValue(const ColumnarBlock& block, size_t column, size_t row);
+
+        ColumnarBlocks _blocks;
+        size_t _block;
+        size_t _row;
+        Values _values;
+        std::vector<ValueSlot> _slots;
+    };
+
+
+    /**
+     * Reads all rows of the provider into columnar blocks of the given capacity.
+     */
+    CSVSQLDB_EXPORT ColumnarBlocks readColumnarBlocks(RowProvider& provider, const Types& types, size_t capacity);
+}
+
+#endif
@@ -40,6 +40,10 @@ namespace csvsqldb
     ExecutionContext::ExecutionContext(Database& database)
     : _database(database)
     , _showHeaderLine(true)
+    , _numberOfThreads(1)
+    , _memoryBudget(1000 * 1024 * 1024)
+    , _hugePages(false)
+    , _outputFormat(CSV_FORMAT)
     {
     }
 }
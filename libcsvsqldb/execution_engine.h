@@ -56,6 +56,10 @@ namespace csvsqldb
         Database& _database;
         csvsqldb::StringVector _files;
         bool _showHeaderLine;
+        uint16_t _numberOfThreads;
+        size_t _memoryBudget;
+        bool _hugePages;
+        eOutputFormat _outputFormat;
     };
 
     struct CSVSQLDB_EXPORT ExecutionStatistics {
@@ -69,6 +73,9 @@ namespace csvsqldb
         size_t _maxUsedBlocks;
         size_t _totalBlocks;
         size_t _maxUsedCapacity;
+        size_t _spilledBlocks;
+        size_t _pooledBlocks;
+        size_t _allocatedBlocks;
     };
 
     template <typename OperatorNodeFactory>
@@ -78,7 +85,7 @@ namespace csvsqldb
         ExecutionEngine(ExecutionContext& execContext)
         : _execContext(execContext)
         , _parser(_functions)
-        , _blockManager(1000)
+        , _blockManager(MemoryBudget(execContext._memoryBudget), blockCapacity(execContext._memoryBudget), execContext._hugePages)
         {
             initBuildInFunctions(_functions);
         }
@@ -93,6 +100,8 @@ namespace csvsqldb
         {
             OperatorContext context(_execContext._database, _functions, _blockManager, _execContext._files);
             context._showHeaderLine = _execContext._showHeaderLine;
+            context._numberOfThreads = _execContext._numberOfThreads;
+            context._outputFormat = _execContext._outputFormat;
 
             statistics._startParsing = csvsqldb::chrono::ProcessTimeClock::now();
             ASTNodePtr astnode = _parser.parse();
@@ -119,11 +128,24 @@ namespace csvsqldb
             statistics._maxUsedBlocks = _blockManager.getMaxUsedBlocks();
             statistics._maxUsedCapacity = (_blockManager.getMaxUsedBlocks() * _blockManager.getBlockCapacity()) / (1024 * 1024);
             statistics._totalBlocks = _blockManager.getTotalBlocks();
+            statistics._spilledBlocks = _blockManager.getSpilledBlocks();
+            statistics._pooledBlocks = _blockManager.getPooledBlocks();
+            statistics._allocatedBlocks = _blockManager.getAllocatedBlocks();
 
             return rowCount;
         }
 
+        /// small memory budgets are split into smaller blocks, so that all operators of a query still get enough blocks
+        static size_t blockCapacity(size_t memoryBudget)
+        {
+            const size_t maxCapacity = 1 * 1024 * 1024;
+            const size_t minBlocks = 32;
+            const size_t pageSize = 4096;
+            return std::max(pageSize, std::min(maxCapacity, memoryBudget / minBlocks / pageSize * pageSize));
+        }
+
     private:
+
         ExecutionContext _execContext;
         FunctionRegistry _functions;
         SQLParser _parser;
@@ -87,6 +87,7 @@ namespace csvsqldb
         : _context(context)
         , _executionPlan(executionPlan)
         , _outputStream(outputStream)
+        , _rowOrderRequired(true)
         {
         }
 
@@ -156,7 +157,16 @@ namespace csvsqldb
 
         virtual void visit(ASTQuerySpecificationNode& node)
         {
+            // grouping, aggregation and sorting do not depend on the order of the scanned rows
+            bool rowOrderRequired = _rowOrderRequired;
+            _rowOrderRequired = !node._tableExpression->_group && !node._tableExpression->_order
+                                && !std::dynamic_pointer_cast<ASTAggregateFunctionNode>(node._nodes[0]);
+            // the scans of this query only have to read the columns referenced in it
+            ReferencedColumns referencedColumns = _referencedColumns;
+            _referencedColumns = collectReferencedColumns(node);
             node._tableExpression->accept(*this);
+            _rowOrderRequired = rowOrderRequired;
+            _referencedColumns = referencedColumns;
 
             RowOperatorNodePtr projection;
 
@@ -180,6 +190,19 @@ namespace csvsqldb
             projection->connect(_currentRowOperator);
             _currentRowOperator = projection;
 
+            if(node._tableExpression->_order && node._tableExpression->_limit &&
+               evaluateConstant(_context, node._tableExpression->_limit->_limit) > 0) {
+                // only the first rows are needed, so there is no need to sort all of them. A negative limit means no
+                // limit to the LimitOperatorNode, so only positive limits are fused.
+                const ASTOrderByNodePtr& order = node._tableExpression->_order;
+                const ASTLimitNodePtr& limit = node._tableExpression->_limit;
+                RowOperatorNodePtr topN =
+                OperatorFactory::createTopNOperatorNode(_context, order->symbolTable(), order->_orderExpressions, limit->_limit, limit->_offset);
+                topN->connect(_currentRowOperator);
+                _currentRowOperator = topN;
+                return;
+            }
+
             if(node._tableExpression->_order) {
                 node._tableExpression->_order->accept(*this);
             }
@@ -191,10 +214,36 @@ namespace csvsqldb
 
         virtual void visit(ASTTableExpressionNode& node)
         {
-            node._from->accept(*this);
+            // conjuncts of the where clause referencing a single table are handed to the scan of the table, only the
+            // remaining ones are evaluated after the joins
+            ScanPredicates scanPredicates;
+            Expressions residualPredicates;
+            std::swap(scanPredicates, _scanPredicates);
+            std::swap(residualPredicates, _residualPredicates);
+
             if(node._where) {
-                node._where->accept(*this);
+                StringSet tables;
+                for(const auto& reference : node._from->_tableReferences) {
+                    collectTables(reference, tables);
+                }
+                distributePredicates(node._where->_exp, tables);
             }
+            node._from->accept(*this);
+            for(const auto& predicates : _scanPredicates) {
+                _residualPredicates.insert(_residualPredicates.end(), predicates.second.begin(), predicates.second.end());
+            }
+            if(!_residualPredicates.empty()) {
+                ASTExprNodePtr exp = _residualPredicates[0];
+                for(size_t n = 1; n < _residualPredicates.size(); ++n) {
+                    exp = std::make_shared<ASTBinaryNode>(node._where->symbolTable(), OP_AND, exp, _residualPredicates[n]);
+                }
+                RowOperatorNodePtr select = OperatorFactory::createSelectOperatorNode(_context, node._where->symbolTable(), exp);
+                select->connect(_currentRowOperator);
+                _currentRowOperator = select;
+            }
+
+            std::swap(scanPredicates, _scanPredicates);
+            std::swap(residualPredicates, _residualPredicates);
         }
 
         virtual void visit(ASTBinaryNode& node)
@@ -252,6 +301,22 @@ namespace csvsqldb
             } else {
                 scan = OperatorFactory::createScanOperatorNode(_context, node.symbolTable(), *node._factor->_info);
             }
+            auto scanNode = std::dynamic_pointer_cast<ScanOperatorNode>(scan);
+            if(scanNode) {
+                scanNode->setRowOrderRequired(_rowOrderRequired);
+                if(!_referencedColumns.allColumnsReferenced(*node._factor->_info)) {
+                    scanNode->setReferencedColumns(_referencedColumns.columnsOf(*node._factor->_info));
+                }
+            }
+            auto predicates = _scanPredicates.find(node._factor->_info->_name);
+            if(predicates != _scanPredicates.end()) {
+                for(const auto& predicate : predicates->second) {
+                    if(!scanNode || !scanNode->pushDownPredicate(predicate)) {
+                        _residualPredicates.push_back(predicate);
+                    }
+                }
+                _scanPredicates.erase(predicates);
+            }
             _currentRowOperator = scan;
         }
 
@@ -279,22 +344,31 @@ namespace csvsqldb
 
         virtual void visit(ASTInnerJoinNode& node)
         {
-            RowOperatorNodePtr join;
+            node._tableReference->accept(*this);
+            RowOperatorNodePtr lhs = _currentRowOperator;
+            node._factor->accept(*this);
+            RowOperatorNodePtr rhs = _currentRowOperator;
 
-            ASTBinaryNodePtr binaryExpression = std::dynamic_pointer_cast<ASTBinaryNode>(node._expression);
-            if(binaryExpression && binaryExpression->_op == OP_EQ && std::dynamic_pointer_cast<ASTIdentifier>(binaryExpression->_lhs)
-               && std::dynamic_pointer_cast<ASTIdentifier>(binaryExpression->_rhs)) {
-                // only equi joins can be performed as hash joins
-                join = OperatorFactory::createInnerHashJoinOperatorNode(_context, node._factor->symbolTable(), node._expression);
+            SymbolInfos lhsSymbols;
+            SymbolInfos rhsSymbols;
+            lhs->getColumnInfos(lhsSymbols);
+            rhs->getColumnInfos(rhsSymbols);
+            IndexVector lhsKeyIndices;
+            IndexVector rhsKeyIndices;
+            Expressions residuals;
+            splitJoinCondition(node._expression, lhsSymbols, rhsSymbols, lhsKeyIndices, rhsKeyIndices, residuals);
+
+            RowOperatorNodePtr join;
+            if(!lhsKeyIndices.empty()) {
+                // only equalities between a lhs and a rhs column can be used as keys of hash or merge joins, further
+                // conjuncts are evaluated on the joined rows
+                join = createEquiJoin(node, lhs, rhs, lhsSymbols, rhsSymbols, lhsKeyIndices, rhsKeyIndices);
             } else {
                 join = OperatorFactory::createInnerJoinOperatorNode(_context, node._factor->symbolTable(), node._expression);
             }
 
-            node._tableReference->accept(*this);
-            join->connect(_currentRowOperator);
-
-            node._factor->accept(*this);
-            join->connect(_currentRowOperator);
+            join->connect(lhs);
+            join->connect(rhs);
             _currentRowOperator = join;
         }
 
@@ -340,10 +414,174 @@ namespace csvsqldb
         }
 
     private:
+        struct ReferencedColumns {
+            ReferencedColumns()
+            : _all(true)
+            {
+            }
+
+            bool allColumnsReferenced(const SymbolInfo& table) const
+            {
+                return _all || _asteriskPrefixes.count("") || _asteriskPrefixes.count(table._name)
+                       || (!table._alias.empty() && _asteriskPrefixes.count(table._alias));
+            }
+
+            StringSet columnsOf(const SymbolInfo& table) const
+            {
+                StringSet columns;
+                for(const auto& identifier : _identifiers) {
+                    if(identifier._info && identifier._info->_relation == table._name) {
+                        columns.insert(identifier._info->_identifier);
+                    }
+                }
+                return columns;
+            }
+
+            bool _all;
+            IdentifierSet _identifiers;
+            StringSet _asteriskPrefixes;
+        };
+
+        ReferencedColumns collectReferencedColumns(ASTQuerySpecificationNode& node)
+        {
+            ReferencedColumns columns;
+            columns._all = false;
+            ASTReferencedIdentifierVisitor visitor(columns._identifiers);
+
+            for(const auto& exp : node._nodes) {
+                if(std::dynamic_pointer_cast<ASTQualifiedAsterisk>(exp)) {
+                    columns._asteriskPrefixes.insert(std::dynamic_pointer_cast<ASTQualifiedAsterisk>(exp)->_prefix);
+                } else {
+                    exp->accept(visitor);
+                }
+            }
+            for(const auto& reference : node._tableExpression->_from->_tableReferences) {
+                collectJoinColumns(reference, columns, visitor);
+            }
+            if(node._tableExpression->_where) {
+                node._tableExpression->_where->_exp->accept(visitor);
+            }
+            if(node._tableExpression->_group) {
+                for(const auto& identifier : node._tableExpression->_group->_identifiers) {
+                    identifier->accept(visitor);
+                }
+            }
+            if(node._tableExpression->_having) {
+                node._tableExpression->_having->_exp->accept(visitor);
+            }
+            if(node._tableExpression->_order) {
+                for(const auto& orderExpression : node._tableExpression->_order->_orderExpressions) {
+                    orderExpression.first->accept(visitor);
+                }
+            }
+            return columns;
+        }
+
+        void distributePredicates(const ASTExprNodePtr& exp, const StringSet& tables)
+        {
+            ASTBinaryNodePtr binary = std::dynamic_pointer_cast<ASTBinaryNode>(exp);
+            if(binary && binary->_op == OP_AND) {
+                distributePredicates(binary->_lhs, tables);
+                distributePredicates(binary->_rhs, tables);
+                return;
+            }
+
+            IdentifierSet identifiers;
+            ASTReferencedIdentifierVisitor visitor(identifiers);
+            exp->accept(visitor);
+
+            std::string relation;
+            for(const auto& identifier : identifiers) {
+                if(!identifier._info || identifier._info->_relation.empty()
+                   || (!relation.empty() && relation != identifier._info->_relation)) {
+                    relation.clear();
+                    break;
+                }
+                relation = identifier._info->_relation;
+            }
+            if(!relation.empty() && tables.count(relation)) {
+                _scanPredicates[relation].push_back(exp);
+            } else {
+                _residualPredicates.push_back(exp);
+            }
+        }
+
+        RowOperatorNodePtr createEquiJoin(ASTInnerJoinNode& node,
+                                          const RowOperatorNodePtr& lhs,
+                                          const RowOperatorNodePtr& rhs,
+                                          const SymbolInfos& lhsSymbols,
+                                          const SymbolInfos& rhsSymbols,
+                                          const IndexVector& lhsKeyIndices,
+                                          const IndexVector& rhsKeyIndices)
+        {
+            bool mergeable = true;
+            for(size_t n = 0; mergeable && n < lhsKeyIndices.size(); ++n) {
+                mergeable = lhsSymbols[lhsKeyIndices[n]]->_type == rhsSymbols[rhsKeyIndices[n]]->_type;
+            }
+
+            int64_t lhsRows = lhs->estimateRowCount();
+            int64_t rhsRows = rhs->estimateRowCount();
+            bool lhsSorted = mergeable && lhs->isSortedBy(lhsKeyIndices);
+            bool rhsSorted = mergeable && rhs->isSortedBy(rhsKeyIndices);
+            // an unsorted input is sorted in memory by the merge join, so it should not be larger than a hash table would be
+            if((lhsSorted && rhsSorted) || (lhsSorted && rhsRows >= 0 && rhsRows <= lhsRows)
+               || (rhsSorted && lhsRows >= 0 && lhsRows <= rhsRows)) {
+                RowOperatorNodePtr join =
+                OperatorFactory::createInnerMergeJoinOperatorNode(_context, node._factor->symbolTable(), node._expression);
+                std::dynamic_pointer_cast<InnerMergeJoinOperatorNode>(join)->setSortedInputs(lhsSorted, rhsSorted);
+                return join;
+            }
+
+            RowOperatorNodePtr join =
+            OperatorFactory::createInnerHashJoinOperatorNode(_context, node._factor->symbolTable(), node._expression);
+            auto hashJoin = std::dynamic_pointer_cast<InnerHashJoinOperatorNode>(join);
+            if(hashJoin) {
+                // the hash table is built from the smaller input
+                hashJoin->setBuildLhs(lhsRows >= 0 && rhsRows >= 0 && lhsRows < rhsRows);
+            }
+            return join;
+        }
+
+        void collectTables(const ASTTableReferenceNodePtr& reference, StringSet& tables)
+        {
+            if(std::dynamic_pointer_cast<ASTTableIdentifierNode>(reference)) {
+                tables.insert(std::dynamic_pointer_cast<ASTTableIdentifierNode>(reference)->_factor->_info->_name);
+            } else if(std::dynamic_pointer_cast<ASTJoinNode>(reference)) {
+                collectTables(std::dynamic_pointer_cast<ASTJoinNode>(reference)->_tableReference, tables);
+                if(std::dynamic_pointer_cast<ASTCrossJoinNode>(reference)) {
+                    collectTables(std::dynamic_pointer_cast<ASTCrossJoinNode>(reference)->_factor, tables);
+                } else if(std::dynamic_pointer_cast<ASTNaturalJoinNode>(reference)) {
+                    collectTables(std::dynamic_pointer_cast<ASTNaturalJoinNode>(reference)->_factor, tables);
+                } else if(std::dynamic_pointer_cast<ASTJoinWithCondition>(reference)) {
+                    collectTables(std::dynamic_pointer_cast<ASTJoinWithCondition>(reference)->_factor, tables);
+                }
+            }
+        }
+
+        void collectJoinColumns(const ASTTableReferenceNodePtr& reference, ReferencedColumns& columns, ASTNodeVisitor& visitor)
+        {
+            if(std::dynamic_pointer_cast<ASTNaturalJoinNode>(reference)) {
+                // the join columns are implicit
+                columns._all = true;
+            }
+            if(std::dynamic_pointer_cast<ASTJoinNode>(reference)) {
+                collectJoinColumns(std::dynamic_pointer_cast<ASTJoinNode>(reference)->_tableReference, columns, visitor);
+            }
+            if(std::dynamic_pointer_cast<ASTJoinWithCondition>(reference)) {
+                std::dynamic_pointer_cast<ASTJoinWithCondition>(reference)->_expression->accept(visitor);
+            }
+        }
+
         OperatorContext& _context;
         ExecutionPlan& _executionPlan;
         RowOperatorNodePtr _currentRowOperator;
         std::ostream& _outputStream;
+        typedef std::map<std::string, Expressions> ScanPredicates;
+
+        bool _rowOrderRequired;
+        ReferencedColumns _referencedColumns;
+        ScanPredicates _scanPredicates;
+        Expressions _residualPredicates;
     };
 }
 
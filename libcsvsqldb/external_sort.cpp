@@ -0,0 +1,252 @@
+//
+//  external_sort.cpp
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "external_sort.h"
+
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
+
+
+namespace csvsqldb
+{
+
+    namespace
+    {
+        const size_t RUN_FILE_BUFFER_SIZE = 256 * 1024;
+
+        std::string createRunFilePath()
+        {
+            return (fs::temp_directory_path() / fs::unique_path("csvsqldb-%%%%-%%%%-%%%%-%%%%.run")).string();
+        }
+    }
+
+
+    SortRunWriter::SortRunWriter()
+    : _path(createRunFilePath())
+    , _buffer(RUN_FILE_BUFFER_SIZE)
+    {
+        _stream.rdbuf()->pubsetbuf(_buffer.data(), static_cast<std::streamsize>(_buffer.size()));
+        _stream.open(_path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if(!_stream.is_open()) {
+            CSVSQLDB_THROW(csvsqldb::Exception, "could not create run file " << _path);
+        }
+    }
+
+    SortRunWriter::~SortRunWriter()
+    {
+        if(_stream.is_open()) {
+            // the run was not finished, so nobody will read it
+            _stream.close();
+            boost::system::error_code ec;
+            fs::remove(_path, ec);
+        }
+    }
+
+    void SortRunWriter::writeRow(const unsigned char* key, size_t keyLength, const Values& row)
+    {
+        write(static_cast<uint32_t>(keyLength));
+        _stream.write(reinterpret_cast<const char*>(key), static_cast<std::streamsize>(keyLength));
+        for(const auto& value : row) {
+            write(static_cast<char>(value->isNull()));
+            if(value->isNull()) {
+                continue;
+            }
+            switch(value->getType()) {
+                case INT:
+                    write(static_cast<const ValInt*>(value)->asInt());
+                    break;
+                case REAL:
+                    write(static_cast<const ValDouble*>(value)->asDouble());
+                    break;
+                case BOOLEAN:
+                    write(static_cast<char>(static_cast<const ValBool*>(value)->asBool()));
+                    break;
+                case DATE:
+                    write(static_cast<const ValDate*>(value)->asDate().asJulianDay());
+                    break;
+                case TIME:
+                    write(static_cast<const ValTime*>(value)->asTime().asInteger());
+                    break;
+                case TIMESTAMP:
+                    write(static_cast<const ValTimestamp*>(value)->asTimestamp().asInteger());
+                    break;
+                case STRING: {
+                    const ValString* s = static_cast<const ValString*>(value);
+                    write(static_cast<uint32_t>(s->length()));
+                    _stream.write(s->asString(), static_cast<std::streamsize>(s->length()));
+                    break;
+                }
+                case NONE:
+                    CSVSQLDB_THROW(csvsqldb::Exception, "type not allowed " << typeToString(value->getType()));
+            }
+        }
+        if(!_stream) {
+            CSVSQLDB_THROW(csvsqldb::Exception, "could not write to run file " << _path);
+        }
+    }
+
+    std::string SortRunWriter::finish()
+    {
+        _stream.close();
+        if(!_stream) {
+            CSVSQLDB_THROW(csvsqldb::Exception, "could not write to run file " << _path);
+        }
+        return _path;
+    }
+
+
+    SortRunReader::SortRunReader(const std::string& path, const Types& types, BlockManager& blockManager)
+    : _path(path)
+    , _types(types)
+    , _blockManager(blockManager)
+    , _block(nullptr)
+    , _buffer(RUN_FILE_BUFFER_SIZE)
+    , _exhausted(false)
+    {
+        _stream.rdbuf()->pubsetbuf(_buffer.data(), static_cast<std::streamsize>(_buffer.size()));
+        _stream.open(_path, std::ios::in | std::ios::binary);
+        if(!_stream.is_open()) {
+            boost::system::error_code ec;
+            fs::remove(_path, ec);
+            CSVSQLDB_THROW(csvsqldb::Exception, "could not open run file " << _path);
+        }
+        _block = _blockManager.createBlock();
+        _row.resize(_types.size());
+    }
+
+    SortRunReader::~SortRunReader()
+    {
+        _blockManager.release(_block);
+        _stream.close();
+        boost::system::error_code ec;
+        fs::remove(_path, ec);
+    }
+
+    bool SortRunReader::next()
+    {
+        if(_stream.peek() == std::char_traits<char>::eof()) {
+            _exhausted = true;
+            return false;
+        }
+
+        _key.resize(read<uint32_t>());
+        _stream.read(reinterpret_cast<char*>(_key.data()), static_cast<std::streamsize>(_key.size()));
+
+        _block->rewind(0);
+        size_t index = 0;
+        for(auto type : _types) {
+            bool isNull = read<char>() != 0;
+            Value* val = nullptr;
+            switch(type) {
+                case INT:
+                    val = _block->addInt(isNull ? 0 : read<int64_t>(), isNull);
+                    break;
+                case REAL:
+                    val = _block->addReal(isNull ? 0.0 : read<double>(), isNull);
+                    break;
+                case BOOLEAN:
+                    val = _block->addBool(isNull ? false : read<char>() != 0, isNull);
+                    break;
+                case DATE:
+                    val = _block->addDate(isNull ? csvsqldb::Date() : csvsqldb::Date(read<uint32_t>()), isNull);
+                    break;
+                case TIME:
+                    val = _block->addTime(isNull ? csvsqldb::Time() : csvsqldb::Time(read<int32_t>()), isNull);
+                    break;
+                case TIMESTAMP:
+                    val = _block->addTimestamp(isNull ? csvsqldb::Timestamp() : csvsqldb::Timestamp(read<int64_t>()), isNull);
+                    break;
+                case STRING:
+                    if(!isNull) {
+                        _string.resize(read<uint32_t>());
+                        _stream.read(&_string[0], static_cast<std::streamsize>(_string.size()));
+                        val = _block->addString(_string.c_str(), _string.size(), false);
+                    } else {
+                        val = _block->addString(nullptr, 0, true);
+                    }
+                    break;
+                case NONE:
+                    CSVSQLDB_THROW(csvsqldb::Exception, "type not allowed " << typeToString(type));
+            }
+            if(!val) {
+                CSVSQLDB_THROW(csvsqldb::Exception, "row of run file " << _path << " does not fit into a block");
+            }
+            _row[index++] = val;
+        }
+        if(!_stream) {
+            CSVSQLDB_THROW(csvsqldb::Exception, "could not read from run file " << _path);
+        }
+        return true;
+    }
+
+
+    LoserTree::LoserTree(size_t sources, Less less)
+    : _sources(sources)
+    , _less(less)
+    , _losers(sources, 0)
+    , _winner(0)
+    {
+        if(!_sources) {
+            CSVSQLDB_THROW(csvsqldb::Exception, "a loser tree needs at least one source");
+        }
+        // the sources are the leaves _sources to 2 * _sources - 1 of an implicit binary tree with the root at 1
+        std::vector<size_t> winners(2 * _sources);
+        for(size_t n = 0; n < _sources; ++n) {
+            winners[_sources + n] = n;
+        }
+        for(size_t node = _sources - 1; node > 0; --node) {
+            size_t left = winners[2 * node];
+            size_t right = winners[2 * node + 1];
+            if(_less(right, left)) {
+                winners[node] = right;
+                _losers[node] = left;
+            } else {
+                winners[node] = left;
+                _losers[node] = right;
+            }
+        }
+        _winner = winners[1];
+    }
+
+    void LoserTree::replay()
+    {
+        size_t winner = _winner;
+        for(size_t node = (_winner + _sources) / 2; node > 0; node /= 2) {
+            if(_less(_losers[node], winner)) {
+                std::swap(_losers[node], winner);
+            }
+        }
+        _winner = winner;
+    }
+}
@@ -0,0 +1,187 @@
+//
+//  external_sort.h
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef csvsqldb_external_sort_h
+#define csvsqldb_external_sort_h
+
+#include "libcsvsqldb/inc.h"
+
+#include "block.h"
+
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace csvsqldb
+{
+
+    /**
+     * Writes sorted rows together with their normalized sort keys to a temporary run file. The values are stored in a
+     * compact binary form, a null flag followed by the plain value. The file is only meant to be read again by a
+     * SortRunReader of the same process.
+     */
+    class CSVSQLDB_EXPORT SortRunWriter
+    {
+    public:
+        SortRunWriter();
+
+        ~SortRunWriter();
+
+        void writeRow(const unsigned char* key, size_t keyLength, const Values& row);
+
+        /**
+         * Closes the run file. No more rows can be written afterwards.
+         * @return The path of the run file, the caller is responsible to remove it
+         */
+        std::string finish();
+
+    private:
+        template <typename T>
+        void write(T value)
+        {
+            _stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        std::string _path;
+        std::vector<char> _buffer;
+        std::ofstream _stream;
+    };
+
+    typedef std::unique_ptr<SortRunWriter> SortRunWriterPtr;
+
+
+    /**
+     * Reads the rows of a run file written by a SortRunWriter one after the other. The current row is decoded into a
+     * block of the block manager and stays valid until the next row is read. The run file is removed on destruction.
+     */
+    class CSVSQLDB_EXPORT SortRunReader
+    {
+    public:
+        SortRunReader(const std::string& path, const Types& types, BlockManager& blockManager);
+
+        ~SortRunReader();
+
+        /**
+         * Reads the next row of the run.
+         * @return false, if the run is exhausted
+         */
+        bool next();
+
+        bool exhausted() const
+        {
+            return _exhausted;
+        }
+
+        const unsigned char* key() const
+        {
+            return _key.data();
+        }
+
+        size_t keyLength() const
+        {
+            return _key.size();
+        }
+
+        const Values& row() const
+        {
+            return _row;
+        }
+
+    private:
+        template <typename T>
+        T read()
+        {
+            T value;
+            _stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+            return value;
+        }
+
+        std::string _path;
+        const Types& _types;
+        BlockManager& _blockManager;
+        BlockPtr _block;
+        std::vector<char> _buffer;
+        std::ifstream _stream;
+        std::vector<unsigned char> _key;
+        std::string _string;
+        Values _row;
+        bool _exhausted;
+    };
+
+    typedef std::unique_ptr<SortRunReader> SortRunReaderPtr;
+    typedef std::vector<SortRunReaderPtr> SortRunReaders;
+
+
+    /**
+     * A tournament tree to merge k sorted sources. Every inner node keeps the loser of its match and the overall winner
+     * is kept separately, so after the winning source advanced, only the log(k) matches on its path to the root have to
+     * be replayed.
+     */
+    class CSVSQLDB_EXPORT LoserTree
+    {
+    public:
+        /// Returns true, if the current element of the first source sorts before the one of the second source
+        typedef std::function<bool(size_t, size_t)> Less;
+
+        /**
+         * Constructs the tree and plays the initial tournament.
+         * @param sources The number of sources, has to be at least one
+         * @param less The comparison of two sources, exhausted sources have to sort after all others
+         */
+        LoserTree(size_t sources, Less less);
+
+        /**
+         * @return The index of the source with the smallest current element
+         */
+        size_t winner() const
+        {
+            return _winner;
+        }
+
+        /**
+         * Has to be called after the winning source advanced to its next element.
+         */
+        void replay();
+
+    private:
+        size_t _sources;
+        Less _less;
+        std::vector<size_t> _losers;
+        size_t _winner;
+    };
+}
+
+#endif
@@ -0,0 +1,280 @@
+//
+//  hash_join_table.cpp
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "hash_join_table.h"
+
+#include "base/exception.h"
+#include "base/thread_pool.h"
+
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+
+
+namespace csvsqldb
+{
+
+    namespace
+    {
+        // the entries and buckets of a partition should fit into the L2 cache
+        const size_t PARTITION_SIZE = 256 * 1024;
+        const size_t MAX_PARTITION_BITS = 12;
+
+        size_t nextPowerOfTwo(size_t value)
+        {
+            size_t result = 1;
+            while(result < value) {
+                result <<= 1;
+            }
+            return result;
+        }
+    }
+
+
+    HashJoinTable::HashJoinTable(const Types& types, const IndexVector& keyIndices, BlockManager& blockManager, uint16_t numberOfThreads)
+    : _types(types)
+    , _keyIndices(keyIndices)
+    , _blockManager(blockManager)
+    , _numberOfThreads(std::max(numberOfThreads, uint16_t(1)))
+    , _partitionBits(0)
+    {
+    }
+
+    HashJoinTable::~HashJoinTable()
+    {
+        clear();
+    }
+
+    void HashJoinTable::clear()
+    {
+        for(auto& block : _blocks) {
+            _blockManager.release(block);
+        }
+        _blocks.clear();
+        std::vector<const Value*>().swap(_values);
+        Entries().swap(_entries);
+        Partitions().swap(_partitions);
+        std::vector<uint32_t>().swap(_buckets);
+        _partitionBits = 0;
+    }
+
+    bool HashJoinTable::build(RowProvider& rowProvider, size_t maxBlocks)
+    {
+        clear();
+
+        Entries entries;
+        while(const Values* row = rowProvider.getNextRow()) {
+            _key.clear();
+            bool isNull = false;
+            for(auto index : _keyIndices) {
+                isNull |= (*row)[index]->isNull();
+                appendHashKey(*(*row)[index], _key);
+            }
+            if(isNull) {
+                // can never match
+                continue;
+            }
+            if(_values.size() / _types.size() >= std::numeric_limits<uint32_t>::max()) {
+                CSVSQLDB_THROW(csvsqldb::Exception, "too many rows for the hash join");
+            }
+            entries.push_back({ hashKeyBytes(_key.data(), _key.size()), static_cast<uint32_t>(_values.size() / _types.size()), 0 });
+            addRow(*row);
+            if(maxBlocks && _blocks.size() > maxBlocks) {
+                return false;
+            }
+        }
+
+        partition(entries);
+        Entries().swap(entries);
+
+        if(_numberOfThreads > 1 && _partitions.size() > 1) {
+            ThreadPool threadPool(_numberOfThreads);
+            std::mutex mutex;
+            std::condition_variable cv;
+            size_t running = _numberOfThreads;
+            std::exception_ptr error;
+
+            threadPool.start();
+            for(uint16_t n = 0; n < _numberOfThreads; ++n) {
+                threadPool.enqueueTask([&, n]() {
+                    try {
+                        for(size_t partition = n; partition < _partitions.size(); partition += _numberOfThreads) {
+                            buildPartition(_partitions[partition]);
+                        }
+                    } catch(...) {
+                        std::unique_lock<std::mutex> lk(mutex);
+                        error = std::current_exception();
+                    }
+                    std::unique_lock<std::mutex> lk(mutex);
+                    --running;
+                    cv.notify_all();
+                });
+            }
+            {
+                std::unique_lock<std::mutex> lk(mutex);
+                cv.wait(lk, [&] { return running == 0; });
+            }
+            threadPool.stop();
+            if(error) {
+                std::rethrow_exception(error);
+            }
+        } else {
+            for(auto& partition : _partitions) {
+                buildPartition(partition);
+            }
+        }
+        return true;
+    }
+
+    void HashJoinTable::addRow(const Values& row)
+    {
+        if(_blocks.empty()) {
+            _blocks.push_back(_blockManager.createBlock());
+        }
+        for(const auto* value : row) {
+            Value* copy = _blocks.back()->addValue(*value);
+            if(!copy) {
+                _blocks.back()->markNextBlock();
+                _blocks.push_back(_blockManager.createBlock());
+                copy = _blocks.back()->addValue(*value);
+                if(!copy) {
+                    CSVSQLDB_THROW(csvsqldb::Exception, "value does not fit into a block");
+                }
+            }
+            _values.push_back(copy);
+        }
+    }
+
+    void HashJoinTable::partition(const Entries& entries)
+    {
+        size_t partitions = nextPowerOfTwo(entries.size() * (sizeof(Entry) + sizeof(uint32_t)) / PARTITION_SIZE + 1);
+        _partitionBits = 0;
+        while((size_t(1) << _partitionBits) < partitions && _partitionBits < MAX_PARTITION_BITS) {
+            ++_partitionBits;
+        }
+        _partitions.resize(size_t(1) << _partitionBits);
+
+        // radix partitioning: count, prefix sum, scatter
+        std::vector<size_t> offsets(_partitions.size() + 1, 0);
+        for(const auto& entry : entries) {
+            ++offsets[getPartition(entry._hash) + 1];
+        }
+        size_t buckets = 0;
+        for(size_t n = 0; n < _partitions.size(); ++n) {
+            offsets[n + 1] += offsets[n];
+            Partition& partition = _partitions[n];
+            partition._begin = offsets[n];
+            partition._end = offsets[n + 1];
+            partition._buckets = buckets;
+            size_t count = nextPowerOfTwo(partition._end - partition._begin);
+            partition._bucketMask = count - 1;
+            buckets += count;
+        }
+        _entries.resize(entries.size());
+        for(const auto& entry : entries) {
+            _entries[offsets[getPartition(entry._hash)]++] = entry;
+        }
+        _buckets.resize(buckets, 0);
+    }
+
+    void HashJoinTable::buildPartition(Partition& partition)
+    {
+        // insert backwards, so the chains keep the insertion order
+        uint32_t* buckets = &_buckets[partition._buckets];
+        for(size_t n = partition._end; n-- > partition._begin;) {
+            Entry& entry = _entries[n];
+            uint32_t& head = buckets[entry._hash & partition._bucketMask];
+            entry._next = head;
+            head = static_cast<uint32_t>(n + 1);
+        }
+    }
+
+    bool HashJoinTable::hashProbeKey(const Value* const* row, const IndexVector& keyIndices, HashKey& key, uint64_t& hash) const
+    {
+        key.clear();
+        for(auto index : keyIndices) {
+            if(row[index]->isNull()) {
+                return false;
+            }
+            appendHashKey(*row[index], key);
+        }
+        hash = hashKeyBytes(key.data(), key.size());
+        return true;
+    }
+
+    void HashJoinTable::probe(const Value* const* row, const IndexVector& keyIndices, ProbeContext& context) const
+    {
+        uint64_t hash = 0;
+        if(_entries.empty() || !hashProbeKey(row, keyIndices, context._key, hash)) {
+            context._entry = 0;
+            return;
+        }
+        probe(row, keyIndices, hash, context);
+    }
+
+    void HashJoinTable::probe(const Value* const* row, const IndexVector& keyIndices, uint64_t hash, ProbeContext& context) const
+    {
+        context._row = row;
+        context._keyIndices = &keyIndices;
+        context._hash = hash;
+        if(_entries.empty()) {
+            context._entry = 0;
+            return;
+        }
+        const Partition& partition = _partitions[getPartition(hash)];
+        context._entry = _buckets[partition._buckets + (hash & partition._bucketMask)];
+    }
+
+    const Value* const* HashJoinTable::getNextMatch(ProbeContext& context) const
+    {
+        while(context._entry) {
+            const Entry& entry = _entries[context._entry - 1];
+            context._entry = entry._next;
+            if(entry._hash == context._hash && keyEquals(entry, context)) {
+                return &_values[entry._row * _types.size()];
+            }
+        }
+        return nullptr;
+    }
+
+    bool HashJoinTable::keyEquals(const Entry& entry, const ProbeContext& context) const
+    {
+        const Value* const* row = &_values[entry._row * _types.size()];
+        for(size_t n = 0; n < _keyIndices.size(); ++n) {
+            if(!equalHashKeyValues(*row[_keyIndices[n]], *context._row[(*context._keyIndices)[n]])) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
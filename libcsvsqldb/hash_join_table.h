@@ -0,0 +1,191 @@
+//
+//  hash_join_table.h
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef csvsqldb_hash_join_table_h
+#define csvsqldb_hash_join_table_h
+
+#include "libcsvsqldb/inc.h"
+
+#include "block.h"
+#include "hash_key.h"
+
+#include <memory>
+
+
+namespace csvsqldb
+{
+
+    class HashJoinTable;
+    typedef std::shared_ptr<HashJoinTable> HashJoinTablePtr;
+
+
+    /**
+     * The build side of a hash join. All rows of the build input are copied into blocks, and the values of each row are
+     * kept as an array of pointers, so a match can be returned without decoding the row again.
+     * The rows are radix partitioned by the high bits of their key hash into partitions, whose tables fit into the L2
+     * cache, and every partition gets a compact bucket chained table. The partition tables are built in parallel.
+     * The table is read only after building, so any number of threads can probe it concurrently with their own
+     * ProbeContext. Rows with a NULL key value never match.
+     */
+    class CSVSQLDB_EXPORT HashJoinTable
+    {
+    public:
+        /// The state of a running probe
+        struct ProbeContext {
+            ProbeContext()
+            : _row(nullptr)
+            , _keyIndices(nullptr)
+            , _hash(0)
+            , _entry(0)
+            {
+            }
+
+            const Value* const* _row;
+            const IndexVector* _keyIndices;
+            uint64_t _hash;
+            uint32_t _entry;
+            HashKey _key;
+        };
+
+        /**
+         * Constructs an empty table.
+         * @param types The types of the build rows
+         * @param keyIndices The indices of the key values in the build rows
+         * @param blockManager The block manager to allocate the row blocks from
+         * @param numberOfThreads The number of threads to build the partition tables with
+         */
+        HashJoinTable(const Types& types, const IndexVector& keyIndices, BlockManager& blockManager, uint16_t numberOfThreads = 1);
+
+        ~HashJoinTable();
+
+        /**
+         * Reads all rows from the row provider and builds the partition tables.
+         * @param rowProvider The build rows
+         * @param maxBlocks The maximum number of blocks for the rows, 0 for no limit
+         * @return false, if the rows exceed maxBlocks. Then reading stops without building the tables, the rows read so
+         * far can be retrieved with getRowCount and getRow.
+         */
+        bool build(RowProvider& rowProvider, size_t maxBlocks = 0);
+
+        /// Releases all rows and tables
+        void clear();
+
+        /// Returns the number of rows with a non NULL key
+        size_t size() const
+        {
+            return _entries.size();
+        }
+
+        /// Returns the number of rows read by build, that have a non NULL key
+        size_t getRowCount() const
+        {
+            return _values.size() / _types.size();
+        }
+
+        /// Returns the values of a row read by build
+        const Value* const* getRow(size_t row) const
+        {
+            return &_values[row * _types.size()];
+        }
+
+        /// Returns the number of radix partitions
+        size_t getPartitionCount() const
+        {
+            return _partitions.size();
+        }
+
+        /// Returns the partition a key hash belongs to
+        size_t getPartition(uint64_t hash) const
+        {
+            return _partitionBits ? static_cast<size_t>(hash >> (64 - _partitionBits)) : 0;
+        }
+
+        /**
+         * Calculates the hash of the key values of a probe row.
+         * @return false, if a key value is NULL, as such a row cannot match
+         */
+        bool hashProbeKey(const Value* const* row, const IndexVector& keyIndices, HashKey& key, uint64_t& hash) const;
+
+        /**
+         * Starts probing for the build rows with the same key as the given row.
+         * @param row The values of the probe row, they have to stay valid while probing
+         * @param keyIndices The indices of the key values in the probe row, in the order of the build key indices
+         * @param context The context to keep the probe state in
+         */
+        void probe(const Value* const* row, const IndexVector& keyIndices, ProbeContext& context) const;
+
+        /// Like probe, but with an already calculated hash
+        void probe(const Value* const* row, const IndexVector& keyIndices, uint64_t hash, ProbeContext& context) const;
+
+        /**
+         * Returns the values of the next matching build row.
+         * @return The values of the row, or nullptr if there are no more matches
+         */
+        const Value* const* getNextMatch(ProbeContext& context) const;
+
+    private:
+        struct Entry {
+            uint64_t _hash;
+            uint32_t _row;
+            uint32_t _next;
+        };
+        typedef std::vector<Entry> Entries;
+
+        struct Partition {
+            size_t _begin;
+            size_t _end;
+            size_t _buckets;
+            size_t _bucketMask;
+        };
+        typedef std::vector<Partition> Partitions;
+
+        void addRow(const Values& row);
+        void partition(const Entries& entries);
+        void buildPartition(Partition& partition);
+        bool keyEquals(const Entry& entry, const ProbeContext& context) const;
+
+        const Types _types;
+        const IndexVector _keyIndices;
+        BlockManager& _blockManager;
+        const uint16_t _numberOfThreads;
+        Blocks _blocks;
+        std::vector<const Value*> _values;
+        Entries _entries;
+        Partitions _partitions;
+        std::vector<uint32_t> _buckets;
+        size_t _partitionBits;
+        HashKey _key;
+    };
+}
+
+#endif
@@ -0,0 +1,149 @@
+//
+//  hash_key.cpp
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "hash_key.h"
+
+#include "base/exception.h"
+
+#include <cstring>
+
+
+namespace csvsqldb
+{
+
+    namespace
+    {
+        template <typename T>
+        void appendRaw(const T& value, HashKey& key)
+        {
+            const char* p = reinterpret_cast<const char*>(&value);
+            key.insert(key.end(), p, p + sizeof(T));
+        }
+    }
+
+    void appendHashKey(const Value& value, HashKey& key)
+    {
+        if(value.isNull()) {
+            key.push_back(0);
+            return;
+        }
+        key.push_back(1);
+        switch(value.getType()) {
+            case BOOLEAN:
+                key.push_back(static_cast<const ValBool&>(value).asBool() ? 1 : 0);
+                break;
+            case INT:
+                appendRaw(static_cast<const ValInt&>(value).asInt(), key);
+                break;
+            case REAL: {
+                double d = static_cast<const ValDouble&>(value).asDouble();
+                if(d == 0.0) {
+                    // -0.0 and 0.0 are equal
+                    d = 0.0;
+                }
+                appendRaw(d, key);
+                break;
+            }
+            case DATE:
+                appendRaw(static_cast<const ValDate&>(value).asDate().asJulianDay(), key);
+                break;
+            case TIME:
+                appendRaw(static_cast<const ValTime&>(value).asTime().asInteger(), key);
+                break;
+            case TIMESTAMP:
+                appendRaw(static_cast<const ValTimestamp&>(value).asTimestamp().asInteger(), key);
+                break;
+            case STRING: {
+                const ValString& s = static_cast<const ValString&>(value);
+                appendRaw(s.length(), key);
+                key.insert(key.end(), s.asString(), s.asString() + s.length());
+                break;
+            }
+            case NONE:
+                CSVSQLDB_THROW(csvsqldb::Exception, "type not allowed " << typeToString(value.getType()));
+        }
+    }
+
+    bool equalHashKeyValues(const Value& lhs, const Value& rhs)
+    {
+        if(lhs.getType() != rhs.getType()) {
+            return false;
+        }
+        switch(lhs.getType()) {
+            case BOOLEAN:
+                return static_cast<const ValBool&>(lhs).asBool() == static_cast<const ValBool&>(rhs).asBool();
+            case INT:
+                return static_cast<const ValInt&>(lhs).asInt() == static_cast<const ValInt&>(rhs).asInt();
+            case REAL:
+                return static_cast<const ValDouble&>(lhs).asDouble() == static_cast<const ValDouble&>(rhs).asDouble();
+            case DATE:
+                return static_cast<const ValDate&>(lhs).asDate().asJulianDay() == static_cast<const ValDate&>(rhs).asDate().asJulianDay();
+            case TIME:
+                return static_cast<const ValTime&>(lhs).asTime().asInteger() == static_cast<const ValTime&>(rhs).asTime().asInteger();
+            case TIMESTAMP:
+                return static_cast<const ValTimestamp&>(lhs).asTimestamp().asInteger()
+                       == static_cast<const ValTimestamp&>(rhs).asTimestamp().asInteger();
+            case STRING: {
+                const ValString& l = static_cast<const ValString&>(lhs);
+                const ValString& r = static_cast<const ValString&>(rhs);
+                return l.length() == r.length() && ::memcmp(l.asString(), r.asString(), l.length()) == 0;
+            }
+            case NONE:
+                break;
+        }
+        CSVSQLDB_THROW(csvsqldb::Exception, "type not allowed " << typeToString(lhs.getType()));
+    }
+
+    uint64_t hashKeyBytes(const char* key, size_t length)
+    {
+        const uint64_t multiplier = 0x9e3779b97f4a7c15ULL;
+        uint64_t hash = length * multiplier;
+
+        for(; length >= sizeof(uint64_t); length -= sizeof(uint64_t), key += sizeof(uint64_t)) {
+            uint64_t word;
+            ::memcpy(&word, key, sizeof(word));
+            hash = (hash ^ word) * multiplier;
+            hash ^= hash >> 29;
+        }
+        if(length) {
+            uint64_t word = 0;
+            ::memcpy(&word, key, length);
+            hash = (hash ^ word) * multiplier;
+        }
+        hash ^= hash >> 32;
+        hash *= multiplier;
+        hash ^= hash >> 29;
+
+        return hash;
+    }
+}
@@ -0,0 +1,132 @@
+//
+//  hash_key.h
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef csvsqldb_hash_key_h
+#define csvsqldb_hash_key_h
+
+#include "libcsvsqldb/inc.h"
+
+#include "values.h"
+
+#include <vector>
+
+
+namespace csvsqldb
+{
+
+    typedef std::vector<char> HashKey;
+
+    /**
+     * Serializes a value into a hash key. Values of the same type are equal, if their serialized bytes are equal, so keys
+     * can be compared with memcmp and hashed bytewise. Every value is prefixed with a null flag, so NULL values are
+     * equal to each other and different from all other values.
+     * @param value The value to append
+     * @param key The key to append the value to
+     */
+    CSVSQLDB_EXPORT void appendHashKey(const Value& value, HashKey& key);
+
+    /**
+     * Compares two non NULL values with the same notion of equality as their serialized keys. Values of different types
+     * are never equal, as their serialized keys differ as well.
+     */
+    CSVSQLDB_EXPORT bool equalHashKeyValues(const Value& lhs, const Value& rhs);
+
+    /**
+     * Calculates a 64 bit hash of a serialized key. The high and low bits are both well mixed, so the low bits can be
+     * used as bucket index and the high bits for partitioning.
+     */
+    CSVSQLDB_EXPORT uint64_t hashKeyBytes(const char* key, size_t length);
+
+    /// The number of bits of a spill partition
+    const size_t SPILL_PARTITION_BITS = 4;
+
+    /// The number of partitions, rows of a hash join or grouping are spilled to, if they do not fit into memory
+    const size_t SPILL_PARTITIONS = size_t(1) << SPILL_PARTITION_BITS;
+
+    /**
+     * The number of hash bits, spilled rows are partitioned by at most. A spilled partition, that still does not fit into
+     * memory, is partitioned again by the next bits, so fewer partitions under a small memory budget allow more levels.
+     */
+    const size_t MAX_SPILL_BITS = 5 * SPILL_PARTITION_BITS;
+
+    /**
+     * Returns the spill partition of a key hash. The hash is mixed with the level first, so the partitions of every level
+     * are independent of each other and of the hash bits used for the bucket index, the radix partitioning of the hash
+     * join table and the merge partitioning of the parallel aggregation.
+     * @param hash The hash of the key
+     * @param level The number of hash bits the rows are already partitioned by, less than MAX_SPILL_BITS
+     * @param partitions The number of partitions as returned by spillPartitionCount
+     * @return The partition, less than partitions
+     */
+    inline size_t spillPartition(uint64_t hash, size_t level, size_t partitions = SPILL_PARTITIONS)
+    {
+        const uint64_t multiplier = 0x9e3779b97f4a7c15ULL;
+        uint64_t mixed = (hash ^ ((level + 1) * multiplier)) * multiplier;
+        mixed ^= mixed >> 32;
+        mixed *= multiplier;
+        return static_cast<size_t>(mixed >> (64 - SPILL_PARTITION_BITS)) & (partitions - 1);
+    }
+
+    /**
+     * Returns the number of spill partitions to use, if the row buffers of all partitions have to fit into the given
+     * number of blocks. Every row buffer pins the block rows are added to, so too many partitions would exhaust the memory
+     * budget.
+     * @param blocks The number of blocks available for the row buffers of the partitions
+     * @param buffers The number of row buffers of every partition
+     * @return A power of two between 2 and SPILL_PARTITIONS
+     */
+    inline size_t spillPartitionCount(size_t blocks, size_t buffers = 1)
+    {
+        size_t partitions = SPILL_PARTITIONS;
+        while(partitions > 2 && partitions * buffers > blocks) {
+            partitions /= 2;
+        }
+        return partitions;
+    }
+
+    /**
+     * Returns the number of hash bits, rows are partitioned by into the given number of spill partitions.
+     * @param partitions The number of partitions as returned by spillPartitionCount
+     * @return The number of bits, at most SPILL_PARTITION_BITS
+     */
+    inline size_t spillPartitionBits(size_t partitions)
+    {
+        size_t bits = 0;
+        while((size_t(1) << bits) < partitions) {
+            ++bits;
+        }
+        return bits;
+    }
+}
+
+#endif
@@ -32,27 +32,104 @@
 //
 
 #include "operatornode.h"
+#include "binary_format.h"
 #include "sql_astexpressionvisitor.h"
 
+#include "base/string_helper.h"
+
 #include <boost/regex.hpp>
 
+#include <cstring>
+#include <deque>
 #include <fstream>
 
 
 namespace csvsqldb
 {
+    namespace
+    {
+        // a predicate evaluating to NULL does not select the row, no matter which operator evaluates it
+        bool isSelected(const Variant& result)
+        {
+            return !result.isNull() && result.asBool();
+        }
+
+        // the number of rows formatted by a worker at once
+        const size_t outputBatchRows = 4096;
+
+        struct OutputBatch {
+            OutputBatch(size_t columns)
+            : _columns(columns)
+            , _rows(0)
+            , _ready(false)
+            {
+            }
+
+            Blocks _blocks;
+            Values _values;
+            size_t _columns;
+            size_t _rows;
+            std::unique_ptr<OutputWriter> _output;
+            bool _ready;
+        };
+        typedef std::shared_ptr<OutputBatch> OutputBatchPtr;
+
+        void releaseBatchBlocks(BlockManager& blockManager, OutputBatch& batch)
+        {
+            for(auto& block : batch._blocks) {
+                blockManager.release(block);
+            }
+            batch._blocks.clear();
+        }
+
+        void copyBatchRow(BlockManager& blockManager, const Values& row, OutputBatch& batch)
+        {
+            for(const auto value : row) {
+                Value* copy = batch._blocks.empty() ? nullptr : batch._blocks.back()->addValue(*value);
+                if(!copy) {
+                    batch._blocks.push_back(blockManager.createBlock());
+                    copy = batch._blocks.back()->addValue(*value);
+                    if(!copy) {
+                        CSVSQLDB_THROW(csvsqldb::Exception, "row does not fit into a block");
+                    }
+                }
+                batch._values.push_back(copy);
+            }
+            ++batch._rows;
+        }
+
+        void formatBatch(BlockManager& blockManager, OutputBatch& batch)
+        {
+            batch._output.reset(new OutputWriter(64 * 1024));
+            const Value* const* value = batch._values.data();
+            for(size_t row = 0; row < batch._rows; ++row) {
+                for(size_t column = 0; column < batch._columns; ++column, ++value) {
+                    if(column) {
+                        batch._output->write(',');
+                    }
+                    batch._output->writeValue(**value);
+                }
+                batch._output->write('\n');
+            }
+            releaseBatchBlocks(blockManager, batch);
+        }
+    }
+
 
     OutputRowOperatorNode::OutputRowOperatorNode(const OperatorContext& context, const SymbolTablePtr& symbolTable, std::ostream& stream)
     : RootOperatorNode(context, symbolTable)
-    , _stream(stream)
+    , _writer(stream)
     , _firstCall(true)
     {
     }
 
     int64_t OutputRowOperatorNode::process()
     {
+        if(_context._outputFormat == BINARY_FORMAT) {
+            return processBinary();
+        }
         if(_firstCall && _context._showHeaderLine) {
-            _outputBuffer << "#";
+            _writer.write('#');
 
             SymbolInfos infos;
             _input->getColumnInfos(infos);
@@ -60,43 +137,145 @@ namespace csvsqldb
             bool firstName(true);
             for(const auto& info : infos) {
                 if(!firstName) {
-                    _outputBuffer << ",";
+                    _writer.write(',');
                 } else {
                     firstName = false;
                 }
 
-                _outputBuffer << info->_name;
+                _writer.write(info->_name.c_str(), info->_name.length());
             }
-            _outputBuffer << "\n";
+            _writer.write('\n');
             _firstCall = false;
         }
         int64_t count = 0;
+        if(_context._numberOfThreads > 1) {
+            count = processParallel();
+        } else {
+            const Values* row = nullptr;
+            while((row = _input->getNextRow())) {
+                _writer.writeRow(*row);
+                ++count;
+            }
+        }
+        _writer.flush();
+        return count;
+    }
+
+    int64_t OutputRowOperatorNode::processBinary()
+    {
+        // the binary stream always carries its schema, the header line setting does not apply
+        SymbolInfos infos;
+        _input->getColumnInfos(infos);
+
+        BinaryRowWriter writer(_writer);
+        writer.writeHeader(infos);
+        int64_t count = 0;
         const Values* row = nullptr;
         while((row = _input->getNextRow())) {
-            bool first = true;
-            for(const auto value : *row) {
-                if(!first) {
-                    _outputBuffer << ",";
-                } else {
-                    first = false;
+            writer.writeRow(*row);
+            ++count;
+        }
+        writer.finish();
+        _writer.flush();
+        return count;
+    }
+
+    int64_t OutputRowOperatorNode::processParallel()
+    {
+        // the rows are copied into batches, the workers format each batch into its own buffer and the buffers are written
+        // in the order of the batches
+        // each batch holds up to two blocks, so the pending batches are also bounded by a quarter of the memory budget
+        const size_t maxPendingBatches =
+        std::max<size_t>(1, std::min<size_t>(2u * _context._numberOfThreads, getBlockManager().getMaxActiveBlocks() / 8));
+        std::deque<OutputBatchPtr> batches;
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::exception_ptr error;
+        ThreadPool threadPool(_context._numberOfThreads);
+        threadPool.start();
+
+        auto dispatch = [&](const OutputBatchPtr& batch) {
+            batches.push_back(batch);
+            threadPool.enqueueTask([&, batch]() {
+                try {
+                    formatBatch(getBlockManager(), *batch);
+                } catch(...) {
+                    std::unique_lock<std::mutex> lk(mutex);
+                    if(!error) {
+                        error = std::current_exception();
+                    }
+                }
+                std::unique_lock<std::mutex> lk(mutex);
+                batch->_ready = true;
+                cv.notify_all();
+            });
+        };
+
+        // writes the formatted batches, waits for the oldest one while more than the given number of batches is pending
+        auto writeBatches = [&](size_t pending) {
+            while(!batches.empty()) {
+                OutputBatchPtr batch = batches.front();
+                {
+                    std::unique_lock<std::mutex> lk(mutex);
+                    if(batches.size() > pending) {
+                        cv.wait(lk, [&] { return batch->_ready; });
+                    } else if(!batch->_ready) {
+                        return true;
+                    }
+                    if(error) {
+                        return false;
+                    }
                 }
+                _writer.write(batch->_output->data(), batch->_output->size());
+                batches.pop_front();
+            }
+            return true;
+        };
 
-                if(value->getType() == STRING && !value->isNull()) {
-                    _outputBuffer << "'";
+        int64_t count = 0;
+        OutputBatchPtr batch;
+        try {
+            while(const Values* row = _input->getNextRow()) {
+                if(!batch) {
+                    batch = std::make_shared<OutputBatch>(row->size());
                 }
-                value->toStream(_outputBuffer);
-                if(value->getType() == STRING && !value->isNull()) {
-                    _outputBuffer << "'";
+                copyBatchRow(getBlockManager(), *row, *batch);
+                ++count;
+                if(batch->_rows == outputBatchRows || batch->_blocks.size() > 1) {
+                    dispatch(batch);
+                    batch.reset();
+                    if(!writeBatches(maxPendingBatches - 1)) {
+                        break;
+                    }
                 }
             }
-            ++count;
-            _outputBuffer << "\n";
-            if(count % 1000 == 0) {
-                _stream << _outputBuffer.str();
-                _outputBuffer.str(std::string());
+            if(batch) {
+                dispatch(batch);
+                batch.reset();
+            }
+            writeBatches(0);
+        } catch(...) {
+            std::unique_lock<std::mutex> lk(mutex);
+            if(!error) {
+                error = std::current_exception();
             }
         }
-        _stream << _outputBuffer.str();
+
+        {
+            std::unique_lock<std::mutex> lk(mutex);
+            cv.wait(lk, [&] { return std::all_of(batches.begin(), batches.end(), [](const OutputBatchPtr& batch) { return batch->_ready; }); });
+        }
+        threadPool.stop();
+        if(batch) {
+            releaseBatchBlocks(getBlockManager(), *batch);
+        }
+        for(auto& pending : batches) {
+            releaseBatchBlocks(getBlockManager(), *pending);
+        }
+
+        if(error) {
+            std::rethrow_exception(error);
+        }
         return count;
     }
 
@@ -129,6 +308,78 @@ namespace csvsqldb
     }
 
 
+    int64_t evaluateConstant(const OperatorContext& context, const ASTExprNodePtr& exp)
+    {
+        StackMachine sm;
+        VariableStore store;
+        StackMachine::VariableMapping mapping;
+
+        ASTInstructionStackVisitor visitor(sm, mapping);
+        exp->accept(visitor);
+        return sm.evaluate(store, context._functions).asInt();
+    }
+
+
+    namespace
+    {
+        void resolveSortOrders(const OrderExpressions& orderExpressions,
+                               const SymbolInfos& inputSymbols,
+                               SortingBlockIterator::SortOrders& sortOrders)
+        {
+            for(const auto& orderExp : orderExpressions) {
+                ASTIdentifierPtr ident = std::dynamic_pointer_cast<ASTIdentifier>(orderExp.first);
+                if(ident) {
+                    bool found = false;
+                    for(size_t n = 0; !found && n < inputSymbols.size(); ++n) {
+                        const SymbolInfoPtr& info = inputSymbols[n];
+
+                        if((!ident->_info->_name.empty() && (ident->_info->_name == info->_name))
+                           || (!ident->_info->_qualifiedIdentifier.empty() && (ident->_info->_qualifiedIdentifier == info->_qualifiedIdentifier))
+                           || (ident->_info->_prefix.empty() && ident->_info->_identifier == info->_identifier)) {
+                            sortOrders.push_back({ n, orderExp.second });
+                            found = true;
+                        }
+                    }
+                    if(!found) {
+                        CSVSQLDB_THROW(csvsqldb::Exception, "order expression '" << ident->_info->_name << "' not found in context");
+                    }
+                } else {
+                    CSVSQLDB_THROW(csvsqldb::Exception, "complex order expression not supported yet");
+                }
+            }
+        }
+
+        bool sortOrdersStartWith(const SortingBlockIterator::SortOrders& sortOrders, const IndexVector& columns)
+        {
+            if(columns.size() > sortOrders.size()) {
+                return false;
+            }
+            for(size_t n = 0; n < columns.size(); ++n) {
+                if(sortOrders[n]._index != columns[n] || sortOrders[n]._order != ASC) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void dumpOrderExpressions(std::ostream& stream, const OrderExpressions& orderExpressions)
+        {
+            bool first(true);
+            for(const auto& entry : orderExpressions) {
+                if(first) {
+                    first = false;
+                } else {
+                    stream << ",";
+                }
+                ASTExpressionVisitor visitor;
+                entry.first->accept(visitor);
+                stream << visitor.toString();
+                stream << " " << orderToString(entry.second);
+            }
+        }
+    }
+
+
     LimitOperatorNode::LimitOperatorNode(const OperatorContext& context,
                                          const SymbolTablePtr& symbolTable,
                                          const ASTExprNodePtr& limit,
@@ -136,30 +387,20 @@ namespace csvsqldb
     : RowOperatorNode(context, symbolTable)
     , _limit(-1)
     , _offset(0)
+    , _satisfied(false)
     {
-        {
-            StackMachine sm;
-            VariableStore store;
-            StackMachine::VariableMapping mapping;
-
-            ASTInstructionStackVisitor visitor(sm, mapping);
-            limit->accept(visitor);
-            // as we test from 1 to the limit we have to add one here
-            _limit = sm.evaluate(store, _context._functions).asInt() + 1;
-        }
+        // as we test from 1 to the limit we have to add one here
+        _limit = evaluateConstant(_context, limit) + 1;
         if(offset) {
-            StackMachine sm;
-            VariableStore store;
-            StackMachine::VariableMapping mapping;
-
-            ASTInstructionStackVisitor visitor(sm, mapping);
-            offset->accept(visitor);
-            _offset = sm.evaluate(store, _context._functions).asInt();
+            _offset = evaluateConstant(_context, offset);
         }
     }
 
     const Values* LimitOperatorNode::getNextRow()
     {
+        if(_satisfied) {
+            return nullptr;
+        }
         if(_offset) {
             const Values* row = _input->getNextRow();
             while(row && --_offset) {
@@ -170,14 +411,25 @@ namespace csvsqldb
             }
         }
         if(_limit > 0 && --_limit == 0) {
+            // the query is satisfied, so the inputs can stop reading
+            _satisfied = true;
+            _input->cancel();
             return nullptr;
         }
         return _input->getNextRow();
     }
 
+    void LimitOperatorNode::cancel()
+    {
+        _input->cancel();
+    }
+
     bool LimitOperatorNode::connect(const RowOperatorNodePtr& input)
     {
         _input = input;
+        if(_limit > 0) {
+            _input->pushDownLimit(_limit - 1 + _offset);
+        }
         return true;
     }
 
@@ -187,6 +439,22 @@ namespace csvsqldb
         _input->getColumnInfos(outputSymbols);
     }
 
+    int64_t LimitOperatorNode::estimateRowCount()
+    {
+        int64_t limit = _limit - 1;
+        int64_t rows = _input->estimateRowCount();
+        if(rows < 0) {
+            return limit;
+        }
+        rows = std::max(rows - _offset, int64_t(0));
+        return limit < 0 ? rows : std::min(rows, limit);
+    }
+
+    bool LimitOperatorNode::isSortedBy(const IndexVector& columns)
+    {
+        return _input->isSortedBy(columns);
+    }
+
     void LimitOperatorNode::dump(std::ostream& stream) const
     {
         stream << "LimitOperator (";
@@ -207,39 +475,22 @@ namespace csvsqldb
         return _iterator->getNextRow();
     }
 
+    void SortOperatorNode::cancel()
+    {
+        _input->cancel();
+    }
+
     bool SortOperatorNode::connect(const RowOperatorNodePtr& input)
     {
         _input = input;
         _input->getColumnInfos(_inputSymbols);
 
-        SortingBlockIterator::SortOrders sortOrders;
-
-        for(const auto& orderExp : _orderExpressions) {
-            ASTIdentifierPtr ident = std::dynamic_pointer_cast<ASTIdentifier>(orderExp.first);
-            if(ident) {
-                bool found = false;
-                for(size_t n = 0; !found && n < _inputSymbols.size(); ++n) {
-                    const SymbolInfoPtr& info = _inputSymbols[n];
-
-                    if((!ident->_info->_name.empty() && (ident->_info->_name == info->_name))
-                       || (!ident->_info->_qualifiedIdentifier.empty() && (ident->_info->_qualifiedIdentifier == info->_qualifiedIdentifier))
-                       || (ident->_info->_prefix.empty() && ident->_info->_identifier == info->_identifier)) {
-                        sortOrders.push_back({ n, orderExp.second });
-                        found = true;
-                    }
-                }
-                if(!found) {
-                    CSVSQLDB_THROW(csvsqldb::Exception, "order expression '" << ident->_info->_name << "' not found in context");
-                }
-            } else {
-                CSVSQLDB_THROW(csvsqldb::Exception, "complex order expression not supported yet");
-            }
-        }
+        resolveSortOrders(_orderExpressions, _inputSymbols, _sortOrders);
 
         for(const auto& info : _inputSymbols) {
             _types.push_back(info->_type);
         }
-        _iterator = std::make_shared<SortingBlockIterator>(_types, sortOrders, *_input, getBlockManager());
+        _iterator = std::make_shared<SortingBlockIterator>(_types, _sortOrders, *_input, getBlockManager());
 
         return true;
     }
@@ -250,21 +501,172 @@ namespace csvsqldb
         outputSymbols = _inputSymbols;
     }
 
+    int64_t SortOperatorNode::estimateRowCount()
+    {
+        return _input->estimateRowCount();
+    }
+
+    bool SortOperatorNode::isSortedBy(const IndexVector& columns)
+    {
+        return sortOrdersStartWith(_sortOrders, columns);
+    }
+
     void SortOperatorNode::dump(std::ostream& stream) const
     {
         stream << "SortOperator (";
-        bool first(true);
-        for(const auto& entry : _orderExpressions) {
-            if(first) {
-                first = false;
+        dumpOrderExpressions(stream, _orderExpressions);
+        stream << ")\n-->";
+        _input->dump(stream);
+    }
+
+
+    TopNOperatorNode::TopNOperatorNode(const OperatorContext& context,
+                                       const SymbolTablePtr& symbolTable,
+                                       OrderExpressions orderExpressions,
+                                       const ASTExprNodePtr& limit,
+                                       const ASTExprNodePtr& offset)
+    : RowOperatorNode(context, symbolTable)
+    , _orderExpressions(orderExpressions)
+    , _limit(std::max(evaluateConstant(_context, limit), int64_t(0)))
+    , _offset(offset ? std::max(evaluateConstant(_context, offset), int64_t(0)) : 0)
+    , _sequence(0)
+    , _deadRows(0)
+    , _collected(false)
+    , _current(0)
+    {
+    }
+
+    TopNOperatorNode::~TopNOperatorNode()
+    {
+        for(auto& block : _blocks) {
+            getBlockManager().release(block);
+        }
+    }
+
+    const Values* TopNOperatorNode::getNextRow()
+    {
+        if(!_collected) {
+            collect();
+            _collected = true;
+        }
+        if(_current >= _entries.size()) {
+            return nullptr;
+        }
+        return &_entries[_current++]._row;
+    }
+
+    void TopNOperatorNode::cancel()
+    {
+        _input->cancel();
+    }
+
+    void TopNOperatorNode::collect()
+    {
+        size_t capacity = static_cast<size_t>(_limit + _offset);
+        if(!_limit) {
+            return;
+        }
+
+        SortingBlockIterator::SortKey key;
+        const Values* row = nullptr;
+        while((row = _input->getNextRow())) {
+            key.clear();
+            SortingBlockIterator::appendSortKey(*row, _sortOrders, key);
+            if(_entries.size() < capacity) {
+                _entries.push_back(Entry());
+                Entry& entry = _entries.back();
+                entry._key.swap(key);
+                entry._sequence = _sequence++;
+                entry._row.resize(row->size());
+                copyRow(*row, entry._row);
+                std::push_heap(_entries.begin(), _entries.end(), EntryOrder());
             } else {
-                stream << ",";
+                ++_sequence;
+                // the worst of the kept rows is on top of the heap, the row is only copied if it replaces it
+                const Entry& worst = _entries.front();
+                if(SortingBlockIterator::compareSortKeys(key.data(), key.size(), worst._key.data(), worst._key.size()) < 0) {
+                    std::pop_heap(_entries.begin(), _entries.end(), EntryOrder());
+                    Entry& entry = _entries.back();
+                    entry._key.swap(key);
+                    entry._sequence = _sequence;
+                    copyRow(*row, entry._row);
+                    std::push_heap(_entries.begin(), _entries.end(), EntryOrder());
+                    ++_deadRows;
+                    if(_blocks.size() > 1 && _deadRows > _entries.size()) {
+                        compact();
+                    }
+                }
+            }
+        }
+
+        std::sort_heap(_entries.begin(), _entries.end(), EntryOrder());
+        _current = static_cast<size_t>(_offset);
+    }
+
+    void TopNOperatorNode::copyRow(const Values& row, Values& target)
+    {
+        for(size_t n = 0; n < row.size(); ++n) {
+            Value* value = _blocks.empty() ? nullptr : _blocks.back()->addValue(*row[n]);
+            if(!value) {
+                _blocks.push_back(getBlockManager().createBlock());
+                value = _blocks.back()->addValue(*row[n]);
+                if(!value) {
+                    CSVSQLDB_THROW(csvsqldb::Exception, "row does not fit into a block");
+                }
             }
-            ASTExpressionVisitor visitor;
-            entry.first->accept(visitor);
-            stream << visitor.toString();
-            stream << " " << orderToString(entry.second);
+            target[n] = value;
+        }
+    }
+
+    void TopNOperatorNode::compact()
+    {
+        // the replaced rows are garbage in the blocks, so the kept rows are copied into fresh blocks
+        Blocks blocks;
+        blocks.swap(_blocks);
+        for(auto& entry : _entries) {
+            copyRow(entry._row, entry._row);
+        }
+        for(auto& block : blocks) {
+            getBlockManager().release(block);
+        }
+        _deadRows = 0;
+    }
+
+    bool TopNOperatorNode::connect(const RowOperatorNodePtr& input)
+    {
+        _input = input;
+        _input->getColumnInfos(_inputSymbols);
+
+        resolveSortOrders(_orderExpressions, _inputSymbols, _sortOrders);
+
+        return true;
+    }
+
+    void TopNOperatorNode::getColumnInfos(SymbolInfos& outputSymbols)
+    {
+        remapOutputSymbols(_inputSymbols);
+        outputSymbols = _inputSymbols;
+    }
+
+    int64_t TopNOperatorNode::estimateRowCount()
+    {
+        int64_t rows = _input->estimateRowCount();
+        if(rows < 0) {
+            return _limit;
         }
+        return std::min(std::max(rows - _offset, int64_t(0)), _limit);
+    }
+
+    bool TopNOperatorNode::isSortedBy(const IndexVector& columns)
+    {
+        return sortOrdersStartWith(_sortOrders, columns);
+    }
+
+    void TopNOperatorNode::dump(std::ostream& stream) const
+    {
+        stream << "TopNOperator (";
+        dumpOrderExpressions(stream, _orderExpressions);
+        stream << "; " << _offset << " -> " << _limit;
         stream << ")\n-->";
         _input->dump(stream);
     }
@@ -285,6 +687,11 @@ namespace csvsqldb
         return _iterator->getNextRow();
     }
 
+    void GroupingOperatorNode::cancel()
+    {
+        _input->cancel();
+    }
+
     void GroupingOperatorNode::addPathThrough(const ASTIdentifierPtr& ident,
                                               csvsqldb::IndexVector& groupingIndices,
                                               csvsqldb::IndexVector& outputColumns,
@@ -388,8 +795,8 @@ namespace csvsqldb
             }
         }
 
-        _iterator =
-        std::make_shared<GroupingBlockIterator>(_types, groupingIndices, outputColumns, _aggregateFunctions, *_input, getBlockManager());
+        _iterator = std::make_shared<GroupingBlockIterator>(
+        _types, groupingIndices, outputColumns, _aggregateFunctions, *_input, getBlockManager(), _context._numberOfThreads);
 
         return true;
     }
@@ -432,6 +839,7 @@ namespace csvsqldb
     : RowOperatorNode(context, symbolTable)
     , _nodes(nodes)
     , _block(nullptr)
+    , _vectorized(false)
     {
     }
 
@@ -448,6 +856,11 @@ namespace csvsqldb
         return _iterator->getNextRow();
     }
 
+    void AggregationOperatorNode::cancel()
+    {
+        _input->cancel();
+    }
+
     bool AggregationOperatorNode::connect(const RowOperatorNodePtr& input)
     {
         _input = input;
@@ -518,6 +931,25 @@ namespace csvsqldb
             }
         }
 
+        _vectorized = true;
+        for(auto& sm : _sms) {
+            StackMachine::VariableTypes types;
+            for(const auto& variable : sm._variableMappings) {
+                if(types.size() <= variable.first) {
+                    types.resize(variable.first + 1, NONE);
+                }
+                types[variable.first] = infos[variable.second]->_type;
+            }
+            sm._sm.compile(types, _context._functions);
+            if(sm._sm.isVectorizable()) {
+                for(const auto& variable : sm._variableMappings) {
+                    sm._batch.setVariableType(variable.first, types[variable.first]);
+                }
+            } else {
+                _vectorized = false;
+            }
+        }
+
         return true;
     }
 
@@ -536,16 +968,34 @@ namespace csvsqldb
         size_t smIndex = 0;
         size_t n = 0;
         const Values* row = nullptr;
-        while((row = _input->getNextRow())) {
+        if(_vectorized && _context._numberOfThreads > 1) {
+            aggregateParallel();
+        } else if(_vectorized) {
+            AggregationStates states;
             for(auto& aggrFunc : _aggregateFunctions) {
-                fillVariableStore(_sms[smIndex]._store, _sms[smIndex]._variableMappings, *row);
-                Variant& variant = _sms[smIndex]._sm.evaluate(_sms[smIndex]._store, _context._functions);
-                aggrFunc->step(variant);
-                ++n;
-                ++smIndex;
+                states.push_back(aggrFunc.get());
+            }
+            while((row = _input->getNextRow())) {
+                for(auto& sm : _sms) {
+                    fillVariableBatch(sm._batch, sm._variableMappings, *row);
+                }
+                if(_sms.front()._batch.isFull()) {
+                    stepBatches(_sms, states);
+                }
+            }
+            stepBatches(_sms, states);
+        } else {
+            while((row = _input->getNextRow())) {
+                for(auto& aggrFunc : _aggregateFunctions) {
+                    fillVariableStore(_sms[smIndex]._store, _sms[smIndex]._variableMappings, *row);
+                    Variant& variant = _sms[smIndex]._sm.evaluate(_sms[smIndex]._store, _context._functions);
+                    aggrFunc->step(variant);
+                    ++n;
+                    ++smIndex;
+                }
+                n = 0;
+                smIndex = 0;
             }
-            n = 0;
-            smIndex = 0;
         }
 
         n = 0;
@@ -558,32 +1008,139 @@ namespace csvsqldb
         return _block;
     }
 
-    void AggregationOperatorNode::dump(std::ostream& stream) const
+    void AggregationOperatorNode::stepBatches(StackMachines& sms, const AggregationStates& states)
     {
-        stream << "AggregationOperator (";
-        bool first(true);
-        for(const auto& entry : _aggregateFunctions) {
-            if(first) {
-                first = false;
-            } else {
-                stream << ",";
-            }
-            stream << entry->toString();
+        for(size_t n = 0; n < sms.size(); ++n) {
+            VariableBatch& batch = sms[n]._batch;
+            states[n]->stepBatch(sms[n]._sm.evaluateBatch(batch), batch.size());
+            batch.clear();
         }
-        stream << ")\n-->";
-        _input->dump(stream);
     }
 
-
-    ExtendedProjectionOperatorNode::ExtendedProjectionOperatorNode(const OperatorContext& context,
-                                                                   const SymbolTablePtr& symbolTable,
-                                                                   const Expressions& nodes)
-    : RowOperatorNode(context, symbolTable)
-    , _nodes(nodes)
-    , _block(nullptr)
+    void AggregationOperatorNode::aggregateParallel()
     {
-    }
-
+        // the main thread fills the batches of one worker after the other, the workers evaluate and aggregate them into
+        // their own partial states, which are merged at the end
+        BlockPtr stateBlock = _context._blockManager.createBlock();
+        BatchWorkers workers(_context._numberOfThreads);
+        for(auto& worker : workers) {
+            worker._sms = _sms;
+            worker._busy = false;
+            for(auto& aggrFunc : _aggregateFunctions) {
+                AggregationFunction* state = aggrFunc->clone(stateBlock);
+                if(!state) {
+                    CSVSQLDB_THROW(csvsqldb::Exception, "aggregation states do not fit into a block");
+                }
+                state->init();
+                worker._states.push_back(state);
+            }
+        }
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::exception_ptr error;
+        ThreadPool threadPool(_context._numberOfThreads);
+        threadPool.start();
+
+        // no more batches are dispatched after a worker failed
+        auto dispatch = [&](BatchWorker& worker) {
+            {
+                std::unique_lock<std::mutex> lk(mutex);
+                if(error) {
+                    return false;
+                }
+                worker._busy = true;
+            }
+            threadPool.enqueueTask([&]() {
+                try {
+                    stepBatches(worker._sms, worker._states);
+                } catch(...) {
+                    std::unique_lock<std::mutex> lk(mutex);
+                    if(!error) {
+                        error = std::current_exception();
+                    }
+                }
+                std::unique_lock<std::mutex> lk(mutex);
+                worker._busy = false;
+                cv.notify_all();
+            });
+            return true;
+        };
+
+        try {
+            size_t current = 0;
+            while(const Values* row = _input->getNextRow()) {
+                BatchWorker& worker = workers[current];
+                for(auto& sm : worker._sms) {
+                    fillVariableBatch(sm._batch, sm._variableMappings, *row);
+                }
+                if(worker._sms.front()._batch.isFull()) {
+                    if(!dispatch(worker)) {
+                        break;
+                    }
+                    current = (current + 1) % workers.size();
+                    std::unique_lock<std::mutex> lk(mutex);
+                    cv.wait(lk, [&] { return !workers[current]._busy; });
+                    if(error) {
+                        break;
+                    }
+                }
+            }
+            dispatch(workers[current]);
+        } catch(...) {
+            std::unique_lock<std::mutex> lk(mutex);
+            if(!error) {
+                error = std::current_exception();
+            }
+        }
+
+        {
+            std::unique_lock<std::mutex> lk(mutex);
+            cv.wait(lk, [&] { return std::none_of(workers.begin(), workers.end(), [](const BatchWorker& worker) { return worker._busy; }); });
+        }
+        threadPool.stop();
+
+        for(auto& worker : workers) {
+            for(size_t n = 0; n < worker._states.size(); ++n) {
+                if(!error) {
+                    _aggregateFunctions[n]->merge(*worker._states[n]);
+                }
+                worker._states[n]->~AggregationFunction();
+            }
+        }
+        _context._blockManager.release(stateBlock);
+
+        if(error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    void AggregationOperatorNode::dump(std::ostream& stream) const
+    {
+        stream << "AggregationOperator (";
+        bool first(true);
+        for(const auto& entry : _aggregateFunctions) {
+            if(first) {
+                first = false;
+            } else {
+                stream << ",";
+            }
+            stream << entry->toString();
+        }
+        stream << ")\n-->";
+        _input->dump(stream);
+    }
+
+
+    ExtendedProjectionOperatorNode::ExtendedProjectionOperatorNode(const OperatorContext& context,
+                                                                   const SymbolTablePtr& symbolTable,
+                                                                   const Expressions& nodes)
+    : RowOperatorNode(context, symbolTable)
+    , _nodes(nodes)
+    , _block(nullptr)
+    {
+    }
+
     ExtendedProjectionOperatorNode::~ExtendedProjectionOperatorNode()
     {
     }
@@ -593,6 +1150,17 @@ namespace csvsqldb
         return _iterator->getNextRow();
     }
 
+    void ExtendedProjectionOperatorNode::cancel()
+    {
+        _input->cancel();
+    }
+
+    bool ExtendedProjectionOperatorNode::pushDownLimit(int64_t rows)
+    {
+        // each input row gives exactly one output row
+        return _input->pushDownLimit(rows);
+    }
+
     bool ExtendedProjectionOperatorNode::connect(const RowOperatorNodePtr& input)
     {
         _input = input;
@@ -705,6 +1273,11 @@ namespace csvsqldb
         outputSymbols = _outputSymbols;
     }
 
+    int64_t ExtendedProjectionOperatorNode::estimateRowCount()
+    {
+        return _input->estimateRowCount();
+    }
+
     BlockPtr ExtendedProjectionOperatorNode::getNextBlock()
     {
         BlockPtr previousBlock = prepareNextBuffer();
@@ -850,6 +1423,12 @@ namespace csvsqldb
         return &_row;
     }
 
+    void CrossJoinOperatorNode::cancel()
+    {
+        _lhsInput->cancel();
+        _rhsInput->cancel();
+    }
+
     bool CrossJoinOperatorNode::connect(const RowOperatorNodePtr& input)
     {
         if(!_lhsInput) {
@@ -906,7 +1485,7 @@ namespace csvsqldb
 
             if(row) {
                 fillVariableStore(store, _sm._variableMappings, *row);
-                match = _sm._sm.evaluate(store, _context._functions).asBool();
+                match = isSelected(_sm._sm.evaluate(store, _context._functions));
             }
         } while(row && !match);
 
@@ -968,472 +1547,1795 @@ namespace csvsqldb
     }
 
 
-    InnerHashJoinOperatorNode::InnerHashJoinOperatorNode(const OperatorContext& context, const SymbolTablePtr& symbolTable, const ASTExprNodePtr& exp)
-    : RowOperatorNode(context, symbolTable)
-    , _currentLhs(nullptr)
-    , _exp(exp)
-    , _hashTableKeyPosition(0)
-    {
-    }
-
-    const Values* InnerHashJoinOperatorNode::getNextRow()
+    namespace
     {
-        const Values* row = nullptr;
-
-        do {
-            row = _rhsIterator->getNextKeyValueRow();
-            if(!row) {
-                _currentLhs = _lhsInput->getNextRow();
-                if(!_currentLhs) {
-                    // free all resources, as we have delivered the last row
-                    _rhsIterator->reset();
-                    return nullptr;
-                }
-                for(size_t n = 0; n < _inputLhsSymbols.size(); ++n) {
-                    const Values& values = *(_currentLhs);
-                    _row[n] = values[n];
-                }
-                _rhsIterator->setContextForKeyValue(*_row[_hashTableKeyPosition]);
+        void collectConjuncts(const ASTExprNodePtr& exp, Expressions& conjuncts)
+        {
+            ASTBinaryNodePtr binary = std::dynamic_pointer_cast<ASTBinaryNode>(exp);
+            if(binary && binary->_op == OP_AND) {
+                collectConjuncts(binary->_lhs, conjuncts);
+                collectConjuncts(binary->_rhs, conjuncts);
+            } else {
+                conjuncts.push_back(exp);
             }
-        } while(!row);
-
-        size_t m = 0;
-        for(size_t n = _inputLhsSymbols.size(); n < _inputRhsSymbols.size() + _inputLhsSymbols.size(); ++n, ++m) {
-            const Values& values = *(row);
-            _row[n] = values[m];
         }
-        return &_row;
-    }
 
-    bool InnerHashJoinOperatorNode::connect(const RowOperatorNodePtr& input)
-    {
-        if(!_lhsInput) {
-            _lhsInput = input;
-            _lhsInput->getColumnInfos(_inputLhsSymbols);
-            _outputSymbols.insert(_outputSymbols.end(), _inputLhsSymbols.begin(), _inputLhsSymbols.end());
-            return false;
-        } else if(!_rhsInput) {
-            _rhsInput = input;
-            _rhsInput->getColumnInfos(_inputRhsSymbols);
-            _outputSymbols.insert(_outputSymbols.end(), _inputRhsSymbols.begin(), _inputRhsSymbols.end());
-            Types types;
-            for(const auto& info : _inputRhsSymbols) {
-                types.push_back(info->_type);
+        size_t findColumn(const SymbolInfos& symbols, const ASTIdentifier& identifier)
+        {
+            for(size_t n = 0; n < symbols.size(); ++n) {
+                if(identifier._info->_name == symbols[n]->_name) {
+                    return n;
+                }
             }
+            return std::string::npos;
+        }
 
+        OperatorBaseNode::StackMachineType
+        compileJoinFilter(OperatorBaseNode& node, const Expressions& conjuncts, const SymbolInfos& outputSymbols)
+        {
             StackMachine sm;
-            IdentifierSet expressionVariables;
-
             StackMachine::VariableMapping mapping;
+            IdentifierSet expressionVariables;
             {
                 ASTInstructionStackVisitor visitor(sm, mapping);
-                _exp->accept(visitor);
+                for(size_t n = 0; n < conjuncts.size(); ++n) {
+                    conjuncts[n]->accept(visitor);
+                    if(n > 0) {
+                        sm.addInstruction(StackMachine::Instruction(StackMachine::AND));
+                    }
+                }
             }
-
             {
                 ASTExpressionVariableVisitor visitor(expressionVariables);
-                _exp->accept(visitor);
+                for(const auto& conjunct : conjuncts) {
+                    conjunct->accept(visitor);
+                }
             }
 
-            VariableMapping variableMapping;
-            size_t hashTableKeyPosition = 0;
+            OperatorBaseNode::VariableMapping variableMapping;
             for(const auto& variable : expressionVariables) {
                 bool found = false;
-                for(size_t n = 0; !found && n < _outputSymbols.size(); ++n) {
-                    const SymbolInfoPtr& info = _outputSymbols[n];
+                for(size_t n = 0; !found && n < outputSymbols.size(); ++n) {
+                    const SymbolInfoPtr& info = outputSymbols[n];
 
                     if(variable._info->_name == info->_name) {
-                        variableMapping.push_back(std::make_pair(getMapping(variable.getQualifiedIdentifier(), mapping), n));
+                        variableMapping.push_back(std::make_pair(node.getMapping(variable.getQualifiedIdentifier(), mapping), n));
                         found = true;
                     }
                 }
                 if(!found) {
-                    CSVSQLDB_THROW(csvsqldb::Exception,
-                                   "variable '" << variable.getQualifiedIdentifier() << "' not found in context");
+                    CSVSQLDB_THROW(csvsqldb::Exception, "variable '" << variable.getQualifiedIdentifier() << "' not found in context");
                 }
-                // find the rhs expresion variable for the hash table key
-                found = false;
-                for(size_t n = 0; !found && n < _inputRhsSymbols.size(); ++n) {
-                    const SymbolInfoPtr& info = _inputRhsSymbols[n];
+            }
+            return OperatorBaseNode::StackMachineType(sm, variableMapping);
+        }
+    }
 
-                    if(variable._info->_name == info->_name) {
-                        hashTableKeyPosition = n;
-                        found = true;
+    void splitJoinCondition(const ASTExprNodePtr& exp,
+                            const SymbolInfos& lhsSymbols,
+                            const SymbolInfos& rhsSymbols,
+                            IndexVector& lhsKeyIndices,
+                            IndexVector& rhsKeyIndices,
+                            Expressions& residuals)
+    {
+        Expressions conjuncts;
+        collectConjuncts(exp, conjuncts);
+        for(const auto& conjunct : conjuncts) {
+            ASTBinaryNodePtr binary = std::dynamic_pointer_cast<ASTBinaryNode>(conjunct);
+            if(binary && binary->_op == OP_EQ) {
+                ASTIdentifierPtr lhs = std::dynamic_pointer_cast<ASTIdentifier>(binary->_lhs);
+                ASTIdentifierPtr rhs = std::dynamic_pointer_cast<ASTIdentifier>(binary->_rhs);
+                if(lhs && rhs) {
+                    size_t lhsPosition = findColumn(lhsSymbols, *lhs);
+                    size_t rhsPosition = findColumn(rhsSymbols, *rhs);
+                    if(lhsPosition == std::string::npos || rhsPosition == std::string::npos) {
+                        lhsPosition = findColumn(lhsSymbols, *rhs);
+                        rhsPosition = findColumn(rhsSymbols, *lhs);
                     }
-                }
-                // find the lhs expresion variable for the hash table key
-                found = false;
-                for(size_t n = 0; !found && n < _inputLhsSymbols.size(); ++n) {
-                    const SymbolInfoPtr& info = _inputLhsSymbols[n];
-
-                    if(variable._info->_name == info->_name) {
-                        _hashTableKeyPosition = n;
-                        found = true;
+                    // the key values are hashed and compared by their binary representation, so columns of different
+                    // types, that are only equal after a conversion, are compared by the residual filter
+                    if(lhsPosition != std::string::npos && rhsPosition != std::string::npos &&
+                       lhsSymbols[lhsPosition]->_type == rhsSymbols[rhsPosition]->_type) {
+                        lhsKeyIndices.push_back(lhsPosition);
+                        rhsKeyIndices.push_back(rhsPosition);
+                        continue;
                     }
                 }
             }
-
-            _rhsIterator = std::make_shared<HashingBlockIterator>(types, *_rhsInput, getBlockManager(), hashTableKeyPosition);
-            _row.resize(_outputSymbols.size());
-        } else {
-            CSVSQLDB_THROW(csvsqldb::Exception, "all inputs already set");
+            residuals.push_back(conjunct);
         }
-
-        return true;
     }
 
-    void InnerHashJoinOperatorNode::getColumnInfos(SymbolInfos& outputSymbols)
-    {
-        outputSymbols = _outputSymbols;
-    }
 
-    void InnerHashJoinOperatorNode::dump(std::ostream& stream) const
+    InnerHashJoinOperatorNode::InnerHashJoinOperatorNode(const OperatorContext& context, const SymbolTablePtr& symbolTable, const ASTExprNodePtr& exp)
+    : RowOperatorNode(context, symbolTable)
+    , _currentProbe(nullptr)
+    , _buildLhs(false)
+    , _hasResidual(false)
+    , _built(false)
+    , _probeExhausted(false)
+    , _exp(exp)
+    , _probeOffset(0)
+    , _probeSize(0)
+    , _buildOffset(0)
+    , _buildSize(0)
+    , _probeRows(nullptr)
+    , _currentSlice(0)
+    , _currentMatch(0)
+    , _threadPool(context._numberOfThreads)
     {
-        stream << "InnerHashJoinOperator\n";
-        stream << "-->";
-        _lhsInput->dump(stream);
-        stream << "-->";
-        _rhsInput->dump(stream);
     }
 
-
-    UnionOperatorNode::UnionOperatorNode(const OperatorContext& context, const SymbolTablePtr& symbolTable)
-    : RowOperatorNode(context, symbolTable)
+    InnerHashJoinOperatorNode::~InnerHashJoinOperatorNode()
     {
+        _threadPool.stop();
+        releaseBatch();
     }
 
-    const Values* UnionOperatorNode::getNextRow()
+    const Values* InnerHashJoinOperatorNode::getNextRow()
     {
-        const Values* row;
-
-        row = _currentInput->getNextRow();
-        if(!row && _firstInput) {
-            _currentInput = _secondInput;
-            row = _currentInput->getNextRow();
-            _firstInput.reset();
+        if(!_built) {
+            _built = true;
+            if(buildTable(*_buildInput, *_probeInput, 0)) {
+                _probeRows = _probeInput.get();
+            } else {
+                nextPartition();
+            }
+        }
+        if(_context._numberOfThreads > 1) {
+            return getNextParallelRow();
         }
 
-        return row;
-    }
+        do {
+            const Value* const* match = nullptr;
+            while(!_currentProbe || !(match = _hashTable->getNextMatch(_probe))) {
+                _currentProbe = _probeRows ? _probeRows->getNextRow() : nullptr;
+                if(!_currentProbe) {
+                    if(nextPartition()) {
+                        continue;
+                    }
+                    // free all resources, as we have delivered the last row
+                    _hashTable->clear();
+                    return nullptr;
+                }
+                _hashTable->probe(_currentProbe->data(), _probeKeyIndices, _probe);
+            }
 
-    bool UnionOperatorNode::connect(const RowOperatorNodePtr& input)
-    {
-        if(!_firstInput) {
-            _firstInput = input;
-            _firstInput->getColumnInfos(_inputSymbols);
-            _currentInput = _firstInput;
-        } else if(!_secondInput) {
-            _secondInput = input;
-        } else {
-            CSVSQLDB_THROW(csvsqldb::Exception, "all inputs already set");
-        }
+            std::copy(_currentProbe->begin(), _currentProbe->end(), _row.begin() + _probeOffset);
+            std::copy(match, match + _buildSize, _row.begin() + _buildOffset);
+        } while(!matchesResidual());
 
-        return true;
+        return &_row;
     }
 
-    void UnionOperatorNode::getColumnInfos(SymbolInfos& outputSymbols)
+    void InnerHashJoinOperatorNode::cancel()
     {
-        outputSymbols = _inputSymbols;
+        _lhsInput->cancel();
+        _rhsInput->cancel();
     }
 
-    void UnionOperatorNode::dump(std::ostream& stream) const
+    bool InnerHashJoinOperatorNode::buildTable(RowProvider& buildRows, RowProvider& probeRows, size_t level)
     {
-        stream << "UnionOperatorNode\n";
-        stream << "-->";
-        _firstInput->dump(stream);
-        stream << "-->";
-        _secondInput->dump(stream);
+        // the blocks the spill partitions are filled in are taken from the share of the table, the build and the probe
+        // rows are partitioned one after the other, so only one side pins a block per partition. The number of partitions
+        // only depends on the memory budget, so the rows are joined in the same order with any number of threads.
+        size_t share = getBlockManager().getFreeBlockShare();
+        size_t partitions = spillPartitionCount(getBlockManager().getMaxActiveBlocks() / 4);
+        // the last level is built without limit, e.g. if all build rows have the same key
+        size_t maxBlocks = level < MAX_SPILL_BITS ? std::max<size_t>(share, partitions + 1) - partitions : 0;
+        if(_hashTable->build(buildRows, maxBlocks)) {
+            return true;
+        }
+        spill(buildRows, probeRows, level, partitions);
+        return false;
     }
 
-
-    SelectOperatorNode::SelectOperatorNode(const OperatorContext& context, const SymbolTablePtr& symbolTable, const ASTExprNodePtr& exp)
-    : RowOperatorNode(context, symbolTable)
+    void InnerHashJoinOperatorNode::spill(RowProvider& buildRows, RowProvider& probeRows, size_t level, size_t count)
     {
-        {
-            ASTInstructionStackVisitor visitor(_sm, _mapping);
-            exp->accept(visitor);
+        SpillPartitions partitions(count);
+        for(auto& partition : partitions) {
+            partition._build = std::make_shared<RowBuffer>(_buildTypes, getBlockManager());
+            partition._probe = std::make_shared<RowBuffer>(_probeTypes, getBlockManager());
+            partition._level = level + spillPartitionBits(count);
         }
 
-        {
-            ASTExpressionVariableVisitor visitor(_expressionVariables);
-            exp->accept(visitor);
+        HashKey key;
+        uint64_t hash = 0;
+        for(size_t n = 0; n < _hashTable->getRowCount(); ++n) {
+            const Value* const* row = _hashTable->getRow(n);
+            _hashTable->hashProbeKey(row, _buildKeyIndices, key, hash);
+            partitions[spillPartition(hash, level, partitions.size())]._build->addRow(row);
+        }
+        _hashTable->clear();
+        // rows with a NULL key can never match, so they are dropped
+        while(const Values* row = buildRows.getNextRow()) {
+            if(_hashTable->hashProbeKey(row->data(), _buildKeyIndices, key, hash)) {
+                partitions[spillPartition(hash, level, partitions.size())]._build->addRow(row->data());
+            }
+        }
+        for(auto& partition : partitions) {
+            partition._build->unpinLastBlock();
+        }
+        while(const Values* row = probeRows.getNextRow()) {
+            if(_hashTable->hashProbeKey(row->data(), _probeKeyIndices, key, hash)) {
+                partitions[spillPartition(hash, level, partitions.size())]._probe->addRow(row->data());
+            }
+        }
+        for(auto& partition : partitions) {
+            partition._probe->unpinLastBlock();
+        }
+
+        // the partitions are joined in their order, partitions without rows on one side have no matches
+        for(auto iter = partitions.rbegin(); iter != partitions.rend(); ++iter) {
+            if(iter->_build->size() && iter->_probe->size()) {
+                _spillPartitions.push_back(*iter);
+            }
         }
     }
 
-    const Values* SelectOperatorNode::getNextRow()
+    bool InnerHashJoinOperatorNode::nextPartition()
     {
-        const Values* row = _input->getNextRow();
-        while(row) {
-            fillVariableStore(_store, _variableMapping, *row);
-            if(_sm.evaluate(_store, _context._functions).asBool()) {
-                return row;
+        _probeRows = nullptr;
+        _probePartition.reset();
+        while(!_spillPartitions.empty()) {
+            SpillPartition partition = _spillPartitions.back();
+            _spillPartitions.pop_back();
+            if(buildTable(*partition._build, *partition._probe, partition._level)) {
+                _probePartition = partition._probe;
+                _probeRows = _probePartition.get();
+                return true;
             }
-            row = _input->getNextRow();
         }
-        return nullptr;
+        return false;
     }
 
-    bool SelectOperatorNode::connect(const RowOperatorNodePtr& input)
+    const Values* InnerHashJoinOperatorNode::getNextParallelRow()
     {
-        _input = input;
-        _input->getColumnInfos(_inputSymbols);
-
-        for(const auto& variable : _expressionVariables) {
-            bool found = false;
-            for(size_t n = 0; !found && n < _inputSymbols.size(); ++n) {
-                const SymbolInfoPtr& info = _inputSymbols[n];
-
-                if((info->_identifier == variable._info->_name) || (info->_qualifiedIdentifier == variable._info->_name)) {
-                    _variableMapping.push_back(std::make_pair(getMapping(variable.getQualifiedIdentifier(), _mapping), n));
-                    found = true;
+        do {
+            for(;;) {
+                while(_currentSlice < _batchMatches.size() && _currentMatch >= _batchMatches[_currentSlice].size()) {
+                    ++_currentSlice;
+                    _currentMatch = 0;
+                }
+                if(_currentSlice < _batchMatches.size()) {
+                    break;
+                }
+                if(!probeBatch()) {
+                    if(nextPartition()) {
+                        _probeExhausted = false;
+                        continue;
+                    }
+                    // free all resources, as we have delivered the last row
+                    releaseBatch();
+                    _hashTable->clear();
+                    return nullptr;
                 }
             }
-            if(!found) {
-                CSVSQLDB_THROW(csvsqldb::Exception,
-                               "variable '" << variable.getQualifiedIdentifier() << "' not found in context");
-            }
-        }
 
-        return true;
+            const Match& match = _batchMatches[_currentSlice][_currentMatch++];
+            const Value* const* probe = &_batchValues[match.first * _probeSize];
+            std::copy(probe, probe + _probeSize, _row.begin() + _probeOffset);
+            std::copy(match.second, match.second + _buildSize, _row.begin() + _buildOffset);
+        } while(!matchesResidual());
+
+        return &_row;
     }
 
-    void SelectOperatorNode::getColumnInfos(SymbolInfos& outputSymbols)
+    bool InnerHashJoinOperatorNode::matchesResidual()
     {
-        remapOutputSymbols(_inputSymbols);
-        outputSymbols = _inputSymbols;
+        if(!_hasResidual) {
+            return true;
+        }
+        VariableStore store;
+        fillVariableStore(store, _residual._variableMappings, _row);
+        return isSelected(_residual._sm.evaluate(store, _context._functions));
     }
 
-    void SelectOperatorNode::dump(std::ostream& stream) const
+    bool InnerHashJoinOperatorNode::probeBatch()
     {
-        stream << "SelectOperator\n";
+        // the probe rows are only valid until the next row is requested, so a batch of them is copied into own blocks
+        // and probed in parallel slices, the matches of each slice keep the order of the probe rows
+        const size_t rowsPerThread = 4096;
+        uint16_t numberOfThreads = _context._numberOfThreads;
+
+        releaseBatch();
+        size_t rows = 0;
+        const Values* row = nullptr;
+        while(!_probeExhausted && rows < rowsPerThread * numberOfThreads) {
+            if(!_probeRows || !(row = _probeRows->getNextRow())) {
+                _probeExhausted = true;
+                break;
+            }
+            if(_batchBlocks.empty()) {
+                _batchBlocks.push_back(getBlockManager().createBlock());
+            }
+            for(const auto* value : *row) {
+                Value* copy = _batchBlocks.back()->addValue(*value);
+                if(!copy) {
+                    _batchBlocks.back()->markNextBlock();
+                    _batchBlocks.push_back(getBlockManager().createBlock());
+                    copy = _batchBlocks.back()->addValue(*value);
+                    if(!copy) {
+                        CSVSQLDB_THROW(csvsqldb::Exception, "value does not fit into a block");
+                    }
+                }
+                _batchValues.push_back(copy);
+            }
+            ++rows;
+        }
+        if(!rows) {
+            return false;
+        }
+
+        if(_threadPool.isStopped()) {
+            _threadPool.start();
+        }
+        size_t slices = std::min(static_cast<size_t>(numberOfThreads), rows);
+        size_t sliceSize = (rows + slices - 1) / slices;
+        _batchMatches.resize(slices);
+        std::mutex mutex;
+        std::condition_variable cv;
+        size_t running = slices;
+        std::exception_ptr error;
+
+        for(size_t slice = 0; slice < slices; ++slice) {
+            _threadPool.enqueueTask([&, slice]() {
+                try {
+                    Matches& matches = _batchMatches[slice];
+                    HashJoinTable::ProbeContext probe;
+                    for(size_t n = slice * sliceSize; n < std::min(rows, (slice + 1) * sliceSize); ++n) {
+                        _hashTable->probe(&_batchValues[n * _probeSize], _probeKeyIndices, probe);
+                        while(const Value* const* match = _hashTable->getNextMatch(probe)) {
+                            matches.push_back(std::make_pair(n, match));
+                        }
+                    }
+                } catch(...) {
+                    std::unique_lock<std::mutex> lk(mutex);
+                    error = std::current_exception();
+                }
+                std::unique_lock<std::mutex> lk(mutex);
+                --running;
+                cv.notify_all();
+            });
+        }
+        {
+            std::unique_lock<std::mutex> lk(mutex);
+            cv.wait(lk, [&] { return running == 0; });
+        }
+        if(error) {
+            std::rethrow_exception(error);
+        }
+        return true;
+    }
+
+    void InnerHashJoinOperatorNode::releaseBatch()
+    {
+        for(auto& block : _batchBlocks) {
+            getBlockManager().release(block);
+        }
+        _batchBlocks.clear();
+        _batchValues.clear();
+        _batchMatches.clear();
+        _currentSlice = 0;
+        _currentMatch = 0;
+    }
+
+    bool InnerHashJoinOperatorNode::connect(const RowOperatorNodePtr& input)
+    {
+        if(!_lhsInput) {
+            _lhsInput = input;
+            _lhsInput->getColumnInfos(_inputLhsSymbols);
+            _outputSymbols.insert(_outputSymbols.end(), _inputLhsSymbols.begin(), _inputLhsSymbols.end());
+            return false;
+        } else if(!_rhsInput) {
+            _rhsInput = input;
+            _rhsInput->getColumnInfos(_inputRhsSymbols);
+            _outputSymbols.insert(_outputSymbols.end(), _inputRhsSymbols.begin(), _inputRhsSymbols.end());
+
+            // equalities between a lhs and a rhs column make up the composite hash key, all other conjuncts are
+            // evaluated as residual filter on the joined rows
+            IndexVector lhsKeyIndices;
+            IndexVector rhsKeyIndices;
+            Expressions residuals;
+            splitJoinCondition(_exp, _inputLhsSymbols, _inputRhsSymbols, lhsKeyIndices, rhsKeyIndices, residuals);
+            if(!residuals.empty()) {
+                _residual = compileJoinFilter(*this, residuals, _outputSymbols);
+                _hasResidual = true;
+            }
+
+            const SymbolInfos& buildSymbols = _buildLhs ? _inputLhsSymbols : _inputRhsSymbols;
+            const SymbolInfos& probeSymbols = _buildLhs ? _inputRhsSymbols : _inputLhsSymbols;
+            for(const auto& info : buildSymbols) {
+                _buildTypes.push_back(info->_type);
+            }
+            for(const auto& info : probeSymbols) {
+                _probeTypes.push_back(info->_type);
+            }
+            _probeInput = _buildLhs ? _rhsInput : _lhsInput;
+            _buildInput = _buildLhs ? _lhsInput : _rhsInput;
+            _probeKeyIndices = _buildLhs ? rhsKeyIndices : lhsKeyIndices;
+            _buildKeyIndices = _buildLhs ? lhsKeyIndices : rhsKeyIndices;
+            _probeSize = probeSymbols.size();
+            _buildSize = buildSymbols.size();
+            _probeOffset = _buildLhs ? _inputLhsSymbols.size() : 0;
+            _buildOffset = _buildLhs ? 0 : _inputLhsSymbols.size();
+            _hashTable = std::make_shared<HashJoinTable>(_buildTypes, _buildKeyIndices, getBlockManager(), _context._numberOfThreads);
+            _row.resize(_outputSymbols.size());
+        } else {
+            CSVSQLDB_THROW(csvsqldb::Exception, "all inputs already set");
+        }
+
+        return true;
+    }
+
+    void InnerHashJoinOperatorNode::getColumnInfos(SymbolInfos& outputSymbols)
+    {
+        outputSymbols = _outputSymbols;
+    }
+
+    void InnerHashJoinOperatorNode::dump(std::ostream& stream) const
+    {
+        stream << "InnerHashJoinOperator (build " << (_buildLhs ? "lhs" : "rhs") << ")\n";
+        stream << "-->";
+        _lhsInput->dump(stream);
+        stream << "-->";
+        _rhsInput->dump(stream);
+    }
+
+
+    namespace
+    {
+        bool hasNullKey(const Values& row, const IndexVector& keyIndices)
+        {
+            for(auto index : keyIndices) {
+                if(row[index]->isNull()) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        int compareKeys(const SortingBlockIterator::SortKey& lhs, const SortingBlockIterator::SortKey& rhs)
+        {
+            return SortingBlockIterator::compareSortKeys(&lhs[0], lhs.size(), &rhs[0], rhs.size());
+        }
+    }
+
+    InnerMergeJoinOperatorNode::InnerMergeJoinOperatorNode(const OperatorContext& context, const SymbolTablePtr& symbolTable, const ASTExprNodePtr& exp)
+    : RowOperatorNode(context, symbolTable)
+    , _exp(exp)
+    , _hasResidual(false)
+    , _lhsSorted(false)
+    , _rhsSorted(false)
+    , _started(false)
+    , _lhsRows(nullptr)
+    , _rhsRows(nullptr)
+    , _currentLhs(nullptr)
+    , _nextRhs(nullptr)
+    , _hasGroup(false)
+    , _groupSize(0)
+    , _groupPosition(0)
+    {
+    }
+
+    InnerMergeJoinOperatorNode::~InnerMergeJoinOperatorNode()
+    {
+        releaseGroup();
+    }
+
+    const Values* InnerMergeJoinOperatorNode::getNextRow()
+    {
+        if(!_started) {
+            advanceRhs();
+            _started = true;
+        }
+
+        size_t lhsSize = _inputLhsSymbols.size();
+        size_t rhsSize = _inputRhsSymbols.size();
+        for(;;) {
+            while(_currentLhs && _groupPosition < _groupSize) {
+                const Value* const* rhs = &_groupValues[_groupPosition++ * rhsSize];
+                std::copy(_currentLhs->begin(), _currentLhs->begin() + lhsSize, _row.begin());
+                std::copy(rhs, rhs + rhsSize, _row.begin() + lhsSize);
+                if(matchesResidual()) {
+                    return &_row;
+                }
+            }
+
+            _currentLhs = getNextLhsRow();
+            if(!_currentLhs) {
+                // free all resources, as we have delivered the last row
+                releaseGroup();
+                return nullptr;
+            }
+            _groupPosition = _groupSize;
+            if(hasNullKey(*_currentLhs, _lhsKeyIndices)) {
+                // NULL never matches
+                continue;
+            }
+            if(!_hasGroup || compareKeys(_lhsKey, _groupKey) != 0) {
+                readRhsGroup();
+            }
+            _groupPosition = 0;
+        }
+    }
+
+    void InnerMergeJoinOperatorNode::cancel()
+    {
+        _lhsInput->cancel();
+        _rhsInput->cancel();
+    }
+
+    const Values* InnerMergeJoinOperatorNode::getNextLhsRow()
+    {
+        const Values* row = _lhsRows->getNextRow();
+        if(row) {
+            std::swap(_previousLhsKey, _lhsKey);
+            _lhsKey.clear();
+            SortingBlockIterator::appendSortKey(*row, _lhsSortOrders, _lhsKey);
+            if(!_previousLhsKey.empty() && compareKeys(_previousLhsKey, _lhsKey) > 0) {
+                CSVSQLDB_THROW(csvsqldb::Exception, "lhs input of the merge join is not sorted on the join keys as declared");
+            }
+        }
+        return row;
+    }
+
+    void InnerMergeJoinOperatorNode::advanceRhs()
+    {
+        _nextRhs = _rhsRows->getNextRow();
+        if(_nextRhs) {
+            std::swap(_previousRhsKey, _rhsKey);
+            _rhsKey.clear();
+            SortingBlockIterator::appendSortKey(*_nextRhs, _rhsSortOrders, _rhsKey);
+            if(!_previousRhsKey.empty() && compareKeys(_previousRhsKey, _rhsKey) > 0) {
+                CSVSQLDB_THROW(csvsqldb::Exception, "rhs input of the merge join is not sorted on the join keys as declared");
+            }
+        }
+    }
+
+    void InnerMergeJoinOperatorNode::readRhsGroup()
+    {
+        releaseGroup();
+        _groupKey = _lhsKey;
+        _hasGroup = true;
+
+        // rhs rows with smaller keys have no join partner, this includes the rows with NULL keys, as they sort first
+        while(_nextRhs && compareKeys(_rhsKey, _lhsKey) < 0) {
+            advanceRhs();
+        }
+        while(_nextRhs && compareKeys(_rhsKey, _lhsKey) == 0) {
+            // the rhs rows are only valid until the next row is requested, so the group is copied into own blocks
+            if(_groupBlocks.empty()) {
+                _groupBlocks.push_back(getBlockManager().createBlock());
+            }
+            for(const auto* value : *_nextRhs) {
+                Value* copy = _groupBlocks.back()->addValue(*value);
+                if(!copy) {
+                    _groupBlocks.back()->markNextBlock();
+                    _groupBlocks.push_back(getBlockManager().createBlock());
+                    copy = _groupBlocks.back()->addValue(*value);
+                    if(!copy) {
+                        CSVSQLDB_THROW(csvsqldb::Exception, "value does not fit into a block");
+                    }
+                }
+                _groupValues.push_back(copy);
+            }
+            ++_groupSize;
+            advanceRhs();
+        }
+    }
+
+    void InnerMergeJoinOperatorNode::releaseGroup()
+    {
+        for(auto& block : _groupBlocks) {
+            getBlockManager().release(block);
+        }
+        _groupBlocks.clear();
+        _groupValues.clear();
+        _hasGroup = false;
+        _groupSize = 0;
+        _groupPosition = 0;
+    }
+
+    bool InnerMergeJoinOperatorNode::matchesResidual()
+    {
+        if(!_hasResidual) {
+            return true;
+        }
+        VariableStore store;
+        fillVariableStore(store, _residual._variableMappings, _row);
+        return isSelected(_residual._sm.evaluate(store, _context._functions));
+    }
+
+    bool InnerMergeJoinOperatorNode::connect(const RowOperatorNodePtr& input)
+    {
+        if(!_lhsInput) {
+            _lhsInput = input;
+            _lhsInput->getColumnInfos(_inputLhsSymbols);
+            _outputSymbols.insert(_outputSymbols.end(), _inputLhsSymbols.begin(), _inputLhsSymbols.end());
+            return false;
+        } else if(!_rhsInput) {
+            _rhsInput = input;
+            _rhsInput->getColumnInfos(_inputRhsSymbols);
+            _outputSymbols.insert(_outputSymbols.end(), _inputRhsSymbols.begin(), _inputRhsSymbols.end());
+
+            Expressions residuals;
+            splitJoinCondition(_exp, _inputLhsSymbols, _inputRhsSymbols, _lhsKeyIndices, _rhsKeyIndices, residuals);
+            if(_lhsKeyIndices.empty()) {
+                CSVSQLDB_THROW(csvsqldb::Exception, "merge join needs an equality of a lhs and a rhs column");
+            }
+            if(!residuals.empty()) {
+                _residual = compileJoinFilter(*this, residuals, _outputSymbols);
+                _hasResidual = true;
+            }
+
+            for(size_t n = 0; n < _lhsKeyIndices.size(); ++n) {
+                if(_inputLhsSymbols[_lhsKeyIndices[n]]->_type != _inputRhsSymbols[_rhsKeyIndices[n]]->_type) {
+                    CSVSQLDB_THROW(csvsqldb::Exception, "merge join keys have to be of the same type");
+                }
+                _lhsSortOrders.push_back({ _lhsKeyIndices[n], ASC });
+                _rhsSortOrders.push_back({ _rhsKeyIndices[n], ASC });
+            }
+            for(const auto& info : _inputLhsSymbols) {
+                _lhsTypes.push_back(info->_type);
+            }
+            for(const auto& info : _inputRhsSymbols) {
+                _rhsTypes.push_back(info->_type);
+            }
+            _lhsRows = _lhsInput.get();
+            _rhsRows = _rhsInput.get();
+            if(!_lhsSorted) {
+                _lhsSorter = std::make_shared<SortingBlockIterator>(_lhsTypes, _lhsSortOrders, *_lhsInput, getBlockManager());
+                _lhsRows = _lhsSorter.get();
+            }
+            if(!_rhsSorted) {
+                _rhsSorter = std::make_shared<SortingBlockIterator>(_rhsTypes, _rhsSortOrders, *_rhsInput, getBlockManager());
+                _rhsRows = _rhsSorter.get();
+            }
+            _row.resize(_outputSymbols.size());
+        } else {
+            CSVSQLDB_THROW(csvsqldb::Exception, "all inputs already set");
+        }
+
+        return true;
+    }
+
+    void InnerMergeJoinOperatorNode::getColumnInfos(SymbolInfos& outputSymbols)
+    {
+        outputSymbols = _outputSymbols;
+    }
+
+    bool InnerMergeJoinOperatorNode::isSortedBy(const IndexVector& columns)
+    {
+        // the rows are delivered in the order of the join keys, which are equal on both sides
+        if(columns.size() > _lhsKeyIndices.size()) {
+            return false;
+        }
+        for(size_t n = 0; n < columns.size(); ++n) {
+            if(columns[n] != _lhsKeyIndices[n] && columns[n] != _inputLhsSymbols.size() + _rhsKeyIndices[n]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void InnerMergeJoinOperatorNode::dump(std::ostream& stream) const
+    {
+        stream << "InnerMergeJoinOperator (lhs " << (_lhsSorted ? "sorted" : "unsorted") << ", rhs "
+               << (_rhsSorted ? "sorted" : "unsorted") << ")\n";
+        stream << "-->";
+        _lhsInput->dump(stream);
+        stream << "-->";
+        _rhsInput->dump(stream);
+    }
+
+
+    UnionOperatorNode::UnionOperatorNode(const OperatorContext& context, const SymbolTablePtr& symbolTable)
+    : RowOperatorNode(context, symbolTable)
+    {
+    }
+
+    const Values* UnionOperatorNode::getNextRow()
+    {
+        const Values* row;
+
+        row = _currentInput->getNextRow();
+        if(!row && _firstInput) {
+            _currentInput = _secondInput;
+            row = _currentInput->getNextRow();
+            _firstInput.reset();
+        }
+
+        return row;
+    }
+
+    void UnionOperatorNode::cancel()
+    {
+        if(_firstInput) {
+            _firstInput->cancel();
+        }
+        _secondInput->cancel();
+    }
+
+    bool UnionOperatorNode::connect(const RowOperatorNodePtr& input)
+    {
+        if(!_firstInput) {
+            _firstInput = input;
+            _firstInput->getColumnInfos(_inputSymbols);
+            _currentInput = _firstInput;
+        } else if(!_secondInput) {
+            _secondInput = input;
+        } else {
+            CSVSQLDB_THROW(csvsqldb::Exception, "all inputs already set");
+        }
+
+        return true;
+    }
+
+    void UnionOperatorNode::getColumnInfos(SymbolInfos& outputSymbols)
+    {
+        outputSymbols = _inputSymbols;
+    }
+
+    void UnionOperatorNode::dump(std::ostream& stream) const
+    {
+        stream << "UnionOperatorNode\n";
+        stream << "-->";
+        _firstInput->dump(stream);
+        stream << "-->";
+        _secondInput->dump(stream);
+    }
+
+
+    SelectOperatorNode::SelectOperatorNode(const OperatorContext& context, const SymbolTablePtr& symbolTable, const ASTExprNodePtr& exp)
+    : RowOperatorNode(context, symbolTable)
+    , _vectorized(false)
+    , _endOfInput(false)
+    , _selected(0)
+    {
+        {
+            ASTInstructionStackVisitor visitor(_sm, _mapping);
+            exp->accept(visitor);
+        }
+
+        {
+            ASTExpressionVariableVisitor visitor(_expressionVariables);
+            exp->accept(visitor);
+        }
+    }
+
+    const Values* SelectOperatorNode::getNextRow()
+    {
+        if(_vectorized) {
+            while(_selected == _selection.size()) {
+                if(!selectNextBatch()) {
+                    return nullptr;
+                }
+            }
+            _batchRows->seek(0, _selection[_selected++]);
+            return _batchRows->getNextRow();
+        }
+
+        const Values* row = _input->getNextRow();
+        while(row) {
+            fillVariableStore(_store, _variableMapping, *row);
+            if(isSelected(_sm.evaluate(_store, _context._functions))) {
+                return row;
+            }
+            row = _input->getNextRow();
+        }
+        return nullptr;
+    }
+
+    bool SelectOperatorNode::selectNextBatch()
+    {
+        // the input rows are only valid until the next one is read, so the rows of a batch are collected in a
+        // columnar block, the variables of the predicate are then appended to the batch column by column
+        _batchBlock->clear();
+        _batch.clear();
+        _selection.clear();
+        _selected = 0;
+
+        while(!_endOfInput && !_batchBlock->isFull()) {
+            const Values* row = _input->getNextRow();
+            if(!row) {
+                _endOfInput = true;
+                break;
+            }
+            _batchBlock->addRow(*row);
+        }
+        size_t rows = _batchBlock->getRowCount();
+        if(!rows) {
+            return false;
+        }
+        for(const auto& variable : _variableMapping) {
+            _batchBlock->appendTo(variable.second, 0, rows, _batch.getVariable(variable.first));
+        }
+        _batch.nextRows(rows);
+        _sm.selectBatch(_batch, _selection);
+        return true;
+    }
+
+    void SelectOperatorNode::cancel()
+    {
+        _input->cancel();
+    }
+
+    bool SelectOperatorNode::connect(const RowOperatorNodePtr& input)
+    {
+        _input = input;
+        _input->getColumnInfos(_inputSymbols);
+
+        for(const auto& variable : _expressionVariables) {
+            bool found = false;
+            for(size_t n = 0; !found && n < _inputSymbols.size(); ++n) {
+                const SymbolInfoPtr& info = _inputSymbols[n];
+
+                if((info->_identifier == variable._info->_name) || (info->_qualifiedIdentifier == variable._info->_name)) {
+                    _variableMapping.push_back(std::make_pair(getMapping(variable.getQualifiedIdentifier(), _mapping), n));
+                    found = true;
+                }
+            }
+            if(!found) {
+                CSVSQLDB_THROW(csvsqldb::Exception,
+                               "variable '" << variable.getQualifiedIdentifier() << "' not found in context");
+            }
+        }
+
+        StackMachine::VariableTypes types(_mapping.size(), NONE);
+        for(const auto& variable : _variableMapping) {
+            types[variable.first] = _inputSymbols[variable.second]->_type;
+        }
+        _sm.compile(types, _context._functions);
+        Types columnTypes;
+        for(const auto& info : _inputSymbols) {
+            columnTypes.push_back(info->_type);
+        }
+        _vectorized = _sm.isVectorizable() && _sm.getResultType() == BOOLEAN
+                      && std::find(columnTypes.begin(), columnTypes.end(), NONE) == columnTypes.end();
+        if(_vectorized) {
+            for(const auto& variable : _variableMapping) {
+                _batch.setVariableType(variable.first, types[variable.first]);
+            }
+            _batchBlock = std::make_shared<ColumnarBlock>(columnTypes, VariableBatch::MAX_ROWS);
+            _batchRows.reset(new ColumnarBlockIterator(ColumnarBlocks(1, _batchBlock)));
+        }
+
+        return true;
+    }
+
+    void SelectOperatorNode::getColumnInfos(SymbolInfos& outputSymbols)
+    {
+        remapOutputSymbols(_inputSymbols);
+        outputSymbols = _inputSymbols;
+    }
+
+    int64_t SelectOperatorNode::estimateRowCount()
+    {
+        // without statistics the selectivity of the predicate is unknown, so the input estimation is the upper bound
+        return _input->estimateRowCount();
+    }
+
+    bool SelectOperatorNode::isSortedBy(const IndexVector& columns)
+    {
+        return _input->isSortedBy(columns);
+    }
+
+    void SelectOperatorNode::dump(std::ostream& stream) const
+    {
+        stream << "SelectOperator\n";
         stream << "-->";
         _input->dump(stream);
     }
 
-
-    ScanOperatorNode::ScanOperatorNode(const OperatorContext& context, const SymbolTablePtr& symbolTable, const SymbolInfo& tableInfo)
-    : RowOperatorNode(context, symbolTable)
-    , _tableData(_context._database.getTable(tableInfo._identifier))
-    , _tableInfo(tableInfo)
+
+    ScanOperatorNode::ScanOperatorNode(const OperatorContext& context, const SymbolTablePtr& symbolTable, const SymbolInfo& tableInfo)
+    : RowOperatorNode(context, symbolTable)
+    , _tableData(_context._database.getTable(tableInfo._identifier))
+    , _tableInfo(tableInfo)
+    , _rowOrderRequired(true)
+    , _referencedColumns(_tableData.columnCount(), true)
+    {
+        for(size_t n = 0; n < _tableData.columnCount(); ++n) {
+            _types.push_back(_tableData.getColumn(n)._type);
+        }
+    }
+
+    void ScanOperatorNode::setReferencedColumns(const StringSet& columns)
+    {
+        _types.clear();
+        for(size_t n = 0; n < _tableData.columnCount(); ++n) {
+            _referencedColumns[n] = columns.find(_tableData.getColumn(n)._name) != columns.end();
+            if(_referencedColumns[n]) {
+                _types.push_back(_tableData.getColumn(n)._type);
+            }
+        }
+        if(_types.empty() && !_referencedColumns.empty()) {
+            // rows without any values cannot be iterated, so deliver the first column
+            _referencedColumns[0] = true;
+            _types.push_back(_tableData.getColumn(0)._type);
+        }
+    }
+
+    bool ScanOperatorNode::isSortedBy(const IndexVector& columns)
+    {
+        // a scan free to reorder the rows delivers them in any order
+        const StringVector& sortColumns = _tableData.sortColumns();
+        if(!_rowOrderRequired || columns.size() > sortColumns.size()) {
+            return false;
+        }
+        SymbolInfos symbols;
+        getColumnInfos(symbols);
+        for(size_t n = 0; n < columns.size(); ++n) {
+            if(columns[n] >= symbols.size() || symbols[columns[n]]->_identifier != sortColumns[n]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void ScanOperatorNode::getColumnInfos(SymbolInfos& outputSymbols)
+    {
+        outputSymbols.clear();
+
+        for(size_t n = 0; n < _tableData.columnCount(); ++n) {
+            if(_referencedColumns[n] && getSymbolTable().hasSymbolNameForTable(_tableInfo._name, _tableData.getColumn(n)._name)) {
+                const SymbolInfoPtr& info = getSymbolTable().findSymbolNameForTable(_tableInfo._name, _tableData.getColumn(n)._name);
+                outputSymbols.push_back(info);
+            }
+        }
+    }
+
+
+    SystemTableScanOperatorNode::SystemTableScanOperatorNode(const OperatorContext& context, const SymbolTablePtr& symbolTable, const SymbolInfo& tableInfo)
+    : ScanOperatorNode(context, symbolTable, tableInfo)
+    , _currentBlock(nullptr)
+    {
+    }
+
+    void SystemTableScanOperatorNode::dump(std::ostream& stream) const
+    {
+        stream << "SystemTableScanOperatorNode(" << _tableInfo._identifier << ")\n";
+    }
+
+    const Values* SystemTableScanOperatorNode::getNextRow()
+    {
+        if(!_currentBlock) {
+            _iterator = std::make_shared<BlockIterator>(_types, *this, _context._blockManager);
+        }
+        return _iterator->getNextRow();
+    }
+
+    int64_t SystemTableScanOperatorNode::estimateRowCount()
+    {
+        return 1;
+    }
+
+    BlockPtr SystemTableScanOperatorNode::getNextBlock()
+    {
+        _currentBlock = _context._blockManager.createBlock();
+
+        _currentBlock->addValue(Variant(false));
+        _currentBlock->nextRow();
+        _currentBlock->endBlocks();
+
+        return _currentBlock;
+    }
+
+
+    namespace
+    {
+        // maximal number of filled blocks per reading thread, that are not yet consumed
+        const size_t maxQueuedBlocks = 4;
+
+        // the readers of a scan hold at most a quarter of the memory budget, so that the operators above the scan get their
+        // blocks as well. Each reading thread holds its queued blocks and up to two blocks in construction.
+        size_t scanBlocks(const BlockManager& blockManager)
+        {
+            return blockManager.getMaxActiveBlocks() / 4;
+        }
+
+        uint16_t scanThreads(const BlockManager& blockManager, uint16_t numberOfThreads)
+        {
+            return static_cast<uint16_t>(std::max<size_t>(1, std::min<size_t>(numberOfThreads, scanBlocks(blockManager) / 3)));
+        }
+
+        size_t scanQueueDepth(const BlockManager& blockManager, uint16_t numberOfThreads)
+        {
+            size_t threadBlocks = scanBlocks(blockManager) / numberOfThreads;
+            return std::max<size_t>(1, std::min<size_t>(maxQueuedBlocks, threadBlocks > 2 ? threadBlocks - 2 : 0));
+        }
+    }
+
+    TableScanOperatorNode::TableScanOperatorNode(const OperatorContext& context, const SymbolTablePtr& symbolTable, const SymbolInfo& tableInfo)
+    : ScanOperatorNode(context, symbolTable, tableInfo)
+    , _blockReader(_context._blockManager, scanQueueDepth(_context._blockManager, 1))
+    , _rowBudget(-1)
+    , _cancelled(false)
+    {
+    }
+
+    const Values* TableScanOperatorNode::getNextRow()
+    {
+        if(_cancelled || _rowBudget == 0) {
+            return nullptr;
+        }
+        if(!_iterator) {
+            initializeBlockReader();
+        }
+
+        const Values* row = _iterator->getNextRow();
+        if(row && _rowBudget > 0 && --_rowBudget == 0) {
+            // the whole budget is delivered, so the files need not be read any further
+            cancel();
+        }
+        return row;
+    }
+
+    void TableScanOperatorNode::cancel()
+    {
+        if(_cancelled) {
+            return;
+        }
+        _cancelled = true;
+        if(_parallelBlockReader) {
+            _parallelBlockReader->cancel();
+        } else if(_blockReader.valid()) {
+            _blockReader.cancel();
+        }
+    }
+
+    bool TableScanOperatorNode::pushDownLimit(int64_t rows)
+    {
+        _rowBudget = rows;
+        return true;
+    }
+
+    int64_t TableScanOperatorNode::estimateRowCount()
+    {
+        // the row width is sampled from the start of each file and extrapolated to the file size. Only regular files
+        // are sampled, reading from a pipe or a device would consume the input the scan needs later.
+        const size_t sampleSize = 64 * 1024;
+        std::vector<char> sample(sampleSize);
+        int64_t rows = 0;
+        for(const auto& file : getTableFiles()) {
+            boost::system::error_code ec;
+            if(!fs::is_regular_file(file, ec)) {
+                return -1;
+            }
+            int64_t size = static_cast<int64_t>(fs::file_size(file, ec));
+            std::ifstream stream(file, std::ios::binary);
+            if(ec || !stream) {
+                return -1;
+            }
+            stream.read(&sample[0], sampleSize);
+            std::streamsize bytes = stream.gcount();
+            int64_t lines = std::count(sample.begin(), sample.begin() + bytes, '\n');
+            if(bytes > 0 && sample[bytes - 1] != '\n') {
+                ++lines;
+            }
+            if(lines > 1) {
+                // the first line is the header line
+                rows += static_cast<int64_t>(static_cast<double>(size) / bytes * lines) - 1;
+            }
+        }
+        return rows;
+    }
+
+    BlockBuilder::BlockBuilder(BlockManager& blockManager, BlockSink sink)
+    : _blockManager(blockManager)
+    , _sink(sink)
+    , _block(_blockManager.createBlock())
+    , _rowStart(0)
+    , _column(0)
+    , _constantColumn(std::string::npos)
+    , _filterRows(false)
+    , _rowCount(0)
+    , _output(nullptr)
+    {
+    }
+
+    BlockBuilder::~BlockBuilder()
+    {
+        _blockManager.release(_block);
+        _blockManager.release(_output);
+    }
+
+    void BlockBuilder::nextRow()
+    {
+        // the constant is the last column of the row, or the only one, if all fields of the line are skipped
+        if(_column == _constantColumn) {
+            addConstant();
+        }
+        _column = 0;
+        _block->nextRow();
+        _rowStart = _block->offset();
+        if(_filterRows) {
+            _rows[_rowCount++].swap(_row);
+            _row.clear();
+            if(_rowCount == _rows.size()) {
+                // all rows of the staging block are filtered, so it can be reused
+                filterRows();
+                _block->rewind(0);
+                _rowStart = 0;
+            }
+        }
+    }
+
+    void BlockBuilder::finish(bool lastBlock)
+    {
+        if(_filterRows) {
+            filterRows();
+            _blockManager.release(_block);
+            _block = _output;
+            _output = nullptr;
+        }
+        if(lastBlock) {
+            _block->endBlocks();
+        } else if(_block->offset() == 0) {
+            _blockManager.release(_block);
+            return;
+        } else {
+            _block->markNextBlock();
+        }
+        _sink(_block, true);
+        _block = nullptr;
+    }
+
+    void BlockBuilder::setConstantColumn(size_t column, const std::string& value)
+    {
+        _constantColumn = column;
+        _constantValue = value;
+    }
+
+    void BlockBuilder::setRowFilter(RowFilter filter)
+    {
+        _rowFilter = filter;
+        _filterRows = static_cast<bool>(_rowFilter);
+        if(_filterRows && !_output) {
+            _rows.resize(VariableBatch::MAX_ROWS);
+            _output = _blockManager.createBlock();
+        }
+    }
+
+    void BlockBuilder::nextColumn()
+    {
+        if(_column == _constantColumn) {
+            addConstant();
+            ++_column;
+        }
+        ++_column;
+    }
+
+    void BlockBuilder::addConstant()
+    {
+        Value* value = _block->addString(_constantValue.c_str(), _constantValue.size(), false);
+        if(!value) {
+            flush();
+            value = _block->addString(_constantValue.c_str(), _constantValue.size(), false);
+        }
+        rememberValue(value);
+    }
+
+    void BlockBuilder::flush()
+    {
+        if(_filterRows) {
+            if(_rowStart == 0) {
+                CSVSQLDB_THROW(csvsqldb::Exception, "row does not fit into a block, so it cannot be filtered");
+            }
+            // the completed rows are filtered and the incomplete row is moved into a new staging block
+            BlockPtr staging = _block;
+            _block = _blockManager.createBlock();
+            _rowStart = 0;
+            for(auto& value : _row) {
+                value = _block->addValue(*value);
+            }
+            try {
+                filterRows();
+            } catch(...) {
+                _blockManager.release(staging);
+                throw;
+            }
+            _blockManager.release(staging);
+            return;
+        }
+        // the next block is created before the filled one is handed over, so the builder still owns the filled block
+        // if the memory budget is exhausted
+        BlockPtr block = _blockManager.createBlock();
+        bool rowComplete = _block->offset() == _rowStart;
+        _block->markNextBlock();
+        _sink(_block, rowComplete);
+        _block = block;
+        // the row start is unknown in the new block, if the current row continues there
+        _rowStart = rowComplete ? 0 : std::numeric_limits<size_t>::max();
+    }
+
+    void BlockBuilder::filterRows()
+    {
+        if(!_rowCount) {
+            return;
+        }
+        _rowFilter(_rows, _rowCount, _selection);
+        for(const auto row : _selection) {
+            copyRow(_rows[row]);
+        }
+        for(size_t n = 0; n < _rowCount; ++n) {
+            _rows[n].clear();
+        }
+        _rowCount = 0;
+    }
+
+    void BlockBuilder::copyRow(const Values& row)
+    {
+        size_t rowStart = _output->offset();
+        for(const auto value : row) {
+            if(!_output->addValue(*value)) {
+                if(rowStart == 0) {
+                    CSVSQLDB_THROW(csvsqldb::Exception, "row does not fit into a block");
+                }
+                _output->rewind(rowStart);
+                _output->markNextBlock();
+                BlockPtr block = _blockManager.createBlock();
+                _sink(_output, true);
+                _output = block;
+                copyRow(row);
+                return;
+            }
+        }
+        _output->nextRow();
+    }
+
+    void BlockBuilder::onLong(int64_t num, bool isNull)
+    {
+        nextColumn();
+        Value* value = _block->addInt(num, isNull);
+        if(!value) {
+            flush();
+            value = _block->addInt(num, isNull);
+        }
+        rememberValue(value);
+    }
+
+    void BlockBuilder::onDouble(double num, bool isNull)
+    {
+        nextColumn();
+        Value* value = _block->addReal(num, isNull);
+        if(!value) {
+            flush();
+            value = _block->addReal(num, isNull);
+        }
+        rememberValue(value);
+    }
+
+    void BlockBuilder::onString(const char* s, size_t len, bool isNull)
     {
-        for(size_t n = 0; n < _tableData.columnCount(); ++n) {
-            _types.push_back(_tableData.getColumn(n)._type);
+        nextColumn();
+        Value* value = _block->addString(s, len, isNull);
+        if(!value) {
+            flush();
+            value = _block->addString(s, len, isNull);
         }
+        rememberValue(value);
     }
 
-    void ScanOperatorNode::getColumnInfos(SymbolInfos& outputSymbols)
+    void BlockBuilder::onDate(const csvsqldb::Date& date, bool isNull)
     {
-        outputSymbols.clear();
+        nextColumn();
+        Value* value = _block->addDate(date, isNull);
+        if(!value) {
+            flush();
+            value = _block->addDate(date, isNull);
+        }
+        rememberValue(value);
+    }
 
-        for(size_t n = 0; n < _tableData.columnCount(); ++n) {
-            if(getSymbolTable().hasSymbolNameForTable(_tableInfo._name, _tableData.getColumn(n)._name)) {
-                const SymbolInfoPtr& info = getSymbolTable().findSymbolNameForTable(_tableInfo._name, _tableData.getColumn(n)._name);
-                outputSymbols.push_back(info);
-            }
+    void BlockBuilder::onTime(const csvsqldb::Time& time, bool isNull)
+    {
+        nextColumn();
+        Value* value = _block->addTime(time, isNull);
+        if(!value) {
+            flush();
+            value = _block->addTime(time, isNull);
         }
+        rememberValue(value);
     }
 
+    void BlockBuilder::onTimestamp(const csvsqldb::Timestamp& timestamp, bool isNull)
+    {
+        nextColumn();
+        Value* value = _block->addTimestamp(timestamp, isNull);
+        if(!value) {
+            flush();
+            value = _block->addTimestamp(timestamp, isNull);
+        }
+        rememberValue(value);
+    }
 
-    SystemTableScanOperatorNode::SystemTableScanOperatorNode(const OperatorContext& context, const SymbolTablePtr& symbolTable, const SymbolInfo& tableInfo)
-    : ScanOperatorNode(context, symbolTable, tableInfo)
-    , _currentBlock(nullptr)
+    void BlockBuilder::onBoolean(bool boolean, bool isNull)
     {
+        nextColumn();
+        Value* value = _block->addBool(boolean, isNull);
+        if(!value) {
+            flush();
+            value = _block->addBool(boolean, isNull);
+        }
+        rememberValue(value);
     }
 
-    void SystemTableScanOperatorNode::dump(std::ostream& stream) const
+
+
+    BlockReader::BlockReader(BlockManager& blockManager, size_t queueDepth)
+    : _blockManager(blockManager)
+    , _blockBuilder(blockManager, std::bind(&BlockReader::pushBlock, this, std::placeholders::_1, std::placeholders::_2))
+    , _blocks(queueDepth)
     {
-        stream << "SystemTableScanOperatorNode(" << _tableInfo._identifier << ")\n";
     }
 
-    const Values* SystemTableScanOperatorNode::getNextRow()
+    BlockReader::~BlockReader()
     {
-        if(!_currentBlock) {
-            _iterator = std::make_shared<BlockIterator>(_types, *this, _context._blockManager);
+        cancel();
+        BlockPtr block = nullptr;
+        while(_blocks.tryPop(block)) {
+            _blockManager.release(block);
         }
-        return _iterator->getNextRow();
     }
 
-    BlockPtr SystemTableScanOperatorNode::getNextBlock()
+    void BlockReader::initialize(CSVParserPtr csvparser)
     {
-        _currentBlock = _context._blockManager.createBlock();
+        _csvparser = csvparser;
+        _readThread = std::thread(std::bind(&BlockReader::readBlocks, this));
+    }
 
-        _currentBlock->addValue(Variant(false));
-        _currentBlock->nextRow();
-        _currentBlock->endBlocks();
+    void BlockReader::initialize(RowReader rowReader)
+    {
+        _rowReader = rowReader;
+        _readThread = std::thread(std::bind(&BlockReader::readBlocks, this));
+    }
 
-        return _currentBlock;
+    BlockPtr BlockReader::getNextBlock()
+    {
+        BlockPtr block = nullptr;
+        if(!_blocks.pop(block) && _error) {
+            std::rethrow_exception(_error);
+        }
+        return block;
     }
 
+    void BlockReader::cancel()
+    {
+        _blocks.close();
+        if(_readThread.joinable()) {
+            _readThread.join();
+        }
+    }
 
-    TableScanOperatorNode::TableScanOperatorNode(const OperatorContext& context, const SymbolTablePtr& symbolTable, const SymbolInfo& tableInfo)
-    : ScanOperatorNode(context, symbolTable, tableInfo)
-    , _blockReader(_context._blockManager)
+    void BlockReader::readBlocks()
     {
+        try {
+            if(_rowReader) {
+                while(!_blocks.isClosed() && _rowReader()) {
+                    _blockBuilder.nextRow();
+                }
+            } else {
+                bool moreLines = true;
+                while(!_blocks.isClosed() && moreLines) {
+                    moreLines = _csvparser->parseLine();
+                    if(_csvparser->hasParsedLine()) {
+                        _blockBuilder.nextRow();
+                    }
+                }
+            }
+            _blockBuilder.finish(true);
+        } catch(const std::exception&) {
+            _error = std::current_exception();
+        }
+        _blocks.close();
     }
 
-    const Values* TableScanOperatorNode::getNextRow()
+    void BlockReader::pushBlock(BlockPtr block, bool)
     {
-        if(!_blockReader.valid()) {
-            initializeBlockReader();
+        // the reader parks while the queue is full, as it is usually much faster than the consumer of the blocks
+        if(!_blocks.push(block)) {
+            _blockManager.release(block);
         }
+    }
 
-        return _iterator->getNextRow();
+
+    namespace
+    {
+        // minimal size of a chunk, smaller chunks would not pay off the scheduling overhead
+        const size_t minChunkSize = 1024 * 1024;
+
+        size_t findLineStart(const char* data, size_t length, size_t pos)
+        {
+            while(pos < length && data[pos] != '\n' && data[pos] != '\r') {
+                ++pos;
+            }
+            if(pos < length && data[pos] == '\r') {
+                ++pos;
+            }
+            if(pos < length && data[pos] == '\n') {
+                ++pos;
+            }
+            return pos;
+        }
     }
 
+    namespace
+    {
+        class PredicateRowFilter
+        {
+        public:
+            PredicateRowFilter(const Expressions& predicates,
+                               const std::map<std::string, size_t>& columns,
+                               const Types& columnTypes,
+                               const FunctionRegistry& functions)
+            : _vectorized(false)
+            , _functions(functions)
+            {
+                StackMachine::VariableMapping mapping;
+                ASTInstructionStackVisitor visitor(_sm, mapping);
+                for(size_t n = 0; n < predicates.size(); ++n) {
+                    predicates[n]->accept(visitor);
+                    if(n > 0) {
+                        _sm.addInstruction(StackMachine::Instruction(StackMachine::AND));
+                    }
+                }
+                for(const auto& variable : mapping) {
+                    auto iter = columns.find(variable.first);
+                    if(iter == columns.end()) {
+                        CSVSQLDB_THROW(csvsqldb::Exception, "variable '" << variable.first << "' not found in context");
+                    }
+                    _variableMapping.push_back(std::make_pair(variable.second, iter->second));
+                }
+
+                // compiled from the declared column types, so that NULL values in the first rows do not matter
+                StackMachine::VariableTypes types(mapping.size(), NONE);
+                for(const auto& variable : _variableMapping) {
+                    types[variable.first] = columnTypes[variable.second];
+                }
+                _sm.compile(types, functions);
+                _vectorized = _sm.isVectorizable() && _sm.getResultType() == BOOLEAN;
+                if(_vectorized) {
+                    for(const auto& variable : _variableMapping) {
+                        _batch.setVariableType(variable.first, types[variable.first]);
+                    }
+                }
+            }
+
+            void operator()(const std::vector<Values>& rows, size_t count, StackMachine::SelectionVector& selection)
+            {
+                if(_vectorized) {
+                    _batch.clear();
+                    for(size_t n = 0; n < count; ++n) {
+                        for(const auto& variable : _variableMapping) {
+                            _batch.addValue(variable.first, *rows[n][variable.second]);
+                        }
+                        _batch.nextRow();
+                    }
+                    _sm.selectBatch(_batch, selection);
+                    return;
+                }
+
+                selection.clear();
+                for(size_t n = 0; n < count; ++n) {
+                    for(const auto& variable : _variableMapping) {
+                        _store.addVariable(variable.first, valueToVariant(*rows[n][variable.second]));
+                    }
+                    if(isSelected(_sm.evaluate(_store, _functions))) {
+                        selection.push_back(static_cast<uint32_t>(n));
+                    }
+                }
+            }
+
+        private:
+            StackMachine _sm;
+            bool _vectorized;
+            VariableBatch _batch;
+            VariableStore _store;
+            std::vector<std::pair<size_t, size_t>> _variableMapping;
+            const FunctionRegistry& _functions;
+        };
+    }
 
-    BlockReader::BlockReader(BlockManager& blockManager)
+    ParallelBlockReader::ParallelBlockReader(BlockManager& blockManager, uint16_t numberOfThreads, bool ordered, size_t queueDepth)
     : _blockManager(blockManager)
-    , _block(_blockManager.createBlock())
+    , _numberOfThreads(numberOfThreads)
+    , _ordered(ordered)
+    , _queueDepth(queueDepth)
+    , _nameColumn(std::string::npos)
+    , _currentChunk(0)
+    , _finishedChunks(0)
     , _continue(true)
+    , _threadPool(numberOfThreads)
     {
     }
 
-    BlockReader::~BlockReader()
+    ParallelBlockReader::~ParallelBlockReader()
     {
-        _continue = false;
-        if(_readThread.joinable()) {
-            _readThread.join();
+        cancel();
+
+        for(auto& chunk : _chunks) {
+            while(!chunk._blocks.empty()) {
+                _blockManager.release(chunk._blocks.front());
+                chunk._blocks.pop();
+            }
+            for(auto& block : chunk._pendingBlocks) {
+                _blockManager.release(block);
+            }
+        }
+        while(!_blocks.empty()) {
+            _blockManager.release(_blocks.front());
+            _blocks.pop();
         }
     }
 
-    void BlockReader::initialize(CSVParserPtr csvparser)
+    void ParallelBlockReader::addInput(const char* data, size_t length, const std::string& name)
     {
-        _csvparser = csvparser;
-        _readThread = std::thread(std::bind(&BlockReader::readBlocks, this));
+        _inputs.emplace_back(data, length, nullptr, name);
     }
 
-    BlockPtr BlockReader::getNextBlock()
+    void ParallelBlockReader::addInput(std::istream& stream, const std::string& name)
     {
-        std::unique_lock<std::mutex> lk(_queueMutex);
-        if(_blocks.empty() && !_block) {
-            return nullptr;
+        _inputs.emplace_back(nullptr, 0, &stream, name);
+    }
+
+    void ParallelBlockReader::initialize(const csvsqldb::csv::CSVParserContext& context,
+                                         const csvsqldb::csv::Types& types,
+                                         size_t nameColumn)
+    {
+        _context = context;
+        _types = types;
+        _nameColumn = nameColumn;
+
+        size_t totalLength = 0;
+        for(const auto& input : _inputs) {
+            totalLength += input._length;
         }
-        _cv.wait(lk, [this] { return !_blocks.empty(); });
+        size_t chunkSize = std::max(totalLength / (4 * _numberOfThreads), minChunkSize);
 
-        BlockPtr block = nullptr;
-        if(!_blocks.empty()) {
-            block = _blocks.front();
-            _blocks.pop();
+        for(const auto& input : _inputs) {
+            if(input._stream) {
+                _chunks.emplace_back(&input, nullptr, 0);
+                continue;
+            }
+            const char* data = input._data;
+            size_t length = input._length;
+            size_t begin = _context._skipFirstLine ? findLineStart(data, length, 0) : 0;
+            while(begin < length) {
+                size_t end = begin + chunkSize < length ? findLineStart(data, length, begin + chunkSize) : length;
+                _chunks.emplace_back(&input, data + begin, end - begin);
+                begin = end;
+            }
         }
 
-        return block;
+        if(_rowFilterFactory) {
+            // the filters are created before the workers start, so that they are not copied concurrently
+            for(auto& chunk : _chunks) {
+                chunk._rowFilter = _rowFilterFactory();
+            }
+        }
+
+        _threadPool.start();
+        for(auto& chunk : _chunks) {
+            _threadPool.enqueueTask(std::bind(&ParallelBlockReader::readChunk, this, std::ref(chunk)));
+        }
     }
 
-    void BlockReader::readBlocks()
+    BlockPtr ParallelBlockReader::getNextBlock()
     {
-        bool moreLines = _csvparser->parseLine();
-        _block->nextRow();
-
-        while(_continue && moreLines) {
-            moreLines = _csvparser->parseLine();
-            _block->nextRow();
+        std::unique_lock<std::mutex> lk(_queueMutex);
+        for(;;) {
+            if(_error) {
+                std::rethrow_exception(_error);
+            }
+            std::queue<BlockPtr>* blocks = &_blocks;
+            if(_ordered) {
+                while(_currentChunk < _chunks.size() && _chunks[_currentChunk]._finished && _chunks[_currentChunk]._blocks.empty()) {
+                    ++_currentChunk;
+                }
+                if(_currentChunk == _chunks.size()) {
+                    break;
+                }
+                blocks = &_chunks[_currentChunk]._blocks;
+            } else if(_blocks.empty() && _finishedChunks == _chunks.size()) {
+                break;
+            }
+            if(!blocks->empty()) {
+                BlockPtr block = blocks->front();
+                blocks->pop();
+                lk.unlock();
+                _cv.notify_all();
+                return block;
+            }
+            _cv.wait(lk);
         }
+        lk.unlock();
+
+        // all chunks are consumed, so terminate the chain of blocks
+        BlockPtr block = _blockManager.createBlock();
+        block->endBlocks();
+        return block;
+    }
+
+    void ParallelBlockReader::cancel()
+    {
         {
             std::unique_lock<std::mutex> lk(_queueMutex);
-            _block->endBlocks();
-            _blocks.push(_block);
-            _block = nullptr;
+            _continue = false;
         }
         _cv.notify_all();
+        _threadPool.stop();
     }
 
-    void BlockReader::onLong(int64_t num, bool isNull)
+    void ParallelBlockReader::readChunk(Chunk& chunk)
     {
-        if(!_block->addInt(num, isNull)) {
+        try {
+            BlockBuilder blockBuilder(_blockManager,
+                                      std::bind(&ParallelBlockReader::pushBlock, this, std::ref(chunk), std::placeholders::_1, std::placeholders::_2));
+            if(_nameColumn != std::string::npos) {
+                blockBuilder.setConstantColumn(_nameColumn, chunk._input->_name);
+            }
+            if(chunk._rowFilter) {
+                blockBuilder.setRowFilter(chunk._rowFilter);
+            }
+            std::unique_ptr<csvsqldb::csv::CSVParser> csvparser;
+            if(chunk._input->_stream) {
+                csvparser.reset(new csvsqldb::csv::CSVParser(_context, *chunk._input->_stream, _types, blockBuilder));
+            } else {
+                // the header line was already skipped when splitting the input into chunks
+                csvsqldb::csv::CSVParserContext context = _context;
+                context._skipFirstLine = false;
+                csvparser.reset(new csvsqldb::csv::CSVParser(context, chunk._data, chunk._length, _types, blockBuilder));
+            }
+
+            bool moreLines = true;
+            while(_continue && moreLines) {
+                moreLines = csvparser->parseLine();
+                if(csvparser->hasParsedLine()) {
+                    blockBuilder.nextRow();
+                }
+            }
+            blockBuilder.finish(false);
+        } catch(const std::exception&) {
             std::unique_lock<std::mutex> lk(_queueMutex);
-            _block->markNextBlock();
-            _blocks.push(_block);
-            _cv.notify_all();
-            _block = _blockManager.createBlock();
-            _block->addInt(num, isNull);
+            if(!_error) {
+                _error = std::current_exception();
+            }
         }
-    }
-
-    void BlockReader::onDouble(double num, bool isNull)
-    {
-        if(!_block->addReal(num, isNull)) {
+        {
             std::unique_lock<std::mutex> lk(_queueMutex);
-            _block->markNextBlock();
-            _blocks.push(_block);
-            _cv.notify_all();
-            _block = _blockManager.createBlock();
-            _block->addReal(num, isNull);
+            chunk._finished = true;
+            ++_finishedChunks;
         }
+        _cv.notify_all();
     }
 
-    void BlockReader::onString(const char* s, size_t len, bool isNull)
+    void ParallelBlockReader::pushBlock(Chunk& chunk, BlockPtr block, bool rowComplete)
     {
-        if(!_block->addString(s, len, isNull)) {
-            std::unique_lock<std::mutex> lk(_queueMutex);
-            _block->markNextBlock();
-            _blocks.push(_block);
-            _cv.notify_all();
-            _block = _blockManager.createBlock();
-            _block->addString(s, len, isNull);
+        std::unique_lock<std::mutex> lk(_queueMutex);
+        if(_ordered) {
+            // throttle the workers, as they are usually much faster than the consumer of the blocks
+            _cv.wait(lk, [&] { return !_continue || chunk._blocks.size() < _queueDepth; });
+            chunk._blocks.push(block);
+        } else {
+            // a row continued in the next block must not be interleaved with blocks of other chunks, so blocks are only
+            // published together with the block completing the row
+            chunk._pendingBlocks.push_back(block);
+            if(!rowComplete) {
+                return;
+            }
+            _cv.wait(lk, [&] { return !_continue || _blocks.size() < _queueDepth * _numberOfThreads; });
+            for(auto pendingBlock : chunk._pendingBlocks) {
+                _blocks.push(pendingBlock);
+            }
+            chunk._pendingBlocks.clear();
         }
+        lk.unlock();
+        _cv.notify_all();
     }
 
-    void BlockReader::onDate(const csvsqldb::Date& date, bool isNull)
+
+    bool TableScanOperatorNode::pushDownPredicate(const ASTExprNodePtr& predicate)
     {
-        if(!_block->addDate(date, isNull)) {
-            std::unique_lock<std::mutex> lk(_queueMutex);
-            _block->markNextBlock();
-            _blocks.push(_block);
-            _cv.notify_all();
-            _block = _blockManager.createBlock();
-            _block->addDate(date, isNull);
+        IdentifierSet identifiers;
+        ASTReferencedIdentifierVisitor visitor(identifiers);
+        predicate->accept(visitor);
+
+        bool fileNameOnly = !identifiers.empty();
+        for(const auto& identifier : identifiers) {
+            fileNameOnly = fileNameOnly && csvsqldb::toupper_copy(identifier._info->_identifier) == "SYSTEM_FILENAME";
         }
+        // predicates on the file name alone are evaluated once per file instead of once per row
+        if(fileNameOnly) {
+            _filePredicates.push_back(predicate);
+        } else {
+            _predicates.push_back(predicate);
+        }
+        return true;
     }
 
-    void BlockReader::onTime(const csvsqldb::Time& time, bool isNull)
+    csvsqldb::StringVector TableScanOperatorNode::getTableFiles()
     {
-        if(!_block->addTime(time, isNull)) {
-            std::unique_lock<std::mutex> lk(_queueMutex);
-            _block->markNextBlock();
-            _blocks.push(_block);
-            _cv.notify_all();
-            _block = _blockManager.createBlock();
-            _block->addTime(time, isNull);
+        Mapping mapping = _context._database.getMappingForTable(_tableInfo._identifier);
+        std::string filePattern = mapping._mapping;
+        filePattern = R"(.*)" + filePattern;
+        boost::regex r(filePattern);
+
+        csvsqldb::StringVector csvFiles;
+        for(const auto& file : _context._files) {
+            boost::smatch match;
+            if(regex_match(file, match, r)) {
+                csvFiles.push_back(file);
+            }
+        }
+        if(csvFiles.empty()) {
+            CSVSQLDB_THROW(MappingException, "no file found for mapping '" << filePattern << "'");
         }
+        csvFiles.erase(std::remove_if(csvFiles.begin(), csvFiles.end(), [this](const std::string& file) { return !isFileSelected(file); }),
+                       csvFiles.end());
+        return csvFiles;
     }
 
-    void BlockReader::onTimestamp(const csvsqldb::Timestamp& timestamp, bool isNull)
+    bool TableScanOperatorNode::isFileSelected(const std::string& file) const
     {
-        if(!_block->addTimestamp(timestamp, isNull)) {
-            std::unique_lock<std::mutex> lk(_queueMutex);
-            _block->markNextBlock();
-            _blocks.push(_block);
-            _cv.notify_all();
-            _block = _blockManager.createBlock();
-            _block->addTimestamp(timestamp, isNull);
+        if(_filePredicates.empty()) {
+            return true;
         }
+        IdentifierSet identifiers;
+        ASTReferencedIdentifierVisitor visitor(identifiers);
+        for(const auto& predicate : _filePredicates) {
+            predicate->accept(visitor);
+        }
+        ColumnIndices columns;
+        for(const auto& identifier : identifiers) {
+            columns[identifier.getQualifiedIdentifier()] = 0;
+        }
+
+        // the value takes the ownership of the string
+        char* name = new char[file.size() + 1];
+        ::memcpy(name, file.c_str(), file.size() + 1);
+        ValString fileName(name, file.size());
+        std::vector<Values> rows(1, Values(1, &fileName));
+        StackMachine::SelectionVector selection;
+        PredicateRowFilter filter(_filePredicates, columns, Types(1, STRING), _context._functions);
+        filter(rows, rows.size(), selection);
+        return !selection.empty();
     }
 
-    void BlockReader::onBoolean(bool boolean, bool isNull)
+    BlockBuilder::RowFilter TableScanOperatorNode::createRowFilter() const
     {
-        if(!_block->addBool(boolean, isNull)) {
-            std::unique_lock<std::mutex> lk(_queueMutex);
-            _block->markNextBlock();
-            _blocks.push(_block);
-            _cv.notify_all();
-            _block = _blockManager.createBlock();
-            _block->addBool(boolean, isNull);
-        }
+        // a copy of the compiled filter, as the stack machine cannot be shared between the reading threads
+        return _rowFilter;
     }
 
-
     BlockPtr TableScanOperatorNode::getNextBlock()
     {
+        if(_parallelBlockReader) {
+            return _parallelBlockReader->getNextBlock();
+        }
         return _blockReader.getNextBlock();
     }
 
     void TableScanOperatorNode::initializeBlockReader()
     {
-        _iterator = std::make_shared<BlockIterator>(_types, *this, getBlockManager());
-
         csvsqldb::csv::Types types;
-        for(auto& type : _types) {
-            switch(type) {
+        size_t fileNameColumn = std::string::npos;
+        size_t column = 0;
+        for(size_t n = 0; n < _tableData.columnCount(); ++n) {
+            if(csvsqldb::toupper_copy(_tableData.getColumn(n)._name) == "SYSTEM_FILENAME") {
+                // virtual column, that is not part of the csv file
+                if(_referencedColumns[n]) {
+                    fileNameColumn = column++;
+                }
+                continue;
+            }
+            if(!_referencedColumns[n]) {
+                types.push_back(csvsqldb::csv::SKIP);
+                continue;
+            }
+            ++column;
+            switch(_tableData.getColumn(n)._type) {
                 case INT:
                     types.push_back(csvsqldb::csv::LONG);
                     break;
@@ -1461,37 +3363,131 @@ namespace csvsqldb
         }
 
         Mapping mapping = _context._database.getMappingForTable(_tableInfo._identifier);
-        std::string filePattern = mapping._mapping;
-        filePattern = R"(.*)" + filePattern;
-        boost::regex r(filePattern);
+        csvsqldb::StringVector csvFiles = getTableFiles();
 
-        fs::path pathToCsvFile("");
-
-        for(const auto& file : _context._files) {
-            boost::smatch match;
-            if(regex_match(file, match, r)) {
-                pathToCsvFile = file;
-                break;
+        if(!_predicates.empty()) {
+            IdentifierSet identifiers;
+            ASTReferencedIdentifierVisitor visitor(identifiers);
+            for(const auto& predicate : _predicates) {
+                predicate->accept(visitor);
+            }
+            SymbolInfos columns;
+            getColumnInfos(columns);
+            for(const auto& identifier : identifiers) {
+                for(size_t n = 0; n < columns.size(); ++n) {
+                    if(columns[n]->_identifier == identifier._info->_name || columns[n]->_qualifiedIdentifier == identifier._info->_name) {
+                        _predicateColumns[identifier.getQualifiedIdentifier()] = n;
+                        break;
+                    }
+                }
             }
+            Types columnTypes;
+            for(const auto& info : columns) {
+                columnTypes.push_back(info->_type);
+            }
+            _rowFilter = PredicateRowFilter(_predicates, _predicateColumns, columnTypes, _context._functions);
         }
-        if(pathToCsvFile.string().empty()) {
-            CSVSQLDB_THROW(MappingException, "no file found for mapping '" << filePattern << "'");
+
+        _csvContext._skipFirstLine = true;
+        _csvContext._delimiter = mapping._delimiter;
+
+        for(const auto& file : csvFiles) {
+            MemoryMappedFilePtr mappedFile = std::make_shared<csvsqldb::MemoryMappedFile>(file, csvsqldb::MemoryMappedFile::SEQUENTIAL);
+            if(mappedFile->isMapped()) {
+                _mappedFiles.push_back(mappedFile);
+                _streams.push_back(nullptr);
+                continue;
+            }
+            // not mappable (e.g. a pipe or an empty file), so fall back to stream based input
+            _mappedFiles.push_back(nullptr);
+            _streams.push_back(std::make_shared<std::ifstream>(file, std::ios_base::in | std::ios_base::binary));
+            if(_streams.back()->fail()) {
+                std::cerr << csvsqldb::errnoText() << std::endl;
+                CSVSQLDB_THROW(csvsqldb::FilesystemException, "could not open file '" << file << "'");
+            }
         }
 
-        _stream = std::make_shared<std::fstream>(pathToCsvFile.string());
-        if(!_stream || _stream->fail()) {
-            std::cerr << csvsqldb::errnoText() << std::endl;
-            CSVSQLDB_THROW(csvsqldb::FilesystemException, "could not open file '" << pathToCsvFile << "'");
+        std::vector<BinaryRowParserPtr> binaryParsers;
+        for(size_t n = 0; n < csvFiles.size(); ++n) {
+            bool binary = _mappedFiles[n] ? BinaryRowParser::isBinaryRowStream(_mappedFiles[n]->data(), _mappedFiles[n]->size())
+                                          : BinaryRowParser::isBinaryRowStream(*_streams[n]);
+            if(n > 0 && binary != !binaryParsers.empty()) {
+                CSVSQLDB_THROW(csvsqldb::Exception, "the files of table " << _tableInfo._identifier << " mix csv and binary row streams");
+            }
+            if(!binary) {
+                continue;
+            }
+            if(_mappedFiles[n]) {
+                binaryParsers.push_back(std::make_shared<BinaryRowParser>(_mappedFiles[n]->data(),
+                                                                          _mappedFiles[n]->size(),
+                                                                          types,
+                                                                          _blockReader.callback()));
+            } else {
+                binaryParsers.push_back(std::make_shared<BinaryRowParser>(*_streams[n], types, _blockReader.callback()));
+            }
         }
 
-        _csvContext._skipFirstLine = true;
-        _csvContext._delimiter = mapping._delimiter;
-        _csvparser = std::make_shared<csvsqldb::csv::CSVParser>(_csvContext, *_stream, types, _blockReader);
-        _blockReader.initialize(_csvparser);
+        if(!binaryParsers.empty()) {
+            // binary row streams are already typed, so they are simply read one after the other by a single thread
+            BlockBuilder& builder = _blockReader.builder();
+            if(!_predicates.empty()) {
+                builder.setRowFilter(createRowFilter());
+            }
+            if(fileNameColumn != std::string::npos) {
+                builder.setConstantColumn(fileNameColumn, csvFiles[0]);
+            }
+            size_t current = 0;
+            _blockReader.initialize([binaryParsers, csvFiles, fileNameColumn, &builder, current]() mutable {
+                while(current < binaryParsers.size()) {
+                    if(binaryParsers[current]->parseRow()) {
+                        return true;
+                    }
+                    if(++current < binaryParsers.size() && fileNameColumn != std::string::npos) {
+                        builder.setConstantColumn(fileNameColumn, csvFiles[current]);
+                    }
+                }
+                return false;
+            });
+        } else if(csvFiles.size() != 1 || _context._numberOfThreads > 1 || fileNameColumn != std::string::npos || !_predicates.empty()) {
+            // the files are read by a bounded number of threads, mapped files are additionally split into chunks
+            uint16_t threads = scanThreads(_context._blockManager, _context._numberOfThreads);
+            _parallelBlockReader = std::make_shared<ParallelBlockReader>(
+            _context._blockManager, threads, _rowOrderRequired, scanQueueDepth(_context._blockManager, threads));
+            if(!_predicates.empty()) {
+                _parallelBlockReader->setRowFilterFactory(std::bind(&TableScanOperatorNode::createRowFilter, this));
+            }
+            for(size_t n = 0; n < csvFiles.size(); ++n) {
+                if(_mappedFiles[n]) {
+                    _parallelBlockReader->addInput(_mappedFiles[n]->data(), _mappedFiles[n]->size(), csvFiles[n]);
+                } else {
+                    _parallelBlockReader->addInput(*_streams[n], csvFiles[n]);
+                }
+            }
+            _parallelBlockReader->initialize(_csvContext, types, fileNameColumn);
+        } else {
+            if(_mappedFiles[0]) {
+                _csvparser = std::make_shared<csvsqldb::csv::CSVParser>(_csvContext,
+                                                                        _mappedFiles[0]->data(),
+                                                                        _mappedFiles[0]->size(),
+                                                                        types,
+                                                                        _blockReader.callback());
+            } else {
+                _csvparser = std::make_shared<csvsqldb::csv::CSVParser>(_csvContext, *_streams[0], types, _blockReader.callback());
+            }
+            _blockReader.initialize(_csvparser);
+        }
+        _iterator = std::make_shared<BlockIterator>(_types, *this, getBlockManager());
     }
 
     void TableScanOperatorNode::dump(std::ostream& stream) const
     {
-        stream << "TableScanOperator (" << _tableInfo._identifier << ")\n";
+        stream << "TableScanOperator (" << _tableInfo._identifier << ")";
+        if(!_predicates.empty() || !_filePredicates.empty()) {
+            stream << " with pushed down predicates";
+        }
+        if(_rowBudget >= 0) {
+            stream << " limited to " << _rowBudget << " rows";
+        }
+        stream << "\n";
     }
 }
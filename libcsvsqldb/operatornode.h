@@ -38,16 +38,25 @@
 
 #include "block.h"
 #include "block_iterator.h"
+#include "columnar_block.h"
 #include "file_mapping.h"
+#include "hash_join_table.h"
+#include "output_writer.h"
 #include "stack_machine.h"
 #include "visitor.h"
 
 #include "base/csv_parser.h"
+#include "base/memory_mapped_file.h"
+#include "base/spsc_queue.h"
+#include "base/thread_pool.h"
 #include "base/tribool.h"
 #include "base/types.h"
 
 #include <algorithm>
+#include <atomic>
 #include <condition_variable>
+#include <exception>
+#include <functional>
 #include <istream>
 #include <mutex>
 #include <queue>
@@ -64,6 +73,8 @@ namespace csvsqldb
         , _blockManager(blockManager)
         , _files(files)
         , _showHeaderLine(true)
+        , _numberOfThreads(1)
+        , _outputFormat(CSV_FORMAT)
         {
         }
 
@@ -72,6 +83,8 @@ namespace csvsqldb
         BlockManager& _blockManager;
         const csvsqldb::StringVector& _files;
         bool _showHeaderLine;
+        uint16_t _numberOfThreads;
+        eOutputFormat _outputFormat;
     };
 
 
@@ -104,6 +117,7 @@ namespace csvsqldb
 
             StackMachine _sm;
             VariableStore _store;
+            VariableBatch _batch;
             VariableMapping _variableMappings;
         };
 
@@ -152,6 +166,14 @@ namespace csvsqldb
             }
         }
 
+        void fillVariableBatch(VariableBatch& batch, const VariableMapping& variableMapping, const Values& row)
+        {
+            for(const auto& mapping : variableMapping) {
+                batch.addValue(mapping.first, *row[mapping.second]);
+            }
+            batch.nextRow();
+        }
+
         virtual void dump(std::ostream& stream) const = 0;
 
     protected:
@@ -173,6 +195,39 @@ namespace csvsqldb
             _outputAlias = alias;
         }
 
+        /**
+         * Cheap estimation of the number of rows this operator delivers. It is used by the plan creator to choose between
+         * alternative plans and is never exact.
+         * @return The estimated number of rows or -1, if the operator cannot estimate it
+         */
+        virtual int64_t estimateRowCount()
+        {
+            return -1;
+        }
+
+        /**
+         * Tells if the rows are delivered in ascending order of the given columns, with NULL values first. The rows are not
+         * read to find out, so a consumer relying on the order has to verify it while reading.
+         * @param columns The positions of the sort columns in the output rows, the first one is the most significant
+         * @return true if the rows are known to be sorted, false if they are not or if it is unknown
+         */
+        virtual bool isSortedBy(const IndexVector& columns)
+        {
+            return false;
+        }
+
+        /**
+         * Offers a row budget to the operator, no more than the given number of rows will be requested from it. Operators
+         * delivering exactly one row per input row hand the budget to their input, scans stop reading as soon as they
+         * delivered the budget.
+         * @param rows The maximal number of rows, that will be requested
+         * @return true if the budget was accepted
+         */
+        virtual bool pushDownLimit(int64_t rows)
+        {
+            return false;
+        }
+
     protected:
         RowOperatorNode(const OperatorContext& context, const SymbolTablePtr& symbolTable)
         : OperatorBaseNode(context, symbolTable)
@@ -219,13 +274,22 @@ namespace csvsqldb
         virtual void dump(std::ostream& stream) const;
 
     private:
-        std::ostream& _stream;
-        std::stringstream _outputBuffer;
+        int64_t processParallel();
+        int64_t processBinary();
+
+        OutputWriter _writer;
         bool _firstCall;
         RowOperatorNodePtr _input;
     };
 
 
+    /**
+     * Evaluates a constant expression, like the row count of a LIMIT or OFFSET clause.
+     * @return The value of the expression as integer
+     */
+    CSVSQLDB_EXPORT int64_t evaluateConstant(const OperatorContext& context, const ASTExprNodePtr& exp);
+
+
     class CSVSQLDB_EXPORT LimitOperatorNode : public RowOperatorNode
     {
     public:
@@ -233,10 +297,16 @@ namespace csvsqldb
 
         virtual const Values* getNextRow();
 
+        virtual void cancel();
+
         virtual bool connect(const RowOperatorNodePtr& input);
 
         virtual void getColumnInfos(SymbolInfos& outputSymbols);
 
+        virtual int64_t estimateRowCount();
+
+        virtual bool isSortedBy(const IndexVector& columns);
+
         virtual void dump(std::ostream& stream) const;
 
     private:
@@ -244,6 +314,7 @@ namespace csvsqldb
         SymbolInfos _inputSymbols;
         int64_t _limit;
         int64_t _offset;
+        bool _satisfied;
     };
 
 
@@ -254,10 +325,16 @@ namespace csvsqldb
 
         virtual const Values* getNextRow();
 
+        virtual void cancel();
+
         virtual bool connect(const RowOperatorNodePtr& input);
 
         virtual void getColumnInfos(SymbolInfos& outputSymbols);
 
+        virtual int64_t estimateRowCount();
+
+        virtual bool isSortedBy(const IndexVector& columns);
+
         virtual void dump(std::ostream& stream) const;
 
     private:
@@ -267,9 +344,74 @@ namespace csvsqldb
         RowOperatorNodePtr _input;
         SymbolInfos _inputSymbols;
         OrderExpressions _orderExpressions;
+        SortingBlockIterator::SortOrders _sortOrders;
     };
 
 
+    /**
+     * Returns the first rows of its input in sort order, fusing an ORDER BY with a LIMIT. Only the limit plus offset best
+     * rows are kept in a bounded heap with the worst of them on top. A row is only copied out of the input blocks, if it
+     * replaces the top of the heap. Rows with equal sort keys are returned in input order.
+     */
+    class CSVSQLDB_EXPORT TopNOperatorNode : public RowOperatorNode
+    {
+    public:
+        TopNOperatorNode(const OperatorContext& context,
+                         const SymbolTablePtr& symbolTable,
+                         OrderExpressions orderExpressions,
+                         const ASTExprNodePtr& limit,
+                         const ASTExprNodePtr& offset);
+
+        virtual ~TopNOperatorNode();
+
+        virtual const Values* getNextRow();
+
+        virtual void cancel();
+
+        virtual bool connect(const RowOperatorNodePtr& input);
+
+        virtual void getColumnInfos(SymbolInfos& outputSymbols);
+
+        virtual int64_t estimateRowCount();
+
+        virtual bool isSortedBy(const IndexVector& columns);
+
+        virtual void dump(std::ostream& stream) const;
+
+    private:
+        struct Entry {
+            SortingBlockIterator::SortKey _key;
+            uint64_t _sequence;
+            Values _row;
+        };
+        typedef std::vector<Entry> Entries;
+
+        struct EntryOrder {
+            bool operator()(const Entry& lhs, const Entry& rhs) const
+            {
+                int result = SortingBlockIterator::compareSortKeys(lhs._key.data(), lhs._key.size(), rhs._key.data(), rhs._key.size());
+                return result < 0 || (result == 0 && lhs._sequence < rhs._sequence);
+            }
+        };
+
+        void collect();
+        void copyRow(const Values& row, Values& target);
+        void compact();
+
+        RowOperatorNodePtr _input;
+        SymbolInfos _inputSymbols;
+        OrderExpressions _orderExpressions;
+        SortingBlockIterator::SortOrders _sortOrders;
+        int64_t _limit;
+        int64_t _offset;
+        uint64_t _sequence;
+        size_t _deadRows;
+        Blocks _blocks;
+        Entries _entries;
+        bool _collected;
+        size_t _current;
+    };
+
     class CSVSQLDB_EXPORT GroupingOperatorNode : public RowOperatorNode
     {
     public:
@@ -277,6 +419,8 @@ namespace csvsqldb
 
         virtual const Values* getNextRow();
 
+        virtual void cancel();
+
         virtual bool connect(const RowOperatorNodePtr& input);
 
         virtual void getColumnInfos(SymbolInfos& outputSymbols);
@@ -307,6 +451,8 @@ namespace csvsqldb
 
         virtual const Values* getNextRow();
 
+        virtual void cancel();
+
         virtual bool connect(const RowOperatorNodePtr& input);
 
         virtual void getColumnInfos(SymbolInfos& outputSymbols);
@@ -317,11 +463,24 @@ namespace csvsqldb
         virtual void dump(std::ostream& stream) const;
 
     private:
+        typedef std::vector<AggregationFunction*> AggregationStates;
+
+        struct BatchWorker {
+            StackMachines _sms;
+            AggregationStates _states;
+            bool _busy;
+        };
+        typedef std::vector<BatchWorker> BatchWorkers;
+
+        static void stepBatches(StackMachines& sms, const AggregationStates& states);
+        void aggregateParallel();
+
         SymbolInfos _outputSymbols;
         const Expressions& _nodes;
         AggregationFunctions _aggregateFunctions;
         BlockPtr _block;
         StackMachines _sms;
+        bool _vectorized;
         RowOperatorNodePtr _input;
         BlockIteratorPtr _iterator;
         Types _types;
@@ -337,10 +496,16 @@ namespace csvsqldb
 
         virtual const Values* getNextRow();
 
+        virtual void cancel();
+
         virtual bool connect(const RowOperatorNodePtr& input);
 
         virtual void getColumnInfos(SymbolInfos& outputSymbols);
 
+        virtual int64_t estimateRowCount();
+
+        virtual bool pushDownLimit(int64_t rows);
+
         /// BlockProvider interface
         virtual BlockPtr getNextBlock();
 
@@ -368,6 +533,8 @@ namespace csvsqldb
 
         virtual const Values* getNextRow();
 
+        virtual void cancel();
+
         virtual bool connect(const RowOperatorNodePtr& input);
 
         virtual void getColumnInfos(SymbolInfos& outputSymbols);
@@ -407,13 +574,53 @@ namespace csvsqldb
     };
 
 
+    /**
+     * Splits a join condition into its conjuncts. Equalities comparing a column of the lhs input with a column of the same
+     * type of the rhs input are returned as pairs of join key positions, all other conjuncts as residuals.
+     * @param exp The join condition
+     * @param lhsSymbols The columns of the lhs input
+     * @param rhsSymbols The columns of the rhs input
+     * @param lhsKeyIndices Receives the positions of the join keys in the lhs input
+     * @param rhsKeyIndices Receives the positions of the join keys in the rhs input
+     * @param residuals Receives the conjuncts, that are no join keys
+     */
+    CSVSQLDB_EXPORT void splitJoinCondition(const ASTExprNodePtr& exp,
+                                            const SymbolInfos& lhsSymbols,
+                                            const SymbolInfos& rhsSymbols,
+                                            IndexVector& lhsKeyIndices,
+                                            IndexVector& rhsKeyIndices,
+                                            Expressions& residuals);
+
+
+    /**
+     * Inner join of two inputs on the equalities of the join condition, that compare a lhs with a rhs column. The hash table is
+     * built from one input with all these columns as composite key and probed with the rows of the other input. All other
+     * conjuncts of the join condition are evaluated on the joined rows.
+     * If the build rows do not fit into half of the free blocks, both inputs are hash partitioned by their key into spill
+     * partitions (grace hash join), which are joined one after the other. A partition, whose build rows still do not fit,
+     * is partitioned again.
+     */
     class CSVSQLDB_EXPORT InnerHashJoinOperatorNode : public RowOperatorNode
     {
     public:
         InnerHashJoinOperatorNode(const OperatorContext& context, const SymbolTablePtr& symbolTable, const ASTExprNodePtr& exp);
 
+        virtual ~InnerHashJoinOperatorNode();
+
         virtual const Values* getNextRow();
 
+        virtual void cancel();
+
+        /**
+         * Selects the input the hash table is built from. By default the rhs input is hashed and the lhs input probed. The
+         * order of the output columns is not affected by this choice. Has to be called before the inputs are connected.
+         * @param buildLhs true, if the hash table shall be built from the lhs input
+         */
+        void setBuildLhs(bool buildLhs)
+        {
+            _buildLhs = buildLhs;
+        }
+
         virtual bool connect(const RowOperatorNodePtr& input);
 
         virtual void getColumnInfos(SymbolInfos& outputSymbols);
@@ -421,17 +628,154 @@ namespace csvsqldb
         virtual void dump(std::ostream& stream) const;
 
     private:
+        typedef std::pair<size_t, const Value* const*> Match;
+        typedef std::vector<Match> Matches;
+
+        struct SpillPartition {
+            RowBufferPtr _build;
+            RowBufferPtr _probe;
+            size_t _level;
+        };
+        typedef std::vector<SpillPartition> SpillPartitions;
+
+        bool buildTable(RowProvider& buildRows, RowProvider& probeRows, size_t level);
+        void spill(RowProvider& buildRows, RowProvider& probeRows, size_t level, size_t count);
+        bool nextPartition();
+        const Values* getNextParallelRow();
+        bool matchesResidual();
+        bool probeBatch();
+        void releaseBatch();
+
         SymbolInfos _inputLhsSymbols;
         SymbolInfos _inputRhsSymbols;
 
         Values _row;
-        const Values* _currentLhs;
-        HashingBlockIteratorPtr _rhsIterator;
+        const Values* _currentProbe;
+        HashJoinTablePtr _hashTable;
+        HashJoinTable::ProbeContext _probe;
+        bool _buildLhs;
+        // the conjuncts of the join condition, that are not part of the hash key
+        StackMachineType _residual;
+        bool _hasResidual;
+        bool _built;
+        bool _probeExhausted;
         SymbolInfos _outputSymbols;
         RowOperatorNodePtr _lhsInput;
         RowOperatorNodePtr _rhsInput;
+        RowOperatorNodePtr _probeInput;
+        RowOperatorNodePtr _buildInput;
         ASTExprNodePtr _exp;
-        size_t _hashTableKeyPosition;
+        IndexVector _probeKeyIndices;
+        IndexVector _buildKeyIndices;
+        // positions of the probe and build row values in the output row
+        size_t _probeOffset;
+        size_t _probeSize;
+        size_t _buildOffset;
+        size_t _buildSize;
+        Types _buildTypes;
+        Types _probeTypes;
+
+        // the rows probed against the current table, the probe input or the probe rows of a spill partition
+        RowProvider* _probeRows;
+        RowBufferPtr _probePartition;
+        SpillPartitions _spillPartitions;
+
+        // parallel probing of probe row batches
+        Blocks _batchBlocks;
+        std::vector<const Value*> _batchValues;
+        std::vector<Matches> _batchMatches;
+        size_t _currentSlice;
+        size_t _currentMatch;
+        ThreadPool _threadPool;
+    };
+
+
+    /**
+     * Inner join of two inputs sorted on the join keys, that are merged in one pass. Only the rhs rows of the current join key
+     * are buffered, so the inputs can be much larger than the available memory. An input not sorted on the join keys is
+     * sorted first. The order of an input declared as sorted is verified while it is merged, a violation fails the join
+     * with an exception, as the rows merged before are not kept to sort them after all. The join keys and the residual
+     * filter are taken from the join condition like for the InnerHashJoinOperatorNode. The joined rows are delivered in
+     * the order of the join keys.
+     */
+    class CSVSQLDB_EXPORT InnerMergeJoinOperatorNode : public RowOperatorNode
+    {
+    public:
+        InnerMergeJoinOperatorNode(const OperatorContext& context, const SymbolTablePtr& symbolTable, const ASTExprNodePtr& exp);
+
+        virtual ~InnerMergeJoinOperatorNode();
+
+        virtual const Values* getNextRow();
+
+        virtual void cancel();
+
+        /**
+         * Tells the join, which inputs are declared as sorted on their join keys. Unsorted inputs are sorted by the join.
+         * The default is that none of the inputs is sorted. Has to be called before the inputs are connected.
+         * @param lhsSorted true, if the lhs input is sorted on the join keys
+         * @param rhsSorted true, if the rhs input is sorted on the join keys
+         */
+        void setSortedInputs(bool lhsSorted, bool rhsSorted)
+        {
+            _lhsSorted = lhsSorted;
+            _rhsSorted = rhsSorted;
+        }
+
+        virtual bool connect(const RowOperatorNodePtr& input);
+
+        virtual void getColumnInfos(SymbolInfos& outputSymbols);
+
+        virtual bool isSortedBy(const IndexVector& columns);
+
+        virtual void dump(std::ostream& stream) const;
+
+    private:
+        const Values* getNextLhsRow();
+        void advanceRhs();
+        void readRhsGroup();
+        void releaseGroup();
+        bool matchesResidual();
+
+        SymbolInfos _inputLhsSymbols;
+        SymbolInfos _inputRhsSymbols;
+        SymbolInfos _outputSymbols;
+        RowOperatorNodePtr _lhsInput;
+        RowOperatorNodePtr _rhsInput;
+        ASTExprNodePtr _exp;
+        IndexVector _lhsKeyIndices;
+        IndexVector _rhsKeyIndices;
+        StackMachineType _residual;
+        bool _hasResidual;
+        bool _lhsSorted;
+        bool _rhsSorted;
+        bool _started;
+        Values _row;
+
+        // unsorted inputs are read through a sorting iterator
+        Types _lhsTypes;
+        Types _rhsTypes;
+        SortingBlockIteratorPtr _lhsSorter;
+        SortingBlockIteratorPtr _rhsSorter;
+        SortingBlockIterator::SortOrders _lhsSortOrders;
+        SortingBlockIterator::SortOrders _rhsSortOrders;
+        RowProvider* _lhsRows;
+        RowProvider* _rhsRows;
+
+        // the current lhs row and the next rhs row with their normalized join keys
+        const Values* _currentLhs;
+        SortingBlockIterator::SortKey _lhsKey;
+        SortingBlockIterator::SortKey _previousLhsKey;
+        const Values* _nextRhs;
+        SortingBlockIterator::SortKey _rhsKey;
+        SortingBlockIterator::SortKey _previousRhsKey;
+
+        // the buffered rhs rows matching the join key of the group
+        Blocks _groupBlocks;
+        std::vector<const Value*> _groupValues;
+        SortingBlockIterator::SortKey _groupKey;
+        bool _hasGroup;
+        size_t _groupSize;
+        size_t _groupPosition;
     };
 
 
@@ -442,6 +786,8 @@ namespace csvsqldb
 
         virtual const Values* getNextRow();
 
+        virtual void cancel();
+
         virtual bool connect(const RowOperatorNodePtr& input);
 
         virtual void getColumnInfos(SymbolInfos& outputSymbols);
@@ -463,13 +809,22 @@ namespace csvsqldb
 
         virtual const Values* getNextRow();
 
+        virtual void cancel();
+
         virtual bool connect(const RowOperatorNodePtr& input);
 
         virtual void getColumnInfos(SymbolInfos& outputSymbols);
 
+        virtual int64_t estimateRowCount();
+
+        virtual bool isSortedBy(const IndexVector& columns);
+
         virtual void dump(std::ostream& stream) const;
 
     private:
+        /// reads the next batch of input rows and selects the rows of it the predicate is true for
+        bool selectNextBatch();
+
         SymbolInfos _inputSymbols;
         VariableStore _store;
         StackMachine _sm;
@@ -477,6 +832,13 @@ namespace csvsqldb
         IdentifierSet _expressionVariables;
         VariableMapping _variableMapping;
         RowOperatorNodePtr _input;
+        bool _vectorized;
+        bool _endOfInput;
+        VariableBatch _batch;
+        StackMachine::SelectionVector _selection;
+        size_t _selected;
+        ColumnarBlockPtr _batchBlock;
+        std::unique_ptr<ColumnarBlockIterator> _batchRows;
     };
 
 
@@ -490,12 +852,50 @@ namespace csvsqldb
             CSVSQLDB_THROW(csvsqldb::Exception, "connect not allowed");
         }
 
+        /**
+         * The scan only knows the order declared for the table, the rows are not read to check it.
+         * @param columns The positions of the sort columns in the output rows
+         * @return true if the columns are a prefix of the declared sort columns of the table
+         */
+        virtual bool isSortedBy(const IndexVector& columns);
+
+        /**
+         * Tells the scan, if the following operators depend on the rows being delivered in the order of the input. If not, a
+         * parallel scan is free to deliver the rows in any order. The default is true.
+         * @param required If the row order has to be preserved
+         */
+        void setRowOrderRequired(bool required)
+        {
+            _rowOrderRequired = required;
+        }
+
+        /**
+         * Offers a predicate to the scan, that only references columns of the scanned table. A scan accepting the predicate
+         * only delivers the rows fulfilling it.
+         * @param predicate The predicate to evaluate for each row
+         * @return true if the scan evaluates the predicate, false if it has to be evaluated by a following operator
+         */
+        virtual bool pushDownPredicate(const ASTExprNodePtr& predicate)
+        {
+            return false;
+        }
+
+        /**
+         * Restricts the columns delivered by the scan to the referenced ones, all other columns are skipped while reading
+         * the table. At least one column is delivered, so that the rows can still be counted. The default is to deliver all
+         * columns.
+         * @param columns The names of the referenced columns of the table
+         */
+        void setReferencedColumns(const StringSet& columns);
+
     protected:
         ScanOperatorNode(const OperatorContext& context, const SymbolTablePtr& symbolTable, const SymbolInfo& tableInfo);
 
         Types _types;
         const TableData& _tableData;
         const SymbolInfo& _tableInfo;
+        bool _rowOrderRequired;
+        std::vector<bool> _referencedColumns;
     };
 
 
@@ -508,6 +908,8 @@ namespace csvsqldb
 
         virtual const Values* getNextRow();
 
+        virtual int64_t estimateRowCount();
+
         /// BlockProvider interface
         virtual BlockPtr getNextBlock();
 
@@ -516,23 +918,31 @@ namespace csvsqldb
         BlockIteratorPtr _iterator;
     };
 
-    class CSVSQLDB_EXPORT BlockReader : public csvsqldb::csv::CSVParserCallback
+    class CSVSQLDB_EXPORT BlockBuilder : public csvsqldb::csv::CSVParserCallback
     {
     public:
-        typedef std::shared_ptr<csvsqldb::csv::CSVParser> CSVParserPtr;
+        /// receives the filled blocks, the flag tells if the block ends at a row boundary or the row continues in the next block
+        typedef std::function<void(BlockPtr, bool)> BlockSink;
+        /// selects the kept rows of a batch of the given number of completed rows by filling the selection with their indices
+        typedef std::function<void(const std::vector<Values>&, size_t, StackMachine::SelectionVector&)> RowFilter;
 
-        BlockReader(BlockManager& blockManager);
+        BlockBuilder(BlockManager& blockManager, BlockSink sink);
 
-        ~BlockReader();
+        ~BlockBuilder();
 
-        void initialize(CSVParserPtr csvparser);
+        void nextRow();
 
-        bool valid() const
-        {
-            return _csvparser.get();
-        }
+        /// hands the current block over to the sink, empty blocks are dropped unless they are the last block
+        void finish(bool lastBlock);
 
-        BlockPtr getNextBlock();
+        /// inserts the given string into each row at the column index, in addition to the values delivered by the parser
+        void setConstantColumn(size_t column, const std::string& value);
+
+        /**
+         * With a filter the rows are parsed into a staging block and filtered in batches of up to VariableBatch::MAX_ROWS
+         * rows. Only the kept rows are copied into the delivered blocks, so with a filter rows never span blocks.
+         */
+        void setRowFilter(RowFilter filter);
 
         /// CSVParserCallback interface
         virtual void onLong(int64_t num, bool isNull);
@@ -550,21 +960,215 @@ namespace csvsqldb
         virtual void onBoolean(bool boolean, bool isNull);
 
     private:
-        typedef std::queue<BlockPtr> Blocks;
+        void flush();
+        void nextColumn();
+        void addConstant();
+        void filterRows();
+        void copyRow(const Values& row);
 
-        void readBlocks();
+        void rememberValue(Value* value)
+        {
+            if(_filterRows) {
+                _row.push_back(value);
+            }
+        }
 
-        CSVParserPtr _csvparser;
         BlockManager& _blockManager;
-        Blocks _blocks;
+        BlockSink _sink;
         BlockPtr _block;
+        size_t _rowStart;
+        size_t _column;
+        size_t _constantColumn;
+        std::string _constantValue;
+        RowFilter _rowFilter;
+        bool _filterRows;
+        Values _row;
+        std::vector<Values> _rows;
+        size_t _rowCount;
+        StackMachine::SelectionVector _selection;
+        BlockPtr _output;
+    };
+
+
+    class CSVSQLDB_EXPORT BlockReader
+    {
+    public:
+        typedef std::shared_ptr<csvsqldb::csv::CSVParser> CSVParserPtr;
+        /// delivers the values of the next row to the block builder, returns false if there are no more rows
+        typedef std::function<bool()> RowReader;
+
+        /**
+         * Constructs a reader that parses the csv input in its own thread.
+         * @param blockManager The manager to allocate the blocks from
+         * @param queueDepth The maximal number of filled blocks, that are not yet consumed. The read thread parks until the
+         * consumer takes a block, so the memory use is bounded.
+         */
+        BlockReader(BlockManager& blockManager, size_t queueDepth = 4);
+
+        ~BlockReader();
+
+        void initialize(CSVParserPtr csvparser);
+
+        /// reads the rows with the given reader instead of a csv parser, e.g. from a binary row stream
+        void initialize(RowReader rowReader);
+
+        bool valid() const
+        {
+            return _csvparser.get() || _rowReader;
+        }
+
+        BlockPtr getNextBlock();
+
+        /// stops the read thread, the blocks not yet read are dropped
+        void cancel();
+
+        /// returns true if the read thread waits for the consumer to take a block, may only be called by the consumer
+        bool isParked() const
+        {
+            return _blocks.isProducerParked();
+        }
+
+        csvsqldb::csv::CSVParserCallback& callback()
+        {
+            return _blockBuilder;
+        }
+
+        BlockBuilder& builder()
+        {
+            return _blockBuilder;
+        }
+
+    private:
+        void readBlocks();
+        void pushBlock(BlockPtr block, bool rowComplete);
+
+        BlockManager& _blockManager;
+        CSVParserPtr _csvparser;
+        RowReader _rowReader;
+        BlockBuilder _blockBuilder;
+        SPSCQueue<BlockPtr> _blocks;
         std::thread _readThread;
-        std::condition_variable _cv;
+        std::exception_ptr _error;
+    };
+
+
+    /**
+     * Reads a number of csv inputs in parallel. Memory regions are split into chunks at line boundaries, streams are read as
+     * a whole. Each chunk is parsed into its own blocks by a worker of a thread pool, so the number of threads bounds the
+     * number of inputs read concurrently. The blocks are delivered in the order of the inputs, or in the order of their
+     * completion if the row order is not required.
+     */
+    class CSVSQLDB_EXPORT ParallelBlockReader : public BlockProvider
+    {
+    public:
+        /**
+         * Constructs a reader that parses the inputs with a pool of worker threads.
+         * @param blockManager The manager to allocate the blocks from
+         * @param numberOfThreads The number of workers
+         * @param ordered If true, the blocks are delivered in the order of the inputs
+         * @param queueDepth The maximal number of filled blocks per chunk, or per worker if unordered, that are not yet consumed
+         */
+        ParallelBlockReader(BlockManager& blockManager, uint16_t numberOfThreads, bool ordered, size_t queueDepth = 4);
+
+        ~ParallelBlockReader();
+
+        /// the data is not copied and has to stay valid for the lifetime of the reader
+        void addInput(const char* data, size_t length, const std::string& name = std::string());
+
+        /// the stream cannot be split and has to stay valid for the lifetime of the reader
+        void addInput(std::istream& stream, const std::string& name = std::string());
+
+        /**
+         * Starts reading all added inputs.
+         * @param context The parser context, a skipped first line is skipped in each input
+         * @param types The types of the csv fields
+         * @param nameColumn Index of a column, that is filled with the name of the input, or std::string::npos
+         */
+        void initialize(const csvsqldb::csv::CSVParserContext& context,
+                        const csvsqldb::csv::Types& types,
+                        size_t nameColumn = std::string::npos);
+
+        /// creates a filter for the rows of each chunk when initializing, the filters are not shared between the worker threads
+        void setRowFilterFactory(std::function<BlockBuilder::RowFilter()> factory)
+        {
+            _rowFilterFactory = factory;
+        }
+
+        size_t chunkCount() const
+        {
+            return _chunks.size();
+        }
+
+        /// BlockProvider interface
+        virtual BlockPtr getNextBlock();
+
+        /// stops all workers, the chunks not yet read are dropped
+        virtual void cancel();
+
+    private:
+        struct Input {
+            Input(const char* data, size_t length, std::istream* stream, const std::string& name)
+            : _data(data)
+            , _length(length)
+            , _stream(stream)
+            , _name(name)
+            {
+            }
+
+            const char* _data;
+            size_t _length;
+            std::istream* _stream;
+            std::string _name;
+        };
+        typedef std::vector<Input> Inputs;
+
+        struct Chunk {
+            Chunk(const Input* input, const char* data, size_t length)
+            : _input(input)
+            , _data(data)
+            , _length(length)
+            , _finished(false)
+            {
+            }
+
+            const Input* _input;
+            const char* _data;
+            size_t _length;
+            std::queue<BlockPtr> _blocks;
+            Blocks _pendingBlocks;
+            BlockBuilder::RowFilter _rowFilter;
+            bool _finished;
+        };
+        typedef std::vector<Chunk> Chunks;
+
+        void readChunk(Chunk& chunk);
+        void pushBlock(Chunk& chunk, BlockPtr block, bool rowComplete);
+
+        BlockManager& _blockManager;
+        const uint16_t _numberOfThreads;
+        const bool _ordered;
+        const size_t _queueDepth;
+        csvsqldb::csv::CSVParserContext _context;
+        csvsqldb::csv::Types _types;
+        size_t _nameColumn;
+        std::function<BlockBuilder::RowFilter()> _rowFilterFactory;
+        Inputs _inputs;
+        Chunks _chunks;
+        std::queue<BlockPtr> _blocks;
+        size_t _currentChunk;
+        size_t _finishedChunks;
+        std::exception_ptr _error;
         std::mutex _queueMutex;
-        bool _continue;
+        std::condition_variable _cv;
+        std::atomic<bool> _continue;
+        ThreadPool _threadPool;
     };
 
 
+    /**
+     * Scans all files matching the mapping of the table. A table column named SYSTEM_FILENAME is not read from the files, but
+     * contains the name of the file each row was read from.
+     */
     class CSVSQLDB_EXPORT TableScanOperatorNode : public ScanOperatorNode, public BlockProvider
     {
     public:
@@ -574,21 +1178,46 @@ namespace csvsqldb
 
         virtual const Values* getNextRow();
 
+        virtual void cancel();
+
+        virtual int64_t estimateRowCount();
+
+        virtual bool pushDownPredicate(const ASTExprNodePtr& predicate);
+
+        virtual bool pushDownLimit(int64_t rows);
+
         /// BlockProvider interface
         virtual BlockPtr getNextBlock();
 
     private:
         typedef std::shared_ptr<std::istream> IStreamPtr;
+        typedef std::shared_ptr<csvsqldb::MemoryMappedFile> MemoryMappedFilePtr;
         typedef std::shared_ptr<csvsqldb::csv::CSVParser> CSVParserPtr;
 
         void initializeBlockReader();
+        csvsqldb::StringVector getTableFiles();
+        bool isFileSelected(const std::string& file) const;
+        BlockBuilder::RowFilter createRowFilter() const;
 
-        BlockReader _blockReader;
-        BlockIteratorPtr _iterator;
+        typedef std::shared_ptr<ParallelBlockReader> ParallelBlockReaderPtr;
+        typedef std::map<std::string, size_t> ColumnIndices;
+
+        Expressions _predicates;
+        Expressions _filePredicates;
+        ColumnIndices _predicateColumns;
+        BlockBuilder::RowFilter _rowFilter;
 
-        IStreamPtr _stream;
+        // the input sources have to be declared before the block readers, as the reader threads are joined in their destructors
+        std::vector<MemoryMappedFilePtr> _mappedFiles;
+        std::vector<IStreamPtr> _streams;
         CSVParserPtr _csvparser;
         csvsqldb::csv::CSVParserContext _csvContext;
+
+        BlockReader _blockReader;
+        ParallelBlockReaderPtr _parallelBlockReader;
+        BlockIteratorPtr _iterator;
+        int64_t _rowBudget;
+        bool _cancelled;
     };
 }
 
@@ -56,6 +56,15 @@ namespace csvsqldb
         return std::make_shared<SortOperatorNode>(context, symbolTable, orderExpressions);
     }
 
+    RowOperatorNodePtr OperatorNodeFactory::createTopNOperatorNode(OperatorContext& context,
+                                                                   const SymbolTablePtr& symbolTable,
+                                                                   OrderExpressions orderExpressions,
+                                                                   const ASTExprNodePtr& limit,
+                                                                   const ASTExprNodePtr& offset)
+    {
+        return std::make_shared<TopNOperatorNode>(context, symbolTable, orderExpressions, limit, offset);
+    }
+
     RowOperatorNodePtr OperatorNodeFactory::createGroupingOperatorNode(OperatorContext& context,
                                                                        const SymbolTablePtr& symbolTable,
                                                                        const Expressions& nodes,
@@ -95,6 +104,13 @@ namespace csvsqldb
         return std::make_shared<InnerHashJoinOperatorNode>(context, symbolTable, exp);
     }
 
+    RowOperatorNodePtr OperatorNodeFactory::createInnerMergeJoinOperatorNode(OperatorContext& context,
+                                                                             const SymbolTablePtr& symbolTable,
+                                                                             const ASTExprNodePtr& exp)
+    {
+        return std::make_shared<InnerMergeJoinOperatorNode>(context, symbolTable, exp);
+    }
+
     RowOperatorNodePtr OperatorNodeFactory::createUnionOperatorNode(OperatorContext& context, const SymbolTablePtr& symbolTable)
     {
         return std::make_shared<UnionOperatorNode>(context, symbolTable);
@@ -57,6 +57,12 @@ namespace csvsqldb
                                                                          const SymbolTablePtr& symbolTable,
                                                                          OrderExpressions orderExpressions);
 
+        static CSVSQLDB_EXPORT RowOperatorNodePtr createTopNOperatorNode(OperatorContext& context,
+                                                                         const SymbolTablePtr& symbolTable,
+                                                                         OrderExpressions orderExpressions,
+                                                                         const ASTExprNodePtr& limit,
+                                                                         const ASTExprNodePtr& offset);
+
         static CSVSQLDB_EXPORT RowOperatorNodePtr createGroupingOperatorNode(OperatorContext& context,
                                                                              const SymbolTablePtr& symbolTable,
                                                                              const Expressions& nodes,
@@ -80,6 +86,10 @@ namespace csvsqldb
                                                                                   const SymbolTablePtr& symbolTable,
                                                                                   const ASTExprNodePtr& exp);
 
+        static CSVSQLDB_EXPORT RowOperatorNodePtr createInnerMergeJoinOperatorNode(OperatorContext& context,
+                                                                                   const SymbolTablePtr& symbolTable,
+                                                                                   const ASTExprNodePtr& exp);
+
         static CSVSQLDB_EXPORT RowOperatorNodePtr createUnionOperatorNode(OperatorContext& context, const SymbolTablePtr& symbolTable);
 
         static CSVSQLDB_EXPORT RowOperatorNodePtr createSelectOperatorNode(OperatorContext& context,
@@ -0,0 +1,312 @@
+//
+//  output_writer.cpp
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "output_writer.h"
+
+#include "base/exception.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+
+
+namespace csvsqldb
+{
+    namespace
+    {
+        const char digitPairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+
+        inline void formatTwoDigits(uint16_t num, char* buffer)
+        {
+            buffer[0] = digitPairs[num * 2];
+            buffer[1] = digitPairs[num * 2 + 1];
+        }
+
+        inline void formatFourDigits(uint16_t num, char* buffer)
+        {
+            formatTwoDigits(static_cast<uint16_t>(num / 100), buffer);
+            formatTwoDigits(static_cast<uint16_t>(num % 100), buffer + 2);
+        }
+
+        size_t formatUnsigned(uint64_t num, char* buffer)
+        {
+            char digits[20];
+            char* end = digits + sizeof(digits);
+            char* p = end;
+            while(num >= 100) {
+                p -= 2;
+                formatTwoDigits(static_cast<uint16_t>(num % 100), p);
+                num /= 100;
+            }
+            if(num >= 10) {
+                p -= 2;
+                formatTwoDigits(static_cast<uint16_t>(num), p);
+            } else {
+                *--p = static_cast<char>('0' + num);
+            }
+            size_t length = static_cast<size_t>(end - p);
+            ::memcpy(buffer, p, length);
+            return length;
+        }
+
+        size_t formatYmd(uint16_t year, uint16_t month, uint16_t day, char* buffer)
+        {
+            formatFourDigits(year, buffer);
+            buffer[4] = '-';
+            formatTwoDigits(month, buffer + 5);
+            buffer[7] = '-';
+            formatTwoDigits(day, buffer + 8);
+            return 10;
+        }
+
+        size_t formatHms(uint16_t hour, uint16_t minute, uint16_t second, char* buffer)
+        {
+            formatTwoDigits(hour, buffer);
+            buffer[2] = ':';
+            formatTwoDigits(minute, buffer + 3);
+            buffer[5] = ':';
+            formatTwoDigits(second, buffer + 6);
+            return 8;
+        }
+    }
+
+
+    const size_t OutputWriter::maxDoubleLength;
+
+    OutputWriter::OutputWriter(std::ostream& stream, size_t bufferSize)
+    : _stream(&stream)
+    , _buffer(std::max(bufferSize, maxDoubleLength))
+    , _length(0)
+    , _fd(-1)
+    {
+#ifndef _MSC_VER
+        if(&stream == &std::cout) {
+            _fd = STDOUT_FILENO;
+        }
+#endif
+    }
+
+    OutputWriter::OutputWriter(size_t bufferSize)
+    : _stream(nullptr)
+    , _buffer(std::max(bufferSize, maxDoubleLength))
+    , _length(0)
+    , _fd(-1)
+    {
+    }
+
+    void OutputWriter::write(const char* s, size_t length)
+    {
+        if(!_stream) {
+            ::memcpy(reserve(length), s, length);
+            _length += length;
+            return;
+        }
+        while(length) {
+            if(_length == _buffer.size()) {
+                flush();
+            }
+            size_t chunk = std::min(length, _buffer.size() - _length);
+            ::memcpy(&_buffer[_length], s, chunk);
+            _length += chunk;
+            s += chunk;
+            length -= chunk;
+        }
+    }
+
+    void OutputWriter::writeValue(const Value& value)
+    {
+        if(value.isNull()) {
+            write("NULL", 4);
+            return;
+        }
+        switch(value.getType()) {
+            case INT:
+                _length += formatInt(static_cast<const ValInt&>(value).asInt(), reserve(20));
+                break;
+            case REAL:
+                _length += formatDouble(static_cast<const ValDouble&>(value).asDouble(), reserve(maxDoubleLength));
+                break;
+            case BOOLEAN:
+                write(static_cast<const ValBool&>(value).asBool() ? '1' : '0');
+                break;
+            case DATE:
+                _length += formatDate(static_cast<const ValDate&>(value).asDate(), reserve(10));
+                break;
+            case TIME:
+                _length += formatTime(static_cast<const ValTime&>(value).asTime(), reserve(8));
+                break;
+            case TIMESTAMP:
+                _length += formatTimestamp(static_cast<const ValTimestamp&>(value).asTimestamp(), reserve(19));
+                break;
+            case STRING: {
+                const ValString& s = static_cast<const ValString&>(value);
+                write('\'');
+                write(s.asString(), s.length());
+                write('\'');
+                break;
+            }
+            default: {
+                std::stringstream ss;
+                value.toStream(ss);
+                const std::string& text = ss.str();
+                write(text.c_str(), text.length());
+                break;
+            }
+        }
+    }
+
+    void OutputWriter::writeRow(const Values& row)
+    {
+        bool first = true;
+        for(const auto value : row) {
+            if(!first) {
+                write(',');
+            } else {
+                first = false;
+            }
+            writeValue(*value);
+        }
+        write('\n');
+    }
+
+    void OutputWriter::flush()
+    {
+        if(!_length || !_stream) {
+            return;
+        }
+#ifndef _MSC_VER
+        if(_fd >= 0) {
+            // anything already written through the stream has to go out first
+            _stream->flush();
+            std::fflush(stdout);
+            const char* data = &_buffer[0];
+            size_t length = _length;
+            while(length) {
+                ssize_t written = ::write(_fd, data, length);
+                if(written < 0) {
+                    if(errno == EINTR) {
+                        continue;
+                    }
+                    _length = 0;
+                    CSVSQLDB_THROW(csvsqldb::Exception, "could not write output: " << std::strerror(errno));
+                }
+                data += written;
+                length -= static_cast<size_t>(written);
+            }
+            _length = 0;
+            return;
+        }
+#endif
+        _stream->write(&_buffer[0], static_cast<std::streamsize>(_length));
+        _length = 0;
+    }
+
+    void OutputWriter::makeRoom(size_t length)
+    {
+        if(_stream) {
+            flush();
+        } else {
+            _buffer.resize(std::max(_buffer.size() * 2, _length + length));
+        }
+    }
+
+    size_t OutputWriter::formatInt(int64_t num, char* buffer)
+    {
+        if(num < 0) {
+            *buffer = '-';
+            // negating in unsigned arithmetic also works for the smallest number
+            return formatUnsigned(~static_cast<uint64_t>(num) + 1, buffer + 1) + 1;
+        }
+        return formatUnsigned(static_cast<uint64_t>(num), buffer);
+    }
+
+    size_t OutputWriter::formatDouble(double num, char* buffer)
+    {
+        double magnitude = std::fabs(num);
+        if(magnitude < 1e9) {
+            // below 1e15 the scaled number is exact to 1/16, so the rounding is only ambiguous close to a half
+            double scaled = magnitude * 1e6;
+            double fraction = scaled - std::floor(scaled);
+            if(std::fabs(fraction - 0.5) > 0.1) {
+                uint64_t fixed = static_cast<uint64_t>(scaled + 0.5);
+                size_t length = 0;
+                if(std::signbit(num)) {
+                    buffer[length++] = '-';
+                }
+                length += formatUnsigned(fixed / 1000000, buffer + length);
+                buffer[length++] = '.';
+                uint32_t decimals = static_cast<uint32_t>(fixed % 1000000);
+                formatTwoDigits(static_cast<uint16_t>(decimals / 10000), buffer + length);
+                formatTwoDigits(static_cast<uint16_t>(decimals / 100 % 100), buffer + length + 2);
+                formatTwoDigits(static_cast<uint16_t>(decimals % 100), buffer + length + 4);
+                return length + 6;
+            }
+        }
+        int length = std::snprintf(buffer, maxDoubleLength, "%.6f", num);
+        return length > 0 ? static_cast<size_t>(length) : 0;
+    }
+
+    size_t OutputWriter::formatDate(const Date& date, char* buffer)
+    {
+        uint16_t year, month, day;
+        Date::calcFromJulDay(date.asJulianDay(), year, month, day);
+        return formatYmd(year, month, day, buffer);
+    }
+
+    size_t OutputWriter::formatTime(const Time& time, char* buffer)
+    {
+        uint16_t hour, minute, second, millisecond;
+        Time::calcTimeFromNumber(time.asInteger(), hour, minute, second, millisecond);
+        return formatHms(hour, minute, second, buffer);
+    }
+
+    size_t OutputWriter::formatTimestamp(const Timestamp& timestamp, char* buffer)
+    {
+        uint16_t year, month, day, hour, minute, second, millisecond;
+        Timestamp::calcFromJulDay(timestamp.asInteger(), year, month, day, hour, minute, second, millisecond);
+        formatYmd(year, month, day, buffer);
+        buffer[10] = 'T';
+        formatHms(hour, minute, second, buffer + 11);
+        return 19;
+    }
+}
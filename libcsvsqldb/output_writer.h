@@ -0,0 +1,152 @@
+//
+//  output_writer.h
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef csvsqldb_output_writer_h
+#define csvsqldb_output_writer_h
+
+#include "libcsvsqldb/inc.h"
+
+#include "values.h"
+
+#include <ostream>
+#include <vector>
+
+
+namespace csvsqldb
+{
+    /**
+     * Writes rows as comma separated text into a large reusable buffer. The values are formatted without any stream or
+     * format string machinery, the output is identical to Value::toStream. Full buffers are written to the output stream,
+     * if the stream is std::cout, they are written directly to the standard output file descriptor. A writer without a
+     * stream grows its buffer instead, so the output can be formatted in one thread and written in another.
+     */
+    class CSVSQLDB_EXPORT OutputWriter : noncopyable
+    {
+    public:
+        /**
+         * Constructs a writer for the given stream.
+         * @param stream The stream to write to
+         * @param bufferSize The size of the output buffer in bytes
+         */
+        explicit OutputWriter(std::ostream& stream, size_t bufferSize = 1024 * 1024);
+
+        /**
+         * Constructs a writer that keeps all output in its buffer.
+         * @param bufferSize The initial size of the output buffer in bytes
+         */
+        explicit OutputWriter(size_t bufferSize);
+
+        void write(const char* s, size_t length);
+
+        void write(char c)
+        {
+            *reserve(1) = c;
+            ++_length;
+        }
+
+        /**
+         * Writes the value like Value::toStream, non null strings are enclosed in single quotes.
+         * @param value The value to write
+         */
+        void writeValue(const Value& value);
+
+        /**
+         * Writes the comma separated values of a row followed by a newline.
+         * @param row The row to write
+         */
+        void writeRow(const Values& row);
+
+        /**
+         * Writes the buffered output to the stream. Does nothing for a writer without a stream.
+         */
+        void flush();
+
+        /// the buffered output
+        const char* data() const
+        {
+            return &_buffer[0];
+        }
+
+        /// the number of buffered bytes
+        size_t size() const
+        {
+            return _length;
+        }
+
+        /**
+         * Formats the number into the buffer.
+         * @param num The number to format
+         * @param buffer The target buffer, has to hold at least 20 characters
+         * @return The number of characters written
+         */
+        static size_t formatInt(int64_t num, char* buffer);
+
+        /**
+         * Formats the number with six decimal places, like std::fixed with a precision of 6.
+         * @param num The number to format
+         * @param buffer The target buffer, has to hold at least maxDoubleLength characters
+         * @return The number of characters written
+         */
+        static size_t formatDouble(double num, char* buffer);
+
+        /// formats the date as YYYY-mm-dd, the buffer has to hold at least 10 characters
+        static size_t formatDate(const Date& date, char* buffer);
+
+        /// formats the time as HH:MM:SS, the buffer has to hold at least 8 characters
+        static size_t formatTime(const Time& time, char* buffer);
+
+        /// formats the timestamp as YYYY-mm-ddTHH:MM:SS, the buffer has to hold at least 19 characters
+        static size_t formatTimestamp(const Timestamp& timestamp, char* buffer);
+
+        /// the maximal length of a formatted double
+        static const size_t maxDoubleLength = 330;
+
+    private:
+        char* reserve(size_t length)
+        {
+            if(_length + length > _buffer.size()) {
+                makeRoom(length);
+            }
+            return &_buffer[_length];
+        }
+
+        void makeRoom(size_t length);
+
+        std::ostream* _stream;
+        std::vector<char> _buffer;
+        size_t _length;
+        int _fd;
+    };
+}
+
+#endif
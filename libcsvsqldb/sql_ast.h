@@ -1222,11 +1222,13 @@ namespace csvsqldb
                            const std::string& tableName,
                            const ColumnDefinitions& columnDefinitions,
                            const TableConstraints& tableConstraints,
+                           const csvsqldb::StringVector& sortColumns,
                            bool createIfNotExists)
         : ASTNode(symbolTable)
         , _tableName(tableName)
         , _columnDefinitions(columnDefinitions)
         , _tableConstraints(tableConstraints)
+        , _sortColumns(sortColumns)
         , _createIfNotExists(createIfNotExists)
         {
         }
@@ -1239,6 +1241,7 @@ namespace csvsqldb
         std::string _tableName;
         ColumnDefinitions _columnDefinitions;
         TableConstraints _tableConstraints;
+        csvsqldb::StringVector _sortColumns;
         bool _createIfNotExists;
     };
 
@@ -113,6 +113,14 @@ namespace csvsqldb
                 }
                 std::cout << std::endl;
             }
+            if(!node._sortColumns.empty()) {
+                indent();
+                std::cout << "sorted by [ ";
+                for(const auto& column : node._sortColumns) {
+                    std::cout << column << " ";
+                }
+                std::cout << " ]" << std::endl;
+            }
             _indent -= 4;
         }
 
@@ -256,7 +256,15 @@ namespace csvsqldb
 
         expect(TOK_RIGHT_PAREN);
 
-        return std::make_shared<ASTCreateTableNode>(SymbolTable::createSymbolTable(), name, columns, constraints, createIfNotExists);
+        // declares the order of the rows in the table files
+        csvsqldb::StringVector sortColumns;
+        if(canExpect(TOK_ORDER)) {
+            expect(TOK_BY);
+            sortColumns = parseColumnList();
+        }
+
+        return std::make_shared<ASTCreateTableNode>(
+        SymbolTable::createSymbolTable(), name, columns, constraints, sortColumns, createIfNotExists);
     }
 
     eType SQLParser::parseType()
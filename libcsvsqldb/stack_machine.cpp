@@ -33,10 +33,11 @@
 
 #include "stack_machine.h"
 
-#include "typeoperations.h"
+#include "base/float_helper.h"
 
 #include <algorithm>
 #include <functional>
+#include <new>
 
 
 namespace csvsqldb
@@ -64,9 +65,903 @@ namespace csvsqldb
     }
 
 
+    ValueVector::ValueVector(eType type)
+    : _type(type)
+    {
+    }
+
+    bool ValueVector::isSupportedType(eType type)
+    {
+        return type == INT || type == REAL || type == BOOLEAN || type == DATE;
+    }
+
+    void ValueVector::clear()
+    {
+        _ints.clear();
+        _reals.clear();
+        _nulls.clear();
+    }
+
+    void ValueVector::reset(eType type, size_t rows)
+    {
+        _type = type;
+        _ints.resize(rows);
+        _reals.resize(rows);
+        _nulls.resize(rows);
+    }
+
+    void ValueVector::fill(const Variant& value, size_t rows)
+    {
+        clear();
+        _type = value.getType();
+        for(size_t n = 0; n < rows; ++n) {
+            addValue(value);
+        }
+    }
+
+    void ValueVector::addValue(const Value& value)
+    {
+        if(value.isNull()) {
+            if(_type == REAL) {
+                _reals.push_back(0.0);
+            } else {
+                _ints.push_back(0);
+            }
+            _nulls.push_back(1);
+            return;
+        }
+        if(value.getType() != _type) {
+            CSVSQLDB_THROW(StackMachineException,
+                           "expected value of type " << typeToString(_type) << " but got " << typeToString(value.getType()));
+        }
+        switch(_type) {
+            case INT:
+                _ints.push_back(static_cast<const ValInt&>(value).asInt());
+                break;
+            case REAL:
+                _reals.push_back(static_cast<const ValDouble&>(value).asDouble());
+                break;
+            case BOOLEAN:
+                _ints.push_back(static_cast<const ValBool&>(value).asBool());
+                break;
+            case DATE:
+                _ints.push_back(static_cast<const ValDate&>(value).asDate().asJulianDay());
+                break;
+            default:
+                CSVSQLDB_THROW(StackMachineException, "type " << typeToString(_type) << " not supported in value vectors");
+        }
+        _nulls.push_back(0);
+    }
+
+    void ValueVector::addValue(const Variant& value)
+    {
+        if(value.isNull()) {
+            if(_type == REAL) {
+                _reals.push_back(0.0);
+            } else {
+                _ints.push_back(0);
+            }
+            _nulls.push_back(1);
+            return;
+        }
+        if(value.getType() != _type) {
+            CSVSQLDB_THROW(StackMachineException,
+                           "expected value of type " << typeToString(_type) << " but got " << typeToString(value.getType()));
+        }
+        switch(_type) {
+            case INT:
+                _ints.push_back(value.asInt());
+                break;
+            case REAL:
+                _reals.push_back(value.asDouble());
+                break;
+            case BOOLEAN:
+                _ints.push_back(value.asBool());
+                break;
+            case DATE:
+                _ints.push_back(value.asDate().asJulianDay());
+                break;
+            default:
+                CSVSQLDB_THROW(StackMachineException, "type " << typeToString(_type) << " not supported in value vectors");
+        }
+        _nulls.push_back(0);
+    }
+
+    Variant ValueVector::getVariant(size_t row) const
+    {
+        if(_nulls[row]) {
+            return Variant(_type);
+        }
+        switch(_type) {
+            case INT:
+                return Variant(_ints[row]);
+            case REAL:
+                return Variant(_reals[row]);
+            case BOOLEAN:
+                return Variant(_ints[row] != 0);
+            case DATE:
+                return Variant(csvsqldb::Date(static_cast<uint32_t>(_ints[row])));
+            default:
+                CSVSQLDB_THROW(StackMachineException, "type " << typeToString(_type) << " not supported in value vectors");
+        }
+    }
+
+
+    const size_t VariableBatch::MAX_ROWS;
+
+    VariableBatch::VariableBatch()
+    : _rows(0)
+    {
+    }
+
+    void VariableBatch::setVariableType(size_t index, eType type)
+    {
+        if(!ValueVector::isSupportedType(type)) {
+            CSVSQLDB_THROW(StackMachineException, "type " << typeToString(type) << " not supported in value vectors");
+        }
+        if(_variables.size() <= index) {
+            _variables.resize(index + 1);
+        }
+        _variables[index] = ValueVector(type);
+        if(type == REAL) {
+            _variables[index]._reals.reserve(MAX_ROWS);
+        } else {
+            _variables[index]._ints.reserve(MAX_ROWS);
+        }
+        _variables[index]._nulls.reserve(MAX_ROWS);
+    }
+
+    void VariableBatch::clear()
+    {
+        for(auto& variable : _variables) {
+            variable.clear();
+        }
+        _rows = 0;
+    }
+
+
+    namespace
+    {
+        template <typename T>
+        struct EqualTo {
+            bool operator()(const T& lhs, const T& rhs) const
+            {
+                return lhs == rhs;
+            }
+        };
+
+        template <>
+        struct EqualTo<double> {
+            bool operator()(const double& lhs, const double& rhs) const
+            {
+                return csvsqldb::compare(lhs, rhs);
+            }
+        };
+
+        template <typename T>
+        struct NotEqualTo {
+            bool operator()(const T& lhs, const T& rhs) const
+            {
+                return !EqualTo<T>()(lhs, rhs);
+            }
+        };
+    }
+
+
+    struct StackMachineKernels {
+        static void setRegister(Variant& reg, const Variant& value)
+        {
+            // registers can also receive untyped null values, which the assignment operator refuses
+            reg.~Variant();
+            new(&reg) Variant(value);
+        }
+
+        static Variant executeBinary(StackMachine& sm, const StackMachine::CompiledInstruction& instruction, size_t n,
+                                     eOperationType op, const Variant& lhs, const Variant& rhs)
+        {
+            const BinaryOperation* operation = sm._operations[instruction._firstOperation + n];
+            if(operation) {
+                return executeBinaryOperation(*operation, lhs, rhs);
+            }
+            return binaryOperation(op, lhs, rhs);
+        }
+
+        static void move(StackMachine& sm, const StackMachine::CompiledInstruction& instruction, const VariableStore& store)
+        {
+            setRegister(sm._registers[instruction._result], sm.operand(store, instruction._firstOperand));
+        }
+
+        static void binary(StackMachine& sm, const StackMachine::CompiledInstruction& instruction, const VariableStore& store)
+        {
+            const Variant& lhs = sm.operand(store, instruction._firstOperand);
+            const Variant& rhs = sm.operand(store, instruction._firstOperand + 1);
+            eOperationType op = sm.mapOpCodeToBinaryOperationType(sm._instructions[instruction._instruction]._opCode);
+            setRegister(sm._registers[instruction._result], executeBinary(sm, instruction, 0, op, lhs, rhs));
+        }
+
+        template <typename CAST, typename LHS, typename RHS, typename OP>
+        static void typedBinary(StackMachine& sm, const StackMachine::CompiledInstruction& instruction, const VariableStore& store)
+        {
+            const Variant& lhs = sm.operand(store, instruction._firstOperand);
+            const Variant& rhs = sm.operand(store, instruction._firstOperand + 1);
+            if(lhs.isNull() || rhs.isNull()) {
+                setRegister(sm._registers[instruction._result],
+                            executeBinaryOperation(*sm._operations[instruction._firstOperation], lhs, rhs));
+                return;
+            }
+            sm._registers[instruction._result] =
+            Variant(OP()(static_cast<CAST>(ValueGetter<LHS>::getValue(lhs)), static_cast<CAST>(ValueGetter<RHS>::getValue(rhs))));
+        }
+
+        static void unary(StackMachine& sm, const StackMachine::CompiledInstruction& instruction, const VariableStore& store)
+        {
+            const Variant& rhs = sm.operand(store, instruction._firstOperand);
+            if(instruction._unary) {
+                setRegister(sm._registers[instruction._result], executeUnaryOperation(*instruction._unary, rhs));
+                return;
+            }
+            const StackMachine::Instruction& source = sm._instructions[instruction._instruction];
+            switch(source._opCode) {
+                case StackMachine::NOT:
+                    setRegister(sm._registers[instruction._result], unaryOperation(OP_NOT, BOOLEAN, rhs));
+                    break;
+                case StackMachine::MINUS:
+                    setRegister(sm._registers[instruction._result], unaryOperation(OP_MINUS, rhs.getType(), rhs));
+                    break;
+                default:
+                    setRegister(sm._registers[instruction._result], unaryOperation(OP_CAST, source._value.getType(), rhs));
+                    break;
+            }
+        }
+
+        static void notBool(StackMachine& sm, const StackMachine::CompiledInstruction& instruction, const VariableStore& store)
+        {
+            const Variant& rhs = sm.operand(store, instruction._firstOperand);
+            if(rhs.isNull()) {
+                setRegister(sm._registers[instruction._result], Variant(BOOLEAN));
+                return;
+            }
+            sm._registers[instruction._result] = Variant(!rhs.asBool());
+        }
+
+        template <typename T>
+        static void minus(StackMachine& sm, const StackMachine::CompiledInstruction& instruction, const VariableStore& store)
+        {
+            const Variant& rhs = sm.operand(store, instruction._firstOperand);
+            if(rhs.isNull()) {
+                setRegister(sm._registers[instruction._result], Variant(rhs.getType()));
+                return;
+            }
+            sm._registers[instruction._result] = Variant(static_cast<T>(-ValueGetter<T>::getValue(rhs)));
+        }
+
+        static void between(StackMachine& sm, const StackMachine::CompiledInstruction& instruction, const VariableStore& store)
+        {
+            const Variant& lhs = sm.operand(store, instruction._firstOperand);
+            const Variant& from = sm.operand(store, instruction._firstOperand + 1);
+            const Variant& to = sm.operand(store, instruction._firstOperand + 2);
+
+            Variant result(BOOLEAN);
+            if(not(lhs.isNull() || from.isNull() || to.isNull())) {
+                if(executeBinary(sm, instruction, 0, OP_GE, to, from).asBool()) {
+                    result = executeBinary(sm, instruction, 1, OP_GE, lhs, from);
+                    if(result.asBool()) {
+                        result = executeBinary(sm, instruction, 2, OP_LE, lhs, to);
+                    }
+                } else {
+                    result = executeBinary(sm, instruction, 3, OP_GE, lhs, to);
+                    if(result.asBool()) {
+                        result = executeBinary(sm, instruction, 4, OP_LE, lhs, from);
+                    }
+                }
+            }
+            setRegister(sm._registers[instruction._result], result);
+        }
+
+        static void in(StackMachine& sm, const StackMachine::CompiledInstruction& instruction, const VariableStore& store)
+        {
+            const Variant& lhs = sm.operand(store, instruction._firstOperand);
+            bool found(false);
+            for(size_t n = 1; !found && n < instruction._operandCount; ++n) {
+                found = executeBinary(sm, instruction, n - 1, OP_EQ, lhs, sm.operand(store, instruction._firstOperand + n)).asBool();
+            }
+            sm._registers[instruction._result] = Variant(found);
+        }
+
+        static void like(StackMachine& sm, const StackMachine::CompiledInstruction& instruction, const VariableStore& store)
+        {
+            const Variant& lhs = sm.operand(store, instruction._firstOperand);
+            if(lhs.getType() != STRING) {
+                CSVSQLDB_THROW(StackMachineException, "can only do like operations on strings");
+            }
+            sm._registers[instruction._result] = Variant(sm._instructions[instruction._instruction]._r->match(lhs.asString()));
+        }
+
+        static void function(StackMachine& sm, const StackMachine::CompiledInstruction& instruction, const VariableStore& store)
+        {
+            const Function& func = *instruction._function;
+            sm._parameters.clear();
+            size_t n = 0;
+            for(const auto& param : func.getParameterTypes()) {
+                const Variant& v = sm.operand(store, instruction._firstOperand + n++);
+                if(param != v.getType()) {
+                    try {
+                        sm._parameters.emplace(sm._parameters.end(), unaryOperation(OP_CAST, param, v));
+                    } catch(const std::exception&) {
+                        CSVSQLDB_THROW(StackMachineException, "calling function '" << func.getName() << "' with wrong parameter");
+                    }
+                } else {
+                    sm._parameters.emplace(sm._parameters.end(), v);
+                }
+            }
+            setRegister(sm._registers[instruction._result], func.call(sm._parameters));
+        }
+
+        template <typename CAST, typename LHS, typename RHS>
+        static StackMachine::Kernel arithmeticKernel(StackMachine::OpCode code)
+        {
+            switch(code) {
+                case StackMachine::ADD:
+                    return &typedBinary<CAST, LHS, RHS, std::plus<CAST>>;
+                case StackMachine::SUB:
+                    return &typedBinary<CAST, LHS, RHS, std::minus<CAST>>;
+                case StackMachine::MUL:
+                    return &typedBinary<CAST, LHS, RHS, std::multiplies<CAST>>;
+                case StackMachine::DIV:
+                    return &typedBinary<CAST, LHS, RHS, std::divides<CAST>>;
+                default:
+                    return comparisonKernel<CAST, LHS, RHS>(code);
+            }
+        }
+
+        template <typename CAST, typename LHS, typename RHS>
+        static StackMachine::Kernel comparisonKernel(StackMachine::OpCode code)
+        {
+            switch(code) {
+                case StackMachine::EQ:
+                    return &typedBinary<CAST, LHS, RHS, EqualTo<CAST>>;
+                case StackMachine::NEQ:
+                    return &typedBinary<CAST, LHS, RHS, NotEqualTo<CAST>>;
+                case StackMachine::GT:
+                    return &typedBinary<CAST, LHS, RHS, std::greater<CAST>>;
+                case StackMachine::GE:
+                    return &typedBinary<CAST, LHS, RHS, std::greater_equal<CAST>>;
+                case StackMachine::LT:
+                    return &typedBinary<CAST, LHS, RHS, std::less<CAST>>;
+                case StackMachine::LE:
+                    return &typedBinary<CAST, LHS, RHS, std::less_equal<CAST>>;
+                default:
+                    return nullptr;
+            }
+        }
+
+        /// Returns a kernel working directly on the native values for the most common operand types, or nullptr if
+        /// the bound type operation has to be used. The kernels have to behave exactly like the type operations.
+        static StackMachine::Kernel typedBinaryKernel(StackMachine::OpCode code, eType lhs, eType rhs)
+        {
+            if(lhs == INT && rhs == INT) {
+                if(code == StackMachine::MOD) {
+                    return &typedBinary<int64_t, int64_t, int64_t, std::modulus<int64_t>>;
+                }
+                return arithmeticKernel<int64_t, int64_t, int64_t>(code);
+            } else if(lhs == REAL && rhs == REAL) {
+                return arithmeticKernel<double, double, double>(code);
+            } else if(lhs == INT && rhs == REAL) {
+                return arithmeticKernel<double, int64_t, double>(code);
+            } else if(lhs == REAL && rhs == INT) {
+                return arithmeticKernel<double, double, int64_t>(code);
+            } else if(lhs == DATE && rhs == DATE) {
+                return comparisonKernel<csvsqldb::Date, csvsqldb::Date, csvsqldb::Date>(code);
+            } else if(lhs == BOOLEAN && rhs == BOOLEAN) {
+                if(code == StackMachine::AND) {
+                    // null values are handled by the bound operation, so no three-valued logic is needed here
+                    return &typedBinary<bool, bool, bool, std::logical_and<bool>>;
+                } else if(code == StackMachine::OR) {
+                    return &typedBinary<bool, bool, bool, std::logical_or<bool>>;
+                }
+            }
+            return nullptr;
+        }
+
+        template <typename CAST, typename LHS, typename RHS, typename RET, typename OP>
+        static void batchBinary(StackMachine& sm, const StackMachine::CompiledInstruction& instruction, const VariableBatch& batch, size_t rows)
+        {
+            const ValueVector& lhs = sm.vectorOperand(batch, instruction._firstOperand);
+            const ValueVector& rhs = sm.vectorOperand(batch, instruction._firstOperand + 1);
+            ValueVector& result = sm._vectorRegisters[instruction._result];
+            result.reset(instruction._type, rows);
+
+            const LHS* l = lhs.data<LHS>();
+            const RHS* r = rhs.data<RHS>();
+            const uint8_t* ln = lhs._nulls.data();
+            const uint8_t* rn = rhs._nulls.data();
+            RET* out = result.data<RET>();
+            uint8_t* on = result._nulls.data();
+            OP op;
+            for(size_t n = 0; n < rows; ++n) {
+                out[n] = op(static_cast<CAST>(l[n]), static_cast<CAST>(r[n]));
+                on[n] = ln[n] | rn[n];
+            }
+        }
+
+        template <typename OP>
+        static void batchIntegerDivision(StackMachine& sm, const StackMachine::CompiledInstruction& instruction, const VariableBatch& batch,
+                                         size_t rows)
+        {
+            const ValueVector& lhs = sm.vectorOperand(batch, instruction._firstOperand);
+            const ValueVector& rhs = sm.vectorOperand(batch, instruction._firstOperand + 1);
+            ValueVector& result = sm._vectorRegisters[instruction._result];
+            result.reset(instruction._type, rows);
+
+            const int64_t* l = lhs.data<int64_t>();
+            const int64_t* r = rhs.data<int64_t>();
+            const uint8_t* ln = lhs._nulls.data();
+            const uint8_t* rn = rhs._nulls.data();
+            int64_t* out = result.data<int64_t>();
+            uint8_t* on = result._nulls.data();
+            OP op;
+            for(size_t n = 0; n < rows; ++n) {
+                // null rows carry arbitrary values, which must not be divided
+                on[n] = ln[n] | rn[n];
+                out[n] = on[n] ? 0 : op(l[n], r[n]);
+            }
+        }
+
+        static void batchAnd(StackMachine& sm, const StackMachine::CompiledInstruction& instruction, const VariableBatch& batch, size_t rows)
+        {
+            const ValueVector& lhs = sm.vectorOperand(batch, instruction._firstOperand);
+            const ValueVector& rhs = sm.vectorOperand(batch, instruction._firstOperand + 1);
+            ValueVector& result = sm._vectorRegisters[instruction._result];
+            result.reset(BOOLEAN, rows);
+
+            const int64_t* l = lhs.data<int64_t>();
+            const int64_t* r = rhs.data<int64_t>();
+            const uint8_t* ln = lhs._nulls.data();
+            const uint8_t* rn = rhs._nulls.data();
+            int64_t* out = result.data<int64_t>();
+            uint8_t* on = result._nulls.data();
+            for(size_t n = 0; n < rows; ++n) {
+                // a null combined with false is false, otherwise null
+                uint8_t lfalse = !ln[n] & (l[n] == 0);
+                uint8_t rfalse = !rn[n] & (r[n] == 0);
+                on[n] = (ln[n] | rn[n]) & !(lfalse | rfalse);
+                out[n] = !ln[n] & !rn[n] & (l[n] != 0) & (r[n] != 0);
+            }
+        }
+
+        static void batchOr(StackMachine& sm, const StackMachine::CompiledInstruction& instruction, const VariableBatch& batch, size_t rows)
+        {
+            const ValueVector& lhs = sm.vectorOperand(batch, instruction._firstOperand);
+            const ValueVector& rhs = sm.vectorOperand(batch, instruction._firstOperand + 1);
+            ValueVector& result = sm._vectorRegisters[instruction._result];
+            result.reset(BOOLEAN, rows);
+
+            const int64_t* l = lhs.data<int64_t>();
+            const int64_t* r = rhs.data<int64_t>();
+            const uint8_t* ln = lhs._nulls.data();
+            const uint8_t* rn = rhs._nulls.data();
+            int64_t* out = result.data<int64_t>();
+            uint8_t* on = result._nulls.data();
+            for(size_t n = 0; n < rows; ++n) {
+                // a null combined with true is true, otherwise null
+                uint8_t ltrue = !ln[n] & (l[n] != 0);
+                uint8_t rtrue = !rn[n] & (r[n] != 0);
+                on[n] = (ln[n] | rn[n]) & !(ltrue | rtrue);
+                out[n] = ltrue | rtrue;
+            }
+        }
+
+        static void batchNot(StackMachine& sm, const StackMachine::CompiledInstruction& instruction, const VariableBatch& batch, size_t rows)
+        {
+            const ValueVector& rhs = sm.vectorOperand(batch, instruction._firstOperand);
+            ValueVector& result = sm._vectorRegisters[instruction._result];
+            result.reset(BOOLEAN, rows);
+
+            const int64_t* r = rhs.data<int64_t>();
+            const uint8_t* rn = rhs._nulls.data();
+            int64_t* out = result.data<int64_t>();
+            uint8_t* on = result._nulls.data();
+            for(size_t n = 0; n < rows; ++n) {
+                out[n] = r[n] == 0;
+                on[n] = rn[n];
+            }
+        }
+
+        template <typename T>
+        static void batchMinus(StackMachine& sm, const StackMachine::CompiledInstruction& instruction, const VariableBatch& batch, size_t rows)
+        {
+            const ValueVector& rhs = sm.vectorOperand(batch, instruction._firstOperand);
+            ValueVector& result = sm._vectorRegisters[instruction._result];
+            result.reset(instruction._type, rows);
+
+            const T* r = rhs.data<T>();
+            const uint8_t* rn = rhs._nulls.data();
+            T* out = result.data<T>();
+            uint8_t* on = result._nulls.data();
+            for(size_t n = 0; n < rows; ++n) {
+                out[n] = -r[n];
+                on[n] = rn[n];
+            }
+        }
+
+        static void batchMove(StackMachine& sm, const StackMachine::CompiledInstruction& instruction, const VariableBatch& batch, size_t)
+        {
+            sm._vectorRegisters[instruction._result] = sm.vectorOperand(batch, instruction._firstOperand);
+        }
+
+        template <typename CAST, typename LHS, typename RHS>
+        static StackMachine::BatchKernel batchComparisonKernel(StackMachine::OpCode code)
+        {
+            switch(code) {
+                case StackMachine::EQ:
+                    return &batchBinary<CAST, LHS, RHS, int64_t, EqualTo<CAST>>;
+                case StackMachine::NEQ:
+                    return &batchBinary<CAST, LHS, RHS, int64_t, NotEqualTo<CAST>>;
+                case StackMachine::GT:
+                    return &batchBinary<CAST, LHS, RHS, int64_t, std::greater<CAST>>;
+                case StackMachine::GE:
+                    return &batchBinary<CAST, LHS, RHS, int64_t, std::greater_equal<CAST>>;
+                case StackMachine::LT:
+                    return &batchBinary<CAST, LHS, RHS, int64_t, std::less<CAST>>;
+                case StackMachine::LE:
+                    return &batchBinary<CAST, LHS, RHS, int64_t, std::less_equal<CAST>>;
+                default:
+                    return nullptr;
+            }
+        }
+
+        template <typename CAST, typename LHS, typename RHS>
+        static StackMachine::BatchKernel batchArithmeticKernel(StackMachine::OpCode code)
+        {
+            switch(code) {
+                case StackMachine::ADD:
+                    return &batchBinary<CAST, LHS, RHS, CAST, std::plus<CAST>>;
+                case StackMachine::SUB:
+                    return &batchBinary<CAST, LHS, RHS, CAST, std::minus<CAST>>;
+                case StackMachine::MUL:
+                    return &batchBinary<CAST, LHS, RHS, CAST, std::multiplies<CAST>>;
+                case StackMachine::DIV:
+                    return &batchBinary<CAST, LHS, RHS, CAST, std::divides<CAST>>;
+                default:
+                    return batchComparisonKernel<CAST, LHS, RHS>(code);
+            }
+        }
+
+        /// Returns the batch kernel for the operation or nullptr, if the operand types cannot be evaluated in batches.
+        static StackMachine::BatchKernel batchBinaryKernel(StackMachine::OpCode code, eType lhs, eType rhs)
+        {
+            if(lhs == INT && rhs == INT) {
+                if(code == StackMachine::DIV) {
+                    return &batchIntegerDivision<std::divides<int64_t>>;
+                } else if(code == StackMachine::MOD) {
+                    return &batchIntegerDivision<std::modulus<int64_t>>;
+                }
+                return batchArithmeticKernel<int64_t, int64_t, int64_t>(code);
+            } else if(lhs == REAL && rhs == REAL) {
+                return batchArithmeticKernel<double, double, double>(code);
+            } else if(lhs == INT && rhs == REAL) {
+                return batchArithmeticKernel<double, int64_t, double>(code);
+            } else if(lhs == REAL && rhs == INT) {
+                return batchArithmeticKernel<double, double, int64_t>(code);
+            } else if(lhs == DATE && rhs == DATE) {
+                return batchComparisonKernel<int64_t, int64_t, int64_t>(code);
+            } else if(lhs == BOOLEAN && rhs == BOOLEAN) {
+                if(code == StackMachine::AND) {
+                    return &batchAnd;
+                } else if(code == StackMachine::OR) {
+                    return &batchOr;
+                }
+            }
+            return nullptr;
+        }
+    };
+
+
+    StackMachine::StackMachine()
+    : _state(NOT_COMPILED)
+    , _resultRegister(0)
+    , _resultType(NONE)
+    , _vectorizable(false)
+    {
+    }
+
     void StackMachine::addInstruction(const Instruction& instruction)
     {
         _instructions.emplace(_instructions.end(), instruction);
+        _state = NOT_COMPILED;
+    }
+
+    bool StackMachine::compile(const VariableTypes& types, const FunctionRegistry& functions)
+    {
+        struct Entry {
+            Operand _operand;
+            eType _type;
+            bool _dynamic;
+        };
+        std::vector<Entry> stack;
+        std::vector<size_t> depthRegisters;
+        std::vector<size_t> constantRegisters;
+        bool vectorizable = true;
+
+        _program.clear();
+        _operands.clear();
+        _operations.clear();
+        _registers.clear();
+        _compiledTypes.clear();
+        _vectorRegisters.clear();
+        _vectorizable = false;
+        _state = INTERPRETED;
+
+        auto resultRegister = [&](size_t depth) {
+            while(depthRegisters.size() <= depth) {
+                depthRegisters.push_back(_registers.size());
+                _registers.emplace_back(Variant());
+            }
+            return depthRegisters[depth];
+        };
+        auto newInstruction = [&](Kernel kernel, size_t index, size_t operandCount) {
+            CompiledInstruction instruction;
+            instruction._kernel = kernel;
+            instruction._batchKernel = nullptr;
+            instruction._type = NONE;
+            instruction._instruction = index;
+            instruction._firstOperand = _operands.size();
+            instruction._operandCount = operandCount;
+            instruction._firstOperation = _operations.size();
+            instruction._unary = nullptr;
+            for(size_t n = 0; n < operandCount; ++n) {
+                _operands.push_back(stack[stack.size() - 1 - n]._operand);
+            }
+            stack.resize(stack.size() - operandCount);
+            instruction._result = resultRegister(stack.size());
+            return instruction;
+        };
+        auto pushResult = [&](CompiledInstruction& instruction, eType type, bool dynamic) {
+            instruction._type = type;
+            vectorizable = vectorizable && instruction._batchKernel;
+            _program.push_back(instruction);
+            Entry entry = {{false, instruction._result}, type, dynamic};
+            stack.push_back(entry);
+        };
+        auto bindBinary = [&](eOperationType op, const Entry& lhs, const Entry& rhs, eType& retType) {
+            if(lhs._dynamic || rhs._dynamic) {
+                _operations.push_back(nullptr);
+                return true;
+            }
+            const BinaryOperation* operation = findBinaryOperation(op, lhs._type, rhs._type);
+            if(!operation) {
+                return false;
+            }
+            _operations.push_back(operation);
+            retType = inferTypeOfBinaryOperation(op, lhs._type, rhs._type);
+            return true;
+        };
+
+        for(size_t index = 0; index < _instructions.size(); ++index) {
+            const Instruction& instruction = _instructions[index];
+            switch(instruction._opCode) {
+                case NOP:
+                case PLUS:
+                    break;
+                case PUSH: {
+                    Entry entry = {{false, _registers.size()}, instruction._value.getType(), false};
+                    vectorizable = vectorizable && ValueVector::isSupportedType(instruction._value.getType());
+                    constantRegisters.push_back(_registers.size());
+                    _registers.emplace_back(instruction._value);
+                    stack.push_back(entry);
+                    break;
+                }
+                case PUSHVAR: {
+                    if(instruction._value.getType() != INT) {
+                        return false;
+                    }
+                    size_t variable = static_cast<size_t>(instruction._value.asInt());
+                    if(variable >= types.size()) {
+                        return false;
+                    }
+                    Entry entry = {{true, variable}, types[variable], false};
+                    vectorizable = vectorizable && ValueVector::isSupportedType(types[variable]);
+                    stack.push_back(entry);
+                    _compiledTypes.push_back(std::make_pair(variable, types[variable]));
+                    break;
+                }
+                case ADD:
+                case SUB:
+                case DIV:
+                case MOD:
+                case MUL:
+                case EQ:
+                case NEQ:
+                case IS:
+                case ISNOT:
+                case GT:
+                case GE:
+                case LT:
+                case LE:
+                case AND:
+                case OR:
+                case CONCAT: {
+                    if(stack.size() < 2) {
+                        return false;
+                    }
+                    const Entry lhs = stack[stack.size() - 1];
+                    const Entry rhs = stack[stack.size() - 2];
+                    eType retType = NONE;
+                    CompiledInstruction compiled = newInstruction(&StackMachineKernels::binary, index, 2);
+                    if(!bindBinary(mapOpCodeToBinaryOperationType(instruction._opCode), lhs, rhs, retType)) {
+                        return false;
+                    }
+                    bool dynamic = lhs._dynamic || rhs._dynamic;
+                    if(!dynamic) {
+                        Kernel kernel = StackMachineKernels::typedBinaryKernel(instruction._opCode, lhs._type, rhs._type);
+                        if(kernel) {
+                            compiled._kernel = kernel;
+                        }
+                        compiled._batchKernel = StackMachineKernels::batchBinaryKernel(instruction._opCode, lhs._type, rhs._type);
+                    }
+                    pushResult(compiled, retType, dynamic);
+                    break;
+                }
+                case NOT:
+                case MINUS:
+                case CAST: {
+                    if(stack.empty()) {
+                        return false;
+                    }
+                    const Entry rhs = stack.back();
+                    eOperationType op = instruction._opCode == NOT ? OP_NOT : (instruction._opCode == MINUS ? OP_MINUS : OP_CAST);
+                    eType retType = instruction._opCode == NOT ? BOOLEAN
+                                                               : (instruction._opCode == MINUS ? rhs._type : instruction._value.getType());
+                    CompiledInstruction compiled = newInstruction(&StackMachineKernels::unary, index, 1);
+                    if(!rhs._dynamic) {
+                        compiled._unary = findUnaryOperation(op, retType, rhs._type);
+                        if(!compiled._unary) {
+                            return false;
+                        }
+                        if(instruction._opCode == NOT && rhs._type == BOOLEAN) {
+                            compiled._kernel = &StackMachineKernels::notBool;
+                            compiled._batchKernel = &StackMachineKernels::batchNot;
+                        } else if(instruction._opCode == MINUS && rhs._type == INT) {
+                            compiled._kernel = &StackMachineKernels::minus<int64_t>;
+                            compiled._batchKernel = &StackMachineKernels::batchMinus<int64_t>;
+                        } else if(instruction._opCode == MINUS && rhs._type == REAL) {
+                            compiled._kernel = &StackMachineKernels::minus<double>;
+                            compiled._batchKernel = &StackMachineKernels::batchMinus<double>;
+                        }
+                    }
+                    pushResult(compiled, retType, rhs._dynamic);
+                    break;
+                }
+                case BETWEEN: {
+                    if(stack.size() < 3) {
+                        return false;
+                    }
+                    const Entry lhs = stack[stack.size() - 1];
+                    const Entry from = stack[stack.size() - 2];
+                    const Entry to = stack[stack.size() - 3];
+                    eType retType = NONE;
+                    CompiledInstruction compiled = newInstruction(&StackMachineKernels::between, index, 3);
+                    if(!bindBinary(OP_GE, to, from, retType) || !bindBinary(OP_GE, lhs, from, retType)
+                       || !bindBinary(OP_LE, lhs, to, retType) || !bindBinary(OP_GE, lhs, to, retType)
+                       || !bindBinary(OP_LE, lhs, from, retType)) {
+                        return false;
+                    }
+                    pushResult(compiled, BOOLEAN, false);
+                    break;
+                }
+                case IN: {
+                    size_t count = static_cast<size_t>(instruction._value.asInt());
+                    if(stack.size() < count + 1) {
+                        return false;
+                    }
+                    const Entry lhs = stack.back();
+                    eType retType = NONE;
+                    for(size_t n = 0; n < count; ++n) {
+                        if(!bindBinary(OP_EQ, lhs, stack[stack.size() - 2 - n], retType)) {
+                            return false;
+                        }
+                    }
+                    CompiledInstruction compiled = newInstruction(&StackMachineKernels::in, index, count + 1);
+                    compiled._firstOperation -= count;
+                    pushResult(compiled, BOOLEAN, false);
+                    break;
+                }
+                case LIKE: {
+                    if(stack.empty() || !instruction._r || (!stack.back()._dynamic && stack.back()._type != STRING)) {
+                        return false;
+                    }
+                    CompiledInstruction compiled = newInstruction(&StackMachineKernels::like, index, 1);
+                    pushResult(compiled, BOOLEAN, false);
+                    break;
+                }
+                case FUNC: {
+                    if(instruction._value.getType() != STRING) {
+                        return false;
+                    }
+                    Function::Ptr func = functions.getFunction(instruction._value.asString());
+                    if(!func || stack.size() < func->getParameterTypes().size()) {
+                        return false;
+                    }
+                    CompiledInstruction compiled = newInstruction(&StackMachineKernels::function, index, func->getParameterTypes().size());
+                    compiled._function = func;
+                    // functions are not bound to their declared return type, so the type is only known at runtime
+                    pushResult(compiled, func->getReturnType(), true);
+                    break;
+                }
+            }
+        }
+
+        if(stack.empty()) {
+            return false;
+        }
+        if(stack.back()._operand._isVariable) {
+            CompiledInstruction compiled = newInstruction(&StackMachineKernels::move, _instructions.size(), 1);
+            compiled._batchKernel = &StackMachineKernels::batchMove;
+            pushResult(compiled, stack.back()._type, false);
+        }
+        _resultRegister = stack.back()._operand._index;
+        _resultType = stack.back()._type;
+        _state = COMPILED;
+
+        if(vectorizable) {
+            _vectorRegisters.resize(_registers.size());
+            for(const auto& reg : constantRegisters) {
+                _vectorRegisters[reg].fill(_registers[reg], VariableBatch::MAX_ROWS);
+            }
+            _vectorizable = true;
+        }
+        return true;
+    }
+
+    const ValueVector& StackMachine::evaluateBatch(const VariableBatch& batch)
+    {
+        if(!isVectorizable()) {
+            CSVSQLDB_THROW(StackMachineException, "program cannot be evaluated in batches");
+        }
+        size_t rows = batch.size();
+        if(rows > VariableBatch::MAX_ROWS) {
+            CSVSQLDB_THROW(StackMachineException, "batch exceeds " << VariableBatch::MAX_ROWS << " rows");
+        }
+        for(const auto& variable : _compiledTypes) {
+            if(variable.first >= batch.numberOfVariables() || batch[variable.first].getType() != variable.second) {
+                CSVSQLDB_THROW(StackMachineException, "batch variable types do not match the compiled types");
+            }
+        }
+
+        for(const auto& instruction : _program) {
+            instruction._batchKernel(*this, instruction, batch, rows);
+        }
+        return _vectorRegisters[_resultRegister];
+    }
+
+    size_t StackMachine::selectBatch(const VariableBatch& batch, SelectionVector& selection)
+    {
+        const ValueVector& result = evaluateBatch(batch);
+        if(result.getType() != BOOLEAN) {
+            CSVSQLDB_THROW(StackMachineException, "expected a boolean predicate for selection");
+        }
+        size_t rows = batch.size();
+        const int64_t* values = result.data<int64_t>();
+        const uint8_t* nulls = result._nulls.data();
+
+        selection.resize(rows);
+        size_t count = 0;
+        for(size_t n = 0; n < rows; ++n) {
+            selection[count] = static_cast<uint32_t>(n);
+            count += !nulls[n] & (values[n] != 0);
+        }
+        selection.resize(count);
+        return count;
+    }
+
+    bool StackMachine::matchesCompiledTypes(const VariableStore& store) const
+    {
+        for(const auto& variable : _compiledTypes) {
+            if(variable.first >= store.size() || store[variable.first].getType() != variable.second) {
+                return false;
+            }
+        }
+        return true;
     }
 
     Variant& StackMachine::getTopValue()
@@ -184,6 +1079,25 @@ namespace csvsqldb
     }
 
     Variant& StackMachine::evaluate(const VariableStore& store, const FunctionRegistry& functions)
+    {
+        if(_state == NOT_COMPILED) {
+            VariableTypes types;
+            for(size_t n = 0; n < store.size(); ++n) {
+                types.push_back(store[n].getType());
+            }
+            compile(types, functions);
+        }
+        if(_state != COMPILED || !matchesCompiledTypes(store)) {
+            return interpret(store, functions);
+        }
+
+        for(const auto& instruction : _program) {
+            instruction._kernel(*this, instruction, store);
+        }
+        return _registers[_resultRegister];
+    }
+
+    Variant& StackMachine::interpret(const VariableStore& store, const FunctionRegistry& functions)
     {
         reset();
 
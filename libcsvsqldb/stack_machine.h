@@ -37,6 +37,7 @@
 #include "libcsvsqldb/inc.h"
 
 #include "function_registry.h"
+#include "typeoperations.h"
 #include "variant.h"
 
 #include "base/exception.h"
@@ -60,6 +61,11 @@ namespace csvsqldb
 
         const Variant& operator[](size_t index) const;
 
+        size_t size() const
+        {
+            return _variables.size();
+        }
+
     private:
         typedef std::vector<Variant> Variables;
 
@@ -67,11 +73,153 @@ namespace csvsqldb
     };
 
 
+    /**
+     * A column of values of one type used for batch evaluation. INT, BOOLEAN and DATE values are kept as plain
+     * integers, REAL values as doubles, and a separate null flag per row, so that the kernels can run tight loops over
+     * plain arrays.
+     */
+    struct CSVSQLDB_EXPORT ValueVector {
+        explicit ValueVector(eType type = NONE);
+
+        static bool isSupportedType(eType type);
+
+        eType getType() const
+        {
+            return _type;
+        }
+
+        size_t size() const
+        {
+            return _nulls.size();
+        }
+
+        bool isNull(size_t row) const
+        {
+            return _nulls[row] != 0;
+        }
+
+        void clear();
+
+        void reset(eType type, size_t rows);
+
+        void fill(const Variant& value, size_t rows);
+
+        void addValue(const Value& value);
+
+        void addValue(const Variant& value);
+
+        Variant getVariant(size_t row) const;
+
+        template <typename T>
+        T* data();
+
+        template <typename T>
+        const T* data() const;
+
+        eType _type;
+        std::vector<int64_t> _ints;
+        std::vector<double> _reals;
+        std::vector<uint8_t> _nulls;
+    };
+
+    template <>
+    inline int64_t* ValueVector::data<int64_t>()
+    {
+        return _ints.data();
+    }
+
+    template <>
+    inline const int64_t* ValueVector::data<int64_t>() const
+    {
+        return _ints.data();
+    }
+
+    template <>
+    inline double* ValueVector::data<double>()
+    {
+        return _reals.data();
+    }
+
+    template <>
+    inline const double* ValueVector::data<double>() const
+    {
+        return _reals.data();
+    }
+
+
+    /**
+     * The variables of up to MAX_ROWS rows stored column wise, the batch counterpart of the VariableStore.
+     */
+    class CSVSQLDB_EXPORT VariableBatch
+    {
+    public:
+        static const size_t MAX_ROWS = 1024;
+
+        VariableBatch();
+
+        void setVariableType(size_t index, eType type);
+
+        void addValue(size_t index, const Value& value)
+        {
+            _variables[index].addValue(value);
+        }
+
+        void addValue(size_t index, const Variant& value)
+        {
+            _variables[index].addValue(value);
+        }
+
+        void nextRow()
+        {
+            ++_rows;
+        }
+
+        /// Accounts for rows that were appended to the variable vectors directly.
+        void nextRows(size_t count)
+        {
+            _rows += count;
+        }
+
+        size_t size() const
+        {
+            return _rows;
+        }
+
+        bool isFull() const
+        {
+            return _rows >= MAX_ROWS;
+        }
+
+        void clear();
+
+        const ValueVector& operator[](size_t index) const
+        {
+            return _variables[index];
+        }
+
+        ValueVector& getVariable(size_t index)
+        {
+            return _variables[index];
+        }
+
+        size_t numberOfVariables() const
+        {
+            return _variables.size();
+        }
+
+    private:
+        std::vector<ValueVector> _variables;
+        size_t _rows;
+    };
+
+
     class CSVSQLDB_EXPORT StackMachine
     {
     public:
         typedef std::pair<std::string, size_t> VariableIndex;
         typedef std::vector<VariableIndex> VariableMapping;
+        typedef std::vector<eType> VariableTypes;
+        typedef std::vector<uint32_t> SelectionVector;
 
         enum OpCode {
             ADD,
@@ -156,8 +304,57 @@ namespace csvsqldb
             csvsqldb::RegExp* _r;
         };
 
+        StackMachine();
+
         void addInstruction(const Instruction& instruction);
 
+        /**
+         * Compiles the instructions into a flat program of typed instructions working on fixed register slots. The
+         * operand types are resolved once from the given variable types (indexed by variable index), the operations
+         * and functions are bound up front, so that evaluating a row does no lookups and copies no variables.
+         * Returns false if the instructions cannot be compiled, in which case evaluate keeps interpreting them.
+         */
+        bool compile(const VariableTypes& types, const FunctionRegistry& functions);
+
+        bool isCompiled() const
+        {
+            return _state == COMPILED;
+        }
+
+        /**
+         * Returns true if the compiled program only consists of operations that have a batch implementation, so that
+         * evaluateBatch and selectBatch can be used.
+         */
+        bool isVectorizable() const
+        {
+            return _state == COMPILED && _vectorizable;
+        }
+
+        /**
+         * Returns the type of the result of the compiled program, or NONE if it is not compiled.
+         */
+        eType getResultType() const
+        {
+            return _state == COMPILED ? _resultType : NONE;
+        }
+
+        /**
+         * Evaluates the compiled program for all rows of the batch at once. The variable types of the batch have to
+         * match the compiled types. The returned vector is valid until the next evaluation.
+         */
+        const ValueVector& evaluateBatch(const VariableBatch& batch);
+
+        /**
+         * Evaluates the compiled program as a predicate for all rows of the batch and fills the selection vector with
+         * the indices of the rows the predicate is true for. Returns the number of selected rows.
+         */
+        size_t selectBatch(const VariableBatch& batch, SelectionVector& selection);
+
+        /**
+         * Evaluates the instructions with the given variables. If compile was not called before, the instructions are
+         * compiled on first use with the types of the given variables. Rows whose variable types differ from the
+         * compiled ones are interpreted.
+         */
         Variant& evaluate(const VariableStore& store, const FunctionRegistry& functions);
 
         void reset();
@@ -165,9 +362,51 @@ namespace csvsqldb
         void dump(std::ostream& stream) const;
 
     private:
+        friend struct StackMachineKernels;
+
         typedef std::vector<Instruction> Instructions;
         typedef std::stack<Variant> ValueStack;
 
+        enum State { NOT_COMPILED, COMPILED, INTERPRETED };
+
+        struct Operand {
+            bool _isVariable;
+            size_t _index;
+        };
+        typedef std::vector<Operand> Operands;
+
+        struct CompiledInstruction;
+        typedef void (*Kernel)(StackMachine& sm, const CompiledInstruction& instruction, const VariableStore& store);
+        typedef void (*BatchKernel)(StackMachine& sm, const CompiledInstruction& instruction, const VariableBatch& batch, size_t rows);
+
+        struct CompiledInstruction {
+            Kernel _kernel;
+            BatchKernel _batchKernel;
+            eType _type;
+            size_t _instruction;
+            size_t _result;
+            size_t _firstOperand;
+            size_t _operandCount;
+            size_t _firstOperation;
+            const UnaryOperation* _unary;
+            Function::Ptr _function;
+        };
+        typedef std::vector<CompiledInstruction> CompiledInstructions;
+        typedef std::vector<const BinaryOperation*> BoundOperations;
+
+        Variant& interpret(const VariableStore& store, const FunctionRegistry& functions);
+        bool matchesCompiledTypes(const VariableStore& store) const;
+        const Variant& operand(const VariableStore& store, size_t index) const
+        {
+            const Operand& op = _operands[index];
+            return op._isVariable ? store[op._index] : _registers[op._index];
+        }
+        const ValueVector& vectorOperand(const VariableBatch& batch, size_t index) const
+        {
+            const Operand& op = _operands[index];
+            return op._isVariable ? batch[op._index] : _vectorRegisters[op._index];
+        }
+
         Variant& getTopValue();
         const Variant getNextValue();
         eOperationType mapOpCodeToBinaryOperationType(OpCode code)
@@ -212,6 +451,18 @@ namespace csvsqldb
 
         Instructions _instructions;
         ValueStack _valueStack;
+
+        State _state;
+        CompiledInstructions _program;
+        Operands _operands;
+        BoundOperations _operations;
+        Variants _registers;
+        Variants _parameters;
+        std::vector<std::pair<size_t, eType>> _compiledTypes;
+        size_t _resultRegister;
+        eType _resultType;
+        bool _vectorizable;
+        std::vector<ValueVector> _vectorRegisters;
     };
 }
 
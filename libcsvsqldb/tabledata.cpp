@@ -36,6 +36,7 @@
 #include "sql_parser.h"
 
 #include "base/json_object.h"
+#include "base/string_helper.h"
 
 
 namespace csvsqldb
@@ -78,6 +79,10 @@ namespace csvsqldb
     void TableData::addColumn(
     const std::string name, eType type, bool primaryKey, bool unique, bool notNull, csvsqldb::Any defaultValue, const ASTExprNodePtr& check, uint32_t length)
     {
+        if(csvsqldb::toupper_copy(name) == "SYSTEM_FILENAME" && type != STRING) {
+            // virtual column, that is filled with the name of the scanned file
+            CSVSQLDB_THROW(SqlException, "column 'SYSTEM_FILENAME' of table " << _tableName << " has to be of type VARCHAR");
+        }
         Column column;
         column._name = name;
         column._type = type;
@@ -101,6 +106,16 @@ namespace csvsqldb
         _constraints.push_back(constraint);
     }
 
+    void TableData::setSortColumns(const csvsqldb::StringVector& columns)
+    {
+        for(const auto& column : columns) {
+            if(!hasColumn(column)) {
+                CSVSQLDB_THROW(SqlException, "sort column '" << column << "' not found in table " << _tableName);
+            }
+        }
+        _sortColumns = columns;
+    }
+
     std::string TableData::asJson() const
     {
         std::stringstream table;
@@ -190,7 +205,17 @@ namespace csvsqldb
             table << "\n      }";
             ++m;
         }
-        table << "\n    ]\n  }\n}";
+        table << "\n    ],";
+        table << "\n    \"sort columns\" : [ ";
+        n = 0;
+        for(const auto& column : _sortColumns) {
+            if(n > 0) {
+                table << ",";
+            }
+            table << "\"" << column << "\"";
+            ++n;
+        }
+        table << " ]\n  }\n}";
 
         return table.str();
     }
@@ -248,6 +273,14 @@ namespace csvsqldb
             }
             tabledata.addConstraint(primary, unique, check);
         }
+        // tables stored by older versions have no sort columns
+        if(table.getObjects().count("sort columns")) {
+            csvsqldb::StringVector sortColumns;
+            for(const auto& column : table["sort columns"].getArray()) {
+                sortColumns.push_back(column.getAsString());
+            }
+            tabledata.setSortColumns(sortColumns);
+        }
 
         return tabledata;
     }
@@ -268,6 +301,7 @@ namespace csvsqldb
         for(const auto& constraint : createNode->_tableConstraints) {
             tabledata.addConstraint(constraint._primaryKeys, constraint._uniqueKeys, constraint._check);
         }
+        tabledata.setSortColumns(createNode->_sortColumns);
         return tabledata;
     }
 }
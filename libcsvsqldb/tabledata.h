@@ -78,6 +78,13 @@ namespace csvsqldb
         void addColumn(const std::string name, eType type, bool primaryKey, bool unique, bool notNull, csvsqldb::Any defaultValue, const ASTExprNodePtr& check, uint32_t length);
         void addConstraint(const csvsqldb::StringVector& primaryKey, const csvsqldb::StringVector& unique, const ASTExprNodePtr& check);
 
+        /**
+         * Declares the ascending order of the rows in the table files. The order is not checked here, a merge join relies
+         * on it without sorting the rows and fails with an error, if it finds a row out of the declared order.
+         * @param columns The names of the sort columns, the first one is the most significant
+         */
+        void setSortColumns(const csvsqldb::StringVector& columns);
+
         std::string asJson() const;
         static TableData fromJson(std::istream& stream);
 
@@ -94,6 +101,10 @@ namespace csvsqldb
         const Column& getColumn(const std::string& name) const;
         const Column& getColumn(size_t index) const;
         bool hasColumn(const std::string& name) const;
+        const csvsqldb::StringVector& sortColumns() const
+        {
+            return _sortColumns;
+        }
 
     private:
         typedef std::vector<Column> Columns;
@@ -108,6 +119,7 @@ namespace csvsqldb
         std::string _tableName;
         Columns _columns;
         TableConstraints _constraints;
+        csvsqldb::StringVector _sortColumns;
     };
 }
 
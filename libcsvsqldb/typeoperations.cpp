@@ -1207,6 +1207,21 @@ namespace csvsqldb
         + typeToString(rhs.getType()));
     }
 
+    const BinaryOperation* findBinaryOperation(eOperationType op, eType lhs, eType rhs)
+    {
+        BinaryOperationType::iterator iter = g_binaryOperations.find(OperationKey(op, lhs, rhs));
+
+        if(iter != g_binaryOperations.end()) {
+            return iter->second.get();
+        }
+        return nullptr;
+    }
+
+    Variant executeBinaryOperation(const BinaryOperation& operation, const Variant& lhs, const Variant& rhs)
+    {
+        return operation.execute(lhs, rhs);
+    }
+
     eType inferTypeOfBinaryOperation(eOperationType op, eType lhs, eType rhs)
     {
         BinaryOperationType::iterator iter = g_binaryOperations.find(OperationKey(op, lhs, rhs));
@@ -1340,6 +1355,21 @@ namespace csvsqldb
         }
     }
 
+    const UnaryOperation* findUnaryOperation(eOperationType op, eType retType, eType rhs)
+    {
+        UnaryOperationType::iterator iter = g_unaryOperations.find(OperationKey(op, retType, rhs));
+
+        if(iter != g_unaryOperations.end()) {
+            return iter->second.get();
+        }
+        return nullptr;
+    }
+
+    Variant executeUnaryOperation(const UnaryOperation& operation, const Variant& rhs)
+    {
+        return operation.execute(rhs);
+    }
+
     eType inferTypeOfUnaryOperation(eOperationType op, eType retType, eType rhs)
     {
         UnaryOperationType::iterator iter = g_unaryOperations.find(OperationKey(op, retType, rhs));
@@ -47,6 +47,20 @@ namespace csvsqldb
 
     CSVSQLDB_EXPORT Variant unaryOperation(eOperationType op, eType retType, const Variant& rhs);
 
+    struct BinaryOperation;
+    struct UnaryOperation;
+
+    /// Returns the implementation of the binary operation for the given operand types or nullptr, if there is none.
+    /// The returned operation lives as long as the type system and can be executed repeatedly without any lookup.
+    CSVSQLDB_EXPORT const BinaryOperation* findBinaryOperation(eOperationType op, eType lhs, eType rhs);
+
+    CSVSQLDB_EXPORT Variant executeBinaryOperation(const BinaryOperation& operation, const Variant& lhs, const Variant& rhs);
+
+    /// Returns the implementation of the unary operation for the given types or nullptr, if there is none.
+    CSVSQLDB_EXPORT const UnaryOperation* findUnaryOperation(eOperationType op, eType retType, eType rhs);
+
+    CSVSQLDB_EXPORT Variant executeUnaryOperation(const UnaryOperation& operation, const Variant& rhs);
+
     CSVSQLDB_EXPORT eType inferTypeOfBinaryOperation(eOperationType op, eType lhs, eType rhs);
 
     CSVSQLDB_EXPORT eType inferTypeOfUnaryOperation(eOperationType op, eType retType, eType rhs);
@@ -55,6 +55,8 @@ namespace csvsqldb
 
     enum eDescriptionType { AST, EXEC };
 
+    enum eOutputFormat { CSV_FORMAT, BINARY_FORMAT };
+
     enum eOrder { ASC, DESC };
 
     enum eQuantifier { DISTINCT, ALL };
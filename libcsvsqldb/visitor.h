@@ -270,6 +270,32 @@ namespace csvsqldb
     protected:
         IdentifierSet& _variables;
     };
+
+    class ASTReferencedIdentifierVisitor : public ASTExpressionVariableVisitor
+    {
+    public:
+        using ASTExpressionVariableVisitor::visit;
+
+        ASTReferencedIdentifierVisitor(IdentifierSet& identifiers)
+        : ASTExpressionVariableVisitor(identifiers)
+        {
+        }
+
+        virtual void visit(ASTInNode& node)
+        {
+            for(const auto& exp : node._expressions) {
+                exp->accept(*this);
+            }
+            node._lhs->accept(*this);
+        }
+
+        virtual void visit(ASTAggregateFunctionNode& node)
+        {
+            for(auto& parameter : node._parameters) {
+                parameter._exp->accept(*this);
+            }
+        }
+    };
 }
 
 #endif
@@ -356,6 +356,54 @@ public:
         MPF_TEST_ASSERTEQUAL(1, rowCount);
         MPF_TEST_ASSERTEQUAL("#MIN,MAX NAME,COUNT,ID COUNT\n815,8,3,2\n", ss.str());
     }
+
+    void parallelAggregationTest()
+    {
+        DatabaseTestWrapper dbWrapper;
+        dbWrapper.addTable(TableInitializer("sales", { { "id", csvsqldb::INT }, { "amount", csvsqldb::REAL } }));
+
+        TestRowProvider::Rows& rows = TestRowProvider::getRows("sales");
+        rows.clear();
+        for(int64_t n = 1; n <= 5000; ++n) {
+            rows.push_back({ n, n % 7 ? csvsqldb::Variant(n * 0.5) : csvsqldb::Variant(csvsqldb::REAL) });
+        }
+
+        csvsqldb::ExecutionContext context(dbWrapper.getDatabase());
+        context._numberOfThreads = 4;
+        csvsqldb::ExecutionEngine<TestOperatorNodeFactory> engine(context);
+
+        csvsqldb::ExecutionStatistics statistics;
+        std::stringstream ss;
+        int64_t rowCount =
+        engine.execute("SELECT count(*),count(amount),sum(id),min(id + 1),max(amount) FROM sales", statistics, ss);
+        MPF_TEST_ASSERTEQUAL(1, rowCount);
+        MPF_TEST_ASSERTEQUAL("#$alias_1,$alias_2,$alias_3,$alias_4,$alias_5\n5000,4286,12502500,2,2500.000000\n", ss.str());
+    }
+
+    void batchAggregationTest()
+    {
+        DatabaseTestWrapper dbWrapper;
+        dbWrapper.addTable(TableInitializer("sales", { { "id", csvsqldb::INT }, { "amount", csvsqldb::REAL } }));
+
+        TestRowProvider::Rows& rows = TestRowProvider::getRows("sales");
+        rows.clear();
+        for(int64_t n = 1; n <= 3000; ++n) {
+            rows.push_back({ n, n % 7 ? csvsqldb::Variant(n * 0.5) : csvsqldb::Variant(csvsqldb::REAL) });
+        }
+
+        // a single thread steps the aggregations with whole batches, the select in front of it filters in batches
+        csvsqldb::ExecutionContext context(dbWrapper.getDatabase());
+        context._numberOfThreads = 1;
+        csvsqldb::ExecutionEngine<TestOperatorNodeFactory> engine(context);
+
+        csvsqldb::ExecutionStatistics statistics;
+        std::stringstream ss;
+        int64_t rowCount = engine.execute(
+        "SELECT count(*),count(amount),sum(amount),avg(amount),min(amount),max(id) FROM sales WHERE id > 1000", statistics, ss);
+        MPF_TEST_ASSERTEQUAL(1, rowCount);
+        MPF_TEST_ASSERTEQUAL("#$alias_1,$alias_2,$alias_3,$alias_4,$alias_5,$alias_6\n2000,1714,1714714.500000,1000.416861,501.000000,3000\n",
+                             ss.str());
+    }
 };
 
 MPF_REGISTER_TEST_START("AggreagationTestSuite", AggreagationTestCase);
@@ -368,4 +416,6 @@ MPF_REGISTER_TEST(AggreagationTestCase::nullCountTest);
 MPF_REGISTER_TEST(AggreagationTestCase::nullSumTest);
 MPF_REGISTER_TEST(AggreagationTestCase::allNullTest);
 MPF_REGISTER_TEST(AggreagationTestCase::multiAggregationTest);
+MPF_REGISTER_TEST(AggreagationTestCase::parallelAggregationTest);
+MPF_REGISTER_TEST(AggreagationTestCase::batchAggregationTest);
 MPF_REGISTER_TEST_END();
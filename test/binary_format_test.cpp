@@ -0,0 +1,304 @@
+//
+//  csvsqldb test
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include "test.h"
+
+#include "libcsvsqldb/binary_format.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+
+namespace
+{
+    class RecordingCallback : public csvsqldb::csv::CSVParserCallback
+    {
+    public:
+        virtual void onLong(int64_t num, bool isNull)
+        {
+            if(!isNull) {
+                _ss << num;
+            }
+            next(isNull);
+        }
+
+        virtual void onDouble(double num, bool isNull)
+        {
+            if(!isNull) {
+                _ss << num;
+            }
+            next(isNull);
+        }
+
+        virtual void onString(const char* s, size_t len, bool isNull)
+        {
+            if(!isNull) {
+                _ss << "'" << std::string(s, len) << "'";
+            }
+            next(isNull);
+        }
+
+        virtual void onDate(const csvsqldb::Date& date, bool isNull)
+        {
+            if(!isNull) {
+                _ss << date.format("%F");
+            }
+            next(isNull);
+        }
+
+        virtual void onTime(const csvsqldb::Time& time, bool isNull)
+        {
+            if(!isNull) {
+                _ss << time.format("%H:%M:%S");
+            }
+            next(isNull);
+        }
+
+        virtual void onTimestamp(const csvsqldb::Timestamp& timestamp, bool isNull)
+        {
+            if(!isNull) {
+                _ss << timestamp.format("%Y-%m-%dT%H:%M:%S");
+            }
+            next(isNull);
+        }
+
+        virtual void onBoolean(bool boolean, bool isNull)
+        {
+            if(!isNull) {
+                _ss << (boolean ? "true" : "false");
+            }
+            next(isNull);
+        }
+
+        std::string text() const
+        {
+            return _ss.str();
+        }
+
+    private:
+        void next(bool isNull)
+        {
+            if(isNull) {
+                _ss << "NULL";
+            }
+            _ss << ";";
+        }
+
+        std::stringstream _ss;
+    };
+
+    char* copyString(const char* s)
+    {
+        char* copy = new char[::strlen(s) + 1];
+        ::strcpy(copy, s);
+        return copy;
+    }
+
+    csvsqldb::SymbolInfos makeColumns(const csvsqldb::Types& types)
+    {
+        csvsqldb::SymbolInfos columns;
+        for(size_t n = 0; n < types.size(); ++n) {
+            csvsqldb::SymbolInfoPtr info = std::make_shared<csvsqldb::SymbolInfo>();
+            info->_name = "COLUMN" + std::to_string(n);
+            info->_type = types[n];
+            columns.push_back(info);
+        }
+        return columns;
+    }
+
+    const csvsqldb::Types allTypes = { csvsqldb::INT,
+                                       csvsqldb::REAL,
+                                       csvsqldb::STRING,
+                                       csvsqldb::BOOLEAN,
+                                       csvsqldb::DATE,
+                                       csvsqldb::TIME,
+                                       csvsqldb::TIMESTAMP };
+
+    const csvsqldb::csv::Types allCsvTypes = { csvsqldb::csv::LONG,
+                                               csvsqldb::csv::DOUBLE,
+                                               csvsqldb::csv::STRING,
+                                               csvsqldb::csv::BOOLEAN,
+                                               csvsqldb::csv::DATE,
+                                               csvsqldb::csv::TIME,
+                                               csvsqldb::csv::TIMESTAMP };
+
+    std::string writeStream(size_t rows, size_t frameSize)
+    {
+        csvsqldb::ValInt id(42);
+        csvsqldb::ValDouble amount(12.5);
+        csvsqldb::ValString name(copyString("Fürstenberg"), ::strlen("Fürstenberg"));
+        csvsqldb::ValBool flag(true);
+        csvsqldb::ValDate date(csvsqldb::Date(2015, csvsqldb::Date::June, 29));
+        csvsqldb::ValTime time(csvsqldb::Time(8, 9, 11));
+        csvsqldb::ValTimestamp timestamp(csvsqldb::Timestamp(2015, csvsqldb::Date::June, 29, 8, 9, 11));
+        csvsqldb::Values row = { &id, &amount, &name, &flag, &date, &time, &timestamp };
+
+        csvsqldb::ValInt nullId;
+        csvsqldb::ValDouble nullAmount;
+        csvsqldb::ValString nullName;
+        csvsqldb::ValBool nullFlag;
+        csvsqldb::ValDate nullDate;
+        csvsqldb::ValTime nullTime;
+        csvsqldb::ValTimestamp nullTimestamp;
+        csvsqldb::Values nullRow = { &nullId, &nullAmount, &nullName, &nullFlag, &nullDate, &nullTime, &nullTimestamp };
+
+        std::stringstream ss;
+        csvsqldb::OutputWriter output(ss);
+        csvsqldb::BinaryRowWriter writer(output, frameSize);
+        writer.writeHeader(makeColumns(allTypes));
+        for(size_t n = 0; n < rows; ++n) {
+            writer.writeRow(n % 2 ? nullRow : row);
+        }
+        writer.finish();
+        output.flush();
+        return ss.str();
+    }
+
+    const std::string valueText = "42;12.5;'Fürstenberg';true;2015-06-29;08:09:11;2015-06-29T08:09:11;";
+    const std::string nullText = "NULL;NULL;NULL;NULL;NULL;NULL;NULL;";
+}
+
+
+class BinaryFormatTestCase
+{
+public:
+    void setUp()
+    {
+    }
+
+    void tearDown()
+    {
+    }
+
+    void roundTripTest()
+    {
+        // the small frame size spreads the rows over several frames
+        std::string data = writeStream(100, 64);
+        MPF_TEST_ASSERT(csvsqldb::BinaryRowParser::isBinaryRowStream(data.c_str(), data.size()));
+
+        std::string expected;
+        for(size_t n = 0; n < 100; ++n) {
+            expected += n % 2 ? nullText : valueText;
+        }
+
+        RecordingCallback mappedCallback;
+        csvsqldb::BinaryRowParser mappedParser(data.c_str(), data.size(), allCsvTypes, mappedCallback);
+        MPF_TEST_ASSERTEQUAL(7u, mappedParser.columnNames().size());
+        MPF_TEST_ASSERTEQUAL("COLUMN2", mappedParser.columnNames()[2]);
+        MPF_TEST_ASSERTEQUAL(csvsqldb::TIMESTAMP, mappedParser.columnTypes()[6]);
+        size_t rows = 0;
+        while(mappedParser.parseRow()) {
+            ++rows;
+        }
+        MPF_TEST_ASSERTEQUAL(100u, rows);
+        MPF_TEST_ASSERTEQUAL(expected, mappedCallback.text());
+
+        std::stringstream stream(data);
+        MPF_TEST_ASSERT(csvsqldb::BinaryRowParser::isBinaryRowStream(stream));
+        RecordingCallback streamCallback;
+        csvsqldb::BinaryRowParser streamParser(stream, allCsvTypes, streamCallback);
+        while(streamParser.parseRow()) {
+        }
+        MPF_TEST_ASSERTEQUAL(expected, streamCallback.text());
+    }
+
+    void skipTest()
+    {
+        std::string data = writeStream(2, 1024);
+        csvsqldb::csv::Types types = allCsvTypes;
+        types[1] = csvsqldb::csv::SKIP;
+        types[2] = csvsqldb::csv::SKIP;
+        types[5] = csvsqldb::csv::SKIP;
+
+        RecordingCallback callback;
+        csvsqldb::BinaryRowParser parser(data.c_str(), data.size(), types, callback);
+        MPF_TEST_ASSERT(parser.parseRow());
+        MPF_TEST_ASSERT(parser.parseRow());
+        MPF_TEST_ASSERT(!parser.parseRow());
+        MPF_TEST_ASSERTEQUAL("42;true;2015-06-29;2015-06-29T08:09:11;NULL;NULL;NULL;NULL;", callback.text());
+    }
+
+    void detectionTest()
+    {
+        std::string csv = "id,name\n1,'a'\n";
+        MPF_TEST_ASSERT(!csvsqldb::BinaryRowParser::isBinaryRowStream(csv.c_str(), csv.size()));
+        MPF_TEST_ASSERT(!csvsqldb::BinaryRowParser::isBinaryRowStream("CSV", 3));
+
+        // the detection must not consume the start of a csv stream
+        std::stringstream stream(csv);
+        MPF_TEST_ASSERT(!csvsqldb::BinaryRowParser::isBinaryRowStream(stream));
+        std::string line;
+        std::getline(stream, line);
+        MPF_TEST_ASSERTEQUAL("id,name", line);
+    }
+
+    void errorTest()
+    {
+        std::string data = writeStream(10, 1024);
+        RecordingCallback callback;
+
+        csvsqldb::csv::Types types = allCsvTypes;
+        types.pop_back();
+        MPF_TEST_EXPECTS(csvsqldb::BinaryRowParser(data.c_str(), data.size(), types, callback), csvsqldb::Exception);
+
+        types = allCsvTypes;
+        types[0] = csvsqldb::csv::STRING;
+        MPF_TEST_EXPECTS(csvsqldb::BinaryRowParser(data.c_str(), data.size(), types, callback), csvsqldb::Exception);
+
+        // a stream from a host with the other byte order is rejected instead of being misread
+        std::string swapped = data;
+        std::reverse(swapped.begin() + 9, swapped.begin() + 13);
+        MPF_TEST_EXPECTS(csvsqldb::BinaryRowParser(swapped.c_str(), swapped.size(), allCsvTypes, callback), csvsqldb::Exception);
+
+        // a truncated stream is detected while reading the frames
+        csvsqldb::BinaryRowParser parser(data.c_str(), data.size() - 20, allCsvTypes, callback);
+        MPF_TEST_EXPECTS(parser.parseRow(), csvsqldb::Exception);
+
+        // the writer rejects values, that do not match the column types
+        std::stringstream ss;
+        csvsqldb::OutputWriter output(ss);
+        csvsqldb::BinaryRowWriter writer(output);
+        writer.writeHeader(makeColumns({ csvsqldb::INT }));
+        csvsqldb::ValDouble amount(1.5);
+        csvsqldb::Values row = { &amount };
+        MPF_TEST_EXPECTS(writer.writeRow(row), csvsqldb::Exception);
+    }
+};
+
+MPF_REGISTER_TEST_START("BinaryFormatTestSuite", BinaryFormatTestCase);
+MPF_REGISTER_TEST(BinaryFormatTestCase::roundTripTest);
+MPF_REGISTER_TEST(BinaryFormatTestCase::skipTest);
+MPF_REGISTER_TEST(BinaryFormatTestCase::detectionTest);
+MPF_REGISTER_TEST(BinaryFormatTestCase::errorTest);
+MPF_REGISTER_TEST_END();
@@ -0,0 +1,339 @@
+//
+//  block_reader_test.cpp
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include "test.h"
+
+#include "libcsvsqldb/block_iterator.h"
+#include "libcsvsqldb/operatornode.h"
+
+#include <sstream>
+#include <thread>
+
+
+namespace
+{
+    class BlockReaderProvider : public csvsqldb::BlockProvider
+    {
+    public:
+        BlockReaderProvider(csvsqldb::BlockReader& blockReader)
+        : _blockReader(blockReader)
+        {
+        }
+
+        virtual csvsqldb::BlockPtr getNextBlock()
+        {
+            return _blockReader.getNextBlock();
+        }
+
+    private:
+        csvsqldb::BlockReader& _blockReader;
+    };
+
+    std::string createCSV(size_t lines)
+    {
+        std::string data("id,name\n");
+        for(size_t n = 0; n < lines; ++n) {
+            data += std::to_string(n) + ",name_" + std::to_string(n) + (n % 2 ? "\n" : "\r\n");
+        }
+        return data;
+    }
+}
+
+
+class BlockReaderTestCase
+{
+public:
+    BlockReaderTestCase()
+    {
+    }
+
+    void setUp()
+    {
+        _types.clear();
+        _types.push_back(csvsqldb::INT);
+        _types.push_back(csvsqldb::STRING);
+        _csvTypes.clear();
+        _csvTypes.push_back(csvsqldb::csv::LONG);
+        _csvTypes.push_back(csvsqldb::csv::STRING);
+        _context._skipFirstLine = true;
+    }
+
+    void tearDown()
+    {
+    }
+
+    void serialReaderTest()
+    {
+        std::string data = createCSV(1000);
+        csvsqldb::BlockManager blockManager(100, 4096);
+        {
+            csvsqldb::BlockReader blockReader(blockManager);
+            auto csvparser =
+            std::make_shared<csvsqldb::csv::CSVParser>(_context, data.c_str(), data.size(), _csvTypes, blockReader.callback());
+            blockReader.initialize(csvparser);
+
+            BlockReaderProvider provider(blockReader);
+            csvsqldb::BlockIterator iterator(_types, provider, blockManager);
+            int64_t expected = 0;
+            while(const csvsqldb::Values* row = iterator.getNextRow()) {
+                MPF_TEST_ASSERTEQUAL(expected, static_cast<const csvsqldb::ValInt*>(row->at(0))->asInt());
+                MPF_TEST_ASSERTEQUAL("name_" + std::to_string(expected), static_cast<const csvsqldb::ValString*>(row->at(1))->asString());
+                ++expected;
+            }
+            MPF_TEST_ASSERTEQUAL(1000, expected);
+        }
+        MPF_TEST_ASSERTEQUAL(0u, blockManager.getActiveBlocks());
+    }
+
+    void serialReaderBackpressureTest()
+    {
+        // the input needs far more blocks than the memory budget allows, a slow consumer has to throttle the reader
+        std::string data = createCSV(100000);
+        csvsqldb::BlockManager blockManager(20, 4096);
+        {
+            csvsqldb::BlockReader blockReader(blockManager, 2);
+            auto csvparser =
+            std::make_shared<csvsqldb::csv::CSVParser>(_context, data.c_str(), data.size(), _csvTypes, blockReader.callback());
+            blockReader.initialize(csvparser);
+
+            BlockReaderProvider provider(blockReader);
+            csvsqldb::BlockIterator iterator(_types, provider, blockManager);
+            int64_t expected = 0;
+            while(const csvsqldb::Values* row = iterator.getNextRow()) {
+                MPF_TEST_ASSERTEQUAL(expected, static_cast<const csvsqldb::ValInt*>(row->at(0))->asInt());
+                if(expected % 10000 == 0) {
+                    // let the reader run into the full queue, it must not allocate more blocks while it is parked
+                    while(!blockReader.isParked()) {
+                        std::this_thread::yield();
+                    }
+                    size_t activeBlocks = blockManager.getActiveBlocks();
+                    MPF_TEST_ASSERT(activeBlocks <= 6u);
+                    std::this_thread::yield();
+                    MPF_TEST_ASSERT(blockReader.isParked());
+                    MPF_TEST_ASSERTEQUAL(activeBlocks, blockManager.getActiveBlocks());
+                }
+                ++expected;
+            }
+            MPF_TEST_ASSERTEQUAL(100000, expected);
+            MPF_TEST_ASSERT(blockManager.getTotalBlocks() > 20u);
+        }
+        // two queued blocks, the block in construction, one parked in the reader and two in the iterator
+        MPF_TEST_ASSERT(blockManager.getMaxUsedBlocks() <= 6u);
+        MPF_TEST_ASSERTEQUAL(0u, blockManager.getActiveBlocks());
+    }
+
+    void serialReaderAbortTest()
+    {
+        std::string data = createCSV(100000);
+        csvsqldb::BlockManager blockManager(100, 4096);
+        {
+            csvsqldb::BlockReader blockReader(blockManager);
+            auto csvparser =
+            std::make_shared<csvsqldb::csv::CSVParser>(_context, data.c_str(), data.size(), _csvTypes, blockReader.callback());
+            blockReader.initialize(csvparser);
+
+            // stop reading after some rows, the parked reader has to terminate and the queued blocks have to be released
+            BlockReaderProvider provider(blockReader);
+            csvsqldb::BlockIterator iterator(_types, provider, blockManager);
+            for(size_t n = 0; n < 10; ++n) {
+                MPF_TEST_ASSERT(iterator.getNextRow());
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        MPF_TEST_ASSERTEQUAL(0u, blockManager.getActiveBlocks());
+    }
+
+    void parallelReaderBudgetExhaustedTest()
+    {
+        std::string data = createCSV(100000);
+        // the budget is exhausted while the iterator still holds the first block, which has to be released once
+        csvsqldb::BlockManager blockManager(2, 4096);
+        {
+            csvsqldb::ParallelBlockReader blockReader(blockManager, 1, true);
+            blockReader.addInput(data.c_str(), data.size());
+            blockReader.initialize(_context, _csvTypes);
+
+            csvsqldb::BlockIterator iterator(_types, blockReader, blockManager);
+            MPF_TEST_EXPECTS_START();
+            {
+                while(iterator.getNextRow()) {
+                }
+            }
+            MPF_TEST_EXPECTS_END(csvsqldb::Exception);
+        }
+        MPF_TEST_ASSERTEQUAL(0u, blockManager.getActiveBlocks());
+    }
+
+    void parallelOrderedReaderTest()
+    {
+        std::string data = createCSV(300000);
+        csvsqldb::BlockManager blockManager(1000);
+        {
+            csvsqldb::ParallelBlockReader blockReader(blockManager, 3, true);
+            blockReader.addInput(data.c_str(), data.size());
+            blockReader.initialize(_context, _csvTypes);
+            MPF_TEST_ASSERT(blockReader.chunkCount() > 1);
+
+            csvsqldb::BlockIterator iterator(_types, blockReader, blockManager);
+            int64_t expected = 0;
+            while(const csvsqldb::Values* row = iterator.getNextRow()) {
+                MPF_TEST_ASSERTEQUAL(expected, static_cast<const csvsqldb::ValInt*>(row->at(0))->asInt());
+                MPF_TEST_ASSERTEQUAL("name_" + std::to_string(expected), static_cast<const csvsqldb::ValString*>(row->at(1))->asString());
+                ++expected;
+            }
+            MPF_TEST_ASSERTEQUAL(300000, expected);
+        }
+        MPF_TEST_ASSERTEQUAL(0u, blockManager.getActiveBlocks());
+    }
+
+    void parallelUnorderedReaderTest()
+    {
+        std::string data = createCSV(300000);
+        csvsqldb::BlockManager blockManager(1000);
+        {
+            csvsqldb::ParallelBlockReader blockReader(blockManager, 3, false);
+            blockReader.addInput(data.c_str(), data.size());
+            blockReader.initialize(_context, _csvTypes);
+
+            csvsqldb::BlockIterator iterator(_types, blockReader, blockManager);
+            std::vector<bool> seen(300000, false);
+            size_t count = 0;
+            while(const csvsqldb::Values* row = iterator.getNextRow()) {
+                int64_t id = static_cast<const csvsqldb::ValInt*>(row->at(0))->asInt();
+                MPF_TEST_ASSERT(!seen[static_cast<size_t>(id)]);
+                seen[static_cast<size_t>(id)] = true;
+                ++count;
+            }
+            MPF_TEST_ASSERTEQUAL(300000u, count);
+        }
+        MPF_TEST_ASSERTEQUAL(0u, blockManager.getActiveBlocks());
+    }
+
+    void parallelReaderAbortTest()
+    {
+        std::string data = createCSV(300000);
+        csvsqldb::BlockManager blockManager(1000);
+        {
+            csvsqldb::ParallelBlockReader blockReader(blockManager, 2, true);
+            blockReader.addInput(data.c_str(), data.size());
+            blockReader.initialize(_context, _csvTypes);
+
+            // stop reading after some rows, the workers have to terminate and the queued blocks have to be released
+            csvsqldb::BlockIterator iterator(_types, blockReader, blockManager);
+            for(size_t n = 0; n < 10; ++n) {
+                MPF_TEST_ASSERT(iterator.getNextRow());
+            }
+        }
+        MPF_TEST_ASSERTEQUAL(0u, blockManager.getActiveBlocks());
+    }
+
+    void multipleInputsTest()
+    {
+        std::string data1 = createCSV(200000);
+        std::string data2 = createCSV(1000);
+        std::stringstream stream(createCSV(500));
+        csvsqldb::Types types = { csvsqldb::INT, csvsqldb::STRING, csvsqldb::STRING };
+        csvsqldb::BlockManager blockManager(1000);
+        {
+            csvsqldb::ParallelBlockReader blockReader(blockManager, 2, true);
+            blockReader.addInput(data1.c_str(), data1.size(), "first.csv");
+            blockReader.addInput(stream, "second.csv");
+            blockReader.addInput(data2.c_str(), data2.size(), "third.csv");
+            blockReader.initialize(_context, _csvTypes, 1);
+
+            csvsqldb::BlockIterator iterator(types, blockReader, blockManager);
+            std::vector<std::pair<std::string, int64_t>> expected = { { "first.csv", 200000 }, { "second.csv", 500 }, { "third.csv", 1000 } };
+            for(const auto& input : expected) {
+                for(int64_t n = 0; n < input.second; ++n) {
+                    const csvsqldb::Values* row = iterator.getNextRow();
+                    MPF_TEST_ASSERT(row);
+                    MPF_TEST_ASSERTEQUAL(n, static_cast<const csvsqldb::ValInt*>(row->at(0))->asInt());
+                    MPF_TEST_ASSERTEQUAL(input.first, static_cast<const csvsqldb::ValString*>(row->at(1))->asString());
+                    MPF_TEST_ASSERTEQUAL("name_" + std::to_string(n), static_cast<const csvsqldb::ValString*>(row->at(2))->asString());
+                }
+            }
+            MPF_TEST_ASSERT(!iterator.getNextRow());
+        }
+        MPF_TEST_ASSERTEQUAL(0u, blockManager.getActiveBlocks());
+    }
+
+    void rowFilterTest()
+    {
+        std::string data = createCSV(100000);
+        // small blocks, so that many rows have to be moved into the next block before they can be filtered
+        csvsqldb::BlockManager blockManager(1000, 4096);
+        {
+            csvsqldb::ParallelBlockReader blockReader(blockManager, 2, true);
+            blockReader.setRowFilterFactory([]() {
+                return [](const std::vector<csvsqldb::Values>& rows, size_t count, csvsqldb::StackMachine::SelectionVector& selection) {
+                    selection.clear();
+                    for(size_t n = 0; n < count; ++n) {
+                        if(static_cast<const csvsqldb::ValInt*>(rows[n][0])->asInt() % 3 == 0) {
+                            selection.push_back(static_cast<uint32_t>(n));
+                        }
+                    }
+                };
+            });
+            blockReader.addInput(data.c_str(), data.size());
+            blockReader.initialize(_context, _csvTypes);
+
+            csvsqldb::BlockIterator iterator(_types, blockReader, blockManager);
+            int64_t expected = 0;
+            while(const csvsqldb::Values* row = iterator.getNextRow()) {
+                MPF_TEST_ASSERTEQUAL(expected, static_cast<const csvsqldb::ValInt*>(row->at(0))->asInt());
+                MPF_TEST_ASSERTEQUAL("name_" + std::to_string(expected), static_cast<const csvsqldb::ValString*>(row->at(1))->asString());
+                expected += 3;
+            }
+            MPF_TEST_ASSERTEQUAL(100002, expected);
+        }
+        MPF_TEST_ASSERTEQUAL(0u, blockManager.getActiveBlocks());
+    }
+
+private:
+    csvsqldb::Types _types;
+    csvsqldb::csv::Types _csvTypes;
+    csvsqldb::csv::CSVParserContext _context;
+};
+
+MPF_REGISTER_TEST_START("BlockReaderTestSuite", BlockReaderTestCase);
+MPF_REGISTER_TEST(BlockReaderTestCase::serialReaderTest);
+MPF_REGISTER_TEST(BlockReaderTestCase::serialReaderBackpressureTest);
+MPF_REGISTER_TEST(BlockReaderTestCase::serialReaderAbortTest);
+MPF_REGISTER_TEST(BlockReaderTestCase::parallelOrderedReaderTest);
+MPF_REGISTER_TEST(BlockReaderTestCase::parallelUnorderedReaderTest);
+MPF_REGISTER_TEST(BlockReaderTestCase::parallelReaderAbortTest);
+MPF_REGISTER_TEST(BlockReaderTestCase::parallelReaderBudgetExhaustedTest);
+MPF_REGISTER_TEST(BlockReaderTestCase::multipleInputsTest);
+MPF_REGISTER_TEST(BlockReaderTestCase::rowFilterTest);
+MPF_REGISTER_TEST_END();
@@ -33,7 +33,56 @@
 
 #include "test.h"
 
+#include "libcsvsqldb/base/page_allocator.h"
 #include "libcsvsqldb/block.h"
+#include "libcsvsqldb/block_iterator.h"
+#include "libcsvsqldb/execution_engine.h"
+#include "libcsvsqldb/operatornode_factory.h"
+
+#include <thread>
+
+
+namespace
+{
+    class StringRowProvider : public csvsqldb::RowProvider
+    {
+    public:
+        StringRowProvider(csvsqldb::BlockManager& blockManager, size_t count)
+        : _blockManager(blockManager)
+        , _count(count)
+        , _current(0)
+        , _block(_blockManager.createBlock())
+        {
+            _row.resize(2);
+        }
+
+        ~StringRowProvider()
+        {
+            _blockManager.release(_block);
+        }
+
+        virtual const csvsqldb::Values* getNextRow()
+        {
+            if(_current == _count) {
+                return nullptr;
+            }
+            // produces the numbers in a shuffled order
+            int64_t num = static_cast<int64_t>((_current++ * 7919) % _count);
+            std::string s = "row " + std::to_string(num);
+            _block->rewind(0);
+            _row[0] = _block->addInt(num, false);
+            _row[1] = _block->addString(s.c_str(), s.length(), false);
+            return &_row;
+        }
+
+    private:
+        csvsqldb::BlockManager& _blockManager;
+        size_t _count;
+        size_t _current;
+        csvsqldb::BlockPtr _block;
+        csvsqldb::Values _row;
+    };
+}
 
 
 class BlockManagerTestCase
@@ -65,6 +114,7 @@ public:
         {
             csvsqldb::BlockManager blockManager(1000, 1024 * 1024);
             MPF_TEST_ASSERTEQUAL(1024u * 1024, blockManager.getBlockCapacity());
+            MPF_TEST_ASSERTEQUAL(1000u * 1024 * 1024, blockManager.getMemoryBudget());
             MPF_TEST_ASSERTEQUAL(1000u, blockManager.getMaxActiveBlocks());
             MPF_TEST_ASSERTEQUAL(0u, blockManager.getActiveBlocks());
             MPF_TEST_ASSERTEQUAL(0u, blockManager.getMaxUsedBlocks());
@@ -72,6 +122,26 @@ public:
         }
     }
 
+    void memoryBudgetConstructionTest()
+    {
+        {
+            csvsqldb::BlockManager blockManager(csvsqldb::MemoryBudget(1000 * 1024 * 1024), 1024 * 1024);
+            MPF_TEST_ASSERTEQUAL(1024u * 1024, blockManager.getBlockCapacity());
+            MPF_TEST_ASSERTEQUAL(1000u * 1024 * 1024, blockManager.getMemoryBudget());
+            MPF_TEST_ASSERTEQUAL(1000u, blockManager.getMaxActiveBlocks());
+            MPF_TEST_ASSERTEQUAL(0u, blockManager.getActiveBlocks());
+            MPF_TEST_ASSERTEQUAL(0u, blockManager.getMaxUsedBlocks());
+            MPF_TEST_ASSERTEQUAL(0u, blockManager.getTotalBlocks());
+        }
+
+        {
+            // a budget that is no multiple of the block capacity only keeps whole blocks in memory
+            csvsqldb::BlockManager blockManager(csvsqldb::MemoryBudget(10 * 4096 + 100), 4096);
+            MPF_TEST_ASSERTEQUAL(10u * 4096 + 100, blockManager.getMemoryBudget());
+            MPF_TEST_ASSERTEQUAL(10u, blockManager.getMaxActiveBlocks());
+        }
+    }
+
     void createBlocks()
     {
         csvsqldb::Types types;
@@ -124,9 +194,216 @@ public:
 
         blockManager.release(block);
     }
+
+    void poolTest()
+    {
+        csvsqldb::BlockManager blockManager(10, 4096);
+
+        // streaming blocks through the manager reuses the memory of released blocks
+        csvsqldb::BlockPtr previous = blockManager.createBlock();
+        for(size_t n = 0; n < 100; ++n) {
+            csvsqldb::BlockPtr block = blockManager.createBlock();
+            MPF_TEST_ASSERT(block->addInt(static_cast<int64_t>(n), false));
+            blockManager.release(previous);
+            previous = block;
+        }
+        MPF_TEST_ASSERTEQUAL(2u, blockManager.getAllocatedBlocks());
+        MPF_TEST_ASSERTEQUAL(99u, blockManager.getPooledBlocks());
+        MPF_TEST_ASSERTEQUAL(previous, blockManager.getBlock(previous->getBlockNumber()));
+        blockManager.release(previous);
+        MPF_TEST_ASSERTEQUAL(0u, blockManager.getActiveBlocks());
+    }
+
+    void hugePagesTest()
+    {
+        // huge pages are only a hint, the blocks have to work without them as well
+        csvsqldb::BlockManager blockManager(4, 2 * 1024 * 1024, true);
+        csvsqldb::BlockPtr block = blockManager.createBlock();
+        MPF_TEST_ASSERT(block->addString("huge", 4, false));
+        block->nextRow();
+        MPF_TEST_ASSERT(block->addInt(4711, false));
+        blockManager.release(block);
+
+        block = blockManager.createBlock();
+        MPF_TEST_ASSERTEQUAL(1u, blockManager.getPooledBlocks());
+        blockManager.release(block);
+    }
+
+    void hugePageArenaTest()
+    {
+        // the engine chooses blocks smaller than a huge page, they have to be carved from huge page arenas
+        const size_t memoryBudget = 16 * 1024 * 1024;
+        size_t capacity = csvsqldb::ExecutionEngine<csvsqldb::OperatorNodeFactory>::blockCapacity(memoryBudget);
+        MPF_TEST_ASSERT(capacity < csvsqldb::hugePageSize() || !csvsqldb::hugePageSize());
+
+        csvsqldb::BlockManager blockManager(csvsqldb::MemoryBudget(memoryBudget), capacity, true);
+        size_t allocationSize = blockManager.getAllocationSize();
+        if(!csvsqldb::hugePageSize()) {
+            MPF_TEST_ASSERTEQUAL(capacity, allocationSize);
+            return;
+        }
+        MPF_TEST_ASSERTEQUAL(0u, allocationSize % csvsqldb::hugePageSize());
+
+        size_t blocksPerArena = allocationSize / capacity;
+        csvsqldb::Blocks blocks;
+        for(size_t n = 0; n < blocksPerArena + 1; ++n) {
+            csvsqldb::BlockPtr block = blockManager.createBlock();
+            MPF_TEST_ASSERT(block->addInt(static_cast<int64_t>(n), false));
+            blocks.push_back(block);
+        }
+        MPF_TEST_ASSERTEQUAL(2u, blockManager.getAllocatedBlocks());
+        MPF_TEST_ASSERTEQUAL(blocksPerArena - 1, blockManager.getPooledBlocks());
+        for(auto& block : blocks) {
+            blockManager.release(block);
+        }
+        MPF_TEST_ASSERTEQUAL(0u, blockManager.getActiveBlocks());
+    }
+
+    void memoryBudgetTest()
+    {
+        csvsqldb::BlockManager blockManager(2, 4096);
+        MPF_TEST_ASSERTEQUAL(2u, blockManager.getMaxActiveBlocks());
+
+        csvsqldb::BlockPtr block = blockManager.createBlock();
+        csvsqldb::BlockPtr block2 = blockManager.createBlock();
+        MPF_TEST_EXPECTS(blockManager.createBlock(), csvsqldb::Exception);
+        MPF_TEST_ASSERTEQUAL(2u, blockManager.getActiveBlocks());
+
+        blockManager.release(block);
+        blockManager.release(block2);
+    }
+
+    void spillTest()
+    {
+        csvsqldb::BlockManager blockManager(2, 4096);
+
+        csvsqldb::BlockPtr block = blockManager.createBlock();
+        block->addInt(4711, false);
+        block->addString("Lars", 4, false);
+        block->addString(nullptr, 0, true);
+        block->nextRow();
+        block->endBlocks();
+        size_t blockNumber = block->getBlockNumber();
+        blockManager.cache(block);
+
+        csvsqldb::BlockPtr block2 = blockManager.createBlock();
+        csvsqldb::BlockPtr block3 = blockManager.createBlock();
+        MPF_TEST_ASSERTEQUAL(1u, blockManager.getSpilledBlocks());
+        MPF_TEST_ASSERTEQUAL(3u, blockManager.getActiveBlocks());
+        MPF_TEST_ASSERTEQUAL(2u, blockManager.getMaxUsedBlocks());
+
+        // no block is cacheable, so the spilled block cannot be loaded again
+        MPF_TEST_EXPECTS(blockManager.getBlock(blockNumber), csvsqldb::Exception);
+
+        blockManager.cache(block2);
+        block = blockManager.getBlock(blockNumber);
+        MPF_TEST_ASSERTEQUAL(2u, blockManager.getSpilledBlocks());
+
+        csvsqldb::StoreType store = block->getRawBuffer() - block->offset();
+        MPF_TEST_ASSERTEQUAL(static_cast<char>(0xAA), store[0]);
+        const csvsqldb::Value* value = reinterpret_cast<const csvsqldb::Value*>(store + 1);
+        MPF_TEST_ASSERTEQUAL(4711, static_cast<const csvsqldb::ValInt*>(value)->asInt());
+        store += 1 + value->size();
+        MPF_TEST_ASSERTEQUAL(static_cast<char>(0xAA), store[0]);
+        value = reinterpret_cast<const csvsqldb::Value*>(store + 1);
+        MPF_TEST_ASSERTEQUAL("Lars", std::string(static_cast<const csvsqldb::ValString*>(value)->asString()));
+        MPF_TEST_ASSERTEQUAL(store + 1 + sizeof(csvsqldb::ValString), static_cast<const csvsqldb::ValString*>(value)->asString());
+        store += 1 + value->size();
+        value = reinterpret_cast<const csvsqldb::Value*>(store + 1);
+        MPF_TEST_ASSERT(value->isNull());
+
+        // releasing a spilled block frees its slot in the spill file
+        blockManager.release(block2);
+        blockManager.release(block);
+        blockManager.release(block3);
+        MPF_TEST_ASSERTEQUAL(0u, blockManager.getActiveBlocks());
+    }
+
+    void cachingSpillTest()
+    {
+        csvsqldb::Types types;
+        types.push_back(csvsqldb::INT);
+        types.push_back(csvsqldb::STRING);
+
+        csvsqldb::BlockManager blockManager(8, 4096);
+        StringRowProvider provider(blockManager, 5000);
+        csvsqldb::CachingBlockIterator iterator(types, provider, blockManager);
+
+        std::vector<int64_t> numbers;
+        const csvsqldb::Values* row = nullptr;
+        while((row = iterator.getNextRow())) {
+            numbers.push_back(static_cast<const csvsqldb::ValInt*>(row->at(0))->asInt());
+        }
+        MPF_TEST_ASSERTEQUAL(5000u, numbers.size());
+        MPF_TEST_ASSERT(blockManager.getSpilledBlocks() > 0u);
+
+        for(size_t pass = 0; pass < 2; ++pass) {
+            iterator.rewind();
+            size_t n = 0;
+            while((row = iterator.getNextRow())) {
+                MPF_TEST_ASSERTEQUAL(numbers[n], static_cast<const csvsqldb::ValInt*>(row->at(0))->asInt());
+                MPF_TEST_ASSERTEQUAL("row " + std::to_string(numbers[n]),
+                                     std::string(static_cast<const csvsqldb::ValString*>(row->at(1))->asString()));
+                ++n;
+            }
+            MPF_TEST_ASSERTEQUAL(5000u, n);
+        }
+        MPF_TEST_ASSERT(blockManager.getMaxUsedBlocks() <= 8u);
+    }
+
+    void concurrentSpillTest()
+    {
+        csvsqldb::BlockManager blockManager(8, 4096);
+
+        // the threads spill and load each others blocks, while only one block of each thread is not cacheable
+        std::vector<std::vector<int64_t>> results(4);
+        std::vector<std::thread> threads;
+        for(size_t t = 0; t < results.size(); ++t) {
+            threads.push_back(std::thread([&blockManager, &results, t] {
+                std::vector<size_t> blockNumbers;
+                for(int64_t n = 0; n < 100; ++n) {
+                    csvsqldb::BlockPtr block = blockManager.createBlock();
+                    block->addInt(static_cast<int64_t>(t) * 1000 + n, false);
+                    block->nextRow();
+                    block->endBlocks();
+                    blockNumbers.push_back(block->getBlockNumber());
+                    blockManager.cache(block);
+                }
+                for(size_t blockNumber : blockNumbers) {
+                    csvsqldb::BlockPtr block = blockManager.getBlock(blockNumber);
+                    csvsqldb::StoreType store = block->getRawBuffer() - block->offset();
+                    const csvsqldb::Value* value = reinterpret_cast<const csvsqldb::Value*>(store + 1);
+                    results[t].push_back(static_cast<const csvsqldb::ValInt*>(value)->asInt());
+                    blockManager.release(block);
+                }
+            }));
+        }
+        for(std::thread& thread : threads) {
+            thread.join();
+        }
+
+        for(size_t t = 0; t < results.size(); ++t) {
+            MPF_TEST_ASSERTEQUAL(100u, results[t].size());
+            for(int64_t n = 0; n < 100; ++n) {
+                MPF_TEST_ASSERTEQUAL(static_cast<int64_t>(t) * 1000 + n, results[t][n]);
+            }
+        }
+        MPF_TEST_ASSERT(blockManager.getSpilledBlocks() > 0u);
+        MPF_TEST_ASSERT(blockManager.getMaxUsedBlocks() <= 8u);
+        MPF_TEST_ASSERTEQUAL(0u, blockManager.getActiveBlocks());
+    }
 };
 
 MPF_REGISTER_TEST_START("BlockTestSuite", BlockManagerTestCase);
 MPF_REGISTER_TEST(BlockManagerTestCase::constructionTest);
+MPF_REGISTER_TEST(BlockManagerTestCase::memoryBudgetConstructionTest);
 MPF_REGISTER_TEST(BlockManagerTestCase::createBlocks);
+MPF_REGISTER_TEST(BlockManagerTestCase::getBlockTest);
+MPF_REGISTER_TEST(BlockManagerTestCase::poolTest);
+MPF_REGISTER_TEST(BlockManagerTestCase::hugePagesTest);
+MPF_REGISTER_TEST(BlockManagerTestCase::hugePageArenaTest);
+MPF_REGISTER_TEST(BlockManagerTestCase::memoryBudgetTest);
+MPF_REGISTER_TEST(BlockManagerTestCase::spillTest);
+MPF_REGISTER_TEST(BlockManagerTestCase::cachingSpillTest);
+MPF_REGISTER_TEST(BlockManagerTestCase::concurrentSpillTest);
 MPF_REGISTER_TEST_END();
@@ -0,0 +1,211 @@
+//
+//  columnar_block_test.cpp
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "test.h"
+
+#include "libcsvsqldb/columnar_block.h"
+#include "libcsvsqldb/sql_parser.h"
+#include "libcsvsqldb/visitor.h"
+
+
+class ColumnarBlockTestCase
+{
+public:
+    ColumnarBlockTestCase()
+    {
+    }
+
+    void setUp()
+    {
+    }
+
+    void tearDown()
+    {
+    }
+
+    csvsqldb::ColumnarBlockPtr createBlock(size_t rows)
+    {
+        csvsqldb::Types types = {csvsqldb::INT,
+                                 csvsqldb::REAL,
+                                 csvsqldb::STRING,
+                                 csvsqldb::BOOLEAN,
+                                 csvsqldb::DATE,
+                                 csvsqldb::TIME,
+                                 csvsqldb::TIMESTAMP};
+        csvsqldb::ColumnarBlockPtr block = std::make_shared<csvsqldb::ColumnarBlock>(types, rows);
+        for(size_t n = 0; n < rows; ++n) {
+            bool isNull = n % 10 == 9;
+            block->addInt(static_cast<int64_t>(n), isNull);
+            block->addReal(n * 0.5, false);
+            std::string s = "row " + std::to_string(n);
+            block->addString(s.c_str(), s.length(), n % 7 == 6);
+            block->addBool(n % 2 == 0, false);
+            block->addDate(csvsqldb::Date(2015, csvsqldb::Date::June, 1), isNull);
+            block->addTime(csvsqldb::Time(12, 30, 0), false);
+            block->addTimestamp(csvsqldb::Timestamp(2015, csvsqldb::Date::June, 1, 12, 30, 0), false);
+            block->nextRow();
+        }
+        return block;
+    }
+
+    void columnAccessTest()
+    {
+        csvsqldb::ColumnarBlockPtr block = createBlock(100);
+
+        MPF_TEST_ASSERTEQUAL(100u, block->getRowCount());
+        MPF_TEST_ASSERT(block->isFull());
+        MPF_TEST_ASSERTEQUAL(42, block->getInt(0, 42));
+        MPF_TEST_ASSERT(block->isNull(0, 69));
+        MPF_TEST_ASSERT(!block->isNull(0, 70));
+        MPF_TEST_ASSERTEQUAL(21.0, block->getReal(1, 42));
+        MPF_TEST_ASSERTEQUAL("row 42", std::string(block->getString(2, 42)));
+        MPF_TEST_ASSERTEQUAL(6u, block->getStringLength(2, 42));
+        MPF_TEST_ASSERT(block->isNull(2, 41));
+        MPF_TEST_ASSERT(block->getBool(3, 42));
+        MPF_TEST_ASSERTEQUAL("2015-06-01", block->getVariant(4, 42).toString());
+        MPF_TEST_ASSERTEQUAL("12:30:00", block->getVariant(5, 42).toString());
+        MPF_TEST_ASSERT(block->getVariant(4, 9).isNull());
+
+        const int64_t* ints = block->getColumnData<int64_t>(0);
+        int64_t sum = 0;
+        for(size_t n = 0; n < block->getRowCount(); ++n) {
+            sum += ints[n];
+        }
+        // the null rows are stored as 0
+        MPF_TEST_ASSERTEQUAL(4950 - (9 + 19 + 29 + 39 + 49 + 59 + 69 + 79 + 89 + 99), sum);
+        MPF_TEST_ASSERTEQUAL(uint64_t(1) << 9, block->getNullBitmap(0)[0] & 0x3ff);
+
+        MPF_TEST_EXPECTS(block->addInt(1, false), csvsqldb::Exception);
+
+        csvsqldb::ColumnarBlock partial(block->getTypes(), 10);
+        MPF_TEST_EXPECTS(partial.addReal(1.0, false), csvsqldb::Exception);
+        partial.addInt(1, false);
+        MPF_TEST_EXPECTS(partial.nextRow(), csvsqldb::Exception);
+    }
+
+    void iteratorTest()
+    {
+        csvsqldb::ColumnarBlocks blocks = {createBlock(50), createBlock(30)};
+        csvsqldb::ColumnarBlockIterator iterator(blocks);
+
+        size_t count = 0;
+        const csvsqldb::Values* row = nullptr;
+        while((row = iterator.getNextRow())) {
+            size_t n = count < 50 ? count : count - 50;
+            MPF_TEST_ASSERTEQUAL(7u, row->size());
+            if(n % 10 == 9) {
+                MPF_TEST_ASSERT((*row)[0]->isNull());
+            } else {
+                MPF_TEST_ASSERTEQUAL(std::to_string(n), (*row)[0]->toString());
+            }
+            if(n % 7 != 6) {
+                MPF_TEST_ASSERTEQUAL("row " + std::to_string(n), (*row)[2]->toString());
+            }
+            ++count;
+        }
+        MPF_TEST_ASSERTEQUAL(80u, count);
+
+        iterator.seek(1, 28);
+        row = iterator.getNextRow();
+        MPF_TEST_ASSERTEQUAL("28", (*row)[0]->toString());
+
+        iterator.seek(0, 0);
+        csvsqldb::ColumnarBlocks rechunked = csvsqldb::readColumnarBlocks(iterator, blocks.front()->getTypes(), 32);
+        MPF_TEST_ASSERTEQUAL(3u, rechunked.size());
+        MPF_TEST_ASSERTEQUAL(16u, rechunked.back()->getRowCount());
+        MPF_TEST_ASSERTEQUAL(16, rechunked.back()->getInt(0, 2));
+        MPF_TEST_ASSERTEQUAL("row 16", std::string(rechunked.back()->getString(2, 2)));
+    }
+
+    void batchTest()
+    {
+        csvsqldb::ColumnarBlockPtr block = createBlock(100);
+
+        csvsqldb::FunctionRegistry functions;
+        csvsqldb::SQLParser parser(functions);
+        csvsqldb::ASTExprNodePtr exp = parser.parseExpression("a * 2 > b and c");
+        csvsqldb::StackMachine::VariableMapping mapping;
+        csvsqldb::StackMachine sm;
+        csvsqldb::ASTInstructionStackVisitor visitor(sm, mapping);
+        exp->accept(visitor);
+
+        const std::map<std::string, size_t> columns = {{"A", 0}, {"B", 1}, {"C", 3}};
+        csvsqldb::StackMachine::VariableTypes types(mapping.size());
+        csvsqldb::VariableBatch batch;
+        for(const auto& variable : mapping) {
+            types[variable.second] = block->getTypes()[columns.at(variable.first)];
+            batch.setVariableType(variable.second, types[variable.second]);
+        }
+        MPF_TEST_ASSERT(sm.compile(types, functions));
+
+        for(const auto& variable : mapping) {
+            block->appendTo(columns.at(variable.first), 10, 50, batch.getVariable(variable.second));
+        }
+        batch.nextRows(50);
+
+        csvsqldb::StackMachine::SelectionVector selection;
+        // all even rows are selected, the rows with null values are odd anyway
+        MPF_TEST_ASSERTEQUAL(25u, sm.selectBatch(batch, selection));
+        MPF_TEST_ASSERTEQUAL(0u, selection[0]);
+        MPF_TEST_ASSERTEQUAL(48u, selection.back());
+    }
+
+    void clearTest()
+    {
+        csvsqldb::ColumnarBlockPtr block = createBlock(10);
+        block->clear();
+        MPF_TEST_ASSERTEQUAL(0u, block->getRowCount());
+        MPF_TEST_ASSERT(!block->isFull());
+
+        block->addInt(0, true);
+        block->addReal(1.5, false);
+        block->addString("again", 5, false);
+        block->addBool(true, false);
+        block->addDate(csvsqldb::Date(2015, csvsqldb::Date::June, 1), false);
+        block->addTime(csvsqldb::Time(12, 30, 0), false);
+        block->addTimestamp(csvsqldb::Timestamp(2015, csvsqldb::Date::June, 1, 12, 30, 0), false);
+        block->nextRow();
+
+        MPF_TEST_ASSERTEQUAL(1u, block->getRowCount());
+        MPF_TEST_ASSERT(block->isNull(0, 0));
+        MPF_TEST_ASSERTEQUAL("again", std::string(block->getString(2, 0)));
+        MPF_TEST_ASSERTEQUAL(1.5, block->getReal(1, 0));
+    }
+};
+
+MPF_REGISTER_TEST_START("ColumnarBlockTestSuite", ColumnarBlockTestCase);
+MPF_REGISTER_TEST(ColumnarBlockTestCase::columnAccessTest);
+MPF_REGISTER_TEST(ColumnarBlockTestCase::iteratorTest);
+MPF_REGISTER_TEST(ColumnarBlockTestCase::batchTest);
+MPF_REGISTER_TEST(ColumnarBlockTestCase::clearTest);
+MPF_REGISTER_TEST_END();
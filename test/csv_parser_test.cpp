@@ -37,6 +37,8 @@
 
 #include "libcsvsqldb/base/csv_parser.h"
 #include "libcsvsqldb/base/csv_string_parser.h"
+#include "libcsvsqldb/base/csv_structural_index.h"
+#include "libcsvsqldb/base/memory_mapped_file.h"
 
 #include <fstream>
 #include <functional>
@@ -279,7 +281,93 @@ public:
         MPF_TEST_ASSERTEQUAL(true, log.good());
         std::string line;
         MPF_TEST_ASSERT(std::getline(log, line).good());
-        MPF_TEST_ASSERTEQUAL("ERROR: skipping line 3: expected a date field (YYYY-mm-dd) in line 3", line);
+        MPF_TEST_ASSERTEQUAL("ERROR: using NULL for an invalid field in line 3: expected a date field (YYYY-mm-dd) in line 3", line);
+
+        MPF_TEST_ASSERTEQUAL(9U, callback._results.size());
+        MPF_TEST_ASSERTEQUAL("60134", callback._results[3]);
+        MPF_TEST_ASSERTEQUAL("<NULL>", callback._results[4]);
+        MPF_TEST_ASSERTEQUAL("Seshu", callback._results[5]);
+        MPF_TEST_ASSERTEQUAL("72329", callback._results[6]);
+    }
+
+    void invalidQuotedFieldTest()
+    {
+        csvsqldb::csv::Types types;
+        types.push_back(csvsqldb::csv::LONG);
+        types.push_back(csvsqldb::csv::STRING);
+        types.push_back(csvsqldb::csv::SKIP);
+        types.push_back(csvsqldb::csv::STRING);
+
+        // a quoted field with wrong delimiters becomes NULL, also in a skipped column, and the scan goes on
+        std::string data("id,name,code,note\n1,\"abc\"x,\"def\"y,a\n2,\"ok\",\"z\",b\n");
+        const char* expected[] = { "1", "<NULL>", "a", "2", "ok", "b" };
+        const size_t expectedCount = sizeof(expected) / sizeof(expected[0]);
+
+        csvsqldb::csv::CSVParserContext context;
+        context._skipFirstLine = true;
+
+        RedirectStdErr red;
+        DummyCSVParserCallback memoryCallback;
+        csvsqldb::csv::CSVParser memoryParser(context, data.c_str(), data.size(), types, memoryCallback);
+        while(memoryParser.parseLine()) {
+        }
+
+        std::stringstream ss(data);
+        DummyCSVParserCallback streamCallback;
+        csvsqldb::csv::CSVParser streamParser(context, ss, types, streamCallback);
+        while(streamParser.parseLine()) {
+        }
+
+        std::ifstream log((CSVSQLDB_TEST_PATH + std::string("/stderr.txt")));
+        MPF_TEST_ASSERTEQUAL(true, log.good());
+        std::string line;
+        MPF_TEST_ASSERT(std::getline(log, line).good());
+        MPF_TEST_ASSERTEQUAL("ERROR: using NULL for an invalid field in line 2: wrong delimiters in string", line);
+
+        MPF_TEST_ASSERTEQUAL(expectedCount, memoryCallback._results.size());
+        MPF_TEST_ASSERTEQUAL(expectedCount, streamCallback._results.size());
+        for(size_t n = 0; n < expectedCount; ++n) {
+            MPF_TEST_ASSERTEQUAL(expected[n], memoryCallback._results[n]);
+            MPF_TEST_ASSERTEQUAL(expected[n], streamCallback._results[n]);
+        }
+    }
+
+    void invalidFieldTest()
+    {
+        csvsqldb::csv::Types types;
+        types.push_back(csvsqldb::csv::LONG);
+        types.push_back(csvsqldb::csv::BOOLEAN);
+        types.push_back(csvsqldb::csv::STRING);
+        types.push_back(csvsqldb::csv::LONG);
+
+        // invalid fields in the middle of the input become NULL, the following fields and lines stay in their columns
+        std::string data("id,flag,name,count\n1,1,a,10\nx1,x,b,20\n3,0,c,30\n4,yes,d,40\n5,1,e\n6,0,f,60,surplus\n7,1,g,70\n");
+        const char* expected[] = { "1", "true",  "a", "10",     "<NULL>", "<NULL>", "b", "20",     "3", "false", "c", "30",
+                                   "4", "<NULL>", "d", "40",   "5",      "true",   "e", "<NULL>", "6", "false", "f", "60",
+                                   "7", "true",  "g", "70" };
+        const size_t expectedCount = sizeof(expected) / sizeof(expected[0]);
+
+        csvsqldb::csv::CSVParserContext context;
+        context._skipFirstLine = true;
+
+        RedirectStdErr red;
+        DummyCSVParserCallback memoryCallback;
+        csvsqldb::csv::CSVParser memoryParser(context, data.c_str(), data.size(), types, memoryCallback);
+        while(memoryParser.parseLine()) {
+        }
+
+        std::stringstream ss(data);
+        DummyCSVParserCallback streamCallback;
+        csvsqldb::csv::CSVParser streamParser(context, ss, types, streamCallback);
+        while(streamParser.parseLine()) {
+        }
+
+        for(const auto& results : { memoryCallback._results, streamCallback._results }) {
+            MPF_TEST_ASSERTEQUAL(expectedCount, results.size());
+            for(size_t n = 0; n < expectedCount; ++n) {
+                MPF_TEST_ASSERTEQUAL(expected[n], results[n]);
+            }
+        }
     }
 
     void parseStrings()
@@ -438,12 +526,184 @@ public:
         MPF_TEST_ASSERTEQUAL(1U, sp.parseToBuffer());
         MPF_TEST_ASSERTEQUAL("M", std::string(&buffer[0]));
     }
+
+    void parseMemoryTest()
+    {
+        csvsqldb::csv::Types types;
+        types.push_back(csvsqldb::csv::LONG);
+        types.push_back(csvsqldb::csv::STRING);
+        types.push_back(csvsqldb::csv::DOUBLE);
+
+        // the data is not null terminated, so the parser must not look behind the given length
+        std::string data("id,name,value\n4711,  \"Lars\",12.5\n815,Fürstenberg,\nxxx");
+        data.resize(data.size() - 3);
+
+        DummyCSVParserCallback callback;
+        csvsqldb::csv::CSVParserContext context;
+        context._skipFirstLine = true;
+        csvsqldb::csv::CSVParser csvparser(context, data.c_str(), data.size(), types, callback);
+        while(csvparser.parseLine()) {
+        }
+
+        MPF_TEST_ASSERTEQUAL(3U, csvparser.getLineCount());
+        MPF_TEST_ASSERTEQUAL(6U, callback._results.size());
+        MPF_TEST_ASSERTEQUAL("4711", callback._results[0]);
+        MPF_TEST_ASSERTEQUAL("Lars", callback._results[1]);
+        MPF_TEST_ASSERTEQUAL("12.500000", callback._results[2]);
+        MPF_TEST_ASSERTEQUAL("815", callback._results[3]);
+        MPF_TEST_ASSERTEQUAL("Fürstenberg", callback._results[4]);
+        MPF_TEST_ASSERTEQUAL("<NULL>", callback._results[5]);
+    }
+
+    void skipFieldTest()
+    {
+        csvsqldb::csv::Types types;
+        types.push_back(csvsqldb::csv::SKIP);
+        types.push_back(csvsqldb::csv::LONG);
+        types.push_back(csvsqldb::csv::SKIP);
+        types.push_back(csvsqldb::csv::SKIP);
+
+        // skipped fields are neither converted nor reported, quoted delimiters must not split them
+        std::string data("name,id,date,comment\n\"Lars, F.\",4711,no date,\nMark,815,2015-07-02,'a, b'\n");
+
+        DummyCSVParserCallback callback;
+        csvsqldb::csv::CSVParserContext context;
+        context._skipFirstLine = true;
+        csvsqldb::csv::CSVParser csvparser(context, data.c_str(), data.size(), types, callback);
+        while(csvparser.parseLine()) {
+        }
+
+        MPF_TEST_ASSERTEQUAL(2U, callback._results.size());
+        MPF_TEST_ASSERTEQUAL("4711", callback._results[0]);
+        MPF_TEST_ASSERTEQUAL("815", callback._results[1]);
+    }
+
+    void parseMemoryMappedFileTest()
+    {
+        csvsqldb::csv::Types types;
+        types.push_back(csvsqldb::csv::STRING);
+        types.push_back(csvsqldb::csv::STRING);
+        types.push_back(csvsqldb::csv::DATE);
+        types.push_back(csvsqldb::csv::STRING);
+        types.push_back(csvsqldb::csv::LONG);
+        types.push_back(csvsqldb::csv::STRING);
+        types.push_back(csvsqldb::csv::DOUBLE);
+        types.push_back(csvsqldb::csv::BOOLEAN);
+        types.push_back(csvsqldb::csv::TIME);
+        types.push_back(csvsqldb::csv::TIMESTAMP);
+        types.push_back(csvsqldb::csv::LONG);
+
+        csvsqldb::MemoryMappedFile mappedFile(CSVSQLDB_TEST_PATH + std::string("/testdata/csv/test.csv"));
+#ifndef _WIN32
+        MPF_TEST_ASSERT(mappedFile.isMapped());
+#endif
+        if(!mappedFile.isMapped()) {
+            return;
+        }
+
+        DummyCSVParserCallback callback;
+        csvsqldb::csv::CSVParserContext context;
+        context._skipFirstLine = false;
+        csvsqldb::csv::CSVParser csvparser(context, mappedFile.data(), mappedFile.size(), types, callback);
+        while(csvparser.parseLine()) {
+        }
+
+        MPF_TEST_ASSERTEQUAL(2U, csvparser.getLineCount());
+        MPF_TEST_ASSERTEQUAL(22U, callback._results.size());
+        MPF_TEST_ASSERTEQUAL("Testologe", callback._results[0]);
+        MPF_TEST_ASSERTEQUAL("2015-07-02T14:20:30", callback._results[9]);
+        MPF_TEST_ASSERTEQUAL("von Ravensbrück", callback._results[11]);
+        MPF_TEST_ASSERTEQUAL("525", callback._results[21]);
+
+        csvsqldb::MemoryMappedFile missingFile(CSVSQLDB_TEST_PATH + std::string("/testdata/csv/does_not_exist.csv"));
+        MPF_TEST_ASSERT(!missingFile.isMapped());
+        MPF_TEST_ASSERTEQUAL(0U, missingFile.size());
+    }
+
+    void structuralIndexTest()
+    {
+        std::string data;
+        for(size_t n = 0; n < 1000; ++n) {
+            data += "abc;\"x\"\n'y'\r\n1234567;"[n % 22];
+            data += static_cast<char>('a' + n % 23);
+        }
+
+        std::vector<csvsqldb::csv::CSVStructuralIndex::eInstructionSet> instructionSets{
+        csvsqldb::csv::CSVStructuralIndex::SCALAR, csvsqldb::csv::CSVStructuralIndex::SSE2,
+        csvsqldb::csv::CSVStructuralIndex::AVX2};
+        for(auto instructionSet : instructionSets) {
+            if(!csvsqldb::csv::CSVStructuralIndex::isSupported(instructionSet)) {
+                continue;
+            }
+            csvsqldb::csv::CSVStructuralIndex index(';', instructionSet);
+            MPF_TEST_ASSERTEQUAL(instructionSet, index.instructionSet());
+            // check all buffer lengths around the chunk borders, the index must never report positions behind the end
+            for(size_t length = 0; length < 200; ++length) {
+                index.reset(data.c_str() + 3, length);
+                size_t expected = 0;
+                for(size_t pos = 0; pos <= length; pos = expected + 1) {
+                    expected = pos;
+                    while(expected < length && std::string(";\n\r\"'").find(data[3 + expected]) == std::string::npos) {
+                        ++expected;
+                    }
+                    MPF_TEST_ASSERTEQUAL(expected, index.next(pos));
+                }
+            }
+        }
+        MPF_TEST_ASSERT(csvsqldb::csv::CSVStructuralIndex::isSupported(csvsqldb::csv::CSVStructuralIndex::bestInstructionSet()));
+    }
+
+    void parseBufferBoundaryTest()
+    {
+        csvsqldb::csv::Types types;
+        types.push_back(csvsqldb::csv::LONG);
+        types.push_back(csvsqldb::csv::STRING);
+        types.push_back(csvsqldb::csv::DOUBLE);
+        types.push_back(csvsqldb::csv::DATE);
+
+        // enough lines to cross the stream buffer several times with fields of varying length and some quoted strings
+        std::string data("id;name;value;date\n");
+        for(size_t n = 0; n < 2000; ++n) {
+            data += std::to_string(n) + ";" + (n % 5 == 0 ? std::string("\"q;uoted\"") : std::string(n % 17, 'x') + "plain") + "; " +
+                    std::to_string(n) + ".5;2015-07-0" + std::to_string(1 + n % 9) + (n % 3 ? "\n" : "\r\n");
+        }
+
+        csvsqldb::csv::CSVParserContext context;
+        context._skipFirstLine = true;
+        context._delimiter = ';';
+
+        DummyCSVParserCallback memoryCallback;
+        csvsqldb::csv::CSVParser memoryParser(context, data.c_str(), data.size(), types, memoryCallback);
+        while(memoryParser.parseLine()) {
+        }
+
+        std::stringstream ss(data);
+        DummyCSVParserCallback streamCallback;
+        csvsqldb::csv::CSVParser streamParser(context, ss, types, streamCallback);
+        while(streamParser.parseLine()) {
+        }
+
+        MPF_TEST_ASSERTEQUAL(8000U, memoryCallback._results.size());
+        MPF_TEST_ASSERT(memoryCallback._results == streamCallback._results);
+        MPF_TEST_ASSERTEQUAL("1234", memoryCallback._results[4 * 1234]);
+        MPF_TEST_ASSERTEQUAL("xxxxxxxxxxplain", memoryCallback._results[4 * 1234 + 1]);
+        MPF_TEST_ASSERTEQUAL("1234.500000", memoryCallback._results[4 * 1234 + 2]);
+        MPF_TEST_ASSERTEQUAL("2015-07-02", memoryCallback._results[4 * 1234 + 3]);
+        MPF_TEST_ASSERTEQUAL("q;uoted", memoryCallback._results[4 * 1235 + 1]);
+    }
 };
 
 MPF_REGISTER_TEST_START("CSVSuite", CSVParserTestCase);
 MPF_REGISTER_TEST(CSVParserTestCase::parseSimpleTest);
 MPF_REGISTER_TEST(CSVParserTestCase::parseTest);
 MPF_REGISTER_TEST(CSVParserTestCase::parseErroneousCSV);
+MPF_REGISTER_TEST(CSVParserTestCase::invalidQuotedFieldTest);
+MPF_REGISTER_TEST(CSVParserTestCase::invalidFieldTest);
 MPF_REGISTER_TEST(CSVParserTestCase::parseStrings);
 MPF_REGISTER_TEST(CSVParserTestCase::stringParserTest);
+MPF_REGISTER_TEST(CSVParserTestCase::parseMemoryTest);
+MPF_REGISTER_TEST(CSVParserTestCase::skipFieldTest);
+MPF_REGISTER_TEST(CSVParserTestCase::parseMemoryMappedFileTest);
+MPF_REGISTER_TEST(CSVParserTestCase::structuralIndexTest);
+MPF_REGISTER_TEST(CSVParserTestCase::parseBufferBoundaryTest);
 MPF_REGISTER_TEST_END();
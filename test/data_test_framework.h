@@ -50,12 +50,19 @@ struct TableElement {
 class TableInitializer
 {
 public:
-    TableInitializer(const std::string& table, std::initializer_list<TableElement> elements)
+    TableInitializer(const std::string& table,
+                     std::initializer_list<TableElement> elements,
+                     std::initializer_list<std::string> sortColumns = {})
     : _table(csvsqldb::toupper_copy(table))
     {
         for(const auto& element : elements) {
             _table.addColumn(csvsqldb::toupper_copy(element._name), element._type, false, false, false, csvsqldb::Any(), nullptr, 0);
         }
+        csvsqldb::StringVector columns;
+        for(const auto& column : sortColumns) {
+            columns.push_back(csvsqldb::toupper_copy(column));
+        }
+        _table.setSortColumns(columns);
     }
 
     const csvsqldb::TableData& getTable() const
@@ -92,35 +99,36 @@ private:
 
 
 template <typename TestRowProvider>
-class TestScanOperatorNode : public csvsqldb::ScanOperatorNode, public csvsqldb::BlockProvider
+class TestScanOperatorNode : public csvsqldb::ScanOperatorNode
 {
 public:
     TestScanOperatorNode(const csvsqldb::OperatorContext& context, const csvsqldb::SymbolTablePtr& symbolTable, const csvsqldb::SymbolInfo& tableInfo)
     : csvsqldb::ScanOperatorNode(context, symbolTable, tableInfo)
-    , _block(nullptr)
     {
     }
 
     const csvsqldb::Values* getNextRow()
     {
-        if(!_block) {
+        if(!_rows) {
             prepareBuffer();
         }
 
-        return _iterator->getNextRow();
+        return _rows->getNextRow();
     }
 
-    virtual csvsqldb::BlockPtr getNextBlock()
+    virtual int64_t estimateRowCount()
     {
-        return _block;
+        return TestRowProvider::getRows(_tableInfo._identifier).size();
     }
 
     void addRow(const std::vector<csvsqldb::Variant>& values)
     {
-        for(const auto& value : values) {
-            _block->addValue(value);
+        for(size_t n = 0; n < values.size(); ++n) {
+            if(_referencedColumns[n]) {
+                _rows->addValue(values[n]);
+            }
         }
-        _block->nextRow();
+        _rows->nextRow();
     }
 
     virtual void dump(std::ostream& stream) const
@@ -136,16 +144,13 @@ private:
 
     void prepareBuffer()
     {
-        _block = getBlockManager().createBlock();
+        // the rows are buffered in cacheable blocks, so tables can be larger than the memory budget
+        _rows = std::make_shared<csvsqldb::RowBuffer>(_types, getBlockManager());
 
         addRows();
-
-        _block->endBlocks();
-        _iterator = std::make_shared<csvsqldb::BlockIterator>(_types, *this, getBlockManager());
     }
 
-    csvsqldb::BlockPtr _block;
-    csvsqldb::BlockIteratorPtr _iterator;
+    csvsqldb::RowBufferPtr _rows;
 };
 
 
@@ -200,6 +205,15 @@ public:
         return std::make_shared<csvsqldb::SortOperatorNode>(context, symbolTable, orderExpressions);
     }
 
+    static csvsqldb::RowOperatorNodePtr createTopNOperatorNode(csvsqldb::OperatorContext& context,
+                                                               const csvsqldb::SymbolTablePtr& symbolTable,
+                                                               csvsqldb::OrderExpressions orderExpressions,
+                                                               const csvsqldb::ASTExprNodePtr& limit,
+                                                               const csvsqldb::ASTExprNodePtr& offset)
+    {
+        return std::make_shared<csvsqldb::TopNOperatorNode>(context, symbolTable, orderExpressions, limit, offset);
+    }
+
     static csvsqldb::RowOperatorNodePtr createGroupingOperatorNode(csvsqldb::OperatorContext& context,
                                                                    const csvsqldb::SymbolTablePtr& symbolTable,
                                                                    const csvsqldb::Expressions& nodes,
@@ -241,6 +255,13 @@ public:
         return std::make_shared<csvsqldb::InnerHashJoinOperatorNode>(context, symbolTable, exp);
     }
 
+    static csvsqldb::RowOperatorNodePtr createInnerMergeJoinOperatorNode(csvsqldb::OperatorContext& context,
+                                                                         const csvsqldb::SymbolTablePtr& symbolTable,
+                                                                         const csvsqldb::ASTExprNodePtr& exp)
+    {
+        return std::make_shared<csvsqldb::InnerMergeJoinOperatorNode>(context, symbolTable, exp);
+    }
+
     static csvsqldb::RowOperatorNodePtr createUnionOperatorNode(csvsqldb::OperatorContext& context, const csvsqldb::SymbolTablePtr& symbolTable)
     {
         return std::make_shared<csvsqldb::UnionOperatorNode>(context, symbolTable);
@@ -33,12 +33,20 @@
 
 #include "test.h"
 
+#include "libcsvsqldb/binary_format.h"
 #include "libcsvsqldb/execution_plan_creator.h"
 #include "libcsvsqldb/operatornode_factory.h"
 #include "libcsvsqldb/sql_parser.h"
 #include "libcsvsqldb/validation_visitor.h"
 
+#include <algorithm>
 #include <fstream>
+#include <map>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
 
 #include <boost/filesystem.hpp>
 
@@ -122,8 +130,8 @@ public:
 )");
         dataFile.close();
 
-        csvsqldb::ExecutionPlan execPlan;
         csvsqldb::BlockManager manager;
+        csvsqldb::ExecutionPlan execPlan;
         std::stringstream output;
         csvsqldb::OperatorContext context(database, functions, manager, files);
         csvsqldb::ASTValidationVisitor validationVisitor(database);
@@ -141,8 +149,794 @@ public:
 
         MPF_TEST_ASSERTEQUAL(expected, output.str());
     }
+
+    void multipleFilesTest()
+    {
+        csvsqldb::FunctionRegistry functions;
+        csvsqldb::SQLParser parser(functions);
+
+        fs::path tempDir = fs::temp_directory_path();
+        if(!fs::exists(tempDir)) {
+            fs::create_directories(tempDir);
+        }
+
+        csvsqldb::ASTNodePtr node = parser.parse("CREATE TABLE sales(id INTEGER,amount INTEGER,system_filename VARCHAR(255))");
+        csvsqldb::ASTCreateTableNodePtr createNode = std::dynamic_pointer_cast<csvsqldb::ASTCreateTableNode>(node);
+        MPF_TEST_ASSERT(createNode);
+
+        csvsqldb::TableData tabledata = csvsqldb::TableData::fromCreateAST(createNode);
+        csvsqldb::StringVector files;
+        files.push_back((tempDir / "sales_1.csv").string());
+        files.push_back((tempDir / "employees.csv").string());
+        files.push_back((tempDir / "sales_2.csv").string());
+        csvsqldb::FileMapping::Mappings mappings;
+        mappings.push_back({ "sales_[0-9]+.csv->sales", ',', false });
+        csvsqldb::FileMapping mapping;
+        mapping.initialize(mappings);
+
+        csvsqldb::Database database(tempDir.string(), mapping);
+        database.addTable(tabledata);
+
+        std::fstream dataFile1(files[0], std::ios_base::trunc | std::ios_base::out);
+        dataFile1 << "id,amount\n1,10\n2,20\n";
+        dataFile1.close();
+        std::fstream dataFile2(files[2], std::ios_base::trunc | std::ios_base::out);
+        dataFile2 << "id,amount\n3,30\n";
+        dataFile2.close();
+
+        node = parser.parse("SELECT id,amount,system_filename FROM sales WHERE amount > 10;");
+        node->typeSymbolTable(database);
+
+        csvsqldb::BlockManager manager;
+        csvsqldb::ExecutionPlan execPlan;
+        std::stringstream output;
+        csvsqldb::OperatorContext context(database, functions, manager, files);
+        csvsqldb::ASTValidationVisitor validationVisitor(database);
+        node->accept(validationVisitor);
+        csvsqldb::ExecutionPlanVisitor<csvsqldb::OperatorNodeFactory> execVisitor(context, execPlan, output);
+        node->accept(execVisitor);
+
+        MPF_TEST_ASSERTEQUAL(2, execPlan.execute());
+
+        std::string expected = "#ID,AMOUNT,SYSTEM_FILENAME\n2,20,'" + files[0] + "'\n3,30,'" + files[2] + "'\n";
+        MPF_TEST_ASSERTEQUAL(expected, output.str());
+
+        // with only the file name referenced all csv columns are skipped, so the file name is the only value of each row
+        for(uint16_t threads : { 1, 2 }) {
+            node = parser.parse("SELECT system_filename,count(*) FROM sales GROUP BY system_filename ORDER BY system_filename;");
+            node->typeSymbolTable(database);
+
+            csvsqldb::ExecutionPlan fileNameExecPlan;
+            output.str("");
+            csvsqldb::OperatorContext fileNameContext(database, functions, manager, files);
+            fileNameContext._numberOfThreads = threads;
+            node->accept(validationVisitor);
+            csvsqldb::ExecutionPlanVisitor<csvsqldb::OperatorNodeFactory> fileNameExecVisitor(fileNameContext, fileNameExecPlan, output);
+            node->accept(fileNameExecVisitor);
+
+            MPF_TEST_ASSERTEQUAL(2, fileNameExecPlan.execute());
+            expected = "#SYSTEM_FILENAME,$alias_1\n'" + files[0] + "',2\n'" + files[2] + "',1\n";
+            MPF_TEST_ASSERTEQUAL(expected, output.str());
+        }
+
+        node = parser.parse("SELECT system_filename FROM sales;");
+        node->typeSymbolTable(database);
+
+        csvsqldb::ExecutionPlan fileNameOnlyExecPlan;
+        output.str("");
+        node->accept(validationVisitor);
+        csvsqldb::ExecutionPlanVisitor<csvsqldb::OperatorNodeFactory> fileNameOnlyExecVisitor(context, fileNameOnlyExecPlan, output);
+        node->accept(fileNameOnlyExecVisitor);
+
+        MPF_TEST_ASSERTEQUAL(3, fileNameOnlyExecPlan.execute());
+        expected = "#SYSTEM_FILENAME\n'" + files[0] + "'\n'" + files[0] + "'\n'" + files[2] + "'\n";
+        MPF_TEST_ASSERTEQUAL(expected, output.str());
+
+        // a predicate on the file name alone skips the other files, so they need not even exist
+        fs::remove(files[0]);
+        node = parser.parse("SELECT id,amount FROM sales WHERE system_filename LIKE '%sales_2.csv';");
+        node->typeSymbolTable(database);
+
+        csvsqldb::ExecutionPlan prunedExecPlan;
+        output.str("");
+        node->accept(validationVisitor);
+        csvsqldb::ExecutionPlanVisitor<csvsqldb::OperatorNodeFactory> prunedExecVisitor(context, prunedExecPlan, output);
+        node->accept(prunedExecVisitor);
+
+        MPF_TEST_ASSERTEQUAL(1, prunedExecPlan.execute());
+        MPF_TEST_ASSERTEQUAL("#ID,AMOUNT\n3,30\n", output.str());
+    }
+
+    void predicatePushdownTest()
+    {
+        csvsqldb::FunctionRegistry functions;
+        csvsqldb::SQLParser parser(functions);
+
+        fs::path tempDir = fs::temp_directory_path();
+        if(!fs::exists(tempDir)) {
+            fs::create_directories(tempDir);
+        }
+
+        csvsqldb::Database database(tempDir.string(), csvsqldb::FileMapping());
+        csvsqldb::ASTNodePtr node = parser.parse("CREATE TABLE customers(id INTEGER,name VARCHAR(20),country CHAR(2))");
+        database.addTable(csvsqldb::TableData::fromCreateAST(std::dynamic_pointer_cast<csvsqldb::ASTCreateTableNode>(node)));
+        node = parser.parse("CREATE TABLE orders(id INTEGER,customer INTEGER,amount INTEGER)");
+        database.addTable(csvsqldb::TableData::fromCreateAST(std::dynamic_pointer_cast<csvsqldb::ASTCreateTableNode>(node)));
+
+        csvsqldb::StringVector files;
+        files.push_back((tempDir / "pushdown_customers.csv").string());
+        files.push_back((tempDir / "pushdown_orders.csv").string());
+        csvsqldb::FileMapping::Mappings mappings;
+        mappings.push_back({ "pushdown_customers.csv->customers", ',', false });
+        mappings.push_back({ "pushdown_orders.csv->orders", ',', false });
+        csvsqldb::FileMapping mapping;
+        mapping.initialize(mappings);
+        database.addMapping(mapping);
+
+        std::fstream customers(files[0], std::ios_base::trunc | std::ios_base::out);
+        customers << "id,name,country\n1,Lars,DE\n2,Mark,DE\n3,Angelica,PE\n";
+        customers.close();
+        std::fstream orders(files[1], std::ios_base::trunc | std::ios_base::out);
+        orders << "id,customer,amount\n10,1,100\n11,2,5\n12,3,300\n13,2,200\n14,1,20\n15,1,\n";
+        orders.close();
+
+        // one conjunct per table is evaluated by the scans, the last one references both tables
+        node = parser.parse(
+        "SELECT o.id,c.name FROM customers c JOIN orders o ON c.id = o.customer WHERE c.country = 'DE' AND o.amount >= 20 AND "
+        "o.amount > c.id * 50;");
+        node->typeSymbolTable(database);
+
+        csvsqldb::BlockManager manager;
+        csvsqldb::ExecutionPlan execPlan;
+        std::stringstream output;
+        csvsqldb::OperatorContext context(database, functions, manager, files);
+        csvsqldb::ASTValidationVisitor validationVisitor(database);
+        node->accept(validationVisitor);
+        csvsqldb::ExecutionPlanVisitor<csvsqldb::OperatorNodeFactory> execVisitor(context, execPlan, output);
+        node->accept(execVisitor);
+
+        std::stringstream plan;
+        execPlan.dump(plan);
+        MPF_TEST_ASSERT(plan.str().find("TableScanOperator (CUSTOMERS) with pushed down predicates") != std::string::npos);
+        MPF_TEST_ASSERT(plan.str().find("TableScanOperator (ORDERS) with pushed down predicates") != std::string::npos);
+        MPF_TEST_ASSERT(plan.str().find("SelectOperator") != std::string::npos);
+
+        MPF_TEST_ASSERTEQUAL(2, execPlan.execute());
+        MPF_TEST_ASSERTEQUAL("#O.ID,C.NAME\n10,'Lars'\n13,'Mark'\n", output.str());
+
+        // a predicate evaluating to NULL drops the row, whether it is evaluated by a scan or by the select above the join
+        for(const char* sql : { "SELECT o.id FROM orders o WHERE o.amount > 50 ORDER BY o.id;",
+                                "SELECT o.id FROM customers c JOIN orders o ON c.id = o.customer WHERE o.amount > c.id * 50 + 20 "
+                                "ORDER BY o.id;" }) {
+            csvsqldb::ASTNodePtr query = parser.parse(sql);
+            query->typeSymbolTable(database);
+
+            csvsqldb::BlockManager nullManager;
+            csvsqldb::ExecutionPlan nullPlan;
+            std::stringstream nullOutput;
+            csvsqldb::OperatorContext nullContext(database, functions, nullManager, files);
+            nullContext._showHeaderLine = false;
+            csvsqldb::ASTValidationVisitor nullValidationVisitor(database);
+            query->accept(nullValidationVisitor);
+            csvsqldb::ExecutionPlanVisitor<csvsqldb::OperatorNodeFactory> nullVisitor(nullContext, nullPlan, nullOutput);
+            query->accept(nullVisitor);
+
+            MPF_TEST_ASSERTEQUAL(3, nullPlan.execute());
+            MPF_TEST_ASSERTEQUAL("10\n12\n13\n", nullOutput.str());
+        }
+    }
+
+    void projectionTest()
+    {
+        csvsqldb::FunctionRegistry functions;
+        csvsqldb::SQLParser parser(functions);
+
+        fs::path tempDir = fs::temp_directory_path();
+        if(!fs::exists(tempDir)) {
+            fs::create_directories(tempDir);
+        }
+
+        csvsqldb::ASTNodePtr node = parser.parse("CREATE TABLE orders(id INTEGER,ordered DATE,amount INTEGER,remark VARCHAR(20))");
+        csvsqldb::ASTCreateTableNodePtr createNode = std::dynamic_pointer_cast<csvsqldb::ASTCreateTableNode>(node);
+        MPF_TEST_ASSERT(createNode);
+
+        csvsqldb::TableData tabledata = csvsqldb::TableData::fromCreateAST(createNode);
+        csvsqldb::StringVector files;
+        files.push_back((tempDir / "orders.csv").string());
+        csvsqldb::FileMapping::Mappings mappings;
+        mappings.push_back({ "orders.csv->orders", ',', false });
+        csvsqldb::FileMapping mapping;
+        mapping.initialize(mappings);
+
+        csvsqldb::Database database(tempDir.string(), mapping);
+        database.addTable(tabledata);
+
+        // the unreferenced date column contains garbage, that would be reported as invalid if it was parsed
+        std::fstream dataFile(files[0], std::ios_base::trunc | std::ios_base::out);
+        dataFile << "id,ordered,amount,remark\n1,garbage,10,first\n2,garbage,20,second\n3,garbage,30,third\n";
+        dataFile.close();
+
+        node = parser.parse("SELECT remark,id FROM orders WHERE amount >= 20;");
+        node->typeSymbolTable(database);
+
+        csvsqldb::BlockManager manager;
+        csvsqldb::ExecutionPlan execPlan;
+        std::stringstream output;
+        csvsqldb::OperatorContext context(database, functions, manager, files);
+        csvsqldb::ASTValidationVisitor validationVisitor(database);
+        node->accept(validationVisitor);
+        csvsqldb::ExecutionPlanVisitor<csvsqldb::OperatorNodeFactory> execVisitor(context, execPlan, output);
+        node->accept(execVisitor);
+
+        MPF_TEST_ASSERTEQUAL(2, execPlan.execute());
+        MPF_TEST_ASSERTEQUAL("#REMARK,ID\n'second',2\n'third',3\n", output.str());
+    }
+
+    void buildSideSelectionTest()
+    {
+        csvsqldb::FunctionRegistry functions;
+        csvsqldb::SQLParser parser(functions);
+
+        fs::path tempDir = fs::temp_directory_path();
+        if(!fs::exists(tempDir)) {
+            fs::create_directories(tempDir);
+        }
+
+        csvsqldb::Database database(tempDir.string(), csvsqldb::FileMapping());
+        csvsqldb::ASTNodePtr node = parser.parse("CREATE TABLE customers(id INTEGER,name VARCHAR(20))");
+        database.addTable(csvsqldb::TableData::fromCreateAST(std::dynamic_pointer_cast<csvsqldb::ASTCreateTableNode>(node)));
+        node = parser.parse("CREATE TABLE orders(id INTEGER,customer INTEGER)");
+        database.addTable(csvsqldb::TableData::fromCreateAST(std::dynamic_pointer_cast<csvsqldb::ASTCreateTableNode>(node)));
+
+        csvsqldb::StringVector files;
+        files.push_back((tempDir / "build_side_customers.csv").string());
+        files.push_back((tempDir / "build_side_orders.csv").string());
+        csvsqldb::FileMapping::Mappings mappings;
+        mappings.push_back({ "build_side_customers.csv->customers", ',', false });
+        mappings.push_back({ "build_side_orders.csv->orders", ',', false });
+        csvsqldb::FileMapping mapping;
+        mapping.initialize(mappings);
+        database.addMapping(mapping);
+
+        std::fstream customers(files[0], std::ios_base::trunc | std::ios_base::out);
+        customers << "id,name\n1,Lars\n2,Mark\n";
+        customers.close();
+        std::fstream orders(files[1], std::ios_base::trunc | std::ios_base::out);
+        orders << "id,customer\n";
+        for(int n = 0; n < 1000; ++n) {
+            orders << n << "," << (n % 100) << "\n";
+        }
+        orders.close();
+
+        struct Query {
+            std::string _sql;
+            std::string _buildSide;
+            int64_t _rows;
+            std::string _firstRow;
+        };
+        for(const auto& query :
+            { Query{ "SELECT * FROM customers c JOIN orders o ON c.id = o.customer;", "build lhs", 20, "1,'Lars',1,1" },
+              Query{ "SELECT * FROM orders o JOIN customers c ON o.customer = c.id;", "build rhs", 20, "1,1,1,'Lars'" },
+              Query{ "SELECT * FROM customers c JOIN orders o ON c.id = o.customer AND o.id > c.id;", "build lhs", 18, "1,'Lars',101,1" } }) {
+            node = parser.parse(query._sql);
+            node->typeSymbolTable(database);
+
+            csvsqldb::BlockManager manager;
+            csvsqldb::ExecutionPlan execPlan;
+            std::stringstream output;
+            csvsqldb::OperatorContext context(database, functions, manager, files);
+            csvsqldb::ASTValidationVisitor validationVisitor(database);
+            node->accept(validationVisitor);
+            csvsqldb::ExecutionPlanVisitor<csvsqldb::OperatorNodeFactory> execVisitor(context, execPlan, output);
+            node->accept(execVisitor);
+
+            std::stringstream plan;
+            execPlan.dump(plan);
+            MPF_TEST_ASSERT(plan.str().find("InnerHashJoinOperator (" + query._buildSide + ")") != std::string::npos);
+
+            // the output columns keep the order of the query
+            MPF_TEST_ASSERTEQUAL(query._rows, execPlan.execute());
+            std::string result = output.str();
+            MPF_TEST_ASSERT(result.find("\n" + query._firstRow + "\n") != std::string::npos);
+        }
+    }
+
+    void mergeJoinTest()
+    {
+        csvsqldb::FunctionRegistry functions;
+        csvsqldb::SQLParser parser(functions);
+
+        fs::path tempDir = fs::temp_directory_path();
+        if(!fs::exists(tempDir)) {
+            fs::create_directories(tempDir);
+        }
+
+        csvsqldb::StringVector files;
+        files.push_back((tempDir / "merge_join_customers.csv").string());
+        files.push_back((tempDir / "merge_join_orders.csv").string());
+        csvsqldb::FileMapping::Mappings mappings;
+        mappings.push_back({ "merge_join_customers.csv->customers", ',', false });
+        mappings.push_back({ "merge_join_orders.csv->orders", ',', false });
+        csvsqldb::FileMapping mapping;
+        mapping.initialize(mappings);
+
+        struct Query {
+            std::string _table;
+            std::string _orders;
+            std::string _plan;
+            std::string _result;
+        };
+        for(const auto& query :
+            { Query{ "CREATE TABLE orders(id INTEGER,customer INTEGER) ORDER BY customer",
+                     "id,customer\n10,1\n11,1\n12,3\n13,4\n",
+                     "InnerMergeJoinOperator (lhs sorted, rhs sorted)",
+                     "#C.NAME,O.ID\n'Lars',10\n'Lars',11\n'Angelica',12\n" },
+              // the smaller unsorted input is sorted by the merge join
+              Query{ "CREATE TABLE orders(id INTEGER,customer INTEGER)",
+                     "id,customer\n10,3\n11,1\n12,1\n",
+                     "InnerMergeJoinOperator (lhs sorted, rhs unsorted)",
+                     "#C.NAME,O.ID\n'Lars',11\n'Lars',12\n'Angelica',10\n" },
+              // the larger unsorted input is hashed
+              Query{ "CREATE TABLE orders(id INTEGER,customer INTEGER)",
+                     "id,customer\n10,3\n11,1\n12,1\n13,2\n",
+                     "InnerHashJoinOperator",
+                     "#C.NAME,O.ID\n'Angelica',10\n'Lars',11\n'Lars',12\n'Mark',13\n" },
+              // a wrong declaration is detected while merging and fails the query
+              Query{ "CREATE TABLE orders(id INTEGER,customer INTEGER) ORDER BY customer",
+                     "id,customer\n10,3\n11,1\n13,2\n",
+                     "InnerMergeJoinOperator (lhs sorted, rhs sorted)",
+                     "" } }) {
+            csvsqldb::Database database(tempDir.string(), csvsqldb::FileMapping());
+            csvsqldb::ASTNodePtr node = parser.parse("CREATE TABLE customers(id INTEGER,name VARCHAR(20)) ORDER BY id");
+            database.addTable(csvsqldb::TableData::fromCreateAST(std::dynamic_pointer_cast<csvsqldb::ASTCreateTableNode>(node)));
+            node = parser.parse(query._table);
+            database.addTable(csvsqldb::TableData::fromCreateAST(std::dynamic_pointer_cast<csvsqldb::ASTCreateTableNode>(node)));
+            database.addMapping(mapping);
+
+            std::fstream customers(files[0], std::ios_base::trunc | std::ios_base::out);
+            customers << "id,name\n1,Lars\n2,Mark\n3,Angelica\n";
+            customers.close();
+            std::fstream orders(files[1], std::ios_base::trunc | std::ios_base::out);
+            orders << query._orders;
+            orders.close();
+
+            node = parser.parse("SELECT c.name,o.id FROM customers c JOIN orders o ON c.id = o.customer;");
+            node->typeSymbolTable(database);
+
+            csvsqldb::BlockManager manager;
+            csvsqldb::ExecutionPlan execPlan;
+            std::stringstream output;
+            csvsqldb::OperatorContext context(database, functions, manager, files);
+            csvsqldb::ASTValidationVisitor validationVisitor(database);
+            node->accept(validationVisitor);
+            csvsqldb::ExecutionPlanVisitor<csvsqldb::OperatorNodeFactory> execVisitor(context, execPlan, output);
+            node->accept(execVisitor);
+
+            std::stringstream plan;
+            execPlan.dump(plan);
+            MPF_TEST_ASSERT(plan.str().find(query._plan) != std::string::npos);
+
+            if(query._result.empty()) {
+                MPF_TEST_EXPECTS(execPlan.execute(), csvsqldb::Exception);
+                continue;
+            }
+            execPlan.execute();
+            MPF_TEST_ASSERTEQUAL(query._result, output.str());
+        }
+    }
+
+#ifndef _WIN32
+    void pipeJoinTest()
+    {
+        csvsqldb::FunctionRegistry functions;
+        csvsqldb::SQLParser parser(functions);
+
+        fs::path tempDir = fs::temp_directory_path();
+        if(!fs::exists(tempDir)) {
+            fs::create_directories(tempDir);
+        }
+
+        csvsqldb::Database database(tempDir.string(), csvsqldb::FileMapping());
+        csvsqldb::ASTNodePtr node = parser.parse("CREATE TABLE customers(id INTEGER,name VARCHAR(20))");
+        database.addTable(csvsqldb::TableData::fromCreateAST(std::dynamic_pointer_cast<csvsqldb::ASTCreateTableNode>(node)));
+        node = parser.parse("CREATE TABLE orders(id INTEGER,customer INTEGER)");
+        database.addTable(csvsqldb::TableData::fromCreateAST(std::dynamic_pointer_cast<csvsqldb::ASTCreateTableNode>(node)));
+
+        csvsqldb::StringVector files;
+        files.push_back((tempDir / "pipe_join_customers.csv").string());
+        files.push_back((tempDir / "pipe_join_orders.csv").string());
+        csvsqldb::FileMapping::Mappings mappings;
+        mappings.push_back({ "pipe_join_customers.csv->customers", ',', false });
+        mappings.push_back({ "pipe_join_orders.csv->orders", ',', false });
+        csvsqldb::FileMapping mapping;
+        mapping.initialize(mappings);
+        database.addMapping(mapping);
+
+        for(const auto& file : files) {
+            fs::remove(file);
+            MPF_TEST_ASSERTEQUAL(0, ::mkfifo(file.c_str(), 0600));
+        }
+
+        // planning must not read from the pipes, their content can only be read once by the scans
+        node = parser.parse("SELECT c.name,o.id FROM customers c JOIN orders o ON c.id = o.customer;");
+        node->typeSymbolTable(database);
+
+        csvsqldb::BlockManager manager;
+        csvsqldb::ExecutionPlan execPlan;
+        std::stringstream output;
+        csvsqldb::OperatorContext context(database, functions, manager, files);
+        csvsqldb::ASTValidationVisitor validationVisitor(database);
+        node->accept(validationVisitor);
+        csvsqldb::ExecutionPlanVisitor<csvsqldb::OperatorNodeFactory> execVisitor(context, execPlan, output);
+        node->accept(execVisitor);
+
+        std::stringstream plan;
+        execPlan.dump(plan);
+        MPF_TEST_ASSERT(plan.str().find("InnerHashJoinOperator") != std::string::npos);
+
+        std::thread customers([&]() { std::ofstream(files[0]) << "id,name\n1,Lars\n2,Mark\n3,Angelica\n"; });
+        std::thread orders([&]() { std::ofstream(files[1]) << "id,customer\n10,1\n11,1\n12,3\n"; });
+        int64_t rows = execPlan.execute();
+        customers.join();
+        orders.join();
+        for(const auto& file : files) {
+            fs::remove(file);
+        }
+
+        MPF_TEST_ASSERTEQUAL(3, rows);
+        MPF_TEST_ASSERTEQUAL("#C.NAME,O.ID\n'Lars',10\n'Lars',11\n'Angelica',12\n", output.str());
+    }
+#endif
+
+    void limitPushdownTest()
+    {
+        csvsqldb::FunctionRegistry functions;
+        csvsqldb::SQLParser parser(functions);
+
+        fs::path tempDir = fs::temp_directory_path();
+        if(!fs::exists(tempDir)) {
+            fs::create_directories(tempDir);
+        }
+
+        csvsqldb::Database database(tempDir.string(), csvsqldb::FileMapping());
+        csvsqldb::ASTNodePtr node = parser.parse("CREATE TABLE orders(id INTEGER,customer INTEGER)");
+        database.addTable(csvsqldb::TableData::fromCreateAST(std::dynamic_pointer_cast<csvsqldb::ASTCreateTableNode>(node)));
+
+        csvsqldb::StringVector files;
+        files.push_back((tempDir / "limit_pushdown_orders.csv").string());
+        csvsqldb::FileMapping::Mappings mappings;
+        mappings.push_back({ "limit_pushdown_orders.csv->orders", ',', false });
+        csvsqldb::FileMapping mapping;
+        mapping.initialize(mappings);
+        database.addMapping(mapping);
+
+        std::fstream orders(files[0], std::ios_base::trunc | std::ios_base::out);
+        orders << "id,customer\n";
+        for(int n = 0; n < 50000; ++n) {
+            orders << n << "," << (n % 100) << "\n";
+        }
+        orders.close();
+
+        struct Query {
+            std::string _sql;
+            std::string _plan;
+            int64_t _rows;
+            std::string _result;
+        };
+        size_t fullScanBlocks = 0;
+        for(const auto& query :
+            { Query{ "SELECT * FROM orders;", "TableScanOperator (ORDERS)\n", 50000, "" },
+              Query{ "SELECT * FROM orders LIMIT 3;", "limited to 3 rows", 3, "#ORDERS.ID,ORDERS.CUSTOMER\n0,0\n1,1\n2,2\n" },
+              Query{ "SELECT id FROM orders LIMIT 2 OFFSET 5;", "limited to 7 rows", 2, "#ID\n5\n6\n" },
+              Query{ "SELECT * FROM orders LIMIT 0;", "limited to 0 rows", 0, "#ORDERS.ID,ORDERS.CUSTOMER\n" } }) {
+            node = parser.parse(query._sql);
+            node->typeSymbolTable(database);
+
+            csvsqldb::BlockManager manager(csvsqldb::MemoryBudget(100 * 1024 * 1024), 16 * 1024);
+            csvsqldb::ExecutionPlan execPlan;
+            std::stringstream output;
+            csvsqldb::OperatorContext context(database, functions, manager, files);
+            csvsqldb::ASTValidationVisitor validationVisitor(database);
+            node->accept(validationVisitor);
+            csvsqldb::ExecutionPlanVisitor<csvsqldb::OperatorNodeFactory> execVisitor(context, execPlan, output);
+            node->accept(execVisitor);
+
+            std::stringstream plan;
+            execPlan.dump(plan);
+            MPF_TEST_ASSERT(plan.str().find(query._plan) != std::string::npos);
+
+            MPF_TEST_ASSERTEQUAL(query._rows, execPlan.execute());
+            if(query._result.empty()) {
+                fullScanBlocks = manager.getTotalBlocks();
+            } else {
+                MPF_TEST_ASSERTEQUAL(query._result, output.str());
+                // the reader stops early instead of parsing the whole file
+                MPF_TEST_ASSERT(manager.getTotalBlocks() * 4 < fullScanBlocks);
+            }
+        }
+    }
+
+    void parallelOutputTest()
+    {
+        csvsqldb::FunctionRegistry functions;
+        csvsqldb::SQLParser parser(functions);
+
+        fs::path tempDir = fs::temp_directory_path();
+        if(!fs::exists(tempDir)) {
+            fs::create_directories(tempDir);
+        }
+
+        csvsqldb::Database database(tempDir.string(), csvsqldb::FileMapping());
+        csvsqldb::ASTNodePtr node = parser.parse("CREATE TABLE sales(id INTEGER,item VARCHAR(20),price REAL,sold DATE)");
+        database.addTable(csvsqldb::TableData::fromCreateAST(std::dynamic_pointer_cast<csvsqldb::ASTCreateTableNode>(node)));
+
+        csvsqldb::StringVector files;
+        files.push_back((tempDir / "parallel_output_sales.csv").string());
+        csvsqldb::FileMapping::Mappings mappings;
+        mappings.push_back({ "parallel_output_sales.csv->sales", ',', false });
+        csvsqldb::FileMapping mapping;
+        mapping.initialize(mappings);
+        database.addMapping(mapping);
+
+        std::fstream sales(files[0], std::ios_base::trunc | std::ios_base::out);
+        sales << "id,item,price,sold\n";
+        for(int n = 0; n < 30000; ++n) {
+            sales << (n * 7919) % 30000 << ",item " << n << "," << n * 0.25 << ",2015-0" << (n % 9 + 1) << "-1" << (n % 10) << "\n";
+        }
+        sales.close();
+
+        // the rows are formatted by several workers, but have to be written in the order of the query
+        std::string expected;
+        for(uint16_t threads : { 1, 4 }) {
+            node = parser.parse("SELECT * FROM sales ORDER BY id DESC;");
+            node->typeSymbolTable(database);
+
+            csvsqldb::BlockManager manager;
+            {
+                csvsqldb::ExecutionPlan execPlan;
+                std::stringstream output;
+                csvsqldb::OperatorContext context(database, functions, manager, files);
+                context._numberOfThreads = threads;
+                csvsqldb::ASTValidationVisitor validationVisitor(database);
+                node->accept(validationVisitor);
+                csvsqldb::ExecutionPlanVisitor<csvsqldb::OperatorNodeFactory> execVisitor(context, execPlan, output);
+                node->accept(execVisitor);
+
+                MPF_TEST_ASSERTEQUAL(30000, execPlan.execute());
+                if(expected.empty()) {
+                    expected = output.str();
+                    MPF_TEST_ASSERT(expected.find("\n29999,'item 22321',5580.250000,2015-02-11\n") != std::string::npos);
+                } else {
+                    MPF_TEST_ASSERT(expected == output.str());
+                }
+            }
+            MPF_TEST_ASSERTEQUAL(0u, manager.getActiveBlocks());
+        }
+    }
+
+    void spillingParallelGroupByTest()
+    {
+        csvsqldb::FunctionRegistry functions;
+        csvsqldb::SQLParser parser(functions);
+
+        fs::path tempDir = fs::temp_directory_path();
+        if(!fs::exists(tempDir)) {
+            fs::create_directories(tempDir);
+        }
+
+        csvsqldb::Database database(tempDir.string(), csvsqldb::FileMapping());
+        csvsqldb::ASTNodePtr node = parser.parse("CREATE TABLE sales(id INTEGER,item INTEGER,amount INTEGER)");
+        database.addTable(csvsqldb::TableData::fromCreateAST(std::dynamic_pointer_cast<csvsqldb::ASTCreateTableNode>(node)));
+
+        csvsqldb::StringVector files;
+        files.push_back((tempDir / "spilling_group_sales.csv").string());
+        csvsqldb::FileMapping::Mappings mappings;
+        mappings.push_back({ "spilling_group_sales.csv->sales", ',', false });
+        csvsqldb::FileMapping mapping;
+        mapping.initialize(mappings);
+        database.addMapping(mapping);
+
+        const int64_t items = 20000;
+        std::fstream sales(files[0], std::ios_base::trunc | std::ios_base::out);
+        sales << "id,item,amount\n";
+        for(int64_t n = 0; n < 3 * items; ++n) {
+            sales << n << "," << (n * 7919) % items << "," << n % 100 << "\n";
+        }
+        sales.close();
+
+        // the scan readers, the queue of the aggregating workers, their partial tables and spill partitions all have to
+        // share the budget, so the groups are spilled instead of exceeding it
+        for(size_t budgetBlocks : { 16u, 32u, 64u, 128u }) {
+            node = parser.parse("SELECT item,count(*),sum(amount) FROM sales GROUP BY item;");
+            node->typeSymbolTable(database);
+
+            csvsqldb::BlockManager manager(csvsqldb::MemoryBudget(budgetBlocks * 4096), 4096);
+            {
+                csvsqldb::ExecutionPlan execPlan;
+                std::stringstream output;
+                csvsqldb::OperatorContext context(database, functions, manager, files);
+                context._numberOfThreads = 4;
+                csvsqldb::ASTValidationVisitor validationVisitor(database);
+                node->accept(validationVisitor);
+                csvsqldb::ExecutionPlanVisitor<csvsqldb::OperatorNodeFactory> execVisitor(context, execPlan, output);
+                node->accept(execVisitor);
+
+                MPF_TEST_ASSERTEQUAL(items, execPlan.execute());
+                MPF_TEST_ASSERT(manager.getSpilledBlocks() > 0);
+                MPF_TEST_ASSERT(manager.getMaxUsedBlocks() <= budgetBlocks);
+
+                // every group has to be returned once with all of its rows
+                std::vector<bool> seen(items, false);
+                std::string line;
+                std::getline(output, line);
+                int64_t item = 0;
+                int64_t count = 0;
+                int64_t sum = 0;
+                char comma = 0;
+                while(output >> item >> comma >> count >> comma >> sum) {
+                    MPF_TEST_ASSERT(item >= 0 && item < items);
+                    MPF_TEST_ASSERT(!seen[item]);
+                    seen[item] = true;
+                    MPF_TEST_ASSERTEQUAL(3, count);
+                }
+                MPF_TEST_ASSERT(std::all_of(seen.begin(), seen.end(), [](bool value) { return value; }));
+            }
+            MPF_TEST_ASSERTEQUAL(0u, manager.getActiveBlocks());
+        }
+    }
+
+    void externalSortScanTest()
+    {
+        csvsqldb::FunctionRegistry functions;
+        csvsqldb::SQLParser parser(functions);
+
+        fs::path tempDir = fs::temp_directory_path();
+        if(!fs::exists(tempDir)) {
+            fs::create_directories(tempDir);
+        }
+
+        csvsqldb::Database database(tempDir.string(), csvsqldb::FileMapping());
+        csvsqldb::ASTNodePtr node = parser.parse("CREATE TABLE shuffled(id INTEGER,name VARCHAR(20))");
+        database.addTable(csvsqldb::TableData::fromCreateAST(std::dynamic_pointer_cast<csvsqldb::ASTCreateTableNode>(node)));
+
+        csvsqldb::StringVector files;
+        files.push_back((tempDir / "external_sort_shuffled.csv").string());
+        csvsqldb::FileMapping::Mappings mappings;
+        mappings.push_back({ "external_sort_shuffled.csv->shuffled", ',', false });
+        csvsqldb::FileMapping mapping;
+        mapping.initialize(mappings);
+        database.addMapping(mapping);
+
+        std::map<std::string, int> sorted;
+        std::fstream shuffled(files[0], std::ios_base::trunc | std::ios_base::out);
+        shuffled << "id,name\n";
+        for(int n = 0; n < 20000; ++n) {
+            std::string name = std::to_string(100000 + (n * 7919) % 20000);
+            shuffled << n << ",name " << name << "\n";
+            sorted["name " + name] = n;
+        }
+        shuffled.close();
+
+        std::string expected = "#ID,NAME\n";
+        for(auto iter = sorted.rbegin(); iter != sorted.rend(); ++iter) {
+            expected += std::to_string(iter->second) + ",'" + iter->first + "'\n";
+        }
+
+        // the budget holds only a few blocks, so the scan, the runs of the sort and the output have to share them
+        for(uint16_t threads : { 1, 4 }) {
+            node = parser.parse("SELECT id,name FROM shuffled ORDER BY name DESC;");
+            node->typeSymbolTable(database);
+
+            csvsqldb::BlockManager manager(12, 4096);
+            {
+                csvsqldb::ExecutionPlan execPlan;
+                std::stringstream output;
+                csvsqldb::OperatorContext context(database, functions, manager, files);
+                context._numberOfThreads = threads;
+                csvsqldb::ASTValidationVisitor validationVisitor(database);
+                node->accept(validationVisitor);
+                csvsqldb::ExecutionPlanVisitor<csvsqldb::OperatorNodeFactory> execVisitor(context, execPlan, output);
+                node->accept(execVisitor);
+
+                MPF_TEST_ASSERTEQUAL(20000, execPlan.execute());
+                MPF_TEST_ASSERT(expected == output.str());
+            }
+            MPF_TEST_ASSERT(manager.getTotalBlocks() > manager.getMaxActiveBlocks());
+            MPF_TEST_ASSERT(manager.getMaxUsedBlocks() <= manager.getMaxActiveBlocks());
+            MPF_TEST_ASSERTEQUAL(0u, manager.getActiveBlocks());
+        }
+    }
+
+    void binaryRoundTripTest()
+    {
+        csvsqldb::FunctionRegistry functions;
+        csvsqldb::SQLParser parser(functions);
+
+        fs::path tempDir = fs::temp_directory_path();
+        if(!fs::exists(tempDir)) {
+            fs::create_directories(tempDir);
+        }
+
+        csvsqldb::Database database(tempDir.string(), csvsqldb::FileMapping());
+        csvsqldb::ASTNodePtr node = parser.parse("CREATE TABLE sales(id INTEGER,item VARCHAR(20),price REAL,sold DATE)");
+        database.addTable(csvsqldb::TableData::fromCreateAST(std::dynamic_pointer_cast<csvsqldb::ASTCreateTableNode>(node)));
+        node = parser.parse("CREATE TABLE piped(id INTEGER,item VARCHAR(20),price REAL,sold DATE)");
+        database.addTable(csvsqldb::TableData::fromCreateAST(std::dynamic_pointer_cast<csvsqldb::ASTCreateTableNode>(node)));
+
+        csvsqldb::StringVector files;
+        files.push_back((tempDir / "binary_sales.csv").string());
+        files.push_back((tempDir / "binary_piped.bin").string());
+        csvsqldb::FileMapping::Mappings mappings;
+        mappings.push_back({ "binary_sales.csv->sales", ',', false });
+        mappings.push_back({ "binary_piped.bin->piped", ',', false });
+        csvsqldb::FileMapping mapping;
+        mapping.initialize(mappings);
+        database.addMapping(mapping);
+
+        std::fstream sales(files[0], std::ios_base::trunc | std::ios_base::out);
+        sales << "id,item,price,sold\n";
+        for(int n = 0; n < 1000; ++n) {
+            sales << n << ",item " << n << ",";
+            if(n % 7) {
+                sales << n * 0.25;
+            }
+            sales << ",2015-0" << (n % 9 + 1) << "-1" << (n % 10) << "\n";
+        }
+        sales.close();
+
+        auto execute = [&](const std::string& sql, csvsqldb::eOutputFormat format, uint16_t threads) {
+            csvsqldb::ASTNodePtr query = parser.parse(sql);
+            query->typeSymbolTable(database);
+
+            csvsqldb::BlockManager manager;
+            std::stringstream output;
+            {
+                csvsqldb::ExecutionPlan execPlan;
+                csvsqldb::OperatorContext context(database, functions, manager, files);
+                context._showHeaderLine = false;
+                context._outputFormat = format;
+                context._numberOfThreads = threads;
+                csvsqldb::ASTValidationVisitor validationVisitor(database);
+                query->accept(validationVisitor);
+                csvsqldb::ExecutionPlanVisitor<csvsqldb::OperatorNodeFactory> execVisitor(context, execPlan, output);
+                query->accept(execVisitor);
+                execPlan.execute();
+            }
+            MPF_TEST_ASSERTEQUAL(0u, manager.getActiveBlocks());
+            return output.str();
+        };
+
+        // the binary output of one query is read as the table of the next query without parsing any text
+        std::string binary = execute("SELECT id,item,price * 2 AS price,sold FROM sales WHERE id < 500", csvsqldb::BINARY_FORMAT, 1);
+        MPF_TEST_ASSERT(csvsqldb::BinaryRowParser::isBinaryRowStream(binary.c_str(), binary.size()));
+        std::fstream piped(files[1], std::ios_base::trunc | std::ios_base::out | std::ios_base::binary);
+        piped.write(binary.c_str(), static_cast<std::streamsize>(binary.size()));
+        piped.close();
+
+        std::string expected = execute("SELECT id,item,price * 2,sold FROM sales WHERE id < 500 AND id > 100", csvsqldb::CSV_FORMAT, 1);
+        MPF_TEST_ASSERT(expected.find("\n105,'item 105',NULL,2015-07-15\n") != std::string::npos);
+        MPF_TEST_ASSERT(expected.find("\n106,'item 106',53.000000,2015-08-16\n") != std::string::npos);
+        for(uint16_t threads : { 1, 4 }) {
+            MPF_TEST_ASSERTEQUAL(expected, execute("SELECT * FROM piped WHERE id > 100", csvsqldb::CSV_FORMAT, threads));
+        }
+        MPF_TEST_ASSERTEQUAL("1000\n", execute("SELECT count(*) FROM sales", csvsqldb::CSV_FORMAT, 1));
+        MPF_TEST_ASSERTEQUAL("500\n", execute("SELECT count(*) FROM piped", csvsqldb::CSV_FORMAT, 1));
+    }
 };
 
 MPF_REGISTER_TEST_START("ExecutionPlanSuite", ExecutionPlanTestCase);
 MPF_REGISTER_TEST(ExecutionPlanTestCase::planTest);
+MPF_REGISTER_TEST(ExecutionPlanTestCase::multipleFilesTest);
+MPF_REGISTER_TEST(ExecutionPlanTestCase::projectionTest);
+MPF_REGISTER_TEST(ExecutionPlanTestCase::predicatePushdownTest);
+MPF_REGISTER_TEST(ExecutionPlanTestCase::buildSideSelectionTest);
+MPF_REGISTER_TEST(ExecutionPlanTestCase::mergeJoinTest);
+#ifndef _WIN32
+MPF_REGISTER_TEST(ExecutionPlanTestCase::pipeJoinTest);
+#endif
+MPF_REGISTER_TEST(ExecutionPlanTestCase::limitPushdownTest);
+MPF_REGISTER_TEST(ExecutionPlanTestCase::parallelOutputTest);
+MPF_REGISTER_TEST(ExecutionPlanTestCase::spillingParallelGroupByTest);
+MPF_REGISTER_TEST(ExecutionPlanTestCase::externalSortScanTest);
+MPF_REGISTER_TEST(ExecutionPlanTestCase::binaryRoundTripTest);
 MPF_REGISTER_TEST_END();
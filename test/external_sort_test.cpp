@@ -0,0 +1,246 @@
+//
+//  external_sort_test.cpp
+//  csvsqldb
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include "test.h"
+
+#include "libcsvsqldb/block_iterator.h"
+#include "libcsvsqldb/external_sort.h"
+
+#include <boost/filesystem.hpp>
+
+
+namespace
+{
+    class MixedRowProvider : public csvsqldb::RowProvider
+    {
+    public:
+        MixedRowProvider(csvsqldb::BlockManager& blockManager, size_t count)
+        : _blockManager(blockManager)
+        , _count(count)
+        , _current(0)
+        , _block(_blockManager.createBlock())
+        {
+            _row.resize(7);
+        }
+
+        ~MixedRowProvider()
+        {
+            _blockManager.release(_block);
+        }
+
+        static csvsqldb::Types types()
+        {
+            return {csvsqldb::INT, csvsqldb::STRING, csvsqldb::REAL, csvsqldb::BOOLEAN, csvsqldb::DATE, csvsqldb::TIME, csvsqldb::TIMESTAMP};
+        }
+
+        virtual const csvsqldb::Values* getNextRow()
+        {
+            if(_current == _count) {
+                return nullptr;
+            }
+            // produces the numbers in a shuffled order
+            int64_t num = static_cast<int64_t>((_current++ * 7919) % _count);
+            fillRow(_block, _row, num);
+            return &_row;
+        }
+
+        static void fillRow(csvsqldb::BlockPtr block, csvsqldb::Values& row, int64_t num)
+        {
+            std::string s = "name " + std::to_string(num % 100);
+            bool isNull = num % 10 == 0;
+            block->rewind(0);
+            row[0] = block->addInt(num, false);
+            row[1] = block->addString(s.c_str(), s.length(), num % 13 == 0);
+            row[2] = block->addReal(static_cast<double>(num) / 4, isNull);
+            row[3] = block->addBool(num % 2 == 0, isNull);
+            row[4] = block->addDate(csvsqldb::Date(2456293 + static_cast<uint32_t>(num)), isNull);
+            row[5] = block->addTime(csvsqldb::Time(static_cast<uint16_t>(num % 24), static_cast<uint16_t>(num % 60)), isNull);
+            row[6] = block->addTimestamp(csvsqldb::Timestamp(2015, csvsqldb::Date::June, 1, 12, 0, static_cast<uint16_t>(num % 60)), isNull);
+        }
+
+    private:
+        csvsqldb::BlockManager& _blockManager;
+        size_t _count;
+        size_t _current;
+        csvsqldb::BlockPtr _block;
+        csvsqldb::Values _row;
+    };
+}
+
+
+class ExternalSortTestCase
+{
+public:
+    ExternalSortTestCase()
+    {
+    }
+
+    void setUp()
+    {
+    }
+
+    void tearDown()
+    {
+    }
+
+    void loserTreeTest()
+    {
+        std::vector<std::vector<int>> sources = {{1, 4, 9}, {2, 3, 10, 11}, {}, {0, 5}, {6, 7, 8}};
+        std::vector<size_t> positions(sources.size(), 0);
+
+        csvsqldb::LoserTree tree(sources.size(), [&](size_t lhs, size_t rhs) {
+            if(positions[lhs] == sources[lhs].size()) {
+                return false;
+            }
+            if(positions[rhs] == sources[rhs].size()) {
+                return true;
+            }
+            return sources[lhs][positions[lhs]] < sources[rhs][positions[rhs]];
+        });
+
+        std::vector<int> merged;
+        while(positions[tree.winner()] != sources[tree.winner()].size()) {
+            merged.push_back(sources[tree.winner()][positions[tree.winner()]++]);
+            tree.replay();
+        }
+        MPF_TEST_ASSERTEQUAL(12u, merged.size());
+        for(int n = 0; n < 12; ++n) {
+            MPF_TEST_ASSERTEQUAL(n, merged[static_cast<size_t>(n)]);
+        }
+
+        csvsqldb::LoserTree singleTree(1, [](size_t, size_t) { return false; });
+        MPF_TEST_ASSERTEQUAL(0u, singleTree.winner());
+        singleTree.replay();
+        MPF_TEST_ASSERTEQUAL(0u, singleTree.winner());
+
+        MPF_TEST_EXPECTS(csvsqldb::LoserTree(0, [](size_t, size_t) { return false; }), csvsqldb::Exception);
+    }
+
+    void runFileTest()
+    {
+        csvsqldb::Types types = MixedRowProvider::types();
+        csvsqldb::BlockManager blockManager;
+        csvsqldb::BlockPtr block = blockManager.createBlock();
+        csvsqldb::Values row(types.size());
+
+        std::string path;
+        {
+            csvsqldb::SortRunWriter writer;
+            for(int64_t num = 0; num < 30; ++num) {
+                MixedRowProvider::fillRow(block, row, num);
+                unsigned char key = static_cast<unsigned char>(num);
+                writer.writeRow(&key, 1, row);
+            }
+            path = writer.finish();
+        }
+        MPF_TEST_ASSERT(boost::filesystem::exists(path));
+
+        {
+            csvsqldb::SortRunReader reader(path, types, blockManager);
+            for(int64_t num = 0; num < 30; ++num) {
+                MPF_TEST_ASSERT(reader.next());
+                MPF_TEST_ASSERTEQUAL(1u, reader.keyLength());
+                MPF_TEST_ASSERTEQUAL(static_cast<unsigned char>(num), reader.key()[0]);
+                MixedRowProvider::fillRow(block, row, num);
+                for(size_t n = 0; n < types.size(); ++n) {
+                    MPF_TEST_ASSERTEQUAL(row[n]->isNull(), reader.row()[n]->isNull());
+                    if(!row[n]->isNull()) {
+                        MPF_TEST_ASSERT(*row[n] == *reader.row()[n]);
+                    }
+                }
+            }
+            MPF_TEST_ASSERT(!reader.next());
+            MPF_TEST_ASSERT(reader.exhausted());
+        }
+        MPF_TEST_ASSERT(!boost::filesystem::exists(path));
+
+        blockManager.release(block);
+    }
+
+    void externalSortTest()
+    {
+        checkSort(8 * 4096, 5000);
+    }
+
+    void multiPassMergeTest()
+    {
+        // with only five blocks, runs have two blocks and at most two runs are merged at once
+        checkSort(5 * 4096, 5000);
+    }
+
+private:
+    void checkSort(size_t memoryBudget, size_t count)
+    {
+        csvsqldb::Types types = MixedRowProvider::types();
+        csvsqldb::BlockManager blockManager(csvsqldb::MemoryBudget(memoryBudget), 4096);
+        MixedRowProvider provider(blockManager, count);
+
+        csvsqldb::SortingBlockIterator::SortOrders sortOrders;
+        sortOrders.push_back({1, csvsqldb::DESC});
+        sortOrders.push_back({0, csvsqldb::ASC});
+        csvsqldb::SortingBlockIterator iterator(types, sortOrders, provider, blockManager);
+
+        csvsqldb::SortingBlockIterator::SortKey previous;
+        size_t rows = 0;
+        const csvsqldb::Values* row = nullptr;
+        while((row = iterator.getNextRow())) {
+            csvsqldb::SortingBlockIterator::SortKey key;
+            csvsqldb::SortingBlockIterator::appendSortKey(*row, sortOrders, key);
+            if(rows) {
+                MPF_TEST_ASSERT(csvsqldb::SortingBlockIterator::compareSortKeys(previous.data(), previous.size(), key.data(), key.size()) < 0);
+            }
+            int64_t num = static_cast<const csvsqldb::ValInt*>(row->at(0))->asInt();
+            MPF_TEST_ASSERTEQUAL(num % 10 == 0, row->at(2)->isNull());
+            if(num % 13 != 0) {
+                MPF_TEST_ASSERTEQUAL("name " + std::to_string(num % 100),
+                                     std::string(static_cast<const csvsqldb::ValString*>(row->at(1))->asString()));
+            }
+            previous.swap(key);
+            ++rows;
+        }
+        MPF_TEST_ASSERTEQUAL(count, rows);
+        MPF_TEST_ASSERT(!iterator.getNextRow());
+        // the rows did not fit into memory, but the runs kept the sort within the budget without spilling blocks
+        MPF_TEST_ASSERT(blockManager.getTotalBlocks() > blockManager.getMaxActiveBlocks());
+        MPF_TEST_ASSERT(blockManager.getMaxUsedBlocks() <= blockManager.getMaxActiveBlocks());
+        MPF_TEST_ASSERTEQUAL(0u, blockManager.getSpilledBlocks());
+    }
+};
+
+MPF_REGISTER_TEST_START("BlockTestSuite", ExternalSortTestCase);
+MPF_REGISTER_TEST(ExternalSortTestCase::loserTreeTest);
+MPF_REGISTER_TEST(ExternalSortTestCase::runFileTest);
+MPF_REGISTER_TEST(ExternalSortTestCase::externalSortTest);
+MPF_REGISTER_TEST(ExternalSortTestCase::multiPassMergeTest);
+MPF_REGISTER_TEST_END();
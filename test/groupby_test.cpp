@@ -33,10 +33,12 @@
 
 #include "test.h"
 
+#include "libcsvsqldb/aggregation_hash_table.h"
 #include "libcsvsqldb/block.h"
 
 #include "data_test_framework.h"
 
+#include <set>
 #include <unordered_set>
 
 
@@ -92,6 +94,171 @@ public:
         MPF_TEST_ASSERT(found != hashSet.end());
     }
 
+    void aggregationHashTableTest()
+    {
+        csvsqldb::BlockManager blockManager;
+        csvsqldb::AggregationFunctions functions;
+        functions.push_back(csvsqldb::AggregationFunction::create(csvsqldb::COUNT_STAR, csvsqldb::INT));
+        functions.push_back(csvsqldb::AggregationFunction::create(csvsqldb::SUM, csvsqldb::INT));
+
+        csvsqldb::AggregationHashTable table(functions, blockManager);
+        csvsqldb::IndexVector groupingIndices = { 0, 1 };
+
+        csvsqldb::BlockPtr block = blockManager.createBlock();
+        csvsqldb::Values row(3);
+
+        // enough groups to let the table grow several times
+        for(int64_t n = 0; n < 20000; ++n) {
+            block->rewind(0);
+            row[0] = block->addValue(csvsqldb::Variant(n % 5000));
+            row[1] = block->addValue(csvsqldb::Variant(n % 2 ? "odd" : "even"));
+            row[2] = block->addValue(csvsqldb::Variant(n));
+            csvsqldb::AggregationFunction* const* states = table.findOrInsert(row, groupingIndices);
+            states[0]->step(csvsqldb::Variant(csvsqldb::INT));
+            states[1]->step(csvsqldb::Variant(n));
+        }
+        MPF_TEST_ASSERTEQUAL(5000UL, table.size());
+        MPF_TEST_ASSERTEQUAL(4, table.getStates(0)[0]->finalize().asInt());
+        MPF_TEST_ASSERTEQUAL(0 + 5000 + 10000 + 15000, table.getStates(0)[1]->finalize().asInt());
+        MPF_TEST_ASSERTEQUAL(4999 + 9999 + 14999 + 19999, table.getStates(4999)[1]->finalize().asInt());
+
+        // NULL grouping values end up in one group
+        block->rewind(0);
+        row[0] = block->addValue(csvsqldb::Variant(csvsqldb::INT));
+        row[1] = block->addString(nullptr, 0, true);
+        table.findOrInsert(row, groupingIndices);
+        table.findOrInsert(row, groupingIndices);
+        MPF_TEST_ASSERTEQUAL(5001UL, table.size());
+
+        blockManager.release(block);
+        table.clear();
+        MPF_TEST_ASSERTEQUAL(0UL, table.size());
+        MPF_TEST_ASSERTEQUAL(0UL, blockManager.getActiveBlocks());
+
+        // a limited table rejects new groups instead of growing beyond its blocks
+        csvsqldb::BlockManager smallBlockManager(10, 1024);
+        csvsqldb::AggregationHashTable limitedTable(functions, smallBlockManager);
+        block = smallBlockManager.createBlock();
+        size_t rejected = 0;
+        for(int64_t n = 0; n < 1000; ++n) {
+            block->rewind(0);
+            row[0] = block->addValue(csvsqldb::Variant(n));
+            row[1] = block->addValue(csvsqldb::Variant("group"));
+            uint64_t hash = 0;
+            if(!limitedTable.findOrInsert(row, groupingIndices, 2, hash)) {
+                ++rejected;
+            }
+        }
+        MPF_TEST_ASSERT(rejected > 0);
+        MPF_TEST_ASSERTEQUAL(1000UL, limitedTable.size() + rejected);
+        MPF_TEST_ASSERTEQUAL(3UL, smallBlockManager.getActiveBlocks());
+        smallBlockManager.release(block);
+        limitedTable.clear();
+    }
+
+    void spillPartitionTest()
+    {
+        // the groups of one spill partition have to be spread over all merge partitions and sub partitions
+        std::set<size_t> mergePartitions;
+        std::set<size_t> subPartitions;
+        for(int64_t n = 0; n < 10000; ++n) {
+            std::string key = std::to_string(n);
+            uint64_t hash = csvsqldb::hashKeyBytes(key.data(), key.size());
+            if(csvsqldb::spillPartition(hash, 0) == 3) {
+                mergePartitions.insert((hash >> 32) % 4);
+                subPartitions.insert(csvsqldb::spillPartition(hash, csvsqldb::SPILL_PARTITION_BITS));
+            }
+        }
+        MPF_TEST_ASSERTEQUAL(4u, mergePartitions.size());
+        MPF_TEST_ASSERTEQUAL(csvsqldb::SPILL_PARTITIONS, subPartitions.size());
+
+        // the pinned blocks of all partitions have to fit into the given blocks, but there are at least two partitions
+        MPF_TEST_ASSERTEQUAL(csvsqldb::SPILL_PARTITIONS, csvsqldb::spillPartitionCount(100));
+        MPF_TEST_ASSERTEQUAL(4u, csvsqldb::spillPartitionCount(7));
+        MPF_TEST_ASSERTEQUAL(2u, csvsqldb::spillPartitionCount(15, 4));
+        MPF_TEST_ASSERTEQUAL(2u, csvsqldb::spillPartitionCount(0));
+        MPF_TEST_ASSERTEQUAL(csvsqldb::SPILL_PARTITION_BITS, csvsqldb::spillPartitionBits(csvsqldb::SPILL_PARTITIONS));
+        MPF_TEST_ASSERTEQUAL(1u, csvsqldb::spillPartitionBits(2));
+        for(int64_t n = 0; n < 1000; ++n) {
+            MPF_TEST_ASSERT(csvsqldb::spillPartition(static_cast<uint64_t>(n) * 0x9e3779b97f4a7c15ULL, 0, 4) < 4u);
+        }
+    }
+
+    void parallelGroupByTest()
+    {
+        DatabaseTestWrapper dbWrapper;
+        dbWrapper.addTable(TableInitializer("sales", { { "id", csvsqldb::INT }, { "region", csvsqldb::STRING }, { "amount", csvsqldb::INT } }));
+
+        TestRowProvider::Rows& rows = TestRowProvider::getRows("sales");
+        rows.clear();
+        const char* regions[] = { "north", "east", "south", "west", "center" };
+        for(int64_t n = 0; n < 5000; ++n) {
+            rows.push_back({ n, regions[n % 5], n % 100 });
+        }
+
+        std::string results[2];
+        for(uint16_t threads : { 1, 4 }) {
+            csvsqldb::ExecutionContext context(dbWrapper.getDatabase());
+            context._numberOfThreads = threads;
+            csvsqldb::ExecutionEngine<TestOperatorNodeFactory> engine(context);
+
+            csvsqldb::ExecutionStatistics statistics;
+            std::stringstream ss;
+            int64_t rowCount = engine.execute(
+            "SELECT region,count(*),sum(amount),min(amount),max(id),avg(amount) FROM sales GROUP BY region ORDER BY region",
+            statistics,
+            ss);
+            MPF_TEST_ASSERTEQUAL(5, rowCount);
+            results[threads == 1 ? 0 : 1] = ss.str();
+        }
+        MPF_TEST_ASSERTEQUAL(results[0], results[1]);
+        MPF_TEST_ASSERT(results[0].find("'center',1000,") != std::string::npos);
+    }
+
+    void spillingGroupByTest()
+    {
+        DatabaseTestWrapper dbWrapper;
+        dbWrapper.addTable(TableInitializer("sales", { { "id", csvsqldb::INT }, { "item", csvsqldb::INT }, { "amount", csvsqldb::INT } }));
+
+        // the groups need far more blocks than the budget of 32 blocks
+        const int64_t items = 20000;
+        TestRowProvider::Rows& rows = TestRowProvider::getRows("sales");
+        rows.clear();
+        for(int64_t n = 0; n < 3 * items; ++n) {
+            rows.push_back({ n, n % items, n });
+        }
+
+        for(uint16_t threads : { 1, 4 }) {
+            csvsqldb::ExecutionContext context(dbWrapper.getDatabase());
+            context._numberOfThreads = threads;
+            context._memoryBudget = 32 * 4096;
+            context._showHeaderLine = false;
+            csvsqldb::ExecutionEngine<TestOperatorNodeFactory> engine(context);
+
+            csvsqldb::ExecutionStatistics statistics;
+            std::stringstream ss;
+            int64_t rowCount = engine.execute("SELECT item,count(*),sum(amount) FROM sales GROUP BY item", statistics, ss);
+            MPF_TEST_ASSERTEQUAL(items, rowCount);
+            MPF_TEST_ASSERT(statistics._spilledBlocks > 0);
+            MPF_TEST_ASSERT(statistics._maxUsedBlocks <= 32u);
+
+            // every group has to be returned once with all of its rows
+            std::vector<bool> seen(items, false);
+            int64_t item = 0;
+            int64_t count = 0;
+            int64_t sum = 0;
+            char comma = 0;
+            while(ss >> item >> comma >> count >> comma >> sum) {
+                MPF_TEST_ASSERT(item >= 0 && item < items);
+                MPF_TEST_ASSERT(!seen[item]);
+                seen[item] = true;
+                MPF_TEST_ASSERTEQUAL(3, count);
+                MPF_TEST_ASSERTEQUAL(3 * item + 3 * items, sum);
+            }
+            MPF_TEST_ASSERT(std::all_of(seen.begin(), seen.end(), [](bool value) { return value; }));
+        }
+    }
+
     void simpleGroupByTest()
     {
         DatabaseTestWrapper dbWrapper;
@@ -125,8 +292,8 @@ public:
         MPF_TEST_ASSERTEQUAL(2, rowCount);
 
         std::string expected = R"(#COUNT,LAST_NAME,MAX BIRTHDATE,MIN HIRE
-1,'Tello de Fürstenberg',1963-03-06,2003-06-15
 2,'Fürstenberg',1970-09-23,2003-04-15
+1,'Tello de Fürstenberg',1963-03-06,2003-06-15
 )";
         MPF_TEST_ASSERTEQUAL(expected, ss.str());
     }
@@ -164,8 +331,8 @@ public:
         MPF_TEST_ASSERTEQUAL(2, rowCount);
 
         std::string expected = R"(#COUNT,LAST_NAME,MAX BIRTHDATE,MIN HIRE
-1,'Tello de Fürstenberg',1963-03-06,2003-06-15
 1,'Fürstenberg',1970-09-23,2003-04-15
+1,'Tello de Fürstenberg',1963-03-06,2003-06-15
 )";
         MPF_TEST_ASSERTEQUAL(expected, ss.str());
     }
@@ -203,8 +370,8 @@ public:
         MPF_TEST_ASSERTEQUAL(2, rowCount);
 
         std::string expected = R"(#COUNT,MAX BIRTHDATE,MIN HIRE
-1,1963-03-06,2003-06-15
 2,1970-09-23,2003-04-15
+1,1963-03-06,2003-06-15
 )";
         MPF_TEST_ASSERTEQUAL(expected, ss.str());
     }
@@ -212,6 +379,10 @@ public:
 
 MPF_REGISTER_TEST_START("GroupByTestSuite", GroupByTestCase);
 MPF_REGISTER_TEST(GroupByTestCase::groupingElementTest);
+MPF_REGISTER_TEST(GroupByTestCase::aggregationHashTableTest);
+MPF_REGISTER_TEST(GroupByTestCase::spillPartitionTest);
+MPF_REGISTER_TEST(GroupByTestCase::parallelGroupByTest);
+MPF_REGISTER_TEST(GroupByTestCase::spillingGroupByTest);
 MPF_REGISTER_TEST(GroupByTestCase::simpleGroupByTest);
 MPF_REGISTER_TEST(GroupByTestCase::simpleGroupByCountWithNullTest);
 MPF_REGISTER_TEST(GroupByTestCase::groupByWithSupressedGroupBy);
@@ -35,6 +35,10 @@
 
 #include "data_test_framework.h"
 
+#include "libcsvsqldb/hash_join_table.h"
+
+#include <algorithm>
+
 
 class JoinTestCase
 {
@@ -258,6 +262,418 @@ public:
             MPF_TEST_ASSERTEQUAL(expected, ss.str());
         }
     }
+
+    void hashJoinTableTest()
+    {
+        struct Provider : public csvsqldb::RowProvider {
+            Provider(csvsqldb::BlockManager& blockManager, int64_t rows)
+            : _blockManager(blockManager)
+            , _block(blockManager.createBlock())
+            , _rows(rows)
+            , _current(0)
+            {
+                _row.resize(2);
+            }
+
+            ~Provider()
+            {
+                _blockManager.release(_block);
+            }
+
+            const csvsqldb::Values* getNextRow()
+            {
+                if(_current == _rows) {
+                    return nullptr;
+                }
+                _block->rewind(0);
+                // every key is contained twice, and one key is NULL
+                _row[0] = _current == 7 ? _block->addInt(0, true) : _block->addInt(_current % (_rows / 2), false);
+                _row[1] = _block->addValue(csvsqldb::Variant(_current));
+                ++_current;
+                return &_row;
+            }
+
+            csvsqldb::BlockManager& _blockManager;
+            csvsqldb::BlockPtr _block;
+            csvsqldb::Values _row;
+            int64_t _rows;
+            int64_t _current;
+        };
+
+        csvsqldb::BlockManager blockManager;
+        for(uint16_t threads : { 1, 4 }) {
+            csvsqldb::HashJoinTable table({ csvsqldb::INT, csvsqldb::INT }, { 0 }, blockManager, threads);
+            Provider provider(blockManager, 100000);
+            table.build(provider);
+            MPF_TEST_ASSERTEQUAL(99999UL, table.size());
+            MPF_TEST_ASSERT(table.getPartitionCount() > 1);
+
+            csvsqldb::ValInt key(4711);
+            const csvsqldb::Value* probeRow[] = { &key };
+            csvsqldb::IndexVector probeKeys = { 0 };
+            csvsqldb::HashJoinTable::ProbeContext context;
+            table.probe(probeRow, probeKeys, context);
+            const csvsqldb::Value* const* match = table.getNextMatch(context);
+            MPF_TEST_ASSERT(match);
+            MPF_TEST_ASSERTEQUAL(4711, static_cast<const csvsqldb::ValInt*>(match[1])->asInt());
+            match = table.getNextMatch(context);
+            MPF_TEST_ASSERT(match);
+            MPF_TEST_ASSERTEQUAL(4711 + 50000, static_cast<const csvsqldb::ValInt*>(match[1])->asInt());
+            MPF_TEST_ASSERT(!table.getNextMatch(context));
+
+            // the row with the NULL key was not added
+            csvsqldb::ValInt seven(7);
+            probeRow[0] = &seven;
+            table.probe(probeRow, probeKeys, context);
+            MPF_TEST_ASSERT(table.getNextMatch(context));
+            MPF_TEST_ASSERT(!table.getNextMatch(context));
+
+            csvsqldb::ValInt nullKey;
+            probeRow[0] = &nullKey;
+            table.probe(probeRow, probeKeys, context);
+            MPF_TEST_ASSERT(!table.getNextMatch(context));
+
+            csvsqldb::ValInt missing(100000);
+            probeRow[0] = &missing;
+            table.probe(probeRow, probeKeys, context);
+            MPF_TEST_ASSERT(!table.getNextMatch(context));
+        }
+        MPF_TEST_ASSERTEQUAL(0UL, blockManager.getActiveBlocks());
+    }
+
+    void parallelInnerJoinTest()
+    {
+        DatabaseTestWrapper dbWrapper;
+        dbWrapper.addTable(TableInitializer("orders", { { "id", csvsqldb::INT }, { "customer", csvsqldb::INT } }));
+        dbWrapper.addTable(TableInitializer("customers", { { "id", csvsqldb::INT }, { "name", csvsqldb::STRING } }));
+
+        TestRowProvider::Rows& orders = TestRowProvider::getRows("orders");
+        orders.clear();
+        for(int64_t n = 0; n < 8000; ++n) {
+            orders.push_back({ n, n % 3000 });
+        }
+        TestRowProvider::Rows& customers = TestRowProvider::getRows("customers");
+        customers.clear();
+        for(int64_t n = 0; n < 2000; ++n) {
+            customers.push_back({ n, "customer " + std::to_string(n) });
+        }
+
+        std::string results[2];
+        for(uint16_t threads : { 1, 4 }) {
+            csvsqldb::ExecutionContext context(dbWrapper.getDatabase());
+            context._numberOfThreads = threads;
+            csvsqldb::ExecutionEngine<TestOperatorNodeFactory> engine(context);
+
+            csvsqldb::ExecutionStatistics statistics;
+            std::stringstream ss;
+            int64_t rowCount = engine.execute(
+            "SELECT orders.id,customers.name FROM orders INNER JOIN customers ON orders.customer = customers.id", statistics, ss);
+            MPF_TEST_ASSERTEQUAL(6000, rowCount);
+            results[threads == 1 ? 0 : 1] = ss.str();
+        }
+        MPF_TEST_ASSERTEQUAL(results[0], results[1]);
+    }
+
+    void spillingInnerJoinTest()
+    {
+        DatabaseTestWrapper dbWrapper;
+        dbWrapper.addTable(TableInitializer("orders", { { "id", csvsqldb::INT }, { "customer", csvsqldb::INT } }));
+        dbWrapper.addTable(TableInitializer("customers", { { "id", csvsqldb::INT }, { "name", csvsqldb::STRING } }));
+
+        // both inputs need far more blocks than the budget of 32 blocks
+        const int64_t customerCount = 20000;
+        TestRowProvider::Rows& orders = TestRowProvider::getRows("orders");
+        orders.clear();
+        for(int64_t n = 0; n < 2 * customerCount + 1000; ++n) {
+            orders.push_back({ n, n % (customerCount + 500) });
+        }
+        orders.push_back({ int64_t(-1), csvsqldb::Variant(csvsqldb::INT) });
+        TestRowProvider::Rows& customers = TestRowProvider::getRows("customers");
+        customers.clear();
+        for(int64_t n = 0; n < customerCount; ++n) {
+            customers.push_back({ n, "customer " + std::to_string(n) });
+        }
+
+        // the depth of the spill partitioning depends on the free blocks, which differ with the number of threads, so only
+        // the joined rows are compared and not their order
+        std::vector<std::string> results[2];
+        for(uint16_t threads : { 1, 4 }) {
+            csvsqldb::ExecutionContext context(dbWrapper.getDatabase());
+            context._numberOfThreads = threads;
+            context._memoryBudget = 32 * 4096;
+            context._showHeaderLine = false;
+            csvsqldb::ExecutionEngine<TestOperatorNodeFactory> engine(context);
+
+            csvsqldb::ExecutionStatistics statistics;
+            std::stringstream ss;
+            int64_t rowCount = engine.execute(
+            "SELECT orders.id,orders.customer,customers.id,customers.name FROM orders INNER JOIN customers ON orders.customer = "
+            "customers.id",
+            statistics,
+            ss);
+            MPF_TEST_ASSERTEQUAL(2 * customerCount, rowCount);
+            MPF_TEST_ASSERT(statistics._spilledBlocks > 0);
+            MPF_TEST_ASSERT(statistics._maxUsedBlocks <= 32u);
+
+            // every order of an existing customer has to be joined once with its customer
+            std::vector<bool> seen(orders.size(), false);
+            std::string line;
+            while(std::getline(ss, line)) {
+                results[threads == 1 ? 0 : 1].push_back(line);
+                int64_t order = 0;
+                int64_t customer = 0;
+                int64_t customerId = 0;
+                char name[32] = { 0 };
+                MPF_TEST_ASSERTEQUAL(4, ::sscanf(line.c_str(), "%ld,%ld,%ld,'%31[^']'", &order, &customer, &customerId, name));
+                MPF_TEST_ASSERT(order >= 0 && order < static_cast<int64_t>(seen.size()));
+                MPF_TEST_ASSERT(!seen[order]);
+                seen[order] = true;
+                MPF_TEST_ASSERTEQUAL(order % (customerCount + 500), customer);
+                MPF_TEST_ASSERTEQUAL(customer, customerId);
+                MPF_TEST_ASSERTEQUAL("customer " + std::to_string(customer), std::string(name));
+            }
+        }
+        std::sort(results[0].begin(), results[0].end());
+        std::sort(results[1].begin(), results[1].end());
+        MPF_TEST_ASSERT(results[0] == results[1]);
+    }
+
+    void compositeKeyJoinTest()
+    {
+        DatabaseTestWrapper dbWrapper;
+        dbWrapper.addTable(TableInitializer("stock", { { "store", csvsqldb::INT }, { "item", csvsqldb::STRING }, { "amount", csvsqldb::INT } }));
+        dbWrapper.addTable(TableInitializer("orders", { { "store", csvsqldb::INT }, { "item", csvsqldb::STRING }, { "amount", csvsqldb::INT } }));
+
+        TestRowProvider::setRows("stock",
+                                 { { 1, "apple", 10 }, { 1, "pear", 5 }, { 2, "apple", 3 }, { 2, "plum", 20 }, { 3, "pear", 8 } });
+        TestRowProvider::setRows(
+        "orders", { { 1, "apple", 4 }, { 1, "apple", 12 }, { 2, "apple", 2 }, { 2, "pear", 1 }, { 3, "pear", 9 }, { 1, "pear", 5 } });
+
+        for(uint16_t threads : { 1, 4 }) {
+            csvsqldb::ExecutionContext context(dbWrapper.getDatabase());
+            context._numberOfThreads = threads;
+            csvsqldb::ExecutionEngine<TestOperatorNodeFactory> engine(context);
+
+            {
+                csvsqldb::ExecutionStatistics statistics;
+                std::stringstream ss;
+                int64_t rowCount = engine.execute(
+                "SELECT o.store,o.item,o.amount,s.amount FROM orders o INNER JOIN stock s ON o.store = s.store AND s.item = o.item",
+                statistics,
+                ss);
+                MPF_TEST_ASSERTEQUAL(5, rowCount);
+                std::string expected = R"(#O.STORE,O.ITEM,O.AMOUNT,S.AMOUNT
+1,'apple',4,10
+1,'apple',12,10
+2,'apple',2,3
+3,'pear',9,8
+1,'pear',5,5
+)";
+                MPF_TEST_ASSERTEQUAL(expected, ss.str());
+            }
+            {
+                // the non equi conjunct is evaluated on the joined rows
+                csvsqldb::ExecutionStatistics statistics;
+                std::stringstream ss;
+                int64_t rowCount = engine.execute(
+                "SELECT o.store,o.item,o.amount,s.amount FROM orders o INNER JOIN stock s ON o.store = s.store AND o.item = s.item AND "
+                "o.amount <= s.amount",
+                statistics,
+                ss);
+                MPF_TEST_ASSERTEQUAL(3, rowCount);
+                std::string expected = R"(#O.STORE,O.ITEM,O.AMOUNT,S.AMOUNT
+1,'apple',4,10
+2,'apple',2,3
+1,'pear',5,5
+)";
+                MPF_TEST_ASSERTEQUAL(expected, ss.str());
+            }
+        }
+    }
+
+    void mixedTypeJoinTest()
+    {
+        DatabaseTestWrapper dbWrapper;
+        dbWrapper.addTable(TableInitializer("items", { { "id", csvsqldb::INT }, { "name", csvsqldb::STRING } }));
+        dbWrapper.addTable(TableInitializer("prices", { { "item", csvsqldb::REAL }, { "price", csvsqldb::INT } }));
+
+        TestRowProvider::setRows("items", { { 1, "apple" }, { 2, "pear" }, { 3, "plum" } });
+        TestRowProvider::setRows("prices", { { 1.0, 10 }, { 2.5, 20 }, { 3.0, 30 } });
+
+        // INT and REAL values are compared after conversion, so they cannot be hash keys
+        csvsqldb::ExecutionContext context(dbWrapper.getDatabase());
+        csvsqldb::ExecutionEngine<TestOperatorNodeFactory> engine(context);
+        csvsqldb::ExecutionStatistics statistics;
+        std::stringstream ss;
+        int64_t rowCount =
+        engine.execute("SELECT items.name,prices.price FROM items INNER JOIN prices ON items.id = prices.item", statistics, ss);
+        MPF_TEST_ASSERTEQUAL(2, rowCount);
+        std::string expected = R"(#ITEMS.NAME,PRICES.PRICE
+'apple',10
+'plum',30
+)";
+        MPF_TEST_ASSERTEQUAL(expected, ss.str());
+    }
+
+    void mergeJoinTest()
+    {
+        DatabaseTestWrapper dbWrapper;
+        dbWrapper.addTable(TableInitializer("accounts", { { "id", csvsqldb::INT }, { "name", csvsqldb::STRING } }, { "id" }));
+        dbWrapper.addTable(
+        TableInitializer("bookings", { { "account", csvsqldb::INT }, { "amount", csvsqldb::INT } }, { "account", "amount" }));
+        dbWrapper.addTable(TableInitializer("flags", { { "account", csvsqldb::INT } }));
+
+        // accounts and bookings are declared as sorted on the join key, flags is not
+        TestRowProvider::setRows("accounts", { { 1, "a" }, { 2, "b" }, { 2, "b2" }, { 4, "d" }, { 5, "e" } });
+        TestRowProvider::setRows(
+        "bookings",
+        { { csvsqldb::Variant(csvsqldb::INT), 1 }, { 1, 10 }, { 1, 11 }, { 2, 20 }, { 3, 30 }, { 5, 50 }, { 5, 51 } });
+        TestRowProvider::setRows("flags", { { 5 }, { 1 }, { 5 } });
+
+        csvsqldb::ExecutionContext context(dbWrapper.getDatabase());
+        csvsqldb::ExecutionEngine<TestOperatorNodeFactory> engine(context);
+
+        {
+            csvsqldb::ExecutionStatistics statistics;
+            std::stringstream ss;
+            int64_t rowCount = engine.execute(
+            "SELECT a.id,a.name,b.amount FROM accounts a INNER JOIN bookings b ON a.id = b.account", statistics, ss);
+            MPF_TEST_ASSERTEQUAL(6, rowCount);
+            std::string expected = R"(#A.ID,A.NAME,B.AMOUNT
+1,'a',10
+1,'a',11
+2,'b',20
+2,'b2',20
+5,'e',50
+5,'e',51
+)";
+            MPF_TEST_ASSERTEQUAL(expected, ss.str());
+        }
+        {
+            csvsqldb::ExecutionStatistics statistics;
+            std::stringstream ss;
+            int64_t rowCount = engine.execute(
+            "SELECT a.id,a.name,b.amount FROM bookings b INNER JOIN accounts a ON a.id = b.account AND b.amount > 10", statistics, ss);
+            MPF_TEST_ASSERTEQUAL(5, rowCount);
+            std::string expected = R"(#A.ID,A.NAME,B.AMOUNT
+1,'a',11
+2,'b',20
+2,'b2',20
+5,'e',50
+5,'e',51
+)";
+            MPF_TEST_ASSERTEQUAL(expected, ss.str());
+        }
+        {
+            csvsqldb::ExecutionStatistics statistics;
+            std::stringstream ss;
+            int64_t rowCount =
+            engine.execute("SELECT a.name,f.account FROM accounts a INNER JOIN flags f ON f.account = a.id", statistics, ss);
+            MPF_TEST_ASSERTEQUAL(3, rowCount);
+            std::string expected = R"(#A.NAME,F.ACCOUNT
+'a',1
+'e',5
+'e',5
+)";
+            MPF_TEST_ASSERTEQUAL(expected, ss.str());
+        }
+    }
+
+    void unsortedMergeJoinTest()
+    {
+        DatabaseTestWrapper dbWrapper;
+        dbWrapper.addTable(TableInitializer("accounts", { { "id", csvsqldb::INT }, { "name", csvsqldb::STRING } }, { "id" }));
+        dbWrapper.addTable(TableInitializer("bookings", { { "account", csvsqldb::INT }, { "amount", csvsqldb::INT } }, { "account" }));
+        dbWrapper.addTable(TableInitializer("ledger", { { "account", csvsqldb::INT }, { "amount", csvsqldb::INT } }, { "account" }));
+
+        // the declared order is violated after some rows were joined already, the join fails
+        TestRowProvider::setRows("accounts", { { 1, "a" }, { 3, "c" }, { 2, "b" }, { 4, "d" } });
+        TestRowProvider::setRows("bookings", { { 1, 10 }, { 2, 20 }, { 3, 30 }, { 1, 11 }, { 4, 40 } });
+        TestRowProvider::setRows("ledger", { { 1, 10 }, { 1, 11 }, { 2, 20 }, { 3, 30 }, { 4, 40 } });
+
+        std::string sql = "SELECT a.id,a.name,b.amount FROM accounts a INNER JOIN bookings b ON a.id = b.account";
+        csvsqldb::FunctionRegistry functions;
+        csvsqldb::SQLParser parser(functions);
+        csvsqldb::ASTNodePtr node = parser.parse(sql);
+        csvsqldb::ASTValidationVisitor validationVisitor(dbWrapper.getDatabase());
+        node->accept(validationVisitor);
+
+        csvsqldb::BlockManager blockManager;
+        csvsqldb::StringVector files;
+        csvsqldb::OperatorContext operatorContext(dbWrapper.getDatabase(), functions, blockManager, files);
+        csvsqldb::ExecutionPlan execPlan;
+        std::stringstream output;
+        csvsqldb::ExecutionPlanVisitor<TestOperatorNodeFactory> execVisitor(operatorContext, execPlan, output);
+        node->accept(execVisitor);
+
+        std::stringstream plan;
+        execPlan.dump(plan);
+        MPF_TEST_ASSERT(plan.str().find("InnerMergeJoinOperator (lhs sorted, rhs sorted)") != std::string::npos);
+
+        csvsqldb::ExecutionContext context(dbWrapper.getDatabase());
+        csvsqldb::ExecutionEngine<TestOperatorNodeFactory> engine(context);
+        {
+            // the rhs is unsorted, which is detected after the first rows were joined
+            csvsqldb::ExecutionStatistics statistics;
+            std::stringstream ss;
+            MPF_TEST_EXPECTS(engine.execute(sql, statistics, ss), csvsqldb::Exception);
+        }
+        {
+            // the lhs is unsorted
+            csvsqldb::ExecutionStatistics statistics;
+            std::stringstream ss;
+            MPF_TEST_EXPECTS(
+            engine.execute("SELECT a.id,a.name,l.amount FROM accounts a INNER JOIN ledger l ON a.id = l.account", statistics, ss),
+            csvsqldb::Exception);
+        }
+    }
+
+    void sameTableConditionTest()
+    {
+        DatabaseTestWrapper dbWrapper;
+        dbWrapper.addTable(TableInitializer("accounts", { { "id", csvsqldb::INT }, { "name", csvsqldb::STRING } }));
+        dbWrapper.addTable(TableInitializer("bookings", { { "account", csvsqldb::INT }, { "amount", csvsqldb::INT } }));
+
+        TestRowProvider::setRows("accounts", { { 1, "a" }, { 2, "b" } });
+        TestRowProvider::setRows("bookings", { { 1, 10 }, { 5, 5 }, { 7, 7 } });
+
+        // both columns of the unqualified equality belong to bookings, so there is no join key
+        std::string sql = "SELECT id,account FROM accounts INNER JOIN bookings ON account = amount";
+
+        csvsqldb::FunctionRegistry functions;
+        csvsqldb::SQLParser parser(functions);
+        csvsqldb::ASTNodePtr node = parser.parse(sql);
+        csvsqldb::ASTValidationVisitor validationVisitor(dbWrapper.getDatabase());
+        node->accept(validationVisitor);
+
+        csvsqldb::BlockManager blockManager;
+        csvsqldb::StringVector files;
+        csvsqldb::OperatorContext operatorContext(dbWrapper.getDatabase(), functions, blockManager, files);
+        csvsqldb::ExecutionPlan execPlan;
+        std::stringstream output;
+        csvsqldb::ExecutionPlanVisitor<TestOperatorNodeFactory> execVisitor(operatorContext, execPlan, output);
+        node->accept(execVisitor);
+
+        std::stringstream plan;
+        execPlan.dump(plan);
+        MPF_TEST_ASSERT(plan.str().find("InnerJoinOperatorNode") != std::string::npos);
+        MPF_TEST_ASSERT(plan.str().find("HashJoin") == std::string::npos);
+        MPF_TEST_ASSERT(plan.str().find("MergeJoin") == std::string::npos);
+
+        csvsqldb::ExecutionContext context(dbWrapper.getDatabase());
+        csvsqldb::ExecutionEngine<TestOperatorNodeFactory> engine(context);
+        csvsqldb::ExecutionStatistics statistics;
+        std::stringstream ss;
+        int64_t rowCount = engine.execute(sql, statistics, ss);
+        MPF_TEST_ASSERTEQUAL(4, rowCount);
+        std::string expected = R"(#ID,ACCOUNT
+1,5
+1,7
+2,5
+2,7
+)";
+        MPF_TEST_ASSERTEQUAL(expected, ss.str());
+    }
 };
 
 MPF_REGISTER_TEST_START("JoinTestSuite", JoinTestCase);
@@ -265,4 +681,12 @@ MPF_REGISTER_TEST(JoinTestCase::simpleCrossJoinTest);
 MPF_REGISTER_TEST(JoinTestCase::simpleInnerJoinTest);
 MPF_REGISTER_TEST(JoinTestCase::complexInnerJoinTest);
 MPF_REGISTER_TEST(JoinTestCase::selfJoinTest);
+MPF_REGISTER_TEST(JoinTestCase::hashJoinTableTest);
+MPF_REGISTER_TEST(JoinTestCase::parallelInnerJoinTest);
+MPF_REGISTER_TEST(JoinTestCase::spillingInnerJoinTest);
+MPF_REGISTER_TEST(JoinTestCase::compositeKeyJoinTest);
+MPF_REGISTER_TEST(JoinTestCase::mixedTypeJoinTest);
+MPF_REGISTER_TEST(JoinTestCase::mergeJoinTest);
+MPF_REGISTER_TEST(JoinTestCase::unsortedMergeJoinTest);
+MPF_REGISTER_TEST(JoinTestCase::sameTableConditionTest);
 MPF_REGISTER_TEST_END();
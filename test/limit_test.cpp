@@ -37,6 +37,8 @@
 
 #include "data_test_framework.h"
 
+#include <algorithm>
+
 
 class LimitTestCase
 {
@@ -124,9 +126,93 @@ public:
 )";
         MPF_TEST_ASSERTEQUAL(expected, ss.str());
     }
+
+    void topNTest()
+    {
+        DatabaseTestWrapper dbWrapper;
+        dbWrapper.addTable(TableInitializer("measurements", { { "id", csvsqldb::INT }, { "grp", csvsqldb::INT } }));
+
+        csvsqldb::ExecutionContext context(dbWrapper.getDatabase());
+        csvsqldb::ExecutionEngine<TestOperatorNodeFactory> engine(context);
+
+        TestRowProvider::Rows& rows = TestRowProvider::getRows("measurements");
+        rows.clear();
+        for(int64_t n = 0; n < 5000; ++n) {
+            int64_t id = (n * 7919) % 5000;
+            rows.push_back({ id, id % 7 });
+        }
+        // rows with equal sort keys keep their input order
+        TestRowProvider::Rows sorted = rows;
+        std::stable_sort(sorted.begin(), sorted.end(), [](const TestRowProvider::Row& lhs, const TestRowProvider::Row& rhs) {
+            return lhs[1].asInt() > rhs[1].asInt();
+        });
+
+        csvsqldb::ExecutionStatistics statistics;
+        std::stringstream ss;
+        int64_t rowCount = engine.execute("SELECT id,grp FROM measurements order by grp desc limit 5 offset 2", statistics, ss);
+        MPF_TEST_ASSERTEQUAL(5, rowCount);
+
+        std::stringstream expected;
+        expected << "#ID,GRP\n";
+        for(size_t n = 2; n < 7; ++n) {
+            expected << sorted[n][0].asInt() << "," << sorted[n][1].asInt() << "\n";
+        }
+        MPF_TEST_ASSERTEQUAL(expected.str(), ss.str());
+
+        ss.str("");
+        rowCount = engine.execute("SELECT id,grp FROM measurements order by grp desc limit 0", statistics, ss);
+        MPF_TEST_ASSERTEQUAL(0, rowCount);
+
+        ss.str("");
+        rowCount = engine.execute("SELECT id,grp FROM measurements order by grp desc limit 10 offset 4998", statistics, ss);
+        MPF_TEST_ASSERTEQUAL(2, rowCount);
+
+        // a negative limit means no limit, with or without ORDER BY
+        ss.str("");
+        rowCount = engine.execute("SELECT id,grp FROM measurements limit -1", statistics, ss);
+        MPF_TEST_ASSERTEQUAL(5000, rowCount);
+        ss.str("");
+        rowCount = engine.execute("SELECT id,grp FROM measurements order by grp desc limit -1 offset 4998", statistics, ss);
+        MPF_TEST_ASSERTEQUAL(2, rowCount);
+    }
+
+    void topNReplacementTest()
+    {
+        DatabaseTestWrapper dbWrapper;
+        dbWrapper.addTable(TableInitializer("xs", { { "x", csvsqldb::INT } }));
+        dbWrapper.addTable(TableInitializer("ys", { { "y", csvsqldb::INT } }));
+
+        csvsqldb::ExecutionContext context(dbWrapper.getDatabase());
+        csvsqldb::ExecutionEngine<TestOperatorNodeFactory> engine(context);
+
+        TestRowProvider::Rows& xs = TestRowProvider::getRows("xs");
+        TestRowProvider::Rows& ys = TestRowProvider::getRows("ys");
+        xs.clear();
+        ys.clear();
+        for(int64_t n = 0; n < 300; ++n) {
+            xs.push_back({ n });
+            ys.push_back({ n });
+        }
+
+        // every row of the ascending input replaces the top of the heap, so the copied rows have to be compacted
+        csvsqldb::ExecutionStatistics statistics;
+        std::stringstream ss;
+        int64_t rowCount = engine.execute("SELECT x,y FROM xs CROSS JOIN ys order by x desc, y desc limit 3", statistics, ss);
+        MPF_TEST_ASSERTEQUAL(3, rowCount);
+
+        std::string expected = R"(#X,Y
+299,299
+299,298
+299,297
+)";
+        MPF_TEST_ASSERTEQUAL(expected, ss.str());
+        MPF_TEST_ASSERT(statistics._maxUsedBlocks < 10u);
+    }
 };
 
 MPF_REGISTER_TEST_START("LimitTestSuite", LimitTestCase);
 MPF_REGISTER_TEST(LimitTestCase::simpleLimitTest);
 MPF_REGISTER_TEST(LimitTestCase::simpleLimitOffsetTest);
+MPF_REGISTER_TEST(LimitTestCase::topNTest);
+MPF_REGISTER_TEST(LimitTestCase::topNReplacementTest);
 MPF_REGISTER_TEST_END();
@@ -0,0 +1,174 @@
+//
+//  csvsqldb test
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include "test.h"
+
+#include "libcsvsqldb/output_writer.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <sstream>
+
+
+namespace
+{
+    std::string streamed(const csvsqldb::Value& value)
+    {
+        std::stringstream ss;
+        value.toStream(ss);
+        return ss.str();
+    }
+
+    std::string written(const csvsqldb::Value& value)
+    {
+        std::stringstream ss;
+        {
+            csvsqldb::OutputWriter writer(ss);
+            writer.writeValue(value);
+            writer.flush();
+        }
+        return ss.str();
+    }
+
+    char* copyString(const char* s)
+    {
+        char* copy = new char[::strlen(s) + 1];
+        ::strcpy(copy, s);
+        return copy;
+    }
+}
+
+
+class OutputWriterTestCase
+{
+public:
+    void setUp()
+    {
+    }
+
+    void tearDown()
+    {
+    }
+
+    void intTest()
+    {
+        for(int64_t num : { int64_t(0),
+                            int64_t(7),
+                            int64_t(-7),
+                            int64_t(10),
+                            int64_t(99),
+                            int64_t(100),
+                            int64_t(4711),
+                            int64_t(-1234567890123),
+                            std::numeric_limits<int64_t>::max(),
+                            std::numeric_limits<int64_t>::min() }) {
+            csvsqldb::ValInt value(num);
+            MPF_TEST_ASSERTEQUAL(streamed(value), written(value));
+        }
+        MPF_TEST_ASSERTEQUAL("NULL", written(csvsqldb::ValInt()));
+    }
+
+    void doubleTest()
+    {
+        for(double num : { 0.0, -0.0, 1.0, -1.5, 0.1, 3.1415926535, 0.0000005, 0.0000015, 2.5e-7, 999999999.9999996, 1e9, -1e15,
+                           1.7976931348623157e308, 4.9e-324, std::numeric_limits<double>::infinity() }) {
+            csvsqldb::ValDouble value(num);
+            MPF_TEST_ASSERTEQUAL(streamed(value), written(value));
+        }
+
+        // the formatting has to be identical to the stream output for any magnitude
+        std::mt19937_64 generator(4711);
+        std::uniform_real_distribution<double> mantissa(-10.0, 10.0);
+        std::uniform_int_distribution<int> exponent(-8, 12);
+        for(size_t n = 0; n < 20000; ++n) {
+            csvsqldb::ValDouble value(mantissa(generator) * std::pow(10.0, exponent(generator)));
+            MPF_TEST_ASSERTEQUAL(streamed(value), written(value));
+        }
+        // halves of the last decimal place are rounded like the stream output
+        for(int64_t n = 0; n < 20000; ++n) {
+            csvsqldb::ValDouble value(static_cast<double>(n) / 2000000.0);
+            MPF_TEST_ASSERTEQUAL(streamed(value), written(value));
+        }
+    }
+
+    void dateTimeTest()
+    {
+        csvsqldb::ValDate date(csvsqldb::Date(2015, csvsqldb::Date::June, 29));
+        MPF_TEST_ASSERTEQUAL("2015-06-29", written(date));
+        MPF_TEST_ASSERTEQUAL(streamed(date), written(date));
+        csvsqldb::ValDate early(csvsqldb::Date(812, csvsqldb::Date::January, 3));
+        MPF_TEST_ASSERTEQUAL("0812-01-03", written(early));
+
+        csvsqldb::ValTime time(csvsqldb::Time(8, 5, 9, 123));
+        MPF_TEST_ASSERTEQUAL("08:05:09", written(time));
+        MPF_TEST_ASSERTEQUAL(streamed(time), written(time));
+
+        csvsqldb::ValTimestamp timestamp(csvsqldb::Timestamp(1970, csvsqldb::Date::December, 31, 23, 59, 1, 999));
+        MPF_TEST_ASSERTEQUAL("1970-12-31T23:59:01", written(timestamp));
+        MPF_TEST_ASSERTEQUAL(streamed(timestamp), written(timestamp));
+
+        MPF_TEST_ASSERTEQUAL("NULL", written(csvsqldb::ValDate()));
+        MPF_TEST_ASSERTEQUAL("NULL", written(csvsqldb::ValTime()));
+        MPF_TEST_ASSERTEQUAL("NULL", written(csvsqldb::ValTimestamp()));
+    }
+
+    void rowTest()
+    {
+        csvsqldb::ValInt id(42);
+        csvsqldb::ValString name(copyString("Fürstenberg"), ::strlen("Fürstenberg"));
+        csvsqldb::ValString nothing;
+        csvsqldb::ValBool flag(true);
+        csvsqldb::ValDouble amount(12.5);
+        csvsqldb::Values row = { &id, &name, &nothing, &flag, &amount };
+
+        // a small buffer has to be flushed several times while writing
+        std::stringstream ss;
+        csvsqldb::OutputWriter writer(ss, 16);
+        std::string expected;
+        for(size_t n = 0; n < 100; ++n) {
+            writer.writeRow(row);
+            expected += "42,'Fürstenberg',NULL,1,12.500000\n";
+        }
+        writer.flush();
+        MPF_TEST_ASSERTEQUAL(expected, ss.str());
+    }
+};
+
+MPF_REGISTER_TEST_START("OutputWriterTestSuite", OutputWriterTestCase);
+MPF_REGISTER_TEST(OutputWriterTestCase::intTest);
+MPF_REGISTER_TEST(OutputWriterTestCase::doubleTest);
+MPF_REGISTER_TEST(OutputWriterTestCase::dateTimeTest);
+MPF_REGISTER_TEST(OutputWriterTestCase::rowTest);
+MPF_REGISTER_TEST_END();
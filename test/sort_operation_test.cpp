@@ -35,6 +35,8 @@
 
 #include "data_test_framework.h"
 
+#include "libcsvsqldb/block_iterator.h"
+
 
 class SortOperationTestCase
 {
@@ -101,8 +103,85 @@ NULL,'Lars','Fürstenberg',2010-02-01,1970-09-23
 
         MPF_TEST_ASSERTEQUAL(expected, ss.str());
     }
+
+    void multiColumnSortTest()
+    {
+        DatabaseTestWrapper dbWrapper;
+        dbWrapper.addTable(TableInitializer("measurements", { { "name", csvsqldb::STRING }, { "val", csvsqldb::REAL }, { "cnt", csvsqldb::INT } }));
+
+        csvsqldb::ExecutionContext context(dbWrapper.getDatabase());
+        csvsqldb::ExecutionEngine<TestOperatorNodeFactory> engine(context);
+
+        TestRowProvider::setRows("measurements",
+                                 { { "ab", 1.5, 10 },
+                                   { "a", -2.5, -7 },
+                                   { "ab", -0.5, csvsqldb::Variant(csvsqldb::INT) },
+                                   { "", 0.0, 3 },
+                                   { "a", 4.0, -100 },
+                                   { "abc", csvsqldb::Variant(csvsqldb::REAL), 5 } });
+
+        csvsqldb::ExecutionStatistics statistics;
+        std::stringstream ss;
+        int64_t rowCount = engine.execute("SELECT name,val,cnt FROM measurements order by name, cnt desc", statistics, ss);
+        MPF_TEST_ASSERTEQUAL(6, rowCount);
+
+        std::string expected = R"(#NAME,VAL,CNT
+'',0.000000,3
+'a',-2.500000,-7
+'a',4.000000,-100
+'ab',1.500000,10
+'ab',-0.500000,NULL
+'abc',NULL,5
+)";
+        MPF_TEST_ASSERTEQUAL(expected, ss.str());
+
+        ss.clear();
+        ss.str("");
+        rowCount = engine.execute("SELECT name,val,cnt FROM measurements order by val desc", statistics, ss);
+        MPF_TEST_ASSERTEQUAL(6, rowCount);
+
+        expected = R"(#NAME,VAL,CNT
+'a',4.000000,-100
+'ab',1.500000,10
+'',0.000000,3
+'ab',-0.500000,NULL
+'a',-2.500000,-7
+'abc',NULL,5
+)";
+        MPF_TEST_ASSERTEQUAL(expected, ss.str());
+    }
+
+    void sortKeyTest()
+    {
+        csvsqldb::SortingBlockIterator::SortOrders orders = { { 0, csvsqldb::ASC } };
+
+        auto compare = [&orders](const csvsqldb::Value& lhs, const csvsqldb::Value& rhs) {
+            csvsqldb::SortingBlockIterator::SortKey left;
+            csvsqldb::SortingBlockIterator::SortKey right;
+            csvsqldb::SortingBlockIterator::appendSortKey({ &lhs }, orders, left);
+            csvsqldb::SortingBlockIterator::appendSortKey({ &rhs }, orders, right);
+            return csvsqldb::SortingBlockIterator::compareSortKeys(left.data(), left.size(), right.data(), right.size());
+        };
+
+        MPF_TEST_ASSERT(compare(csvsqldb::ValInt(-5), csvsqldb::ValInt(3)) < 0);
+        MPF_TEST_ASSERT(compare(csvsqldb::ValInt(-5), csvsqldb::ValInt(-6)) > 0);
+        MPF_TEST_ASSERT(compare(csvsqldb::ValInt(), csvsqldb::ValInt(-6)) < 0);
+        MPF_TEST_ASSERT(compare(csvsqldb::ValInt(42), csvsqldb::ValInt(42)) == 0);
+        MPF_TEST_ASSERT(compare(csvsqldb::ValDouble(-0.5), csvsqldb::ValDouble(-0.25)) < 0);
+        MPF_TEST_ASSERT(compare(csvsqldb::ValDouble(-0.0), csvsqldb::ValDouble(0.0)) == 0);
+        MPF_TEST_ASSERT(compare(csvsqldb::ValDouble(1e10), csvsqldb::ValDouble(2.5)) > 0);
+        MPF_TEST_ASSERT(compare(csvsqldb::ValBool(false), csvsqldb::ValBool(true)) < 0);
+        MPF_TEST_ASSERT(compare(csvsqldb::ValDate(csvsqldb::Date(1970, csvsqldb::Date::January, 1)),
+                                csvsqldb::ValDate(csvsqldb::Date(1969, csvsqldb::Date::December, 31))) > 0);
+
+        orders[0]._order = csvsqldb::DESC;
+        MPF_TEST_ASSERT(compare(csvsqldb::ValInt(-5), csvsqldb::ValInt(3)) > 0);
+        MPF_TEST_ASSERT(compare(csvsqldb::ValInt(), csvsqldb::ValInt(-6)) > 0);
+    }
 };
 
 MPF_REGISTER_TEST_START("OperationTestSuite", SortOperationTestCase);
 MPF_REGISTER_TEST(SortOperationTestCase::simpleSortTest);
+MPF_REGISTER_TEST(SortOperationTestCase::multiColumnSortTest);
+MPF_REGISTER_TEST(SortOperationTestCase::sortKeyTest);
 MPF_REGISTER_TEST_END();
@@ -0,0 +1,134 @@
+//
+//  csvsqldb test
+//
+//  BSD 3-Clause License
+//  Copyright (c) 2015, Lars-Christian Fürstenberg
+//  All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without modification, are permitted
+//  provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this list of
+//  conditions and the following disclaimer.
+//
+//  2. Redistributions in binary form must reproduce the above copyright notice, this list of
+//  conditions and the following disclaimer in the documentation and/or other materials provided
+//  with the distribution.
+//
+//  3. Neither the name of the copyright holder nor the names of its contributors may be used to
+//  endorse or promote products derived from this software without specific prior written
+//  permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+//  AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+//  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+//  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+//  SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+//  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+//  POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include "test.h"
+
+#include "libcsvsqldb/base/spsc_queue.h"
+
+#include <atomic>
+#include <thread>
+
+
+class SPSCQueueTestCase
+{
+public:
+    void setUp()
+    {
+    }
+
+    void tearDown()
+    {
+    }
+
+    void orderTest()
+    {
+        csvsqldb::SPSCQueue<int> queue(3);
+        MPF_TEST_ASSERTEQUAL(3u, queue.capacity());
+
+        std::thread producer([&] {
+            for(int n = 0; n < 100000; ++n) {
+                queue.push(n);
+            }
+            queue.close();
+        });
+
+        int expected = 0;
+        int value = 0;
+        while(queue.pop(value)) {
+            MPF_TEST_ASSERTEQUAL(expected, value);
+            ++expected;
+        }
+        producer.join();
+        MPF_TEST_ASSERTEQUAL(100000, expected);
+    }
+
+    void backpressureTest()
+    {
+        csvsqldb::SPSCQueue<int> queue(2);
+        std::atomic<int> pushed(0);
+
+        std::thread producer([&] {
+            for(int n = 0; n < 5; ++n) {
+                queue.push(n);
+                ++pushed;
+            }
+        });
+
+        // the producer parks on the full queue and stays there until a value is taken
+        while(!queue.isProducerParked()) {
+            std::this_thread::yield();
+        }
+        MPF_TEST_ASSERTEQUAL(2, pushed.load());
+        MPF_TEST_ASSERT(queue.isProducerParked());
+        MPF_TEST_ASSERTEQUAL(2, pushed.load());
+
+        int value = 0;
+        for(int n = 0; n < 5; ++n) {
+            MPF_TEST_ASSERT(queue.pop(value));
+            MPF_TEST_ASSERTEQUAL(n, value);
+        }
+        producer.join();
+        MPF_TEST_ASSERTEQUAL(5, pushed.load());
+        MPF_TEST_ASSERT(!queue.tryPop(value));
+    }
+
+    void closeTest()
+    {
+        csvsqldb::SPSCQueue<int> queue(1);
+        MPF_TEST_ASSERT(queue.push(1));
+
+        bool result = true;
+        std::thread producer([&] { result = queue.push(2); });
+
+        // closing wakes up the parked producer, the value already queued can still be taken
+        while(!queue.isProducerParked()) {
+            std::this_thread::yield();
+        }
+        queue.close();
+        producer.join();
+        MPF_TEST_ASSERT(!result);
+        MPF_TEST_ASSERT(queue.isClosed());
+
+        int value = 0;
+        MPF_TEST_ASSERT(queue.pop(value));
+        MPF_TEST_ASSERTEQUAL(1, value);
+        MPF_TEST_ASSERT(!queue.pop(value));
+        MPF_TEST_ASSERT(!queue.push(3));
+    }
+};
+
+MPF_REGISTER_TEST_START("SPSCQueueTestSuite", SPSCQueueTestCase);
+MPF_REGISTER_TEST(SPSCQueueTestCase::orderTest);
+MPF_REGISTER_TEST(SPSCQueueTestCase::backpressureTest);
+MPF_REGISTER_TEST(SPSCQueueTestCase::closeTest);
+MPF_REGISTER_TEST_END();
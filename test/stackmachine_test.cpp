@@ -900,6 +900,171 @@ public:
             MPF_TEST_ASSERTEQUAL(true, sm.evaluate(store, functions).asBool());
         }
     }
+
+    void compiledExpressionTest()
+    {
+        csvsqldb::FunctionRegistry functions;
+        csvsqldb::initBuildInFunctions(functions);
+        csvsqldb::SQLParser parser(functions);
+
+        csvsqldb::ASTExprNodePtr exp = parser.parseExpression("(a * 2 + b) > 10.5 and c between 1 and a and d in (3, 4)");
+        csvsqldb::StackMachine::VariableMapping mapping;
+        csvsqldb::StackMachine sm;
+        csvsqldb::ASTInstructionStackVisitor visitor(sm, mapping);
+        exp->accept(visitor);
+
+        csvsqldb::StackMachine::VariableTypes types(mapping.size());
+        for(const auto& variable : mapping) {
+            types[variable.second] = variable.first == "B" ? csvsqldb::REAL : csvsqldb::INT;
+        }
+        MPF_TEST_ASSERT(sm.compile(types, functions));
+        MPF_TEST_ASSERT(sm.isCompiled());
+
+        auto evaluate = [&](const csvsqldb::Variant& a, const csvsqldb::Variant& b, const csvsqldb::Variant& c, const csvsqldb::Variant& d) {
+            csvsqldb::VariableStore store;
+            for(const auto& variable : mapping) {
+                const std::string& name = variable.first;
+                store.addVariable(variable.second, name == "A" ? a : (name == "B" ? b : (name == "C" ? c : d)));
+            }
+            const csvsqldb::Variant& result = sm.evaluate(store, functions);
+            return result.isNull() ? std::string("NULL") : result.toString();
+        };
+
+        MPF_TEST_ASSERTEQUAL("1", evaluate(csvsqldb::Variant(5), csvsqldb::Variant(1.0), csvsqldb::Variant(3), csvsqldb::Variant(4)));
+        MPF_TEST_ASSERTEQUAL("0", evaluate(csvsqldb::Variant(5), csvsqldb::Variant(0.5), csvsqldb::Variant(3), csvsqldb::Variant(4)));
+        MPF_TEST_ASSERTEQUAL("0", evaluate(csvsqldb::Variant(5), csvsqldb::Variant(1.0), csvsqldb::Variant(6), csvsqldb::Variant(4)));
+        MPF_TEST_ASSERTEQUAL("0", evaluate(csvsqldb::Variant(5), csvsqldb::Variant(1.0), csvsqldb::Variant(3), csvsqldb::Variant(5)));
+        MPF_TEST_ASSERTEQUAL("NULL", evaluate(csvsqldb::Variant(csvsqldb::INT), csvsqldb::Variant(1.0), csvsqldb::Variant(3), csvsqldb::Variant(4)));
+        MPF_TEST_ASSERTEQUAL("0", evaluate(csvsqldb::Variant(csvsqldb::INT), csvsqldb::Variant(1.0), csvsqldb::Variant(3), csvsqldb::Variant(5)));
+        // variables of other types than compiled for are interpreted
+        MPF_TEST_ASSERTEQUAL("1", evaluate(csvsqldb::Variant(5.0), csvsqldb::Variant(1), csvsqldb::Variant(3), csvsqldb::Variant(4)));
+        MPF_TEST_ASSERT(sm.isCompiled());
+
+        {
+            csvsqldb::ASTExprNodePtr exp = parser.parseExpression("upper(name) || '!'");
+            csvsqldb::StackMachine::VariableMapping mapping;
+            csvsqldb::StackMachine sm;
+            csvsqldb::ASTInstructionStackVisitor visitor(sm, mapping);
+            exp->accept(visitor);
+            csvsqldb::VariableStore store;
+            store.addVariable(0, csvsqldb::Variant("Lars"));
+            MPF_TEST_ASSERTEQUAL("LARS!", sm.evaluate(store, functions).toString());
+            MPF_TEST_ASSERT(sm.isCompiled());
+            store.addVariable(0, csvsqldb::Variant("Mark"));
+            MPF_TEST_ASSERTEQUAL("MARK!", sm.evaluate(store, functions).toString());
+        }
+    }
+
+    void batchEvaluationTest()
+    {
+        csvsqldb::FunctionRegistry functions;
+        csvsqldb::SQLParser parser(functions);
+
+        const std::vector<std::string> expressions = {"a * 2 + b / 4 - -a",
+                                                      "a / 3 + a % 7",
+                                                      "(a > 10 or b <= 2.5) and not c",
+                                                      "c or a = 5",
+                                                      "c and a <> 5",
+                                                      "d >= DATE'2015-06-01'",
+                                                      "a"};
+
+        for(const auto& expression : expressions) {
+            csvsqldb::ASTExprNodePtr exp = parser.parseExpression(expression);
+            csvsqldb::StackMachine::VariableMapping mapping;
+            csvsqldb::StackMachine sm;
+            csvsqldb::ASTInstructionStackVisitor visitor(sm, mapping);
+            exp->accept(visitor);
+
+            const std::map<std::string, csvsqldb::eType> columns = {
+            {"A", csvsqldb::INT}, {"B", csvsqldb::REAL}, {"C", csvsqldb::BOOLEAN}, {"D", csvsqldb::DATE}};
+            csvsqldb::StackMachine::VariableTypes types(mapping.size());
+            csvsqldb::VariableBatch batch;
+            for(const auto& variable : mapping) {
+                types[variable.second] = columns.at(variable.first);
+                batch.setVariableType(variable.second, types[variable.second]);
+            }
+            MPF_TEST_ASSERT(sm.compile(types, functions));
+            MPF_TEST_ASSERT(sm.isVectorizable());
+
+            std::vector<csvsqldb::VariableStore> stores(100);
+            for(size_t row = 0; row < stores.size(); ++row) {
+                for(const auto& variable : mapping) {
+                    csvsqldb::Variant value(types[variable.second]);
+                    if(row % 7 != 3) {
+                        switch(types[variable.second]) {
+                            case csvsqldb::INT:
+                                value = csvsqldb::Variant(static_cast<int64_t>(row % 13));
+                                break;
+                            case csvsqldb::REAL:
+                                value = csvsqldb::Variant(static_cast<double>(row % 5));
+                                break;
+                            case csvsqldb::BOOLEAN:
+                                value = csvsqldb::Variant(row % 3 == 0);
+                                break;
+                            default:
+                                value = csvsqldb::Variant(csvsqldb::Date(2015, csvsqldb::Date::May, 1).addDays(static_cast<int16_t>(row)));
+                                break;
+                        }
+                    } else if(variable.first == "C" && row % 2) {
+                        // mix nulls in only some of the variables for the three-valued logic
+                        value = csvsqldb::Variant(false);
+                    }
+                    stores[row].addVariable(variable.second, value);
+                    batch.addValue(variable.second, value);
+                }
+                batch.nextRow();
+            }
+
+            const csvsqldb::ValueVector& result = sm.evaluateBatch(batch);
+            for(size_t row = 0; row < stores.size(); ++row) {
+                const csvsqldb::Variant& expected = sm.evaluate(stores[row], functions);
+                MPF_TEST_ASSERTEQUAL(expected.isNull(), result.isNull(row));
+                if(!expected.isNull()) {
+                    MPF_TEST_ASSERTEQUAL(expected.toString(), result.getVariant(row).toString());
+                }
+            }
+        }
+
+        {
+            csvsqldb::ASTExprNodePtr exp = parser.parseExpression("a between 1 and 10 and b > 1.5");
+            csvsqldb::StackMachine::VariableMapping mapping;
+            csvsqldb::StackMachine sm;
+            csvsqldb::ASTInstructionStackVisitor visitor(sm, mapping);
+            exp->accept(visitor);
+            MPF_TEST_ASSERT(sm.compile(csvsqldb::StackMachine::VariableTypes({csvsqldb::INT, csvsqldb::REAL}), functions));
+            MPF_TEST_ASSERT(!sm.isVectorizable());
+        }
+
+        {
+            csvsqldb::ASTExprNodePtr exp = parser.parseExpression("a > 2 and b < 3.5");
+            csvsqldb::StackMachine::VariableMapping mapping;
+            csvsqldb::StackMachine sm;
+            csvsqldb::ASTInstructionStackVisitor visitor(sm, mapping);
+            exp->accept(visitor);
+            csvsqldb::StackMachine::VariableTypes types(2);
+            types[mapping[0].first == "A" ? mapping[0].second : mapping[1].second] = csvsqldb::INT;
+            types[mapping[0].first == "B" ? mapping[0].second : mapping[1].second] = csvsqldb::REAL;
+            MPF_TEST_ASSERT(sm.compile(types, functions));
+
+            csvsqldb::VariableBatch batch;
+            for(size_t n = 0; n < types.size(); ++n) {
+                batch.setVariableType(n, types[n]);
+            }
+            for(int64_t row = 0; row < 6; ++row) {
+                for(const auto& variable : mapping) {
+                    if(variable.first == "A") {
+                        batch.addValue(variable.second, row == 4 ? csvsqldb::Variant(csvsqldb::INT) : csvsqldb::Variant(row));
+                    } else {
+                        batch.addValue(variable.second, csvsqldb::Variant(static_cast<double>(row) / 2.0 + 1.0));
+                    }
+                }
+                batch.nextRow();
+            }
+            csvsqldb::StackMachine::SelectionVector selection;
+            MPF_TEST_ASSERTEQUAL(1u, sm.selectBatch(batch, selection));
+            MPF_TEST_ASSERTEQUAL(3u, selection[0]);
+        }
+    }
 };
 
 MPF_REGISTER_TEST_START("StackmachineTestSuite", StackmachineTestCase);
@@ -914,4 +1079,6 @@ MPF_REGISTER_TEST(StackmachineTestCase::nullFunctionsTest);
 MPF_REGISTER_TEST(StackmachineTestCase::nullOperationsTest);
 MPF_REGISTER_TEST(StackmachineTestCase::nopTest);
 MPF_REGISTER_TEST(StackmachineTestCase::likeTest);
+MPF_REGISTER_TEST(StackmachineTestCase::compiledExpressionTest);
+MPF_REGISTER_TEST(StackmachineTestCase::batchEvaluationTest);
 MPF_REGISTER_TEST_END();
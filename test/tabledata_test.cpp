@@ -78,8 +78,55 @@ public:
         csvsqldb::TableData decoded = csvsqldb::TableData::fromJson(ss);
         MPF_TEST_ASSERTEQUAL(json, decoded.asJson());
     }
+
+    void fileNameColumnTest()
+    {
+        csvsqldb::TableData tabledata("TestTable");
+
+        csvsqldb::ASTExprNodePtr check;
+        tabledata.addColumn("system_filename", csvsqldb::STRING, false, false, false, csvsqldb::Any(), check, 255);
+        MPF_TEST_ASSERT(tabledata.hasColumn("system_filename"));
+
+        csvsqldb::TableData intTabledata("IntTable");
+        MPF_TEST_EXPECTS(intTabledata.addColumn("SYSTEM_FILENAME", csvsqldb::INT, false, false, false, csvsqldb::Any(), check, 0),
+                         csvsqldb::SqlException);
+
+        csvsqldb::FunctionRegistry functions;
+        csvsqldb::SQLParser parser(functions);
+        csvsqldb::ASTNodePtr node = parser.parse("CREATE TABLE sales(id INTEGER,system_filename INTEGER)");
+        csvsqldb::ASTCreateTableNodePtr createNode = std::dynamic_pointer_cast<csvsqldb::ASTCreateTableNode>(node);
+        MPF_TEST_ASSERT(createNode);
+        MPF_TEST_EXPECTS(csvsqldb::TableData::fromCreateAST(createNode), csvsqldb::SqlException);
+    }
+
+    void sortColumnsTest()
+    {
+        csvsqldb::FunctionRegistry functions;
+        csvsqldb::SQLParser parser(functions);
+        csvsqldb::ASTNodePtr node = parser.parse("CREATE TABLE sales(id INTEGER,sold DATE,amount REAL) ORDER BY sold,id");
+        csvsqldb::ASTCreateTableNodePtr createNode = std::dynamic_pointer_cast<csvsqldb::ASTCreateTableNode>(node);
+        MPF_TEST_ASSERT(createNode);
+        csvsqldb::TableData tabledata = csvsqldb::TableData::fromCreateAST(createNode);
+        MPF_TEST_ASSERTEQUAL(2u, tabledata.sortColumns().size());
+        MPF_TEST_ASSERTEQUAL("SOLD", tabledata.sortColumns()[0]);
+        MPF_TEST_ASSERTEQUAL("ID", tabledata.sortColumns()[1]);
+
+        std::stringstream ss(tabledata.asJson());
+        csvsqldb::TableData decoded = csvsqldb::TableData::fromJson(ss);
+        MPF_TEST_ASSERTEQUAL(tabledata.asJson(), decoded.asJson());
+
+        // tables stored without sort columns are unsorted
+        std::stringstream old(R"({ "Table" : { "name" : "OLD", "columns" : [ { "name" : "ID", "type" : "INTEGER", "primary key" : false, "not null" : false, "unique" : false, "default" : "", "check" : "", "length" : 0 } ], "constraints" : [ ] } })");
+        MPF_TEST_ASSERT(csvsqldb::TableData::fromJson(old).sortColumns().empty());
+
+        node = parser.parse("CREATE TABLE sales(id INTEGER) ORDER BY sold");
+        createNode = std::dynamic_pointer_cast<csvsqldb::ASTCreateTableNode>(node);
+        MPF_TEST_EXPECTS(csvsqldb::TableData::fromCreateAST(createNode), csvsqldb::SqlException);
+    }
 };
 
 MPF_REGISTER_TEST_START("TabledataTestSuite", TabledataTestCase);
 MPF_REGISTER_TEST(TabledataTestCase::encodeDecodeTest);
+MPF_REGISTER_TEST(TabledataTestCase::fileNameColumnTest);
+MPF_REGISTER_TEST(TabledataTestCase::sortColumnsTest);
 MPF_REGISTER_TEST_END();